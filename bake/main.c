@@ -0,0 +1,14 @@
+#include "sysifus.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Built from src/bake.c alone, without the tables it generates, so the build
+// can run it before compiling the rest of the library
+int main(int argc, const char *argv[]) {
+  if (argc > 2) {
+    (void)fprintf(stderr, "Usage: %s [<output directory>]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  return bakeLuts(argc == 2 ? argv[1] : ".") ? EXIT_SUCCESS : EXIT_FAILURE;
+}
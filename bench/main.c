@@ -0,0 +1,1059 @@
+#define _POSIX_C_SOURCE 200809L
+
+#ifdef SYSIFUS_HEADER_ONLY
+#include "amalgamation.h"
+#endif /* ifdef SYSIFUS_HEADER_ONLY */
+
+#include "bitboard.h"
+#include "dataset.h"
+#include "evaluate.h"
+#include "fill.h"
+#include "generators.h"
+#include "luts.h"
+#include "mobility.h"
+#include "nnue.h"
+#include "pgn.h"
+#include "position.h"
+#include "sysifus.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif /* ifdef __x86_64__ */
+
+// Both power of two, batches wrap around the corpora with a mask
+#define CORPUS_SIZE 4096
+#define CORPUS_POSITIONS 1024
+// Larger than any cache, like the sets deduplicating real datasets
+#define POSITION_SET_MEGABYTES 64
+// Same seed on every run and every release, so results stay comparable
+#define CORPUS_SEED 0x5359534946555342ULL
+#define RANDOM_GAME_PLIES 96
+
+// A sample times a whole batch, a single call is shorter than the clock's
+// resolution
+#define BATCH_CALLS 256
+#define WARMUP_SAMPLES 64
+#define DEFAULT_SAMPLES 1024
+
+// How the library got linked in, to compare the builds
+#if defined(SYSIFUS_HEADER_ONLY)
+#define LIBRARY_KIND "header-only"
+#elif defined(SYSIFUS_STATIC)
+#define LIBRARY_KIND "static"
+#else
+#define LIBRARY_KIND "shared"
+#endif /* if defined(SYSIFUS_HEADER_ONLY) */
+
+#define STARTING_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+#define KIWIPETE_FEN                                                           \
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"
+
+// Inputs of every kernel, generated once before anything gets timed
+typedef struct {
+  Coordinate coords[CORPUS_SIZE];
+  uint64_t friendly[CORPUS_SIZE], enemy[CORPUS_SIZE];
+  bool isWhite[CORPUS_SIZE];
+
+  // Positions of random games, with the sliders of their side to move
+  Position positions[CORPUS_POSITIONS];
+  uint64_t orthogonal[CORPUS_POSITIONS], diagonal[CORPUS_POSITIONS];
+  uint64_t orthogonalPieces[CORPUS_POSITIONS][MAX_SLIDERS];
+  uint64_t diagonalPieces[CORPUS_POSITIONS][MAX_SLIDERS];
+  uint8_t sliderCounts[CORPUS_POSITIONS];
+
+  // Accumulators of the positions and a legal move out of each, to time
+  // updating them against summing them again
+  const Network *network;
+  Accumulator accumulators[CORPUS_POSITIONS];
+  PackedMove moves[CORPUS_POSITIONS];
+  // The same moves in SAN, as PGN files have them
+  char sans[CORPUS_POSITIONS][SAN_MAX_LENGTH];
+
+  // The positions packed and as FEN, to compare the two formats
+  PackedPosition packed[CORPUS_POSITIONS];
+  char fens[CORPUS_POSITIONS][FEN_MAX_LENGTH];
+  uint8_t fenLengths[CORPUS_POSITIONS];
+  PositionSet *set;
+
+  // The positions again as columns, the way countMobility takes them
+  uint64_t columnFriendly[CORPUS_POSITIONS], columnEnemy[CORPUS_POSITIONS];
+  uint64_t columnPieces[PIECE_TYPES][CORPUS_POSITIONS];
+  uint8_t columnSideToMove[CORPUS_POSITIONS];
+  uint8_t columnCastlingRights[CORPUS_POSITIONS];
+  int8_t columnEnPassant[CORPUS_POSITIONS];
+} Corpus;
+
+// Runs BATCH_CALLS calls starting at `offset` in the corpus. Results are
+// folded into the returned value so no call can be optimized away.
+typedef uint64_t (*BatchKernel)(const Corpus *corpus, uint32_t offset,
+                                Piece piece);
+
+typedef enum {
+  VARY_NOTHING,
+  VARY_INDEXING, // Once per sliding indexing the CPU runs
+  VARY_FILL,     // Once per fill kernel the CPU runs
+  VARY_NNUE,     // Once per NNUE kernel the CPU runs
+} Variation;
+
+typedef struct {
+  const char *name;
+  BatchKernel kernel;
+  Piece piece; // For the kernels taking one
+  Variation variation;
+} Benchmark;
+
+typedef struct {
+  double median, p99, min;
+} Summary;
+
+static uint64_t nextCorpusRandom(uint64_t *state) {
+  // xorshift64*, plenty for test data
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t readCycles(void) {
+#ifdef __x86_64__
+  return __rdtsc();
+#else
+  return 0;
+#endif /* ifdef __x86_64__ */
+}
+
+static bool hasCycleCounter(void) {
+#ifdef __x86_64__
+  return true;
+#else
+  return false;
+#endif /* ifdef __x86_64__ */
+}
+
+static uint64_t getNanoseconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static void addSliders(Corpus *corpus, const uint32_t index) {
+  const Position *position = &corpus->positions[index];
+  const uint64_t *pieces = position->pieces[position->sideToMove];
+  uint8_t count = 0;
+
+  corpus->orthogonal[index] = pieces[ROOK] | pieces[QUEEN];
+  corpus->diagonal[index] = pieces[BISHOP] | pieces[QUEEN];
+  for (uint64_t sliders = corpus->orthogonal[index] | corpus->diagonal[index];
+       sliders; sliders &= sliders - 1) {
+    const uint64_t slider = sliders & -sliders;
+
+    corpus->orthogonalPieces[index][count] = slider & corpus->orthogonal[index];
+    corpus->diagonalPieces[index][count] = slider & corpus->diagonal[index];
+    count++;
+  }
+  corpus->sliderCounts[index] = count;
+}
+
+static void addColumns(Corpus *corpus, const uint32_t index) {
+  const Position *position = &corpus->positions[index];
+  const Color us = position->sideToMove;
+
+  corpus->columnFriendly[index] = position->occupancy[us];
+  corpus->columnEnemy[index] = position->occupancy[!us];
+  for (Piece type = PAWN; type < PIECE_TYPES; type++) {
+    corpus->columnPieces[type][index] =
+        position->pieces[WHITE][type] | position->pieces[BLACK][type];
+  }
+  corpus->columnSideToMove[index] = (uint8_t)us;
+  corpus->columnCastlingRights[index] = position->castlingRights;
+  corpus->columnEnPassant[index] = position->enPassant;
+}
+
+// Occupancies spread like a middlegame, a quarter of the squares taken. The
+// positions come from random games out of the starting position and kiwipete,
+// so they have every kind of move the generators know about.
+static void generateCorpus(Corpus *corpus) {
+  uint64_t state = CORPUS_SEED;
+
+  for (uint32_t index = 0; index < CORPUS_SIZE; index++) {
+    const int8_t square = (int8_t)(nextCorpusRandom(&state) % BOARD_AREA);
+    const uint64_t occupied =
+        nextCorpusRandom(&state) & nextCorpusRandom(&state);
+    const uint64_t white = occupied & nextCorpusRandom(&state);
+
+    corpus->coords[index] = (Coordinate){(int8_t)(square / BOARD_LENGTH),
+                                         (int8_t)(square % BOARD_LENGTH)};
+    corpus->isWhite[index] = nextCorpusRandom(&state) & 1;
+    corpus->friendly[index] =
+        ((corpus->isWhite[index] ? white : occupied & ~white) |
+         (1ULL << square));
+    corpus->enemy[index] = occupied & ~corpus->friendly[index];
+  }
+
+  uint32_t index = 0;
+  for (uint32_t game = 0; index < CORPUS_POSITIONS; game++) {
+    Position position;
+    (void)parseFen(&position, game % 2 ? KIWIPETE_FEN : STARTING_FEN);
+
+    for (uint8_t ply = 0; ply < RANDOM_GAME_PLIES && index < CORPUS_POSITIONS;
+         ply++) {
+      MoveList list;
+      UndoInfo undo;
+
+      generateLegalMoves(&position, &list);
+      if (list.count == 0) {
+        break;
+      }
+      makeMove(&position, list.moves[nextCorpusRandom(&state) % list.count],
+               &undo);
+
+      // Every 8th ply, so one game doesn't fill the corpus
+      generateLegalMoves(&position, &list);
+      if (ply % 8 == 7 && list.count > 0) {
+        corpus->positions[index] = position;
+        corpus->moves[index] =
+            list.moves[nextCorpusRandom(&state) % list.count];
+        refreshAccumulator(corpus->network, &position,
+                           &corpus->accumulators[index]);
+        (void)writeSan(&position, corpus->moves[index], corpus->sans[index]);
+        (void)packPosition(&position, &corpus->packed[index]);
+        corpus->fenLengths[index] =
+            (uint8_t)writeFen(&position, corpus->fens[index]);
+        addSliders(corpus, index);
+        addColumns(corpus, index);
+        index++;
+      }
+    }
+  }
+}
+
+static uint64_t runPawnPushes(const Corpus *corpus, const uint32_t offset,
+                              const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_SIZE - 1);
+
+    sink ^= generatePawnPushes(corpus->coords[index],
+                               corpus->friendly[index] | corpus->enemy[index],
+                               corpus->isWhite[index]);
+  }
+
+  return sink;
+}
+
+static uint64_t runPawnCaptures(const Corpus *corpus, const uint32_t offset,
+                                const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_SIZE - 1);
+
+    sink ^= generatePawnCaptures(corpus->coords[index], corpus->enemy[index],
+                                 corpus->isWhite[index]);
+  }
+
+  return sink;
+}
+
+static uint64_t runAttacksByLUT(const Corpus *corpus, const uint32_t offset,
+                                const Piece piece) {
+  const uint64_t *lut = piece == KNIGHT ? KNIGHT_ATTACK_MAP : KING_ATTACK_MAP;
+  uint64_t sink = 0;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_SIZE - 1);
+
+    sink ^= getAttacksByLUT(lut, coordToSquare(corpus->coords[index]),
+                            corpus->friendly[index]);
+  }
+
+  return sink;
+}
+
+static uint64_t runAttackByOccupancy(const Corpus *corpus,
+                                     const uint32_t offset, const Piece piece) {
+  uint64_t sink = 0;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_SIZE - 1);
+
+    sink ^= getAttackByOccupancy(coordToSquare(corpus->coords[index]), piece,
+                                 corpus->friendly[index], corpus->enemy[index]);
+  }
+
+  return sink;
+}
+
+static uint64_t runPseudoLegal(const Corpus *corpus, const uint32_t offset,
+                               const Piece piece) {
+  uint64_t sink = 0;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_SIZE - 1);
+    const Move move =
+        getPseudoLegal(piece, corpus->coords[index], corpus->friendly[index],
+                       corpus->isWhite[index], corpus->enemy[index]);
+
+    sink ^= move.quiet ^ move.kills;
+  }
+
+  return sink;
+}
+
+// The generators.h entry points on the same corpus, each in its own loop so
+// the piece and color stay compile time constants
+#define DEFINE_SPECIALIZED_RUN(runner, generator)                              \
+  static uint64_t runner(const Corpus *corpus, const uint32_t offset,          \
+                         const Piece piece) {                                  \
+    uint64_t sink = 0;                                                         \
+    (void)piece;                                                               \
+                                                                               \
+    for (uint32_t call = 0; call < BATCH_CALLS; call++) {                      \
+      const uint32_t index = (offset + call) & (CORPUS_SIZE - 1);              \
+      const Move move = generator(coordToSquare(corpus->coords[index]),        \
+                                  corpus->friendly[index],                     \
+                                  corpus->enemy[index]);                       \
+                                                                               \
+      sink ^= move.quiet ^ move.kills;                                         \
+    }                                                                          \
+                                                                               \
+    return sink;                                                               \
+  }
+
+DEFINE_SPECIALIZED_RUN(runWhitePawnMoves, getWhitePawnMoves)
+DEFINE_SPECIALIZED_RUN(runBlackPawnMoves, getBlackPawnMoves)
+DEFINE_SPECIALIZED_RUN(runKnightMoves, getKnightMoves)
+DEFINE_SPECIALIZED_RUN(runBishopMoves, getBishopMoves)
+DEFINE_SPECIALIZED_RUN(runRookMoves, getRookMoves)
+DEFINE_SPECIALIZED_RUN(runQueenMoves, getQueenMoves)
+DEFINE_SPECIALIZED_RUN(runKingMoves, getKingMoves)
+
+// Union of a side's slider attacks by fills, then the same from the tables
+static uint64_t runFillBySide(const Corpus *corpus, const uint32_t offset,
+                              const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+
+    sink ^= fillSliderAttacks(corpus->orthogonal[index],
+                              corpus->diagonal[index],
+                              getOccupancy(&corpus->positions[index]));
+  }
+
+  return sink;
+}
+
+static uint64_t runLookupBySide(const Corpus *corpus, const uint32_t offset,
+                                const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+    const uint64_t occupancy = getOccupancy(&corpus->positions[index]);
+
+    for (uint64_t sliders = corpus->orthogonal[index]; sliders;
+         sliders &= sliders - 1) {
+      sink ^= getAttackByOccupancy((int8_t)__builtin_ctzll(sliders), ROOK, 0,
+                                   occupancy);
+    }
+    for (uint64_t sliders = corpus->diagonal[index]; sliders;
+         sliders &= sliders - 1) {
+      sink ^= getAttackByOccupancy((int8_t)__builtin_ctzll(sliders), BISHOP, 0,
+                                   occupancy);
+    }
+  }
+
+  return sink;
+}
+
+// Attacks of each slider separately, by fills then from the tables
+static uint64_t runFillPerPiece(const Corpus *corpus, const uint32_t offset,
+                                const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+    uint64_t attacks[MAX_SLIDERS];
+
+    fillSliderAttacksPerPiece(
+        corpus->orthogonalPieces[index], corpus->diagonalPieces[index],
+        corpus->sliderCounts[index], getOccupancy(&corpus->positions[index]),
+        attacks);
+    for (uint8_t slider = 0; slider < corpus->sliderCounts[index]; slider++) {
+      sink ^= attacks[slider];
+    }
+  }
+
+  return sink;
+}
+
+static uint64_t runLookupPerPiece(const Corpus *corpus, const uint32_t offset,
+                                  const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+    const Position *position = &corpus->positions[index];
+    const uint64_t occupancy = getOccupancy(position);
+
+    for (uint64_t sliders = corpus->orthogonal[index] | corpus->diagonal[index];
+         sliders; sliders &= sliders - 1) {
+      const int8_t square = (int8_t)__builtin_ctzll(sliders);
+
+      sink ^= getAttackByOccupancy(square, (Piece)position->board[square], 0,
+                                   occupancy);
+    }
+  }
+
+  return sink;
+}
+
+// One call per position, so positions per second is 1e9 over the ns per call
+static uint64_t runLegalMoves(const Corpus *corpus, const uint32_t offset,
+                              const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+    MoveList list;
+
+    generateLegalMoves(&corpus->positions[index], &list);
+    sink += list.count;
+  }
+
+  return sink;
+}
+
+// What countMobility computes, through the per-call functions: the legal
+// moves, getPseudoLegal for each piece and the attacks of the side to move
+static uint64_t runMobilityPerCall(const Corpus *corpus, const uint32_t offset,
+                                   const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+    const Position *position = &corpus->positions[index];
+    const Color us = position->sideToMove;
+    uint16_t mobility[PIECE_TYPES] = {0};
+    MoveList list;
+
+    for (uint64_t pieces = position->occupancy[us]; pieces;
+         pieces &= pieces - 1) {
+      const int8_t square = (int8_t)__builtin_ctzll(pieces);
+      const Coordinate coord = {(int8_t)(square / BOARD_LENGTH),
+                                (int8_t)(square % BOARD_LENGTH)};
+      const Move move = getPseudoLegal(
+          (Piece)position->board[square], coord, position->occupancy[us],
+          us == WHITE, position->occupancy[!us]);
+
+      mobility[position->board[square]] +=
+          (uint16_t)__builtin_popcountll(move.quiet | move.kills);
+    }
+    generateLegalMoves(position, &list);
+
+    sink += list.count + mobility[call % PIECE_TYPES];
+    sink ^= attackedBy(position, us);
+  }
+
+  return sink;
+}
+
+// countMobility over `count` positions from `first` on, which mustn't run
+// past the end of the corpus
+static uint64_t countCorpusMobility(const Corpus *corpus, const uint32_t first,
+                                    const uint32_t count) {
+  uint16_t legalMoves[BATCH_CALLS];
+  uint16_t mobility[PIECE_TYPES][BATCH_CALLS];
+  uint64_t attacks[BATCH_CALLS];
+  const PositionBatch batch = {
+      &corpus->columnFriendly[first],
+      &corpus->columnEnemy[first],
+      {&corpus->columnPieces[PAWN][first], &corpus->columnPieces[KNIGHT][first],
+       &corpus->columnPieces[BISHOP][first], &corpus->columnPieces[ROOK][first],
+       &corpus->columnPieces[QUEEN][first], &corpus->columnPieces[KING][first]},
+      &corpus->columnSideToMove[first],
+      &corpus->columnCastlingRights[first],
+      &corpus->columnEnPassant[first],
+  };
+  const MobilityBatch results = {
+      legalMoves,
+      {mobility[PAWN], mobility[KNIGHT], mobility[BISHOP], mobility[ROOK],
+       mobility[QUEEN], mobility[KING]},
+      attacks,
+  };
+  uint64_t sink = 0;
+
+  countMobility(&batch, count, &results);
+  for (uint32_t index = 0; index < count; index++) {
+    sink += legalMoves[index] + mobility[index % PIECE_TYPES][index];
+    sink ^= attacks[index];
+  }
+
+  return sink;
+}
+
+// All the calls' positions in one batch. Offsets go up by BATCH_CALLS, so
+// the batch never wraps around the corpus.
+static uint64_t runCountMobility(const Corpus *corpus, const uint32_t offset,
+                                 const Piece piece) {
+  (void)piece;
+
+  return countCorpusMobility(corpus, offset & (CORPUS_POSITIONS - 1),
+                             BATCH_CALLS);
+}
+
+// One position per batch, so no lookups overlap across positions
+static uint64_t runCountMobilitySingly(const Corpus *corpus,
+                                       const uint32_t offset,
+                                       const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    sink += countCorpusMobility(
+        corpus, (offset + call) & (CORPUS_POSITIONS - 1), 1);
+  }
+
+  return sink;
+}
+
+static uint64_t runParseSan(const Corpus *corpus, const uint32_t offset,
+                            const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+
+    sink += parseSan(&corpus->positions[index], corpus->sans[index],
+                     strlen(corpus->sans[index]));
+  }
+
+  return sink;
+}
+
+static uint64_t runPackPosition(const Corpus *corpus, const uint32_t offset,
+                                const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+    PackedPosition packed;
+
+    sink += packPosition(&corpus->positions[index], &packed);
+    sink ^= packed.occupancy ^ packed.pieces[call & 15];
+  }
+
+  return sink;
+}
+
+static uint64_t runUnpackPosition(const Corpus *corpus, const uint32_t offset,
+                                  const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+    Position position;
+
+    sink += unpackPosition(&corpus->packed[index], &position);
+    sink ^= position.hash;
+  }
+
+  return sink;
+}
+
+// The text formats the packed one replaces
+static uint64_t runParseFen(const Corpus *corpus, const uint32_t offset,
+                            const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+    Position position;
+
+    sink += parseFenSpan(&position, corpus->fens[index],
+                         corpus->fenLengths[index]);
+    sink ^= position.hash;
+  }
+
+  return sink;
+}
+
+static uint64_t runWriteFen(const Corpus *corpus, const uint32_t offset,
+                            const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+    char fen[FEN_MAX_LENGTH];
+
+    sink += writeFen(&corpus->positions[index], fen);
+    sink ^= (uint8_t)fen[call & 15];
+  }
+
+  return sink;
+}
+
+// New keys every call, the set only gets bigger as the samples go
+static uint64_t runInsertPositionSet(const Corpus *corpus,
+                                     const uint32_t offset,
+                                     const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+
+    sink += insertPositionSet(corpus->set,
+                              corpus->positions[index].hash ^
+                                  ((offset + call) * 0x9E3779B97F4A7C15ULL));
+  }
+
+  return sink;
+}
+
+// The classical evaluation, for comparison with the network's
+static uint64_t runEvaluate(const Corpus *corpus, const uint32_t offset,
+                            const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+
+    sink += (uint64_t)evaluate(&corpus->positions[index]);
+  }
+
+  return sink;
+}
+
+// Output layers only, the accumulators are up to date as in a search
+static uint64_t runNetworkEvaluation(const Corpus *corpus,
+                                     const uint32_t offset,
+                                     const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+
+    sink += (uint64_t)evaluateNetwork(corpus->network,
+                                      &corpus->positions[index],
+                                      &corpus->accumulators[index]);
+  }
+
+  return sink;
+}
+
+static uint64_t runAccumulatorUpdate(const Corpus *corpus,
+                                     const uint32_t offset,
+                                     const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+    Accumulator accumulator;
+
+    updateAccumulator(corpus->network, &corpus->positions[index],
+                      corpus->moves[index], &corpus->accumulators[index],
+                      &accumulator);
+    sink += (uint16_t)accumulator.values[WHITE][index & (NNUE_HIDDEN - 1)];
+  }
+
+  return sink;
+}
+
+static uint64_t runAccumulatorRefresh(const Corpus *corpus,
+                                      const uint32_t offset,
+                                      const Piece piece) {
+  uint64_t sink = 0;
+  (void)piece;
+
+  for (uint32_t call = 0; call < BATCH_CALLS; call++) {
+    const uint32_t index = (offset + call) & (CORPUS_POSITIONS - 1);
+    Accumulator accumulator;
+
+    refreshAccumulator(corpus->network, &corpus->positions[index],
+                       &accumulator);
+    sink += (uint16_t)accumulator.values[WHITE][index & (NNUE_HIDDEN - 1)];
+  }
+
+  return sink;
+}
+
+static const Benchmark BENCHMARKS[] = {
+    {"generatePawnPushes", runPawnPushes, PAWN, VARY_NOTHING},
+    {"generatePawnCaptures", runPawnCaptures, PAWN, VARY_NOTHING},
+    {"getAttacksByLUT", runAttacksByLUT, KNIGHT, VARY_NOTHING},
+    {"getAttacksByLUT", runAttacksByLUT, KING, VARY_NOTHING},
+    {"getAttackByOccupancy", runAttackByOccupancy, BISHOP, VARY_INDEXING},
+    {"getAttackByOccupancy", runAttackByOccupancy, ROOK, VARY_INDEXING},
+    {"getAttackByOccupancy", runAttackByOccupancy, QUEEN, VARY_INDEXING},
+    {"getPseudoLegal", runPseudoLegal, PAWN, VARY_NOTHING},
+    {"getPseudoLegal", runPseudoLegal, KNIGHT, VARY_NOTHING},
+    {"getPseudoLegal", runPseudoLegal, BISHOP, VARY_INDEXING},
+    {"getPseudoLegal", runPseudoLegal, ROOK, VARY_INDEXING},
+    {"getPseudoLegal", runPseudoLegal, QUEEN, VARY_INDEXING},
+    {"getPseudoLegal", runPseudoLegal, KING, VARY_NOTHING},
+    {"getWhitePawnMoves", runWhitePawnMoves, PAWN, VARY_NOTHING},
+    {"getBlackPawnMoves", runBlackPawnMoves, PAWN, VARY_NOTHING},
+    {"getKnightMoves", runKnightMoves, KNIGHT, VARY_NOTHING},
+    {"getBishopMoves", runBishopMoves, BISHOP, VARY_INDEXING},
+    {"getRookMoves", runRookMoves, ROOK, VARY_INDEXING},
+    {"getQueenMoves", runQueenMoves, QUEEN, VARY_INDEXING},
+    {"getKingMoves", runKingMoves, KING, VARY_NOTHING},
+    {"fillSliderAttacks", runFillBySide, NOTHING, VARY_FILL},
+    {"lookupSliderAttacks", runLookupBySide, NOTHING, VARY_INDEXING},
+    {"fillSliderAttacksPerPiece", runFillPerPiece, NOTHING, VARY_FILL},
+    {"lookupSliderAttacksPerPiece", runLookupPerPiece, NOTHING, VARY_INDEXING},
+    {"generateLegalMoves", runLegalMoves, NOTHING, VARY_INDEXING},
+    {"mobilityPerCall", runMobilityPerCall, NOTHING, VARY_INDEXING},
+    {"countMobility", runCountMobility, NOTHING, VARY_INDEXING},
+    {"countMobilitySingly", runCountMobilitySingly, NOTHING, VARY_INDEXING},
+    {"parseSan", runParseSan, NOTHING, VARY_INDEXING},
+    {"packPosition", runPackPosition, NOTHING, VARY_NOTHING},
+    {"unpackPosition", runUnpackPosition, NOTHING, VARY_NOTHING},
+    {"parseFenSpan", runParseFen, NOTHING, VARY_NOTHING},
+    {"writeFen", runWriteFen, NOTHING, VARY_NOTHING},
+    {"insertPositionSet", runInsertPositionSet, NOTHING, VARY_NOTHING},
+    {"evaluate", runEvaluate, NOTHING, VARY_NOTHING},
+    {"evaluateNetwork", runNetworkEvaluation, NOTHING, VARY_NNUE},
+    {"updateAccumulator", runAccumulatorUpdate, NOTHING, VARY_NNUE},
+    {"refreshAccumulator", runAccumulatorRefresh, NOTHING, VARY_NNUE},
+};
+
+static const char *const PIECE_NAMES[] = {"pawn",  "knight", "bishop", "rook",
+                                          "queen", "king",   ""};
+static const char *const INDEXING_NAMES[] = {"pext", "magic"};
+static const char *const FILL_NAMES[] = {"scalar", "avx2", "avx512"};
+static const char *const NNUE_NAMES[] = {"scalar", "sse2", "avx2"};
+
+static volatile uint64_t sink;
+
+static int compareDoubles(const void *lhs, const void *rhs) {
+  const double left = *(const double *)lhs, right = *(const double *)rhs;
+
+  return (left > right) - (left < right);
+}
+
+static Summary summarize(double *samples, const uint32_t count) {
+  qsort(samples, count, sizeof(double), compareDoubles);
+
+  return (Summary){
+      .median = samples[count / 2],
+      .p99 = samples[(uint32_t)((uint64_t)count * 99 / 100)],
+      .min = samples[0],
+  };
+}
+
+// Warm-up batches first, to fault the tables in and let the clock settle,
+// then one sample of ns and cycles per call for each batch
+static void measure(const Corpus *corpus, const Benchmark *benchmark,
+                    const uint32_t samples, double *nanoseconds,
+                    double *cycles) {
+  uint32_t offset = 0;
+
+  for (uint32_t sample = 0; sample < WARMUP_SAMPLES + samples; sample++) {
+    const uint64_t startNanoseconds = getNanoseconds();
+    const uint64_t startCycles = readCycles();
+    sink ^= benchmark->kernel(corpus, offset, benchmark->piece);
+    const uint64_t elapsedCycles = readCycles() - startCycles;
+    const uint64_t elapsedNanoseconds = getNanoseconds() - startNanoseconds;
+
+    offset += BATCH_CALLS;
+    if (sample >= WARMUP_SAMPLES) {
+      nanoseconds[sample - WARMUP_SAMPLES] =
+          (double)elapsedNanoseconds / BATCH_CALLS;
+      cycles[sample - WARMUP_SAMPLES] = (double)elapsedCycles / BATCH_CALLS;
+    }
+  }
+}
+
+static void printSummary(const char *name, const Summary *summary,
+                         const bool available) {
+  if (!available) {
+    printf("\"%s\": null", name);
+    return;
+  }
+
+  printf("\"%s\": {\"median\": %.3f, \"p99\": %.3f, \"min\": %.3f}", name,
+         summary->median, summary->p99, summary->min);
+}
+
+// Returns the median ns per call
+static double runBenchmark(const Corpus *corpus, const Benchmark *benchmark,
+                           const char *variant, const uint32_t samples,
+                           double *nanoseconds, double *cycles, bool *first) {
+  measure(corpus, benchmark, samples, nanoseconds, cycles);
+  const Summary nanosecondSummary = summarize(nanoseconds, samples);
+  const Summary cycleSummary = summarize(cycles, samples);
+
+  printf("%s\n    {\"name\": \"%s\", \"piece\": \"%s\", \"variant\": \"%s\", ",
+         *first ? "" : ",", benchmark->name, PIECE_NAMES[benchmark->piece],
+         variant);
+  printSummary("nsPerCall", &nanosecondSummary, true);
+  printf(", ");
+  printSummary("cyclesPerCall", &cycleSummary, hasCycleCounter());
+  // Evaluations, positions or updates per second, depending on the kernel
+  printf(", \"callsPerSecond\": %.0f}", 1e9 / nanosecondSummary.median);
+  *first = false;
+
+  return nanosecondSummary.median;
+}
+
+// Deterministic weights for when no network file is given. They don't play
+// well but take as long to evaluate as trained ones.
+static Network *generateNetwork(void) {
+  void *memory = NULL;
+  if (posix_memalign(&memory, NNUE_ALIGNMENT, sizeof(Network)) != 0) {
+    return NULL;
+  }
+
+  Network *network = memory;
+  uint64_t state = CORPUS_SEED;
+  for (uint16_t feature = 0; feature < NNUE_INPUTS; feature++) {
+    for (uint16_t index = 0; index < NNUE_HIDDEN; index++) {
+      network->featureWeights[feature][index] =
+          (int16_t)(nextCorpusRandom(&state) % 33) - 16;
+    }
+  }
+  for (uint16_t index = 0; index < NNUE_HIDDEN; index++) {
+    network->featureBiases[index] = (int16_t)(nextCorpusRandom(&state) % 128);
+    network->outputWeights[WHITE][index] =
+        (int16_t)(nextCorpusRandom(&state) % 129) - 64;
+    network->outputWeights[BLACK][index] =
+        (int16_t)(nextCorpusRandom(&state) % 129) - 64;
+  }
+  network->outputBias = 0;
+
+  return network;
+}
+
+static void printUsage(const char *program) {
+  (void)fprintf(stderr,
+                "Usage: %s [--samples <N>] [--filter <name>] [--nnue <file>]\n"
+                "Times every generator kernel and prints the results as "
+                "JSON\n"
+                "  --samples <N>    Batches of %d calls timed per kernel, %d "
+                "by default\n"
+                "  --filter <name>  Only run the kernels whose name contains "
+                "it\n"
+                "  --nnue <file>    Network to evaluate with, random weights "
+                "by default\n",
+                program, BATCH_CALLS, DEFAULT_SAMPLES);
+}
+
+int main(int argc, const char *argv[]) {
+  const char *program = argv[0];
+  const char *filter = "";
+  const char *networkPath = NULL;
+  long samples = DEFAULT_SAMPLES;
+
+  for (argc--, argv++; argc > 0; argc--, argv++) {
+    if (argc >= 2 && strcmp(argv[0], "--samples") == 0) {
+      samples = strtol(argv[1], NULL, 10);
+      argc--, argv++;
+    } else if (argc >= 2 && strcmp(argv[0], "--filter") == 0) {
+      filter = argv[1];
+      argc--, argv++;
+    } else if (argc >= 2 && strcmp(argv[0], "--nnue") == 0) {
+      networkPath = argv[1];
+      argc--, argv++;
+    } else {
+      printUsage(program);
+      return EXIT_FAILURE;
+    }
+  }
+  if (samples < 1 || samples > UINT32_MAX / BATCH_CALLS) {
+    (void)fprintf(stderr, "Samples must be between 1 and %u\n",
+                  UINT32_MAX / BATCH_CALLS);
+    return EXIT_FAILURE;
+  }
+
+  Network *network =
+      networkPath ? loadNetwork(networkPath) : generateNetwork();
+  if (!network) {
+    (void)fprintf(stderr, "Can't load the network %s\n",
+                  networkPath ? networkPath : "");
+    return EXIT_FAILURE;
+  }
+
+  // Aligned for the accumulators
+  void *corpusMemory = NULL;
+  if (posix_memalign(&corpusMemory, NNUE_ALIGNMENT, sizeof(Corpus)) != 0) {
+    corpusMemory = NULL;
+  }
+  Corpus *corpus = corpusMemory;
+  PositionSet set = {0};
+  double *nanoseconds = malloc((size_t)samples * sizeof(double));
+  double *cycles = malloc((size_t)samples * sizeof(double));
+  if (!corpus || !nanoseconds || !cycles ||
+      !initPositionSet(&set, POSITION_SET_MEGABYTES)) {
+    (void)fprintf(stderr, "Can't allocate the corpora\n");
+    free(corpus);
+    free(nanoseconds);
+    free(cycles);
+    freePositionSet(&set);
+    freeNetwork(network);
+    return EXIT_FAILURE;
+  }
+  corpus->network = network;
+  corpus->set = &set;
+  // Faults the set's pages in, so only the probes get timed
+  memset(set.keys, 0, (set.mask + 1) * sizeof(uint64_t));
+  generateCorpus(corpus);
+
+  uint64_t fenBytes = 0;
+  for (uint32_t index = 0; index < CORPUS_POSITIONS; index++) {
+    fenBytes += corpus->fenLengths[index];
+  }
+
+  const SlidingIndexing defaultIndexing = getSlidingIndexing();
+  const FillKernel defaultFill = getFillKernel();
+  const NnueKernel defaultNnue = getNnueKernel();
+  // Median ns of an incremental update and of a refresh, per NNUE kernel
+  double updateNanoseconds[NNUE_AVX2 + 1] = {0};
+  double refreshNanoseconds[NNUE_AVX2 + 1] = {0};
+  // Median ns per position of the per-call functions and of countMobility,
+  // per sliding indexing
+  double perCallNanoseconds[INDEX_BY_MAGIC + 1] = {0};
+  double batchNanoseconds[INDEX_BY_MAGIC + 1] = {0};
+
+  printf("{\n  \"benchmark\": \"sysifusBench\",\n");
+  printf("  \"library\": \"%s\",\n", LIBRARY_KIND);
+  printf("  \"corpus\": {\"seed\": \"0x%016" PRIX64 "\", \"occupancies\": %d, "
+         "\"positions\": %d},\n",
+         (uint64_t)CORPUS_SEED, CORPUS_SIZE, CORPUS_POSITIONS);
+  printf("  \"positionBytes\": {\"packed\": %zu, \"fen\": %.1f},\n",
+         sizeof(PackedPosition), (double)fenBytes / CORPUS_POSITIONS);
+  printf("  \"batchCalls\": %d,\n  \"warmupSamples\": %d,\n  \"samples\": "
+         "%ld,\n",
+         BATCH_CALLS, WARMUP_SAMPLES, samples);
+  printf("  \"defaultIndexing\": \"%s\",\n  \"defaultFill\": \"%s\",\n",
+         INDEXING_NAMES[defaultIndexing], FILL_NAMES[defaultFill]);
+  printf("  \"defaultNnue\": \"%s\",\n  \"network\": \"%s\",\n",
+         NNUE_NAMES[defaultNnue], networkPath ? networkPath : "random");
+  // The TSC ticks at a fixed rate, not at the core's current clock
+  printf("  \"cycleCounter\": \"%s\",\n", hasCycleCounter() ? "rdtsc" : "none");
+  printf("  \"results\": [");
+
+  bool first = true;
+  for (size_t benchmarkIndex = 0;
+       benchmarkIndex < sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+       benchmarkIndex++) {
+    const Benchmark *benchmark = &BENCHMARKS[benchmarkIndex];
+
+    if (!strstr(benchmark->name, filter)) {
+      continue;
+    }
+
+    switch (benchmark->variation) {
+    case VARY_NOTHING:
+      runBenchmark(corpus, benchmark, "", (uint32_t)samples, nanoseconds,
+                   cycles, &first);
+      break;
+    case VARY_INDEXING:
+      for (SlidingIndexing indexing = INDEX_BY_PEXT;
+           indexing <= INDEX_BY_MAGIC; indexing++) {
+        if (!setSlidingIndexing(indexing)) {
+          continue;
+        }
+
+        const double median =
+            runBenchmark(corpus, benchmark, INDEXING_NAMES[indexing],
+                         (uint32_t)samples, nanoseconds, cycles, &first);
+        if (benchmark->kernel == runMobilityPerCall) {
+          perCallNanoseconds[indexing] = median;
+        } else if (benchmark->kernel == runCountMobility) {
+          batchNanoseconds[indexing] = median;
+        }
+      }
+      (void)setSlidingIndexing(defaultIndexing);
+      break;
+    case VARY_FILL:
+      for (FillKernel kernel = FILL_SCALAR; kernel <= FILL_AVX512; kernel++) {
+        if (setFillKernel(kernel)) {
+          runBenchmark(corpus, benchmark, FILL_NAMES[kernel],
+                       (uint32_t)samples, nanoseconds, cycles, &first);
+        }
+      }
+      (void)setFillKernel(defaultFill);
+      break;
+    case VARY_NNUE:
+      for (NnueKernel kernel = NNUE_SCALAR; kernel <= NNUE_AVX2; kernel++) {
+        if (!setNnueKernel(kernel)) {
+          continue;
+        }
+
+        const double median =
+            runBenchmark(corpus, benchmark, NNUE_NAMES[kernel],
+                         (uint32_t)samples, nanoseconds, cycles, &first);
+        if (benchmark->kernel == runAccumulatorUpdate) {
+          updateNanoseconds[kernel] = median;
+        } else if (benchmark->kernel == runAccumulatorRefresh) {
+          refreshNanoseconds[kernel] = median;
+        }
+      }
+      (void)setNnueKernel(defaultNnue);
+      break;
+    }
+  }
+  printf("\n  ],\n");
+
+  // What an incremental update costs as a fraction of a refresh, for the
+  // kernels both got timed with
+  printf("  \"updateToRefresh\": {");
+  first = true;
+  for (NnueKernel kernel = NNUE_SCALAR; kernel <= NNUE_AVX2; kernel++) {
+    if (updateNanoseconds[kernel] > 0 && refreshNanoseconds[kernel] > 0) {
+      printf("%s\"%s\": %.3f", first ? "" : ", ", NNUE_NAMES[kernel],
+             updateNanoseconds[kernel] / refreshNanoseconds[kernel]);
+      first = false;
+    }
+  }
+  printf("},\n");
+
+  // How many times more positions per second countMobility gets through than
+  // the per-call functions
+  printf("  \"batchSpeedup\": {");
+  first = true;
+  for (SlidingIndexing indexing = INDEX_BY_PEXT; indexing <= INDEX_BY_MAGIC;
+       indexing++) {
+    if (perCallNanoseconds[indexing] > 0 && batchNanoseconds[indexing] > 0) {
+      printf("%s\"%s\": %.3f", first ? "" : ", ", INDEXING_NAMES[indexing],
+             perCallNanoseconds[indexing] / batchNanoseconds[indexing]);
+      first = false;
+    }
+  }
+  printf("}\n}\n");
+
+  freePositionSet(&set);
+  freeNetwork(network);
+  free(corpus);
+  free(nanoseconds);
+  free(cycles);
+  return EXIT_SUCCESS;
+}
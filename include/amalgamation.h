@@ -0,0 +1,35 @@
+#pragma once
+
+// The whole library in the translation unit including this header, for
+// builds defining SYSIFUS_HEADER_ONLY: the lookup tables and every generator
+// are visible to the compiler at each call site, nothing goes through the
+// PLT. Include it from a single translation unit, before any system header,
+// and don't link the library.
+
+#ifndef SYSIFUS_HEADER_ONLY
+#define SYSIFUS_HEADER_ONLY
+#endif /* ifndef SYSIFUS_HEADER_ONLY */
+
+// What the sources ask for themselves when built on their own
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif /* ifndef _POSIX_C_SOURCE */
+
+#include "../src/sysifus.c"
+
+#include "../src/bake.c"
+#include "../src/dataset.c"
+#include "../src/epd.c"
+#include "../src/evaluate.c"
+#include "../src/fill.c"
+#include "../src/hashtable.c"
+#include "../src/mapping.c"
+#include "../src/mobility.c"
+#include "../src/movepicker.c"
+#include "../src/nnue.c"
+#include "../src/parallel.c"
+#include "../src/perft.c"
+#include "../src/pgn.c"
+#include "../src/position.c"
+#include "../src/search.c"
+#include "../src/see.c"
@@ -6,6 +6,33 @@
 #define BOARD_LENGTH 8
 #define BOARD_AREA 64
 
+// Squares a shift by one or two files can land on without wrapping around the
+// board
+static const uint64_t NOT_FILE_A = 0xFEFEFEFEFEFEFEFE;
+static const uint64_t NOT_FILE_AB = 0xFCFCFCFCFCFCFCFC;
+static const uint64_t NOT_FILE_H = 0x7F7F7F7F7F7F7F7F;
+static const uint64_t NOT_FILE_GH = 0x3F3F3F3F3F3F3F3F;
+
+// Where pawns land after their first push, the only ones that can push again
+// 00000000
+// 00000000
+// 00000000
+// 00000000
+// 00000000
+// 11111111
+// 00000000
+// 00000000
+static const uint64_t RANK_3 = 0xFF0000;
+// 00000000
+// 00000000
+// 11111111
+// 00000000
+// 00000000
+// 00000000
+// 00000000
+// 00000000
+static const uint64_t RANK_6 = 0xFF0000000000;
+
 typedef struct {
   int8_t rank, file;
 } Coordinate;
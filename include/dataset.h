@@ -0,0 +1,108 @@
+#pragma once
+
+#include "position.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Pieces a packed position has room for, every piece of a legal position
+#define PACKED_MAX_PIECES 32
+#define DATASET_VERSION 1
+// Records buffered by a writer before they go to the file, 128 KiB
+#define DATASET_BUFFER_RECORDS 4096
+
+// A position in 32 bytes, a third of a typical FEN. The pieces are listed
+// in the order of the occupancy's bits, from a1 up, one 4-bit code each:
+// color * PIECE_TYPES + type, low nibble first. Unused nibbles and the
+// padding are 0, so equal positions are equal bytes. Stored in the host's
+// byte order, little endian on every target the library builds for.
+typedef struct {
+  uint64_t occupancy;
+  uint8_t pieces[PACKED_MAX_PIECES / 2];
+  uint8_t sideToMove;
+  uint8_t castlingRights;
+  int8_t enPassant;
+  uint8_t halfmoveClock;
+  uint16_t fullmoveNumber;
+  uint16_t padding;
+} PackedPosition;
+
+// A dataset file is a record-sized header, "SYSPOS\0\0" followed by the
+// format version and the record size as uint32 and zeros, then the records
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  uint8_t reserved[16];
+} DatasetHeader;
+
+// Zobrist keys of the positions seen so far, in one flat array of slots
+// probed linearly. Key 0 marks an empty slot, a position hashing to 0 gets a
+// flag of its own.
+typedef struct {
+  uint64_t *keys;
+  uint64_t mask; // Slot count - 1
+  uint64_t count;
+  bool hasZero;
+} PositionSet;
+
+typedef enum {
+  POSITION_ADDED,
+  POSITION_DUPLICATE,
+  // Past 15/16 of the slots the probes get too long, nothing more is added
+  POSITION_SET_FULL,
+} PositionSetStatus;
+
+// Buffers records and writes them out in blocks. With a set, positions it
+// already holds are skipped.
+typedef struct {
+  FILE *file;
+  PackedPosition *buffer;
+  uint32_t buffered;
+  PositionSet *set;
+  uint64_t written;
+  uint64_t duplicates;
+  uint64_t unchecked; // Written without a check, the set being full
+} DatasetWriter;
+
+// Maps the file read-only, like EpdReader. Records are read in place.
+typedef struct {
+  const char *data;
+  size_t size;
+  uint64_t count, next;
+} DatasetReader;
+
+typedef enum {
+  DATASET_RECORD,  // The position holds the next record
+  DATASET_INVALID, // The record can't be a position, reading can go on
+  DATASET_END,
+} DatasetStatus;
+
+// Returns false if the position has more than PACKED_MAX_PIECES pieces
+bool packPosition(const Position *position, PackedPosition *packed);
+// Rebuilds the mailbox and the hash too. Returns false if a field is out of
+// range or the position isn't valid, see isPositionValid, e.g. in a corrupted
+// file.
+bool unpackPosition(const PackedPosition *packed, Position *position);
+
+// Sized to the largest power of two number of slots that fits. Returns
+// false if the memory can't be allocated.
+bool initPositionSet(PositionSet *set, size_t megabytes);
+void freePositionSet(PositionSet *set);
+PositionSetStatus insertPositionSet(PositionSet *set, uint64_t hash);
+
+// Creates or truncates the file and writes the header. `set` can be NULL to
+// keep every position. Returns false if the file can't be written.
+bool openDatasetWriter(DatasetWriter *writer, const char *path,
+                       PositionSet *set);
+// Returns false if the position can't be packed or the file written
+bool writeDatasetPosition(DatasetWriter *writer, const Position *position);
+// Flushes what's buffered. Returns false if it or anything before failed.
+bool closeDatasetWriter(DatasetWriter *writer);
+
+// Returns false if the file can't be mapped or isn't a dataset of this
+// version
+bool openDataset(DatasetReader *reader, const char *path);
+void closeDataset(DatasetReader *reader);
+DatasetStatus readDataset(DatasetReader *reader, Position *position);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "position.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Reads EPD (or plain FEN) lines straight out of a memory-mapped file, one
+// position at a time. Nothing is copied or allocated per line.
+typedef struct {
+  const char *data;
+  size_t size, offset;
+  uint64_t line; // Line number of the last record read, starting at 1
+} EpdReader;
+
+typedef struct {
+  Position position;
+  // What follows the position fields on the line, e.g. `bm e4; id "x";`.
+  // Points into the mapping and isn't NUL terminated, valid until closeEpd.
+  const char *operations;
+  size_t operationsLength;
+} EpdRecord;
+
+typedef enum {
+  EPD_RECORD,  // The record holds the next position
+  EPD_INVALID, // The line isn't a valid position, reading can go on
+  EPD_END,
+} EpdStatus;
+
+// Maps the file read-only. Returns false if it can't be opened or mapped.
+bool openEpd(EpdReader *reader, const char *path);
+void closeEpd(EpdReader *reader);
+
+// Parses the next non-empty line into the record. Handles both LF and CRLF
+// line endings.
+EpdStatus readEpd(EpdReader *reader, EpdRecord *record);
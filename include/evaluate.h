@@ -0,0 +1,16 @@
+#pragma once
+
+#include "position.h"
+#include <stdint.h>
+
+// Midgame and endgame material, the evaluation blends the two by how much
+// material is left on the board
+static const int16_t MIDGAME_VALUES[PIECE_TYPES] = {82,  337, 365,
+                                                    477, 1025, 0};
+static const int16_t ENDGAME_VALUES[PIECE_TYPES] = {94,  281, 297,
+                                                    512, 936, 0};
+
+// Static evaluation in centipawns from the point of view of the side to move:
+// material, piece placement and the bishop pair, tapered between midgame and
+// endgame
+int16_t evaluate(const Position *position);
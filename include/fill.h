@@ -0,0 +1,51 @@
+#pragma once
+
+#include "position.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Sliders a side can have: MAX_SIDE_PIECES pieces, minus the king
+#define MAX_SLIDERS 16
+
+// Sliding attacks computed with Kogge-Stone occluded fills instead of table
+// lookups: every direction is a handful of shifts and ANDs with no memory
+// access, which SIMD lanes can run side by side.
+typedef enum {
+  FILL_SCALAR,
+  // 4 lanes of 64 bits: 4 directions or 4 pieces at once
+  FILL_AVX2,
+  // 8 lanes of 64 bits: all 8 directions or 8 pieces at once
+  FILL_AVX512,
+} FillKernel;
+
+// AVX2 if the CPU supports it, scalar otherwise. Picked once when the library
+// is loaded, AVX-512 is only used when set explicitly.
+FillKernel getFillKernel(void);
+// Forces a kernel, e.g. to compare them. Returns false if the CPU can't run
+// it. Not meant to be called while other threads compute attacks.
+bool setFillKernel(FillKernel kernel);
+
+// Union of the attacks of every orthogonal slider (rooks and queens) and
+// every diagonal slider (bishops and queens) over the given occupancy. Both
+// sets can hold any number of pieces, each direction fills them all at once.
+uint64_t fillSliderAttacks(uint64_t orthogonal, uint64_t diagonal,
+                           uint64_t occupancy);
+
+// Attacks of `count` sliders one by one, `attacks[index]` getting the fill
+// of `orthogonal[index]` along ranks and files plus the fill of
+// `diagonal[index]` along diagonals. A rook has its square in `orthogonal`
+// and 0 in `diagonal`, a queen has it in both.
+void fillSliderAttacksPerPiece(const uint64_t *orthogonal,
+                               const uint64_t *diagonal, size_t count,
+                               uint64_t occupancy, uint64_t *attacks);
+
+// Every square attacked by a bishop, rook or queen of `color`
+uint64_t getSliderAttacksBySide(const Position *position, Color color);
+
+// Attacks of each bishop, rook and queen of `color`, in square order. Returns
+// how many sliders were written to `squares` and `attacks`. The position
+// must be valid, see isPositionValid, for them to fit in MAX_SLIDERS.
+uint8_t getSliderAttacksPerPiece(const Position *position, Color color,
+                                 int8_t squares[MAX_SLIDERS],
+                                 uint64_t attacks[MAX_SLIDERS]);
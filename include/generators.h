@@ -0,0 +1,118 @@
+#pragma once
+
+#include "bitboard.h"
+#include "position.h"
+#include "sysifus.h"
+#include <stdint.h>
+
+// Pseudo-legal moves of one piece type, and of one color for pawns, with no
+// switch on the piece and no color test: everything below is inline and the
+// color is a constant, so the compiler folds the shifts and masks of each
+// entry point. Same results as getPseudoLegal, except that the quiet moves
+// of sliders don't repeat their captures. `square` must be on the board.
+//
+// Knights and kings are computed with shifts instead of being looked up, so
+// any number of them can be passed at once. Sliders take one table lookup
+// per direction kind, a queen exactly one of each.
+
+// One rank towards the enemy, off the board squares fall away
+static inline uint64_t shiftForward(const uint64_t bitboard,
+                                    const Color color) {
+  return color == WHITE ? bitboard << BOARD_LENGTH : bitboard >> BOARD_LENGTH;
+}
+
+static inline uint64_t getPawnPushesOf(const uint64_t pawns,
+                                       const uint64_t empty,
+                                       const Color color) {
+  const uint64_t singlePushes = shiftForward(pawns, color) & empty;
+  const uint64_t doubleRank = color == WHITE ? RANK_3 : RANK_6;
+
+  return singlePushes |
+         (shiftForward(singlePushes & doubleRank, color) & empty);
+}
+
+static inline uint64_t getPawnCapturesOf(const uint64_t pawns,
+                                         const Color color) {
+  const uint64_t forward = shiftForward(pawns, color);
+
+  return ((forward & NOT_FILE_A) >> 1) |
+         ((forward & NOT_FILE_H) << 1);
+}
+
+static inline uint64_t getKnightAttacksOf(const uint64_t knights) {
+  const uint64_t oneFile = ((knights >> 1) & NOT_FILE_H) |
+                           ((knights << 1) & NOT_FILE_A);
+  const uint64_t twoFiles = ((knights >> 2) & NOT_FILE_GH) |
+                            ((knights << 2) & NOT_FILE_AB);
+
+  return (oneFile << 16) | (oneFile >> 16) | (twoFiles << 8) |
+         (twoFiles >> 8);
+}
+
+static inline uint64_t getKingAttacksOf(const uint64_t kings) {
+  const uint64_t sideways = ((kings >> 1) & NOT_FILE_H) |
+                            ((kings << 1) & NOT_FILE_A);
+  const uint64_t row = kings | sideways;
+
+  return sideways | (row << BOARD_LENGTH) | (row >> BOARD_LENGTH);
+}
+
+static inline Move splitTargets(const uint64_t targets,
+                                const uint64_t friendly,
+                                const uint64_t enemy) {
+  return (Move){.quiet = targets & ~(friendly | enemy),
+                .kills = targets & enemy};
+}
+
+static inline Move getPawnMovesOf(const int8_t square, const uint64_t friendly,
+                                  const uint64_t enemy, const Color color) {
+  const uint64_t pawn = 1ULL << square;
+
+  return (Move){.quiet = getPawnPushesOf(pawn, ~(friendly | enemy), color),
+                .kills = getPawnCapturesOf(pawn, color) & enemy};
+}
+
+static inline Move getWhitePawnMoves(const int8_t square,
+                                     const uint64_t friendly,
+                                     const uint64_t enemy) {
+  return getPawnMovesOf(square, friendly, enemy, WHITE);
+}
+
+static inline Move getBlackPawnMoves(const int8_t square,
+                                     const uint64_t friendly,
+                                     const uint64_t enemy) {
+  return getPawnMovesOf(square, friendly, enemy, BLACK);
+}
+
+// The other pieces move the same for both colors, `friendly` and `enemy` are
+// all they need to know
+static inline Move getKnightMoves(const int8_t square, const uint64_t friendly,
+                                  const uint64_t enemy) {
+  return splitTargets(getKnightAttacksOf(1ULL << square), friendly, enemy);
+}
+
+static inline Move getBishopMoves(const int8_t square, const uint64_t friendly,
+                                  const uint64_t enemy) {
+  return splitTargets(getDiagonalAttacks(square, friendly | enemy), friendly,
+                      enemy);
+}
+
+static inline Move getRookMoves(const int8_t square, const uint64_t friendly,
+                                const uint64_t enemy) {
+  return splitTargets(getOrthogonalAttacks(square, friendly | enemy),
+                      friendly, enemy);
+}
+
+static inline Move getQueenMoves(const int8_t square, const uint64_t friendly,
+                                 const uint64_t enemy) {
+  const uint64_t occupancy = friendly | enemy;
+
+  return splitTargets(getDiagonalAttacks(square, occupancy) |
+                          getOrthogonalAttacks(square, occupancy),
+                      friendly, enemy);
+}
+
+static inline Move getKingMoves(const int8_t square, const uint64_t friendly,
+                                const uint64_t enemy) {
+  return splitTargets(getKingAttacksOf(1ULL << square), friendly, enemy);
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "position.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CACHE_LINE_SIZE 64
+#define BUCKET_ENTRIES 4
+#define TABLE_PAYLOAD_BITS 48
+
+// Each entry stores its key XORed with its data. A reader that races a
+// writer sees a key that doesn't verify and treats the entry as a miss, so
+// threads can share the table without locks.
+typedef struct {
+  uint64_t key, data;
+} TableEntry;
+
+// Exactly one cache line, a probe never touches more than one
+typedef struct {
+  TableEntry entries[BUCKET_ENTRIES];
+} TableBucket;
+
+typedef enum {
+  // Evict the entry with the lowest depth, with older generations counting as
+  // shallower. Suits search, where deep results are the expensive ones.
+  REPLACE_DEPTH_AGE,
+  // Evict the shallowest entry whatever its generation. Suits perft, where
+  // counts never go stale.
+  REPLACE_SHALLOWEST,
+} ReplacementPolicy;
+
+typedef struct {
+  TableBucket *buckets;
+  uint64_t mask; // Bucket count - 1
+  ReplacementPolicy policy;
+  uint8_t generation;
+} TranspositionTable;
+
+// Kept by each thread and summed up by whoever reports them, shared counters
+// would bounce their cache line on every probe
+typedef struct {
+  uint64_t probes, hits, stores, evictions;
+} TableStats;
+
+// Data layout: bits 0-7 depth, bits 8-15 generation, bits 16-63 payload
+static inline uint8_t getEntryDepth(const uint64_t data) {
+  return (uint8_t)data;
+}
+
+static inline uint8_t getEntryGeneration(const uint64_t data) {
+  return (uint8_t)(data >> 8);
+}
+
+static inline uint64_t getEntryPayload(const uint64_t data) {
+  return data >> (64 - TABLE_PAYLOAD_BITS);
+}
+
+typedef enum { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT } Bound;
+
+typedef struct {
+  PackedMove move;
+  int16_t score;
+  uint8_t depth;
+  Bound bound;
+} SearchEntry;
+
+// Search payload: bits 0-15 best move, bits 16-31 score, bits 32-33 bound
+static inline uint64_t packSearchEntry(const SearchEntry *entry) {
+  return (uint64_t)entry->move | ((uint64_t)(uint16_t)entry->score << 16) |
+         ((uint64_t)entry->bound << 32);
+}
+
+static inline SearchEntry unpackSearchEntry(const uint64_t data) {
+  const uint64_t payload = getEntryPayload(data);
+
+  return (SearchEntry){
+      .move = (PackedMove)payload,
+      .score = (int16_t)(uint16_t)(payload >> 16),
+      .depth = getEntryDepth(data),
+      .bound = (Bound)((payload >> 32) & 3),
+  };
+}
+
+// Allocates the largest power of two of buckets fitting in `megabytes`.
+// Returns false if the allocation fails.
+bool initTable(TranspositionTable *table, size_t megabytes,
+               ReplacementPolicy policy);
+void freeTable(TranspositionTable *table);
+void clearTable(TranspositionTable *table);
+
+// Starts a new generation, entries from older ones become preferred victims
+void ageTable(TranspositionTable *table);
+
+static inline TableBucket *getBucket(const TranspositionTable *table,
+                                     const uint64_t hash) {
+  return &table->buckets[hash & table->mask];
+}
+
+// Starts loading the bucket of a position we are about to visit, e.g. with
+// the key from getHashAfterMove before making the move
+static inline void prefetchTable(const TranspositionTable *table,
+                                 const uint64_t hash) {
+  __builtin_prefetch(getBucket(table, hash));
+}
+
+// On a hit writes the entry data and returns true. `stats` can be NULL.
+bool probeTable(const TranspositionTable *table, uint64_t hash,
+                uint64_t *data, TableStats *stats);
+
+// The payload keeps its lowest TABLE_PAYLOAD_BITS bits. `stats` can be NULL.
+void storeTable(TranspositionTable *table, uint64_t hash, uint8_t depth,
+                uint64_t payload, TableStats *stats);
+
+// Permille of sampled entries written in the current generation
+uint16_t getTableUsage(const TranspositionTable *table);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+// Layout of luts.bin, the sliding attack maps bakeLuts writes along with the
+// headers compiled into the library. The header fills the first page and
+// every map starts on a page of its own, so the file gets mapped read-only as
+// it is and all the processes mapping it share one copy in the page cache.
+
+#define LUT_BLOB_VERSION 1
+#define LUT_BLOB_ALIGNMENT 4096
+#define LUT_HASH_SEED 0xCBF29CE484222325ULL
+
+static const char LUT_BLOB_MAGIC[8] = "SYSLUTS";
+
+typedef enum {
+  BISHOP_PEXT_MAP,
+  BISHOP_MAGIC_MAP,
+  ROOK_PEXT_MAP,
+  ROOK_MAGIC_MAP,
+  LUT_BLOB_MAPS,
+} LutBlobMap;
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t entries[LUT_BLOB_MAPS];
+  // Hash of the maps, LUT_CHECKSUM in the slidingluts.h of the same bake.
+  // Blobs of another bake have other magic numbers and can't be used.
+  uint64_t checksum;
+  // In bytes from the start of the file, multiples of LUT_BLOB_ALIGNMENT
+  uint64_t offsets[LUT_BLOB_MAPS];
+  uint64_t size;
+} LutBlobHeader;
+
+// FNV-1a over 64-bit words, for LutBlobHeader.checksum
+static inline uint64_t hashLuts(uint64_t hash, const uint64_t *entries,
+                                const uint32_t count) {
+  for (uint32_t index = 0; index < count; index++) {
+    hash = (hash ^ entries[index]) * 0x100000001B3ULL;
+  }
+
+  return hash;
+}
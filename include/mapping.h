@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Maps a whole file read-only for a reader going through it front to back,
+// like the EPD, PGN and dataset readers. An empty file maps to NULL with a
+// size of 0, since mmap refuses those. Returns false if the file can't be
+// opened or mapped.
+bool mapFile(const char *path, const char **data, size_t *size);
+// Releases what mapFile mapped, NULL included
+void unmapFile(const char *data, size_t size);
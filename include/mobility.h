@@ -0,0 +1,38 @@
+#pragma once
+
+#include "position.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Positions countMobility works on side by side. Their sliding lookups get
+// made together in one flat loop, so the attack map misses of a position
+// overlap with those of the others instead of waiting for each other.
+#define MOBILITY_LANES 8
+
+// Positions as a structure of arrays: entry i of every array describes
+// position i, e.g. columns of a batch of training positions
+typedef struct {
+  const uint64_t *friendly; // Pieces of the side to move
+  const uint64_t *enemy;
+  // Pieces of both colors by type, friendly and enemy tell the colors apart
+  const uint64_t *pieces[PIECE_TYPES];
+  const uint8_t *sideToMove;     // Color of the friendly pieces
+  const uint8_t *castlingRights; // CastlingRight flags, NULL if none can
+  const int8_t *enPassant;       // NULL if no position has a square
+} PositionBatch;
+
+// Results, one entry per position. An array left NULL isn't computed, the
+// legal move counts being the most expensive.
+typedef struct {
+  uint16_t *legalMoves; // What generateLegalMoves would count
+  // Targets of the side to move's pieces of each type, added up over its
+  // pieces: the squares of getPseudoLegal's quiet and kills moves
+  uint16_t *mobility[PIECE_TYPES];
+  uint64_t *attacks; // Squares the side to move attacks, like attackedBy
+} MobilityBatch;
+
+// Same results as generateLegalMoves, getPseudoLegal and attackedBy called on
+// each position. Every position needs a friendly king if the legal moves are
+// counted.
+void countMobility(const PositionBatch *batch, size_t count,
+                   const MobilityBatch *results);
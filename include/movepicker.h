@@ -0,0 +1,57 @@
+#pragma once
+
+#include "position.h"
+#include "sysifus.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define KILLER_MOVES 2
+
+typedef enum {
+  STAGE_HASH_MOVE,
+  STAGE_GENERATE_CAPTURES,
+  STAGE_CAPTURES,
+  STAGE_KILLERS,
+  STAGE_GENERATE_QUIETS,
+  STAGE_QUIETS,
+  STAGE_DONE,
+} PickerStage;
+
+// Hands out the legal moves of a position one at a time, best guesses first:
+// the hash move, captures and promotions by MVV-LVA, the killers, then every
+// other quiet move. Each stage is only generated once the previous ones ran
+// out, so a cutoff on the hash move or a capture never pays for the quiet
+// moves. Lives on the stack, no allocations.
+typedef struct {
+  const Position *position;
+  PackedMove hashMove;
+  PackedMove killers[KILLER_MOVES];
+  // Quiet moves come out by decreasing [from][to] score when set, in
+  // generation order otherwise. NULL after init, set it before the quiets.
+  const int16_t (*history)[BOARD_AREA];
+  PickerStage stage;
+  bool capturesOnly;
+  uint8_t killerIndex;
+  uint16_t index; // Next move of `list` to hand out
+  MoveList list;
+  int16_t scores[MAX_MOVES];
+} MovePicker;
+
+// The position must outlive the picker and stay unchanged while it is used.
+// `hashMove` and `killers` may be NO_MOVE or moves of another position, they
+// are checked with isMoveLegal before being handed out. `killers` can be
+// NULL.
+void initMovePicker(MovePicker *picker, const Position *position,
+                    PackedMove hashMove,
+                    const PackedMove killers[KILLER_MOVES]);
+
+// Only the captures and promotions by MVV-LVA, for quiescence search
+void initCapturePicker(MovePicker *picker, const Position *position);
+
+// Next move to try, NO_MOVE once every legal move was handed out. No move
+// comes out twice.
+PackedMove nextMove(MovePicker *picker);
+
+// Most valuable victim first, least valuable attacker among equal victims.
+// Promotions add the piece promoted to as if it was taken.
+int16_t getMvvLvaScore(const Position *position, PackedMove move);
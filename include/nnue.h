@@ -0,0 +1,80 @@
+#pragma once
+
+#include "position.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// One input per piece type and color on each square, as seen from one side:
+// its own pieces first, and the board flipped vertically for black so both
+// sides share the weights
+#define NNUE_INPUTS (COLORS * PIECE_TYPES * BOARD_AREA)
+#define NNUE_HIDDEN 256
+// The accumulator gets clipped to [0, NNUE_QA], the output weights are scaled
+// by NNUE_QB and the output bias by NNUE_QA * NNUE_QB. NNUE_SCALE turns the
+// output into centipawns.
+#define NNUE_QA 255
+#define NNUE_QB 64
+#define NNUE_SCALE 400
+// Largest output weight magnitude, for the output layer's sum over both
+// accumulators of clipped activations to fit in int32
+#define NNUE_MAX_OUTPUT_WEIGHT (INT32_MAX / (COLORS * NNUE_HIDDEN * NNUE_QA))
+// Past it the evaluation is clamped, short of the search's mate scores
+#define NNUE_MAX_SCORE 30000
+#define NNUE_ALIGNMENT 64
+
+// Efficiently updatable network, (768 -> 256) x 2 -> 1: the accumulators of
+// both sides, the side to move's first, through a clipped ReLU into a single
+// output. Quantized to int16 the way the usual trainers do.
+typedef struct {
+  int16_t featureWeights[NNUE_INPUTS][NNUE_HIDDEN];
+  int16_t featureBiases[NNUE_HIDDEN];
+  // Side to move's half first, within +-NNUE_MAX_OUTPUT_WEIGHT
+  int16_t outputWeights[COLORS][NNUE_HIDDEN];
+  int16_t outputBias;
+} __attribute__((aligned(NNUE_ALIGNMENT))) Network;
+
+// First layer of a position from each side's point of view, indexed by
+// Color. Only moves change it, so searches keep one per ply and derive each
+// from the previous one instead of summing every piece again.
+typedef struct {
+  int16_t values[COLORS][NNUE_HIDDEN];
+} __attribute__((aligned(NNUE_ALIGNMENT))) Accumulator;
+
+typedef enum {
+  NNUE_SCALAR,
+  // 8 lanes of 16 bits, there on every x86-64 CPU
+  NNUE_SSE2,
+  // 16 lanes of 16 bits
+  NNUE_AVX2,
+} NnueKernel;
+
+// The widest the CPU runs, picked once when the library is loaded
+NnueKernel getNnueKernel(void);
+// Forces a kernel, e.g. to compare them. Returns false if the CPU can't run
+// it. Not meant to be called while other threads evaluate.
+bool setNnueKernel(NnueKernel kernel);
+
+// A network file is a header, "SYSNNUE\0" followed by the format version and
+// NNUE_HIDDEN as little endian uint32, then the fields of Network in order as
+// little endian int16, without padding. Returns NULL if the file can't be read,
+// doesn't match or has an output weight out of range.
+Network *loadNetwork(const char *path);
+// Returns false if the file can't be written
+bool saveNetwork(const Network *network, const char *path);
+void freeNetwork(Network *network);
+
+// Sums the columns of every piece on the board
+void refreshAccumulator(const Network *network, const Position *position,
+                        Accumulator *accumulator);
+
+// Accumulator of the position after `move` from the one of `position`, which
+// the move hasn't been played on yet: the columns of the pieces it takes off
+// get subtracted and the ones it puts on added, at most two of each.
+// `before` and `after` can be the same.
+void updateAccumulator(const Network *network, const Position *position,
+                       PackedMove move, const Accumulator *before,
+                       Accumulator *after);
+
+// In centipawns from the point of view of the side to move
+int16_t evaluateNetwork(const Network *network, const Position *position,
+                        const Accumulator *accumulator);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "hashtable.h"
+#include "position.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Subtrees this deep or shallower are counted by a single thread, deeper ones
+// get split into one task per move for idle threads to steal
+#define SEQUENTIAL_PERFT_DEPTH 3
+
+typedef struct PerftPool PerftPool;
+
+typedef struct {
+  uint64_t tasks, steals;
+  TableStats table;
+} ParallelPerftStats;
+
+// Starts `threads` workers that sleep until a perft is run. Returns NULL if
+// the threads or their memory can't be set up.
+PerftPool *createPerftPool(uint16_t threads);
+void destroyPerftPool(PerftPool *pool);
+uint16_t getPerftPoolThreads(const PerftPool *pool);
+
+// Counts the leaves `depth` plies under each of the root positions, writing
+// them to `counts[rootIndex]`. Roots can be the children of a single position
+// (divide) or an unrelated batch. The roots are split at the top and
+// subtrees deeper than SEQUENTIAL_PERFT_DEPTH are split again, each worker
+// pushing its splits on its own deque and stealing from the others' when it
+// runs dry. With a `table` the sequential subtrees go through perftHashed,
+// sharing it between threads. `stats` can be NULL.
+void runParallelPerft(PerftPool *pool, const Position *roots, size_t rootCount,
+                      uint8_t depth, TranspositionTable *table,
+                      uint64_t *counts, ParallelPerftStats *stats);
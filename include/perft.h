@@ -0,0 +1,17 @@
+#pragma once
+
+#include "hashtable.h"
+#include "position.h"
+#include <stdint.h>
+
+// Counts the leaf nodes of the move tree `depth` plies deep. The last ply is
+// bulk counted from the size of the move list instead of being played. The
+// position is played on with make/unmake and comes back unchanged.
+uint64_t perft(Position *position, uint8_t depth);
+
+// Same count, but subtrees of positions already seen at the same depth are
+// read back from the table instead of being walked again. The table should be
+// set up with REPLACE_SHALLOWEST and not shared with a search. `stats` can be
+// NULL.
+uint64_t perftHashed(Position *position, uint8_t depth,
+                     TranspositionTable *table, TableStats *stats);
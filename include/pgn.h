@@ -0,0 +1,96 @@
+#pragma once
+
+#include "position.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest move in standard algebraic notation, e.g. "Qa1xb2#" or "exd8=Q+",
+// with its NUL
+#define SAN_MAX_LENGTH 8
+
+// Reads the games of a memory-mapped PGN file one at a time. Like EpdReader,
+// nothing is copied or allocated: games and their moves point into the
+// mapping.
+typedef struct {
+  const char *data;
+  size_t size, offset;
+} PgnReader;
+
+// Both spans point into the mapping and aren't NUL terminated, valid until
+// closePgn
+typedef struct {
+  const char *tags; // Tag pair lines, e.g. `[Event "x"]`, empty if none
+  size_t tagsLength;
+  const char *movetext;
+  size_t movetextLength;
+} PgnGame;
+
+// Walks the movetext of a game, from the position of its FEN tag or the
+// starting position
+typedef struct {
+  Position position;
+  const char *cursor, *end;
+  const char *san; // Last token read, for error messages
+  size_t sanLength;
+} PgnReplay;
+
+typedef enum {
+  PGN_FOUND,   // The next game or move is there
+  PGN_INVALID, // A move that can't be resolved, or a bad FEN tag
+  PGN_END,     // No game left, or the game's moves ran out
+} PgnStatus;
+
+typedef struct {
+  uint64_t games;
+  uint64_t positions; // Moves replayed, one position before each
+  uint64_t invalidGames; // Given up at the first move that can't be resolved
+} PgnStats;
+
+// Called for every move replayed, with the position before it. Runs on
+// every thread of replayPgn at once, `thread` tells which, so statistics can
+// be kept per thread without locks.
+typedef void (*PgnVisitor)(void *context, uint16_t thread,
+                           const Position *position, PackedMove move);
+
+// Maps the file read-only. Returns false if it can't be opened or mapped.
+bool openPgn(PgnReader *reader, const char *path);
+void closePgn(PgnReader *reader);
+
+// Finds the next game: its tag pair lines, then the movetext up to the next
+// line starting with '['. Lines starting with '%' are skipped.
+PgnStatus readPgnGame(PgnReader *reader, PgnGame *game);
+
+// Value of a tag pair without its quotes, escapes left in. Returns false if
+// the game has no such tag.
+bool findPgnTag(const PgnGame *game, const char *name, const char **value,
+                size_t *length);
+
+// Returns PGN_INVALID if the game's FEN tag can't be parsed
+PgnStatus startPgnReplay(PgnReplay *replay, const PgnGame *game);
+
+// Resolves the next move of the movetext against replay->position, skipping
+// move numbers, comments, variations, NAGs and the result. The position
+// doesn't change, play the move with makeMove before reading the next one.
+PgnStatus readPgnMove(PgnReplay *replay, PackedMove *move);
+
+// Resolves a move in standard algebraic notation, check marks and
+// annotations such as "!?" allowed. The piece moving is found among the
+// attackers of the target square with attackersTo and disambiguated by
+// legality, without generating the moves of the position. Returns NO_MOVE if
+// the move is malformed, ambiguous or illegal.
+PackedMove parseSan(const Position *position, const char *san, size_t length);
+
+// Writes a legal move in standard algebraic notation, as short as it can be
+// disambiguated, with + or # when it checks or mates. Returns its length
+// without the NUL.
+size_t writeSan(const Position *position, PackedMove move,
+                char out[SAN_MAX_LENGTH]);
+
+// Replays every game of the file on `threads` threads. The file gets split
+// in shards at blank lines followed by a tag pair, which is where the PGN
+// export format starts a game, and the threads take the shards in turn.
+// `visitor` can be NULL to only count. Returns false if the file can't be
+// mapped or the threads can't be started.
+bool replayPgn(const char *path, uint16_t threads, PgnVisitor visitor,
+               void *context, PgnStats *stats);
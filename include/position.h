@@ -0,0 +1,175 @@
+#pragma once
+
+#include "bitboard.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define COLORS 2
+#define PIECE_TYPES 6
+#define CASTLING_RIGHTS_VARIANTS 16
+#define NO_SQUARE (-1)
+// Pieces a side starts a game with, promotions only ever trade one for another
+#define MAX_SIDE_PIECES 16
+
+typedef enum { PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING, NOTHING } Piece;
+typedef enum { WHITE, BLACK } Color;
+typedef enum {
+  WHITE_KINGSIDE = 1,
+  WHITE_QUEENSIDE = 2,
+  BLACK_KINGSIDE = 4,
+  BLACK_QUEENSIDE = 8,
+} CastlingRight;
+
+typedef struct {
+  uint64_t pieces[COLORS][PIECE_TYPES];
+  uint64_t occupancy[COLORS];
+  uint64_t hash;             // Zobrist key, kept up to date by makeMove
+  uint8_t board[BOARD_AREA]; // Piece on each square, NOTHING if empty
+  Color sideToMove;
+  uint8_t castlingRights; // CastlingRight flags
+  int8_t enPassant;       // Square a pawn just skipped, NO_SQUARE if none
+  uint8_t halfmoveClock;
+  uint16_t fullmoveNumber;
+} Position;
+
+// What makeMove can't derive back from the move itself. Searches keep one per
+// ply instead of copying the whole position.
+typedef struct {
+  uint64_t hash;
+  uint8_t castlingRights;
+  int8_t enPassant;
+  uint8_t halfmoveClock;
+  uint8_t captured; // Piece taken by the move, NOTHING if none
+} UndoInfo;
+
+// Single move packed in 16 bits:
+// bits 0-5 origin square, bits 6-11 target square, bits 12-15 flags
+typedef uint16_t PackedMove;
+// a1a1 can't be a move, so an all zero move stands for none
+#define NO_MOVE ((PackedMove)0)
+
+// Bit 2 of the flags marks captures and bit 3 promotions, whose low 2 bits
+// then hold the piece promoted to, counted from the knight
+typedef enum {
+  QUIET_MOVE = 0,
+  DOUBLE_PAWN_PUSH = 1,
+  KING_CASTLE = 2,
+  QUEEN_CASTLE = 3,
+  CAPTURE = 4,
+  EN_PASSANT_CAPTURE = 5,
+  KNIGHT_PROMOTION = 8,
+  BISHOP_PROMOTION = 9,
+  ROOK_PROMOTION = 10,
+  QUEEN_PROMOTION = 11,
+  KNIGHT_PROMOTION_CAPTURE = 12,
+  BISHOP_PROMOTION_CAPTURE = 13,
+  ROOK_PROMOTION_CAPTURE = 14,
+  QUEEN_PROMOTION_CAPTURE = 15,
+} MoveFlag;
+
+static inline PackedMove packMove(const int8_t from, const int8_t to,
+                                  const MoveFlag flags) {
+  return (PackedMove)(from | (to << 6) | (flags << 12));
+}
+
+static inline int8_t getMoveFrom(const PackedMove move) {
+  return (int8_t)(move & 0x3F);
+}
+
+static inline int8_t getMoveTo(const PackedMove move) {
+  return (int8_t)((move >> 6) & 0x3F);
+}
+
+static inline MoveFlag getMoveFlags(const PackedMove move) {
+  return (MoveFlag)(move >> 12);
+}
+
+static inline bool isCapture(const PackedMove move) {
+  return (getMoveFlags(move) & CAPTURE) != 0;
+}
+
+static inline bool isPromotion(const PackedMove move) {
+  return (getMoveFlags(move) & KNIGHT_PROMOTION) != 0;
+}
+
+// KNIGHT to QUEEN, only meaningful if isPromotion
+static inline Piece getPromotionPiece(const PackedMove move) {
+  return (Piece)(KNIGHT + (getMoveFlags(move) & 3));
+}
+
+static inline bool isCastling(const PackedMove move) {
+  return getMoveFlags(move) == KING_CASTLE ||
+         getMoveFlags(move) == QUEEN_CASTLE;
+}
+
+static inline bool isEnPassant(const PackedMove move) {
+  return getMoveFlags(move) == EN_PASSANT_CAPTURE;
+}
+
+// Neither a capture nor a promotion, castling included
+static inline bool isQuiet(const PackedMove move) {
+  return (getMoveFlags(move) & (CAPTURE | KNIGHT_PROMOTION)) == 0;
+}
+
+static inline uint64_t getOccupancy(const Position *position) {
+  return position->occupancy[WHITE] | position->occupancy[BLACK];
+}
+
+// Empties the board, no castling rights and no en passant square
+void clearPosition(Position *position);
+
+// Puts a piece on an empty square, keeping the hash up to date
+void putPiece(Position *position, Color color, Piece type, int8_t square);
+
+// Zobrist key of the position computed from scratch
+uint64_t computeHash(const Position *position);
+
+// Whether the en passant square, if any, is one a pawn of the side that just
+// moved could have skipped: on the 6th rank with white to move or the 3rd
+// with black, empty, and with that pawn standing right in front of it.
+// makeMove relies on it to find the pawn an en passant capture takes.
+bool isEnPassantSquareValid(const Position *position);
+
+// Whether the generators can be run on the position: each side has exactly
+// one king and at most MAX_SIDE_PIECES pieces, the side that just moved isn't
+// left in check, and the en passant square is valid.
+bool isPositionValid(const Position *position);
+
+// Longest FEN writeFen can produce, NUL included: 64 pieces and 7 slashes,
+// "w", "KQkq", an en passant square and both counters at their maximum
+#define FEN_MAX_LENGTH 92
+
+// Fills the position from a FEN string. The move counters are optional.
+// Returns false if the string is malformed, or if the position it describes
+// isn't valid, see isPositionValid.
+bool parseFen(Position *position, const char *fen);
+
+// Same as parseFen, reading at most `length` bytes from a buffer that doesn't
+// need to be NUL terminated, e.g. a line of a memory-mapped file. Stops right
+// after the last field it understood and returns how many bytes that took, 0
+// if the FEN is malformed. Nothing gets allocated.
+size_t parseFenSpan(Position *position, const char *fen, size_t length);
+
+// Writes the position as a FEN with both counters, NUL terminated. Returns
+// its length without the NUL.
+size_t writeFen(const Position *position, char out[FEN_MAX_LENGTH]);
+
+// Plays the move on the position, updating bitboards, castling rights, en
+// passant square and hash incrementally. `undo` receives what unmakeMove needs
+// to take it back.
+void makeMove(Position *position, PackedMove move, UndoInfo *undo);
+void unmakeMove(Position *position, PackedMove move, const UndoInfo *undo);
+
+// Passes the turn without moving a piece, for null move pruning. The en
+// passant square goes away and the halfmove clock ticks as after a move.
+void makeNullMove(Position *position, UndoInfo *undo);
+void unmakeNullMove(Position *position, const UndoInfo *undo);
+
+// Hash the position will have after makeMove, without touching it. Lets
+// callers prefetch hash table buckets before making the move.
+uint64_t getHashAfterMove(const Position *position, PackedMove move);
+
+// Writes the move in coordinate notation (e.g. "e2e4", "e7e8q") to a buffer
+// of at least 6 bytes
+void moveToString(PackedMove move, char *out);
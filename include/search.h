@@ -0,0 +1,86 @@
+#pragma once
+
+#include "hashtable.h"
+#include "nnue.h"
+#include "position.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_PLY 128
+#define SCORE_INFINITE 32000
+#define SCORE_MATE 31000
+// Scores past it are mates, SCORE_MATE minus the plies until mate
+#define SCORE_MATE_BOUND (SCORE_MATE - MAX_PLY)
+#define SCORE_DRAW 0
+
+// Zero means no limit for any of them. Depth and nodes are checked exactly,
+// time every few thousand nodes.
+typedef struct {
+  uint8_t depth;
+  uint64_t nodes;
+  uint64_t milliseconds;
+  // Past it no new iteration starts, the one running may go on up to
+  // `milliseconds`
+  uint64_t optimalMilliseconds;
+  // Nodes and time don't count until ponderHit, the clock starting then
+  bool ponder;
+} SearchLimits;
+
+typedef struct {
+  PackedMove bestMove; // NO_MOVE if there is no legal move
+  int16_t score;       // From the point of view of the side to move
+  uint8_t depth;       // Last iteration that completed
+  uint8_t selectiveDepth;
+  uint64_t nodes;
+  uint64_t milliseconds;
+  uint8_t pvLength;
+  PackedMove pv[MAX_PLY];
+} SearchResult;
+
+// Called after each completed iteration of the iterative deepening
+typedef void (*SearchReport)(const SearchResult *result, void *context);
+
+typedef struct Searcher Searcher;
+
+// Allocates the hash table and the search stacks of `threads` threads, and
+// starts all but one of them. They sleep until a search is run. Returns NULL
+// if the threads or their memory can't be set up.
+Searcher *createSearcher(size_t hashMegabytes, uint16_t threads);
+void destroySearcher(Searcher *searcher);
+uint16_t getSearchThreads(const Searcher *searcher);
+
+// Forgets everything learnt from previous searches: hash table, killers and
+// history. Searches that follow are then reproducible.
+void clearSearcher(Searcher *searcher);
+
+// Evaluates with the network from now on, or with evaluate() if it's NULL,
+// the default. The network has to outlive the searches using it, and can't
+// change while one runs.
+void setSearchNetwork(Searcher *searcher, const Network *network);
+
+// `report` can be NULL
+void setSearchReport(Searcher *searcher, SearchReport report, void *context);
+
+// Principal variation search with iterative deepening and aspiration windows,
+// quiescence search, null move pruning, late move reductions, killers and
+// history. With more than one thread the helpers search the same root at
+// staggered depths, sharing only the hash table (Lazy SMP), and the calling
+// thread's result is the one kept. Blocks until a limit is hit or stopSearch
+// is called, and fills `result` with the last completed iteration. `history`
+// holds the hashes of the positions played before this one, oldest first, to
+// see repetitions. It can be NULL if `historyLength` is 0.
+void runSearch(Searcher *searcher, const Position *position,
+               const uint64_t *history, size_t historyLength,
+               const SearchLimits *limits, SearchResult *result);
+
+// The move pondered on got played: the running search starts its clock and
+// its node and time limits apply from now on. Safe to call from any thread.
+void ponderHit(Searcher *searcher);
+
+// Permille of the hash table written during the current search
+uint16_t getSearchTableUsage(const Searcher *searcher);
+
+// Makes the running search return as soon as possible. Safe to call from any
+// thread, and a no-op when nothing is running.
+void stopSearch(Searcher *searcher);
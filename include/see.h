@@ -0,0 +1,24 @@
+#pragma once
+
+#include "position.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Material as static exchange evaluation counts it. The king is worth
+// nothing: once it is the only capturer left the exchange stops anyway.
+static const int16_t SEE_PIECE_VALUES[PIECE_TYPES + 1] = {
+    [PAWN] = 100, [KNIGHT] = 300, [BISHOP] = 300, [ROOK] = 500,
+    [QUEEN] = 900, [KING] = 0,    [NOTHING] = 0,
+};
+
+// Material the side to move wins, negative if it loses some, when both sides
+// keep capturing on the target square of `move` with their least valuable
+// piece for as long as it pays off. Sliders lined up behind a capturer join
+// in once it is gone, and the king only captures if nothing can take it
+// back. Pins are ignored and nothing is played on the board. A quiet move
+// counts as giving the piece a chance to be taken.
+int16_t see(const Position *position, PackedMove move);
+
+// Whether see(position, move) >= threshold, stopping as soon as the outcome
+// is known. Cheap enough to prune losing captures at every quiescence node.
+bool seeGE(const Position *position, PackedMove move, int16_t threshold);
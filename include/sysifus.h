@@ -1,13 +1,17 @@
 #pragma once
 
 #include "bitboard.h"
+#include "position.h"
 #include <stdbool.h>
 #include <stdint.h>
 
 #define JUMPING_OFFSETS 8
 #define SLIDING_DIRECTIONS 4
+// Occupancy variants of the square with the most relevant bits, the packed
+// attack maps give each square only as many as it needs
 #define BISHOP_POSSIBLE_VARIANTS 512
 #define ROOK_POSSIBLE_VARIANTS 4096
+#define MAX_MOVES 256
 
 static const Coordinate KNIGHT_OFFSETS[JUMPING_OFFSETS] = {
     {+2, +1}, {+2, -1}, {-2, +1}, {-2, -1},
@@ -35,18 +39,24 @@ static const Coordinate ROOK_DIRECTIONS[SLIDING_DIRECTIONS] = {
     {0, -1}  // Left
 };
 
-typedef enum { PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING, NOTHING } Piece;
 typedef struct {
   uint64_t quiet, kills;
 } Move;
 
+typedef struct {
+  PackedMove moves[MAX_MOVES];
+  uint16_t count;
+} MoveList;
+
 uint64_t generatePawnPushes(Coordinate coord, uint64_t blockedSquares,
                             bool isWhite);
 uint64_t generatePawnCaptures(Coordinate coord, uint64_t enemy, bool isWhite);
 
-inline uint64_t getAttacksByLUT(const uint64_t lut[BOARD_AREA],
-                                const int8_t square,
-                                const uint64_t blockedSquare) {
+// Static so every translation unit has its own copy: a plain C99 inline
+// function needs an external definition for the calls that don't get inlined
+static inline uint64_t getAttacksByLUT(const uint64_t lut[BOARD_AREA],
+                                       const int8_t square,
+                                       const uint64_t blockedSquare) {
   // Add bounds check since this is a public function
   if (square < 0 || square >= BOARD_AREA) {
     return 0;
@@ -55,13 +65,85 @@ inline uint64_t getAttacksByLUT(const uint64_t lut[BOARD_AREA],
   return lut[square] & ~blockedSquare;
 }
 
-uint64_t getAttackByOccupancy(int8_t square,
-                              const uint64_t relevantMask[BOARD_AREA],
-                              uint16_t possibleVariants,
-                              const uint64_t lut[BOARD_AREA][possibleVariants],
-                              uint64_t friendly, uint64_t enemy);
+typedef enum {
+  // Compress the relevant occupancy with the BMI2 pext instruction
+  INDEX_BY_PEXT,
+  // Multiply the relevant occupancy by the square's magic number and keep the
+  // top bits, works on any CPU
+  INDEX_BY_MAGIC,
+} SlidingIndexing;
+
+// How sliding attacks get looked up. Picked once when the library is loaded:
+// pext where the CPU runs it natively, magic numbers elsewhere, including
+// Zen 1 and 2 where pext is microcoded.
+SlidingIndexing getSlidingIndexing(void);
+// Forces an indexing, e.g. to benchmark both. Returns false if the CPU can't
+// run it. Not meant to be called while other threads generate moves.
+bool setSlidingIndexing(SlidingIndexing indexing);
+
+// Attacks of a BISHOP, ROOK or QUEEN, without the squares taken by friendly
+// pieces. Any other piece type attacks nothing.
+uint64_t getAttackByOccupancy(int8_t square, Piece slider, uint64_t friendly,
+                              uint64_t enemy);
 
+// Attacks of a bishop and of a rook over the whole occupancy, the occupied
+// squares they reach included. The lookups getAttackByOccupancy and the
+// generators.h entry points make, with no piece to dispatch on.
+uint64_t getDiagonalAttacks(int8_t square, uint64_t occupancy);
+uint64_t getOrthogonalAttacks(int8_t square, uint64_t occupancy);
+
+// Runtime piece type and color, see generators.h for one entry point per
+// piece with both folded in
 Move getPseudoLegal(Piece type, Coordinate coord, uint64_t friendly,
                     bool isWhite, uint64_t enemy);
 
+// Pieces of both colors attacking `square`, with sliders seeing through the
+// given occupancy instead of the position's, e.g. without the piece about to
+// move. One reverse lookup per piece type, AND it with a side's occupancy to
+// keep that side's attackers.
+uint64_t attackersTo(const Position *position, int8_t square,
+                     uint64_t occupancy);
+
+// Whether any piece of `attacker` attacks `square`
+bool isSquareAttacked(const Position *position, int8_t square, Color attacker);
+
+// Every square attacked by `side`, its own pieces included
+uint64_t attackedBy(const Position *position, Color side);
+
+// Fills the list with every pseudo-legal move of the side to move, promotions,
+// en passant and castling included. King moves into attacked squares aren't
+// filtered, but castling out of or through check is.
+void generateMoves(const Position *position, MoveList *list);
+
+// Fills the list with the legal moves of the side to move, which must have a
+// king. Checkers, the check evasion mask and the pins are computed once up
+// front, so no move has to be tried on the board.
+void generateLegalMoves(const Position *position, MoveList *list);
+
+// generateLegalMoves split in two, for searches that try captures before
+// generating anything else: together they yield the same moves. Promotions
+// go with the captures and castling with the quiet moves, as isQuiet says.
+void generateLegalCaptures(const Position *position, MoveList *list);
+void generateLegalQuiets(const Position *position, MoveList *list);
+
+// Whether generateLegalMoves would yield the move, e.g. a hash move that may
+// come from another position. Much cheaper than generating the list.
+bool isMoveLegal(const Position *position, PackedMove move);
+
+// Writes the generated tables into `directory`: luts.h, slidingluts.h with
+// the sliding attack maps the library gets compiled with, and luts.bin, the
+// same maps for mapLuts. Returns false if a file can't be written.
+bool bakeLuts(const char *directory);
+// bakeLuts into the working directory
 void bake(void);
+
+// Looks sliding attacks up in a luts.bin mapped read-only instead of in the
+// compiled-in maps, so processes mapping the same file share a single copy of
+// it in the page cache. Done when the library gets loaded if the SYSIFUS_LUTS
+// environment variable names the file. Returns false, keeping the current
+// maps, if it can't be mapped or comes from another bake than the library.
+// Neither call is meant to run while other threads generate moves.
+bool mapLuts(const char *path);
+// Back to the compiled-in maps
+void unmapLuts(void);
+bool areLutsMapped(void);
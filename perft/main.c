@@ -0,0 +1,447 @@
+#define _POSIX_C_SOURCE 200809L
+
+#ifdef SYSIFUS_HEADER_ONLY
+#include "amalgamation.h"
+#endif /* ifdef SYSIFUS_HEADER_ONLY */
+
+#include "epd.h"
+#include "hashtable.h"
+#include "parallel.h"
+#include "perft.h"
+#include "position.h"
+#include "sysifus.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STARTING_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+#define KIWIPETE_FEN                                                           \
+  "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"
+#define POSITION3_FEN "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"
+#define POSITION4_FEN                                                          \
+  "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"
+#define POSITION5_FEN                                                          \
+  "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8"
+#define POSITION6_FEN                                                          \
+  "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10"
+#define SCALING_DEPTH 6
+
+// How the library got linked in, to compare the NPS of the builds
+#if defined(SYSIFUS_HEADER_ONLY)
+#define LIBRARY_KIND "Header-only"
+#elif defined(SYSIFUS_STATIC)
+#define LIBRARY_KIND "Static"
+#else
+#define LIBRARY_KIND "Shared"
+#endif /* if defined(SYSIFUS_HEADER_ONLY) */
+
+typedef struct {
+  const char *name, *fen;
+  uint8_t depth;
+  uint64_t nodes;
+} PerftCase;
+
+// Reference counts of the usual test positions, between them they cover
+// castling, en passant, promotions, checks and pins
+static const PerftCase SUITE[] = {
+    {"startpos", STARTING_FEN, 1, 20},
+    {"startpos", STARTING_FEN, 2, 400},
+    {"startpos", STARTING_FEN, 3, 8902},
+    {"startpos", STARTING_FEN, 4, 197281},
+    {"startpos", STARTING_FEN, 5, 4865609},
+    {"startpos", STARTING_FEN, 6, 119060324},
+    {"kiwipete", KIWIPETE_FEN, 1, 48},
+    {"kiwipete", KIWIPETE_FEN, 2, 2039},
+    {"kiwipete", KIWIPETE_FEN, 3, 97862},
+    {"kiwipete", KIWIPETE_FEN, 4, 4085603},
+    {"kiwipete", KIWIPETE_FEN, 5, 193690690},
+    {"position3", POSITION3_FEN, 1, 14},
+    {"position3", POSITION3_FEN, 2, 191},
+    {"position3", POSITION3_FEN, 3, 2812},
+    {"position3", POSITION3_FEN, 4, 43238},
+    {"position3", POSITION3_FEN, 5, 674624},
+    {"position3", POSITION3_FEN, 6, 11030083},
+    {"position4", POSITION4_FEN, 1, 6},
+    {"position4", POSITION4_FEN, 2, 264},
+    {"position4", POSITION4_FEN, 3, 9467},
+    {"position4", POSITION4_FEN, 4, 422333},
+    {"position4", POSITION4_FEN, 5, 15833292},
+    {"position5", POSITION5_FEN, 1, 44},
+    {"position5", POSITION5_FEN, 2, 1486},
+    {"position5", POSITION5_FEN, 3, 62379},
+    {"position5", POSITION5_FEN, 4, 2103487},
+    {"position5", POSITION5_FEN, 5, 89941194},
+    {"position6", POSITION6_FEN, 1, 46},
+    {"position6", POSITION6_FEN, 2, 2079},
+    {"position6", POSITION6_FEN, 3, 89890},
+    {"position6", POSITION6_FEN, 4, 3894594},
+    {"position6", POSITION6_FEN, 5, 164075551},
+};
+
+static double getSeconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (double)now.tv_sec + ((double)now.tv_nsec / 1e9);
+}
+
+static double getNodesPerSecond(const uint64_t nodes, const double seconds) {
+  return seconds > 0 ? (double)nodes / seconds : 0;
+}
+
+typedef struct {
+  TranspositionTable *table; // NULL when running without hashing
+  PerftPool *pool;           // NULL when running on this thread only
+  uint16_t threads;
+  bool scaling;
+} PerftOptions;
+
+static void addRunStats(ParallelPerftStats *total,
+                        const ParallelPerftStats *stats) {
+  total->tasks += stats->tasks;
+  total->steals += stats->steals;
+  total->table.probes += stats->table.probes;
+  total->table.hits += stats->table.hits;
+  total->table.stores += stats->table.stores;
+  total->table.evictions += stats->table.evictions;
+}
+
+// Counts the leaves under each root, in parallel if there is a pool
+static void countNodes(const PerftOptions *options, Position *roots,
+                       const size_t rootCount, const uint8_t depth,
+                       uint64_t *counts, ParallelPerftStats *stats) {
+  if (options->pool) {
+    ParallelPerftStats parallelStats;
+
+    runParallelPerft(options->pool, roots, rootCount, depth, options->table,
+                     counts, &parallelStats);
+    addRunStats(stats, &parallelStats);
+    return;
+  }
+
+  for (size_t rootIndex = 0; rootIndex < rootCount; rootIndex++) {
+    counts[rootIndex] =
+        options->table ? perftHashed(&roots[rootIndex], depth, options->table,
+                                     &stats->table)
+                       : perft(&roots[rootIndex], depth);
+  }
+}
+
+static void printRunStats(const PerftOptions *options,
+                          const ParallelPerftStats *stats) {
+  if (options->pool) {
+    printf("Threads: %d, %" PRIu64 " tasks, %" PRIu64 " steals\n",
+           options->threads, stats->tasks, stats->steals);
+  }
+  if (options->table) {
+    printf("Hash: %" PRIu64 " probes, %.1f%% hits, %" PRIu64
+           " stores, %" PRIu64 " evictions, %d permille full\n",
+           stats->table.probes,
+           stats->table.probes ? 100.0 * (double)stats->table.hits /
+                                     (double)stats->table.probes
+                               : 0,
+           stats->table.stores, stats->table.evictions,
+           getTableUsage(options->table));
+  }
+}
+
+static int runSuite(const PerftOptions *options) {
+  const size_t cases = sizeof(SUITE) / sizeof(SUITE[0]);
+  uint64_t totalNodes = 0;
+  double totalSeconds = 0;
+  ParallelPerftStats stats = {0};
+  int failed = 0;
+
+  for (size_t caseIndex = 0; caseIndex < cases; caseIndex++) {
+    const PerftCase *perftCase = &SUITE[caseIndex];
+    Position position;
+
+    if (!parseFen(&position, perftCase->fen)) {
+      (void)fprintf(stderr, "Invalid FEN in suite: %s\n", perftCase->fen);
+      return EXIT_FAILURE;
+    }
+
+    // Every case starts cold, so the timings don't depend on the order
+    if (options->table) {
+      clearTable(options->table);
+    }
+
+    uint64_t nodes;
+    const double start = getSeconds();
+    countNodes(options, &position, 1, perftCase->depth, &nodes, &stats);
+    const double seconds = getSeconds() - start;
+    const bool passed = nodes == perftCase->nodes;
+
+    printf("%-12s depth %2d %14" PRIu64 " nodes %10.3fs %14.0f nps  %s\n",
+           perftCase->name, perftCase->depth, nodes, seconds,
+           getNodesPerSecond(nodes, seconds), passed ? "OK" : "FAIL");
+    if (!passed) {
+      printf("  expected %" PRIu64 "\n", perftCase->nodes);
+      failed++;
+    }
+
+    totalNodes += nodes;
+    totalSeconds += seconds;
+  }
+
+  printf("\n%zu cases, %d failed, %" PRIu64 " nodes in %.3fs (%.0f nps)\n",
+         cases, failed, totalNodes, totalSeconds,
+         getNodesPerSecond(totalNodes, totalSeconds));
+  printRunStats(options, &stats);
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int runDivide(const PerftOptions *options, const char *fen,
+                     const uint8_t depth) {
+  Position position;
+  if (!parseFen(&position, fen)) {
+    (void)fprintf(stderr, "Invalid FEN: %s\n", fen);
+    return EXIT_FAILURE;
+  }
+
+  MoveList list;
+  generateLegalMoves(&position, &list);
+
+  // Every root move becomes a root of its own, so they can run in parallel
+  Position children[MAX_MOVES];
+  uint64_t counts[MAX_MOVES];
+  for (uint16_t moveIndex = 0; moveIndex < list.count; moveIndex++) {
+    UndoInfo undo;
+
+    children[moveIndex] = position;
+    makeMove(&children[moveIndex], list.moves[moveIndex], &undo);
+  }
+
+  ParallelPerftStats stats = {0};
+  const double start = getSeconds();
+  countNodes(options, children, list.count, (uint8_t)(depth - 1), counts,
+             &stats);
+  const double seconds = getSeconds() - start;
+
+  uint64_t nodes = 0;
+  for (uint16_t moveIndex = 0; moveIndex < list.count; moveIndex++) {
+    char moveString[6];
+
+    moveToString(list.moves[moveIndex], moveString);
+    printf("%s: %" PRIu64 "\n", moveString, counts[moveIndex]);
+    nodes += counts[moveIndex];
+  }
+
+  printf("\nMoves: %d\nNodes: %" PRIu64 "\nTime: %.3fs\nNPS: %.0f\n",
+         list.count, nodes, seconds, getNodesPerSecond(nodes, seconds));
+  printRunStats(options, &stats);
+
+  return EXIT_SUCCESS;
+}
+
+// Times the same perft with 1, 2, 4... threads up to the configured count
+static int runScaling(const PerftOptions *options, const char *fen,
+                      const uint8_t depth) {
+  Position position;
+  if (!parseFen(&position, fen)) {
+    (void)fprintf(stderr, "Invalid FEN: %s\n", fen);
+    return EXIT_FAILURE;
+  }
+
+  printf("Scaling of perft %d on %s\n\n", depth, fen);
+  printf("%8s %14s %10s %14s %8s %10s\n", "threads", "nodes", "time", "nps",
+         "speedup", "efficiency");
+
+  double baseline = 0;
+  for (uint16_t threads = 1; threads <= options->threads;) {
+    PerftOptions run = *options;
+    ParallelPerftStats stats = {0};
+    uint64_t nodes;
+
+    run.threads = threads;
+    run.pool = createPerftPool(threads);
+    if (!run.pool) {
+      (void)fprintf(stderr, "Can't start %d threads\n", threads);
+      return EXIT_FAILURE;
+    }
+    if (run.table) {
+      clearTable(run.table);
+    }
+
+    const double start = getSeconds();
+    countNodes(&run, &position, 1, depth, &nodes, &stats);
+    const double seconds = getSeconds() - start;
+    destroyPerftPool(run.pool);
+
+    if (threads == 1) {
+      baseline = seconds;
+    }
+    const double speedup = seconds > 0 ? baseline / seconds : 0;
+    printf("%8d %14" PRIu64 " %9.3fs %14.0f %7.2fx %9.1f%%\n", threads, nodes,
+           seconds, getNodesPerSecond(nodes, seconds), speedup,
+           100.0 * speedup / threads);
+
+    // Always finish on the exact thread count asked for
+    threads = (threads < options->threads && threads * 2 > options->threads)
+                  ? options->threads
+                  : (uint16_t)(threads * 2);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// Pass over the whole file once only parsing, then once more also generating
+// the legal moves of every position, to weigh parsing against generation
+static int runEpd(const char *path) {
+  EpdReader reader;
+  EpdRecord record;
+  uint64_t records = 0, invalid = 0, moves = 0;
+
+  if (!openEpd(&reader, path)) {
+    (void)fprintf(stderr, "Can't map %s\n", path);
+    return EXIT_FAILURE;
+  }
+  const size_t bytes = reader.size;
+
+  double start = getSeconds();
+  for (EpdStatus status; (status = readEpd(&reader, &record)) != EPD_END;) {
+    if (status == EPD_RECORD) {
+      records++;
+    } else {
+      invalid++;
+    }
+  }
+  const double parseSeconds = getSeconds() - start;
+  closeEpd(&reader);
+
+  if (!openEpd(&reader, path)) {
+    (void)fprintf(stderr, "Can't map %s\n", path);
+    return EXIT_FAILURE;
+  }
+  start = getSeconds();
+  for (EpdStatus status; (status = readEpd(&reader, &record)) != EPD_END;) {
+    const Position *position = &record.position;
+
+    if (status == EPD_RECORD) {
+      MoveList list;
+
+      generateLegalMoves(position, &list);
+      moves += list.count;
+    }
+  }
+  const double generateSeconds = getSeconds() - start;
+  closeEpd(&reader);
+
+  printf("%" PRIu64 " positions, %" PRIu64 " invalid lines, %zu bytes\n",
+         records, invalid, bytes);
+  printf("Parse:            %10.3fs %14.0f lines/s %10.1f MB/s\n",
+         parseSeconds, getNodesPerSecond(records + invalid, parseSeconds),
+         getNodesPerSecond(bytes, parseSeconds) / 1e6);
+  printf("Parse + generate: %10.3fs %14.0f lines/s %10" PRIu64 " moves\n",
+         generateSeconds, getNodesPerSecond(records + invalid, generateSeconds),
+         moves);
+
+  return invalid == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void printUsage(const char *program) {
+  (void)fprintf(
+      stderr,
+      "Usage: %s [--hash <MB>] [--threads <N>] [--scaling] [--magic] "
+      "[\"<fen>\" <depth>]\n"
+      "       %s [--magic] --epd <file>\n"
+      "Without a FEN runs the reference suite\n"
+      "  --hash <MB>    Reuse transposed subtree counts from a hash table\n"
+      "  --threads <N>  Split the work between N threads, 0 for one per "
+      "core\n"
+      "  --scaling      Time the FEN (startpos by default, depth %d) with 1, "
+      "2, 4... up to N threads\n"
+      "  --magic        Look sliding attacks up by magic numbers even if pext "
+      "is fast\n"
+      "  --epd <file>   Time parsing every line of an EPD file, then parsing "
+      "and generating\n",
+      program, program, SCALING_DEPTH);
+}
+
+int main(int argc, const char *argv[]) {
+  const char *program = argv[0];
+  PerftOptions options = {.threads = 1};
+  TranspositionTable table;
+  const char *epdPath = NULL;
+  long megabytes = 0;
+
+  for (argc--, argv++; argc > 0 && strncmp(argv[0], "--", 2) == 0;
+       argc--, argv++) {
+    if (strcmp(argv[0], "--scaling") == 0) {
+      options.scaling = true;
+    } else if (strcmp(argv[0], "--magic") == 0) {
+      (void)setSlidingIndexing(INDEX_BY_MAGIC);
+    } else if (argc >= 2 && strcmp(argv[0], "--epd") == 0) {
+      epdPath = argv[1];
+      argc--, argv++;
+    } else if (argc >= 2 && strcmp(argv[0], "--hash") == 0) {
+      megabytes = strtol(argv[1], NULL, 10);
+      argc--, argv++;
+    } else if (argc >= 2 && strcmp(argv[0], "--threads") == 0) {
+      const long threads = strtol(argv[1], NULL, 10);
+
+      options.threads = (uint16_t)(threads > 0 && threads <= UINT16_MAX
+                                       ? threads
+                                       : sysconf(_SC_NPROCESSORS_ONLN));
+      argc--, argv++;
+    } else {
+      printUsage(program);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (argc != 0 && argc != 2) {
+    printUsage(program);
+    return EXIT_FAILURE;
+  }
+
+  if (epdPath) {
+    return runEpd(epdPath);
+  }
+
+  const char *fen = argc == 2 ? argv[0] : STARTING_FEN;
+  const long depth = argc == 2 ? strtol(argv[1], NULL, 10) : SCALING_DEPTH;
+  if (depth < 1 || depth > UINT8_MAX) {
+    (void)fprintf(stderr, "Depth must be between 1 and %d\n", UINT8_MAX);
+    return EXIT_FAILURE;
+  }
+
+  if (megabytes > 0) {
+    if (!initTable(&table, (size_t)megabytes, REPLACE_SHALLOWEST)) {
+      (void)fprintf(stderr, "Can't allocate a %ld MB hash table\n",
+                    megabytes);
+      return EXIT_FAILURE;
+    }
+    options.table = &table;
+  }
+
+  printf("%s library, sliding attacks indexed by %s\n\n", LIBRARY_KIND,
+         getSlidingIndexing() == INDEX_BY_PEXT ? "pext" : "magic numbers");
+
+  int status;
+  if (options.scaling) {
+    status = runScaling(&options, fen, (uint8_t)depth);
+  } else {
+    if (options.threads > 1) {
+      options.pool = createPerftPool(options.threads);
+      if (!options.pool) {
+        (void)fprintf(stderr, "Can't start %d threads\n", options.threads);
+      }
+    }
+
+    status = (options.threads > 1 && !options.pool) ? EXIT_FAILURE
+             : argc == 2 ? runDivide(&options, fen, (uint8_t)depth)
+                         : runSuite(&options);
+    destroyPerftPool(options.pool);
+  }
+
+  if (options.table) {
+    freeTable(options.table);
+  }
+  return status;
+}
@@ -0,0 +1,74 @@
+#define _POSIX_C_SOURCE 200809L
+
+#ifdef SYSIFUS_HEADER_ONLY
+#include "amalgamation.h"
+#endif /* ifdef SYSIFUS_HEADER_ONLY */
+
+#include "pgn.h"
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t getMilliseconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static uint64_t getPerSecond(const uint64_t count,
+                             const uint64_t milliseconds) {
+  return milliseconds ? count * 1000 / milliseconds : 0;
+}
+
+static void printUsage(const char *program) {
+  (void)fprintf(stderr,
+                "Usage: %s [--threads <N>] <file.pgn>\n"
+                "Replays every game of the file and prints how fast it went\n"
+                "  --threads <N>  Replay on N threads, 0 for one per core, "
+                "1 by default\n",
+                program);
+}
+
+int main(int argc, const char *argv[]) {
+  const char *program = argv[0];
+  uint16_t threads = 1;
+
+  for (argc--, argv++; argc > 1 && strcmp(argv[0], "--threads") == 0;
+       argc -= 2, argv += 2) {
+    const long long value = strtoll(argv[1], NULL, 10);
+
+    threads = (uint16_t)(value > 0 && value <= UINT16_MAX
+                             ? value
+                             : sysconf(_SC_NPROCESSORS_ONLN));
+  }
+  if (argc != 1) {
+    printUsage(program);
+    return EXIT_FAILURE;
+  }
+
+  PgnStats stats;
+  const uint64_t start = getMilliseconds();
+  if (!replayPgn(argv[0], threads, NULL, NULL, &stats)) {
+    (void)fprintf(stderr, "Can't replay %s on %d threads\n", argv[0],
+                  threads);
+    return EXIT_FAILURE;
+  }
+  const uint64_t milliseconds = getMilliseconds() - start;
+
+  printf("Threads: %d\n", threads);
+  printf("Games: %" PRIu64 ", %" PRIu64 " given up at an invalid move\n",
+         stats.games, stats.invalidGames);
+  printf("Positions: %" PRIu64 "\n", stats.positions);
+  printf("Time: %" PRIu64 " ms\n", milliseconds);
+  printf("Games/second: %" PRIu64 "\n",
+         getPerSecond(stats.games, milliseconds));
+  printf("Positions/second: %" PRIu64 "\n",
+         getPerSecond(stats.positions, milliseconds));
+
+  return EXIT_SUCCESS;
+}
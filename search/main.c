@@ -0,0 +1,306 @@
+#define _POSIX_C_SOURCE 200809L
+
+#ifdef SYSIFUS_HEADER_ONLY
+#include "amalgamation.h"
+#endif /* ifdef SYSIFUS_HEADER_ONLY */
+
+#include "nnue.h"
+#include "position.h"
+#include "search.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_BENCH_DEPTH 9
+#define DEFAULT_HASH_MEGABYTES 16
+
+typedef struct {
+  const char *name, *fen;
+} BenchCase;
+
+// Openings, middlegames and endgames, with the usual perft positions among
+// them for their castling, en passant and promotions
+static const BenchCase SUITE[] = {
+    {"startpos", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"},
+    {"kiwipete",
+     "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"},
+    {"position3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"},
+    {"position4",
+     "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"},
+    {"position5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8"},
+    {"position6",
+     "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 "
+     "10"},
+    {"sicilian",
+     "r1bqkb1r/pp2pppp/2np1n2/8/3NP3/2N5/PPP2PPP/R1BQKB1R w KQkq - 2 6"},
+    {"queens-gambit",
+     "rnbqkb1r/ppp2ppp/4pn2/3p2B1/2PP4/2N5/PP2PPPP/R2QKBNR b KQkq - 3 4"},
+    {"middlegame",
+     "r2q1rk1/pp2bppp/2n1bn2/2pp4/3P4/2PBPN2/PP1N1PPP/R1BQ1RK1 w - - 0 10"},
+    {"rook-endgame", "8/5pk1/6p1/1R5p/7P/r5P1/5PK1/8 w - - 0 40"},
+    {"pawn-endgame", "8/8/1p3k2/p1p5/P1P2K2/1P6/8/8 w - - 0 45"},
+    {"exposed-king",
+     "r1b1kb1r/pppp1ppp/5q2/4n3/3KP3/2N3PN/PPP4P/R1BQ1B1R b kq - 0 1"},
+};
+
+static void printPv(const SearchResult *result) {
+  for (uint8_t pvIndex = 0; pvIndex < result->pvLength; pvIndex++) {
+    char moveString[6];
+
+    moveToString(result->pv[pvIndex], moveString);
+    printf(" %s", moveString);
+  }
+}
+
+static void printScore(const int16_t score) {
+  if (score >= SCORE_MATE_BOUND) {
+    printf("mate %d", (SCORE_MATE - score + 1) / 2);
+  } else if (score <= -SCORE_MATE_BOUND) {
+    printf("mate -%d", (SCORE_MATE + score) / 2);
+  } else {
+    printf("cp %d", score);
+  }
+}
+
+static void printIteration(const SearchResult *result, void *context) {
+  (void)context;
+
+  printf("depth %d seldepth %d score ", result->depth,
+         result->selectiveDepth);
+  printScore(result->score);
+  printf(" nodes %" PRIu64 " time %" PRIu64 " pv", result->nodes,
+         result->milliseconds);
+  printPv(result);
+  printf("\n");
+  (void)fflush(stdout);
+}
+
+static uint64_t getNodesPerSecond(const uint64_t nodes,
+                                  const uint64_t milliseconds) {
+  return milliseconds ? nodes * 1000 / milliseconds : 0;
+}
+
+// Every case starts from a cleared searcher and stops on depth alone, so with
+// one thread the node count only changes when the search itself does.
+// Returns false if the suite has a bad FEN.
+static bool searchSuite(Searcher *searcher, const uint8_t depth,
+                        const bool verbose, uint64_t *nodes,
+                        uint64_t *milliseconds) {
+  const size_t cases = sizeof(SUITE) / sizeof(SUITE[0]);
+  const SearchLimits limits = {.depth = depth};
+
+  *nodes = 0;
+  *milliseconds = 0;
+  for (size_t caseIndex = 0; caseIndex < cases; caseIndex++) {
+    const BenchCase *benchCase = &SUITE[caseIndex];
+    Position position;
+    SearchResult result;
+    char moveString[6];
+
+    if (!parseFen(&position, benchCase->fen)) {
+      (void)fprintf(stderr, "Invalid FEN in suite: %s\n", benchCase->fen);
+      return false;
+    }
+
+    clearSearcher(searcher);
+    runSearch(searcher, &position, NULL, 0, &limits, &result);
+    *nodes += result.nodes;
+    *milliseconds += result.milliseconds;
+    if (!verbose) {
+      continue;
+    }
+
+    moveToString(result.bestMove, moveString);
+    printf("%-14s depth %2d %12" PRIu64 " nodes %8" PRIu64 " ms %10" PRIu64
+           " nps  %-5s ",
+           benchCase->name, result.depth, result.nodes, result.milliseconds,
+           getNodesPerSecond(result.nodes, result.milliseconds), moveString);
+    printScore(result.score);
+    printf("\n");
+  }
+
+  return true;
+}
+
+static int runBench(Searcher *searcher, const uint8_t depth) {
+  uint64_t nodes, milliseconds;
+
+  if (!searchSuite(searcher, depth, true, &nodes, &milliseconds)) {
+    return EXIT_FAILURE;
+  }
+
+  printf("\nThreads: %d\n", getSearchThreads(searcher));
+  printf("Time to depth %d: %" PRIu64 " ms\n", depth, milliseconds);
+  printf("Nodes searched: %" PRIu64 "\n", nodes);
+  printf("Nodes/second: %" PRIu64 "\n",
+         getNodesPerSecond(nodes, milliseconds));
+
+  return EXIT_SUCCESS;
+}
+
+// Times the suite to the same depth with 1, 2, 4... threads up to the
+// configured count. Helpers change the tree, so nodes grow with the threads
+// and the time to depth is what tells the speedup.
+static int runScaling(const size_t megabytes, const uint16_t maxThreads,
+                      const uint8_t depth, const Network *network) {
+  printf("Scaling of the bench suite to depth %d\n\n", depth);
+  printf("%8s %14s %12s %14s %8s %10s\n", "threads", "nodes", "time", "nps",
+         "speedup", "efficiency");
+
+  uint64_t baseline = 0;
+  for (uint16_t threads = 1; threads <= maxThreads;) {
+    Searcher *searcher = createSearcher(megabytes, threads);
+    uint64_t nodes, milliseconds;
+
+    if (!searcher) {
+      (void)fprintf(stderr, "Can't start %d threads\n", threads);
+      return EXIT_FAILURE;
+    }
+    setSearchNetwork(searcher, network);
+    const bool valid =
+        searchSuite(searcher, depth, false, &nodes, &milliseconds);
+    destroySearcher(searcher);
+    if (!valid) {
+      return EXIT_FAILURE;
+    }
+
+    if (threads == 1) {
+      baseline = milliseconds;
+    }
+    const double speedup =
+        milliseconds ? (double)baseline / (double)milliseconds : 0;
+    printf("%8d %14" PRIu64 " %9" PRIu64 " ms %14" PRIu64 " %7.2fx %9.1f%%\n",
+           threads, nodes, milliseconds,
+           getNodesPerSecond(nodes, milliseconds), speedup,
+           100.0 * speedup / threads);
+    (void)fflush(stdout);
+
+    // Always finish on the exact thread count asked for
+    threads = (threads < maxThreads && threads * 2 > maxThreads)
+                  ? maxThreads
+                  : (uint16_t)(threads * 2);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+static int runFen(Searcher *searcher, const char *fen,
+                  const SearchLimits *limits) {
+  Position position;
+  SearchResult result;
+  char moveString[6];
+
+  if (!parseFen(&position, fen)) {
+    (void)fprintf(stderr, "Invalid FEN: %s\n", fen);
+    return EXIT_FAILURE;
+  }
+
+  setSearchReport(searcher, printIteration, NULL);
+  runSearch(searcher, &position, NULL, 0, limits, &result);
+
+  moveToString(result.bestMove, moveString);
+  printf("bestmove %s\n", result.bestMove != NO_MOVE ? moveString : "0000");
+
+  return EXIT_SUCCESS;
+}
+
+static void printUsage(const char *program) {
+  (void)fprintf(
+      stderr,
+      "Usage: %s [--hash <MB>] [--threads <N>] [--scaling] [--depth <N>] "
+      "[--nodes <N>] [--time <ms>] [--nnue <file>] [\"<fen>\"]\n"
+      "Without a FEN searches the bench suite to depth %d and prints the "
+      "total node count\n"
+      "  --hash <MB>    Hash table size, %d MB by default\n"
+      "  --threads <N>  Search with N threads sharing the hash table, 0 for "
+      "one per core\n"
+      "  --scaling      Time the bench suite with 1, 2, 4... up to N "
+      "threads\n"
+      "  --depth <N>    Stop after the iteration at depth N\n"
+      "  --nodes <N>    Stop after N nodes, only with a FEN\n"
+      "  --time <ms>    Stop after that many milliseconds, only with a FEN\n"
+      "  --nnue <file>  Evaluate with the network in the file\n",
+      program, DEFAULT_BENCH_DEPTH, DEFAULT_HASH_MEGABYTES);
+}
+
+int main(int argc, const char *argv[]) {
+  const char *program = argv[0];
+  SearchLimits limits = {0};
+  long megabytes = DEFAULT_HASH_MEGABYTES;
+  uint16_t threads = 1;
+  bool scaling = false;
+  Network *network = NULL;
+
+  for (argc--, argv++; argc > 0 && strncmp(argv[0], "--", 2) == 0;
+       argc--, argv++) {
+    if (strcmp(argv[0], "--scaling") == 0) {
+      scaling = true;
+      continue;
+    }
+    if (argc < 2) {
+      printUsage(program);
+      return EXIT_FAILURE;
+    }
+
+    const long long value = strtoll(argv[1], NULL, 10);
+    if (strcmp(argv[0], "--nnue") == 0) {
+      freeNetwork(network);
+      network = loadNetwork(argv[1]);
+      if (!network) {
+        (void)fprintf(stderr, "Can't load the network %s\n", argv[1]);
+        return EXIT_FAILURE;
+      }
+    } else if (strcmp(argv[0], "--hash") == 0 && value > 0) {
+      megabytes = (long)value;
+    } else if (strcmp(argv[0], "--threads") == 0) {
+      threads = (uint16_t)(value > 0 && value <= UINT16_MAX
+                               ? value
+                               : sysconf(_SC_NPROCESSORS_ONLN));
+    } else if (strcmp(argv[0], "--depth") == 0 && value > 0 &&
+               value < MAX_PLY) {
+      limits.depth = (uint8_t)value;
+    } else if (strcmp(argv[0], "--nodes") == 0 && value > 0) {
+      limits.nodes = (uint64_t)value;
+    } else if (strcmp(argv[0], "--time") == 0 && value > 0) {
+      limits.milliseconds = (uint64_t)value;
+    } else {
+      printUsage(program);
+      return EXIT_FAILURE;
+    }
+    argc--, argv++;
+  }
+
+  if (argc > 1 || (scaling && argc == 1)) {
+    printUsage(program);
+    return EXIT_FAILURE;
+  }
+
+  const uint8_t benchDepth =
+      limits.depth ? limits.depth : DEFAULT_BENCH_DEPTH;
+  if (scaling) {
+    const int status =
+        runScaling((size_t)megabytes, threads, benchDepth, network);
+    freeNetwork(network);
+    return status;
+  }
+
+  Searcher *searcher = createSearcher((size_t)megabytes, threads);
+  if (!searcher) {
+    (void)fprintf(stderr, "Can't start %d threads with a %ld MB hash table\n",
+                  threads, megabytes);
+    freeNetwork(network);
+    return EXIT_FAILURE;
+  }
+  setSearchNetwork(searcher, network);
+
+  const int status = argc == 1 ? runFen(searcher, argv[0], &limits)
+                               : runBench(searcher, benchDepth);
+  destroySearcher(searcher);
+  freeNetwork(network);
+
+  return status;
+}
@@ -0,0 +1,597 @@
+#include "bitboard.h"
+#include "lutblob.h"
+#include "sysifus.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Long enough for any build directory, bakeLuts refuses longer ones
+#define LUT_PATH_LENGTH 4096
+
+static uint64_t generateJumpingAttack(const Coordinate offsets[JUMPING_OFFSETS],
+                                      const int8_t square) {
+#ifndef NDEBUG
+  assert(offsets != NULL);
+#endif /* ifndef  NDEBUG */
+
+  Coordinate coord = {
+      .rank = (int8_t)(square / BOARD_LENGTH),
+      .file = (int8_t)(square % BOARD_LENGTH),
+  };
+  uint64_t attack = 0;
+
+  for (int8_t offsetIndex = 0; offsetIndex < JUMPING_OFFSETS; offsetIndex++) {
+    const Coordinate attackedCoord = {
+        (int8_t)(coord.rank + offsets[offsetIndex].rank),
+        (int8_t)(coord.file + offsets[offsetIndex].file),
+    };
+
+    if (isCoordValid(attackedCoord)) {
+      attack |= 1ULL << coordToSquare(attackedCoord);
+    }
+  }
+
+  return attack;
+}
+
+static uint64_t generateOccupancyMask(const Coordinate coord) {
+  // 01111110
+  // 11111111
+  // 11111111
+  // 11111111
+  // 11111111
+  // 11111111
+  // 11111111
+  // 01111110
+  const uint64_t baseMask = 0x7EFFFFFFFFFFFF7E;
+
+  uint64_t mask = baseMask;
+  if (coord.rank != 0) {
+    // 11111111
+    // 11111111
+    // 11111111
+    // 11111111
+    // 11111111
+    // 11111111
+    // 11111111
+    // 00000000
+    const uint64_t rank1 = 0xFFFFFFFFFFFFFF00;
+    mask &= rank1;
+  }
+  if (coord.rank != BOARD_LENGTH - 1) {
+    // 00000000
+    // 11111111
+    // 11111111
+    // 11111111
+    // 11111111
+    // 11111111
+    // 11111111
+    // 11111111
+    const uint64_t rank8 = 0xFFFFFFFFFFFFFF;
+    mask &= rank8;
+  }
+  if (coord.file != 0) {
+    // 11111110
+    // 11111110
+    // 11111110
+    // 11111110
+    // 11111110
+    // 11111110
+    // 11111110
+    // 11111110
+    const uint64_t file8 = 0xFEFEFEFEFEFEFEFE;
+    mask &= file8;
+  }
+  if (coord.file != BOARD_LENGTH - 1) {
+
+    // 01111111
+    // 01111111
+    // 01111111
+    // 01111111
+    // 01111111
+    // 01111111
+    // 01111111
+    // 01111111
+    const uint64_t file1 = 0x7F7F7F7F7F7F7F7F;
+    mask &= file1;
+  }
+
+  return mask;
+}
+
+static uint64_t
+generateSlidingAttack(const uint64_t occupancy,
+                      const Coordinate directions[SLIDING_DIRECTIONS],
+                      const int8_t square) {
+#ifndef NDEBUG
+  assert(directions != NULL);
+#endif /* ifndef  NDEBUG */
+
+  Coordinate coord = {
+      .rank = (int8_t)(square / BOARD_LENGTH),
+      .file = (int8_t)(square % BOARD_LENGTH),
+  };
+  uint64_t attack = 0;
+
+  for (int8_t directionIndex = 0; directionIndex < SLIDING_DIRECTIONS;
+       directionIndex++) {
+    uint64_t ray = 0;
+
+    for (Coordinate attackedCoord =
+             {(int8_t)(coord.rank + directions[directionIndex].rank),
+              (int8_t)(coord.file + directions[directionIndex].file)};
+         isCoordValid(attackedCoord);
+         attackedCoord = (Coordinate){
+             (int8_t)(attackedCoord.rank + directions[directionIndex].rank),
+             (int8_t)(attackedCoord.file + directions[directionIndex].file),
+         }) {
+      ray |= 1ULL << coordToSquare(attackedCoord);
+
+      if (isSet(attackedCoord, occupancy)) {
+        break;
+      }
+    }
+
+    attack |= ray;
+  }
+
+  return attack;
+}
+
+typedef struct {
+  uint64_t mask;
+} RelevantMask;
+
+static void generateOccupancyVariants(const RelevantMask relevantMask,
+                                      const uint16_t possibleVariants,
+                                      uint64_t variants[possibleVariants]) {
+#ifndef NDEBUG
+  assert(variants != NULL);
+#endif
+
+  for (uint16_t variantIndex = 0; variantIndex < possibleVariants;
+       variantIndex++) {
+    // Iterate over bits of the variant index Brian Kernighan's way
+    // https://www.geeksforgeeks.org/count-set-bits-in-an-integer/
+    uint64_t variantIndexTemp = variantIndex;
+    uint64_t relevantMaskTemp = relevantMask.mask;
+    uint64_t occupancy = 0;
+
+    while (variantIndexTemp) {
+      // This a & -a just isolate the least significant bit of number
+      const uint64_t relevantMaskLSB = relevantMaskTemp & -relevantMaskTemp;
+      const bool isCurrentBitSet = variantIndexTemp & 1;
+
+      if (isCurrentBitSet) {
+        occupancy |= relevantMaskLSB; // Append the relevant  mask's lsb
+      }
+
+      // Delete the lsb from the relevant mask
+      relevantMaskTemp &= ~relevantMaskLSB;
+      variantIndexTemp >>= 1; // Move one bit forward
+    }
+
+    variants[variantIndex] = occupancy;
+  }
+}
+
+static void
+generateSlidingRelevantMasksLUT(const Coordinate directions[SLIDING_DIRECTIONS],
+                                uint64_t lut[BOARD_AREA]) {
+  for (int8_t square = 0; square < BOARD_AREA; square++) {
+    lut[square] = generateSlidingAttack(0, directions, square) &
+                  generateOccupancyMask((Coordinate){
+                      .rank = (int8_t)(square / BOARD_LENGTH),
+                      .file = (int8_t)(square % BOARD_LENGTH),
+                  });
+  }
+}
+
+
+static void writeHeader(FILE *fptr) {
+  (void)fprintf(fptr, "// This file stores generated LUTs. DO NOT MODIFY!\n\n");
+  (void)fprintf(fptr, "#pragma once\n\n");
+  (void)fprintf(fptr, "#include \"bitboard.h\"\n");
+  (void)fprintf(fptr, "#include \"position.h\"\n\n");
+}
+
+static void writeJumpingAttackMap(FILE *fptr, const char *name,
+                                  const Coordinate offsets[JUMPING_OFFSETS]) {
+  (void)fprintf(fptr, "static const uint64_t %s[BOARD_AREA] = {", name);
+  for (int8_t square = 0; square < BOARD_AREA; square++) {
+    (void)fprintf(fptr, (square < BOARD_AREA - 1) ? "0x%016lx, " : "0x%016lx",
+                  generateJumpingAttack(offsets, square));
+  }
+  (void)fprintf(fptr, "};\n");
+}
+
+static void writeSlidingRelevantMask(FILE *fptr, const char *name,
+                                     const uint64_t lut[BOARD_AREA]) {
+  (void)fprintf(fptr, "static const uint64_t %s[BOARD_AREA] = {", name);
+  for (int8_t square = 0; square < BOARD_AREA; square++) {
+    (void)fprintf(fptr, (square < BOARD_AREA - 1) ? "0x%016lx, " : "0x%016lx",
+                  lut[square]);
+  }
+  (void)fprintf(fptr, "};\n");
+}
+// xorshift64*, with a fixed seed so every bake produces the same keys
+static uint64_t nextRandom(uint64_t *state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// Tries sparse random numbers until one maps every occupancy variant to an
+// index in [0, 2^relevant bits) without two different attack sets colliding.
+// Variants sharing an attack set may collide, that's what makes it fit.
+static uint64_t findMagic(const uint64_t relevantMask,
+                          const uint16_t possibleVariants,
+                          const uint64_t occupancyVariants[possibleVariants],
+                          const uint64_t attacks[possibleVariants],
+                          uint64_t *state) {
+  const uint8_t shift =
+      (uint8_t)(BOARD_AREA - __builtin_popcountll(relevantMask));
+  uint64_t indexed[possibleVariants];
+
+  for (;;) {
+    const uint64_t magic =
+        nextRandom(state) & nextRandom(state) & nextRandom(state);
+
+    // Too few bits reaching the top byte can't spread the index well
+    if (__builtin_popcountll((relevantMask * magic) & 0xFF00000000000000) < 6) {
+      continue;
+    }
+
+    memset(indexed, 0, sizeof(indexed));
+    bool isValid = true;
+    for (uint16_t variantIndex = 0; isValid && variantIndex < possibleVariants;
+         variantIndex++) {
+      const uint64_t index = (occupancyVariants[variantIndex] * magic) >> shift;
+
+      // Sliders always attack something, so 0 marks an unused slot
+      if (indexed[index] == 0) {
+        indexed[index] = attacks[variantIndex];
+      } else {
+        isValid = indexed[index] == attacks[variantIndex];
+      }
+    }
+
+    if (isValid) {
+      return magic;
+    }
+  }
+}
+
+static void writeBitboards(FILE *fptr, const uint64_t *bitboards,
+                           const uint32_t count) {
+  (void)fprintf(fptr, "{");
+  for (uint32_t index = 0; index < count; index++) {
+    (void)fprintf(fptr, (index < count - 1) ? "0x%016lx, " : "0x%016lx",
+                  bitboards[index]);
+  }
+  (void)fprintf(fptr, "}");
+}
+
+// Every square only gets the 2^popcount(relevant mask) entries it can index,
+// packed one after another. The offset table tells where each square starts
+// and the shift table (64 - relevant bits) how many entries it owns.
+// The slices are filled twice, once in pext order and once in the order of
+// the square's magic, so both indexing methods share the offsets and shifts.
+typedef struct {
+  uint32_t offsets[BOARD_AREA];
+  uint8_t shifts[BOARD_AREA];
+  uint64_t magics[BOARD_AREA];
+  uint32_t entries;
+  uint64_t *pextAttacks, *magicAttacks;
+} SlidingTables;
+
+static void freeSlidingTables(SlidingTables *tables) {
+  free(tables->pextAttacks);
+  free(tables->magicAttacks);
+  tables->pextAttacks = NULL;
+  tables->magicAttacks = NULL;
+}
+
+static bool
+generateSlidingTables(const uint64_t relevantMasks[BOARD_AREA],
+                      const Coordinate directions[SLIDING_DIRECTIONS],
+                      uint64_t *state, SlidingTables *tables) {
+  tables->entries = 0;
+  for (int8_t square = 0; square < BOARD_AREA; square++) {
+    tables->offsets[square] = tables->entries;
+    tables->shifts[square] =
+        (uint8_t)(BOARD_AREA - __builtin_popcountll(relevantMasks[square]));
+    tables->entries += 1U << (BOARD_AREA - tables->shifts[square]);
+  }
+
+  tables->pextAttacks = calloc(tables->entries, sizeof(uint64_t));
+  tables->magicAttacks = calloc(tables->entries, sizeof(uint64_t));
+  if (!tables->pextAttacks || !tables->magicAttacks) {
+    perror("Error allocating sliding attack maps");
+    freeSlidingTables(tables);
+    return false;
+  }
+
+  for (int8_t square = 0; square < BOARD_AREA; square++) {
+    const uint8_t shift = tables->shifts[square];
+    const uint16_t possibleVariants = (uint16_t)(1U << (BOARD_AREA - shift));
+    uint64_t occupancyVariants[possibleVariants];
+    generateOccupancyVariants((RelevantMask){relevantMasks[square]},
+                              possibleVariants, occupancyVariants);
+
+    uint64_t *attacks = &tables->pextAttacks[tables->offsets[square]];
+    for (uint16_t variantIndex = 0; variantIndex < possibleVariants;
+         variantIndex++) {
+      attacks[variantIndex] = generateSlidingAttack(
+          occupancyVariants[variantIndex], directions, square);
+    }
+
+    tables->magics[square] =
+        findMagic(relevantMasks[square], possibleVariants, occupancyVariants,
+                  attacks, state);
+    for (uint16_t variantIndex = 0; variantIndex < possibleVariants;
+         variantIndex++) {
+      const uint64_t index =
+          (occupancyVariants[variantIndex] * tables->magics[square]) >> shift;
+
+      tables->magicAttacks[tables->offsets[square] + index] =
+          attacks[variantIndex];
+    }
+  }
+
+  return true;
+}
+
+// What the lookups index the attack maps with, small enough for every
+// translation unit
+static void writeSlidingIndexing(FILE *fptr, const char *piece,
+                                 const SlidingTables *tables) {
+  (void)fprintf(fptr, "#define %s_ATTACK_ENTRIES %u\n", piece,
+                tables->entries);
+
+  (void)fprintf(fptr, "static const uint32_t %s_ATTACK_OFFSET[BOARD_AREA] = {",
+                piece);
+  for (int8_t square = 0; square < BOARD_AREA; square++) {
+    (void)fprintf(fptr, (square < BOARD_AREA - 1) ? "%u, " : "%u",
+                  tables->offsets[square]);
+  }
+  (void)fprintf(fptr, "};\n");
+
+  (void)fprintf(fptr, "static const uint8_t %s_ATTACK_SHIFT[BOARD_AREA] = {",
+                piece);
+  for (int8_t square = 0; square < BOARD_AREA; square++) {
+    (void)fprintf(fptr, (square < BOARD_AREA - 1) ? "%d, " : "%d",
+                  tables->shifts[square]);
+  }
+  (void)fprintf(fptr, "};\n");
+
+  (void)fprintf(fptr, "static const uint64_t %s_MAGIC[BOARD_AREA] = ", piece);
+  writeBitboards(fptr, tables->magics, BOARD_AREA);
+  (void)fprintf(fptr, ";\n");
+}
+
+static void writeSlidingAttackMaps(FILE *fptr, const char *piece,
+                                   const SlidingTables *tables) {
+  (void)fprintf(fptr,
+                "static const uint64_t %s_ATTACK_MAP[%s_ATTACK_ENTRIES] = ",
+                piece, piece);
+  writeBitboards(fptr, tables->pextAttacks, tables->entries);
+  (void)fprintf(fptr, ";\n");
+
+  (void)fprintf(
+      fptr, "static const uint64_t %s_MAGIC_ATTACK_MAP[%s_ATTACK_ENTRIES] = ",
+      piece, piece);
+  writeBitboards(fptr, tables->magicAttacks, tables->entries);
+  (void)fprintf(fptr, ";\n");
+}
+
+static void writeRandomKeys(FILE *fptr, const uint16_t count,
+                            uint64_t *state) {
+  (void)fprintf(fptr, "{");
+  for (uint16_t keyIndex = 0; keyIndex < count; keyIndex++) {
+    (void)fprintf(fptr, (keyIndex < count - 1) ? "0x%016lx, " : "0x%016lx",
+                  nextRandom(state));
+  }
+  (void)fprintf(fptr, "}");
+}
+
+static void writeZobristKeys(FILE *fptr) {
+  uint64_t state = 0x5359534946555321ULL;
+
+  (void)fprintf(fptr,
+                "static const uint64_t "
+                "ZOBRIST_PIECE_KEYS[COLORS][PIECE_TYPES][BOARD_AREA] = {");
+  for (uint8_t color = 0; color < COLORS; color++) {
+    (void)fprintf(fptr, "{");
+    for (uint8_t type = 0; type < PIECE_TYPES; type++) {
+      writeRandomKeys(fptr, BOARD_AREA, &state);
+      (void)fprintf(fptr, (type < PIECE_TYPES - 1) ? ", " : "");
+    }
+    (void)fprintf(fptr, (color < COLORS - 1) ? "}, " : "}");
+  }
+  (void)fprintf(fptr, "};\n");
+
+  (void)fprintf(fptr, "static const uint64_t "
+                      "ZOBRIST_CASTLING_KEYS[CASTLING_RIGHTS_VARIANTS] = ");
+  writeRandomKeys(fptr, CASTLING_RIGHTS_VARIANTS, &state);
+  (void)fprintf(fptr, ";\n");
+
+  (void)fprintf(fptr,
+                "static const uint64_t ZOBRIST_EN_PASSANT_KEYS[BOARD_LENGTH] = ");
+  writeRandomKeys(fptr, BOARD_LENGTH, &state);
+  (void)fprintf(fptr, ";\n");
+
+  (void)fprintf(fptr, "static const uint64_t ZOBRIST_SIDE_KEY = 0x%016lx;\n",
+                nextRandom(&state));
+}
+
+// Every file is written next to its final path and renamed over it once
+// complete, so neither a compiler nor a process mapping the blob ever sees
+// half of one
+typedef struct {
+  FILE *fptr;
+  char path[LUT_PATH_LENGTH], temporaryPath[LUT_PATH_LENGTH];
+} Output;
+
+static bool openOutput(Output *output, const char *directory,
+                       const char *name, const char *mode) {
+  const int length = snprintf(output->path, LUT_PATH_LENGTH, "%s/%s",
+                              directory, name);
+  const int temporaryLength = snprintf(
+      output->temporaryPath, LUT_PATH_LENGTH, "%s/%s.tmp", directory, name);
+  if (length < 0 || length >= LUT_PATH_LENGTH || temporaryLength < 0 ||
+      temporaryLength >= LUT_PATH_LENGTH) {
+    (void)fprintf(stderr, "LUTs directory path too long: %s\n", directory);
+    return false;
+  }
+
+  output->fptr = fopen(output->temporaryPath, mode);
+  if (!output->fptr) {
+    perror("Error opening LUTs file");
+    return false;
+  }
+
+  return true;
+}
+
+static bool closeOutput(Output *output) {
+  const bool isWritten = !ferror(output->fptr);
+
+  if (!isWritten) {
+    perror("Error writing to LUTs file");
+  }
+  if (fclose(output->fptr) != 0) {
+    perror("Error closing LUTs file");
+    (void)remove(output->temporaryPath);
+    return false;
+  }
+  if (!isWritten) {
+    (void)remove(output->temporaryPath);
+    return false;
+  }
+  if (rename(output->temporaryPath, output->path) != 0) {
+    perror("Error renaming LUTs file");
+    (void)remove(output->temporaryPath);
+    return false;
+  }
+
+  return true;
+}
+
+static uint64_t alignToPage(const uint64_t bytes) {
+  return (bytes + LUT_BLOB_ALIGNMENT - 1) & ~(uint64_t)(LUT_BLOB_ALIGNMENT - 1);
+}
+
+static void writeZeros(FILE *fptr, uint64_t count) {
+  for (; count > 0; count--) {
+    (void)fputc(0, fptr);
+  }
+}
+
+static void writeBlob(FILE *fptr, const SlidingTables *bishop,
+                      const SlidingTables *rook, const uint64_t checksum) {
+  const uint64_t *maps[LUT_BLOB_MAPS] = {
+      [BISHOP_PEXT_MAP] = bishop->pextAttacks,
+      [BISHOP_MAGIC_MAP] = bishop->magicAttacks,
+      [ROOK_PEXT_MAP] = rook->pextAttacks,
+      [ROOK_MAGIC_MAP] = rook->magicAttacks,
+  };
+  LutBlobHeader header;
+
+  // Zeroed padding included, the same bake always gives the same bytes
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, LUT_BLOB_MAGIC, sizeof(header.magic));
+  header.version = LUT_BLOB_VERSION;
+  header.checksum = checksum;
+  header.entries[BISHOP_PEXT_MAP] = bishop->entries;
+  header.entries[BISHOP_MAGIC_MAP] = bishop->entries;
+  header.entries[ROOK_PEXT_MAP] = rook->entries;
+  header.entries[ROOK_MAGIC_MAP] = rook->entries;
+
+  uint64_t size = alignToPage(sizeof(header));
+  for (uint8_t map = 0; map < LUT_BLOB_MAPS; map++) {
+    header.offsets[map] = size;
+    size += alignToPage(header.entries[map] * sizeof(uint64_t));
+  }
+  header.size = size;
+
+  (void)fwrite(&header, sizeof(header), 1, fptr);
+  uint64_t written = sizeof(header);
+  for (uint8_t map = 0; map < LUT_BLOB_MAPS; map++) {
+    writeZeros(fptr, header.offsets[map] - written);
+    (void)fwrite(maps[map], sizeof(uint64_t), header.entries[map], fptr);
+    written = header.offsets[map] + header.entries[map] * sizeof(uint64_t);
+  }
+  writeZeros(fptr, size - written);
+}
+
+static uint64_t BISHOP_RELEVANT_MASK_TEMP[BOARD_AREA];
+static uint64_t ROOK_RELEVANT_MASK_TEMP[BOARD_AREA];
+
+bool bakeLuts(const char *directory) {
+  SlidingTables bishop, rook;
+  uint64_t magicState = 0x4D41474943533634ULL;
+
+  generateSlidingRelevantMasksLUT(BISHOP_DIRECTIONS, BISHOP_RELEVANT_MASK_TEMP);
+  generateSlidingRelevantMasksLUT(ROOK_DIRECTIONS, ROOK_RELEVANT_MASK_TEMP);
+  if (!generateSlidingTables(BISHOP_RELEVANT_MASK_TEMP, BISHOP_DIRECTIONS,
+                             &magicState, &bishop)) {
+    return false;
+  }
+  if (!generateSlidingTables(ROOK_RELEVANT_MASK_TEMP, ROOK_DIRECTIONS,
+                             &magicState, &rook)) {
+    freeSlidingTables(&bishop);
+    return false;
+  }
+
+  uint64_t checksum = LUT_HASH_SEED;
+  checksum = hashLuts(checksum, bishop.pextAttacks, bishop.entries);
+  checksum = hashLuts(checksum, bishop.magicAttacks, bishop.entries);
+  checksum = hashLuts(checksum, rook.pextAttacks, rook.entries);
+  checksum = hashLuts(checksum, rook.magicAttacks, rook.entries);
+
+  Output output;
+  bool isBaked = openOutput(&output, directory, "luts.h", "w");
+  if (isBaked) {
+    writeHeader(output.fptr);
+    writeJumpingAttackMap(output.fptr, "KNIGHT_ATTACK_MAP", KNIGHT_OFFSETS);
+    writeJumpingAttackMap(output.fptr, "KING_ATTACK_MAP", KING_OFFSETS);
+    writeSlidingRelevantMask(output.fptr, "BISHOP_RELEVANT_MASK",
+                             BISHOP_RELEVANT_MASK_TEMP);
+    writeSlidingRelevantMask(output.fptr, "ROOK_RELEVANT_MASK",
+                             ROOK_RELEVANT_MASK_TEMP);
+    writeSlidingIndexing(output.fptr, "BISHOP", &bishop);
+    writeSlidingIndexing(output.fptr, "ROOK", &rook);
+    writeZobristKeys(output.fptr);
+    isBaked = closeOutput(&output);
+  }
+
+  // The megabytes of attack maps get a header of their own, so only the
+  // sources looking them up pay for parsing them
+  isBaked = isBaked && openOutput(&output, directory, "slidingluts.h", "w");
+  if (isBaked) {
+    writeHeader(output.fptr);
+    (void)fprintf(output.fptr, "#include \"luts.h\"\n\n");
+    (void)fprintf(output.fptr, "#define LUT_CHECKSUM 0x%016lxULL\n",
+                  checksum);
+    writeSlidingAttackMaps(output.fptr, "BISHOP", &bishop);
+    writeSlidingAttackMaps(output.fptr, "ROOK", &rook);
+    isBaked = closeOutput(&output);
+  }
+
+  isBaked = isBaked && openOutput(&output, directory, "luts.bin", "wb");
+  if (isBaked) {
+    writeBlob(output.fptr, &bishop, &rook, checksum);
+    isBaked = closeOutput(&output);
+  }
+
+  freeSlidingTables(&bishop);
+  freeSlidingTables(&rook);
+  return isBaked;
+}
+
+void bake(void) { (void)bakeLuts("."); }
@@ -0,0 +1,303 @@
+#include "dataset.h"
+#include "mapping.h"
+#include "position.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PACKED_PIECE_CODES (COLORS * PIECE_TYPES)
+
+static const char DATASET_MAGIC[8] = "SYSPOS";
+
+bool packPosition(const Position *position, PackedPosition *packed) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(packed != NULL);
+#endif /* ifndef NDEBUG */
+
+  const uint64_t occupancy = getOccupancy(position);
+  if (__builtin_popcountll(occupancy) > PACKED_MAX_PIECES) {
+    return false;
+  }
+
+  memset(packed, 0, sizeof(*packed));
+  packed->occupancy = occupancy;
+
+  uint8_t index = 0;
+  for (uint64_t pieces = occupancy; pieces; pieces &= pieces - 1, index++) {
+    const int8_t square = (int8_t)__builtin_ctzll(pieces);
+    const bool black = (position->occupancy[BLACK] >> square) & 1;
+    const uint8_t code =
+        (uint8_t)(black * PIECE_TYPES + position->board[square]);
+
+    packed->pieces[index / 2] |= (uint8_t)(code << (index % 2 * 4));
+  }
+
+  packed->sideToMove = (uint8_t)position->sideToMove;
+  packed->castlingRights = position->castlingRights;
+  packed->enPassant = position->enPassant;
+  packed->halfmoveClock = position->halfmoveClock;
+  packed->fullmoveNumber = position->fullmoveNumber;
+  return true;
+}
+
+bool unpackPosition(const PackedPosition *packed, Position *position) {
+#ifndef NDEBUG
+  assert(packed != NULL);
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  if (__builtin_popcountll(packed->occupancy) > PACKED_MAX_PIECES ||
+      packed->sideToMove > BLACK ||
+      packed->castlingRights >= CASTLING_RIGHTS_VARIANTS ||
+      packed->enPassant < NO_SQUARE || packed->enPassant >= BOARD_AREA) {
+    return false;
+  }
+
+  clearPosition(position);
+
+  // Bitboards and mailbox only, the hash gets computed once at the end
+  uint8_t index = 0;
+  for (uint64_t pieces = packed->occupancy; pieces;
+       pieces &= pieces - 1, index++) {
+    const uint8_t code = (packed->pieces[index / 2] >> (index % 2 * 4)) & 15;
+    const int8_t square = (int8_t)__builtin_ctzll(pieces);
+    const Color color = (Color)(code / PIECE_TYPES);
+
+    if (code >= PACKED_PIECE_CODES) {
+      return false;
+    }
+    position->pieces[color][code % PIECE_TYPES] |= 1ULL << square;
+    position->occupancy[color] |= 1ULL << square;
+    position->board[square] = (uint8_t)(code % PIECE_TYPES);
+  }
+
+  position->sideToMove = (Color)packed->sideToMove;
+  position->castlingRights = packed->castlingRights;
+  position->enPassant = packed->enPassant;
+  position->halfmoveClock = packed->halfmoveClock;
+  position->fullmoveNumber = packed->fullmoveNumber;
+  if (!isPositionValid(position)) {
+    return false;
+  }
+  position->hash = computeHash(position);
+  return true;
+}
+
+bool initPositionSet(PositionSet *set, const size_t megabytes) {
+#ifndef NDEBUG
+  assert(set != NULL);
+#endif /* ifndef NDEBUG */
+
+  const size_t bytes = megabytes << 20;
+  uint64_t slots = 1;
+  while ((slots << 1) * sizeof(uint64_t) <= bytes) {
+    slots <<= 1;
+  }
+
+  // Zeroed pages come straight from the kernel, they only cost memory once
+  // something is stored in them
+  set->keys = calloc(slots, sizeof(uint64_t));
+  if (!set->keys) {
+    return false;
+  }
+
+  set->mask = slots - 1;
+  set->count = 0;
+  set->hasZero = false;
+  return true;
+}
+
+void freePositionSet(PositionSet *set) {
+#ifndef NDEBUG
+  assert(set != NULL);
+#endif /* ifndef NDEBUG */
+
+  free(set->keys);
+  set->keys = NULL;
+  set->mask = 0;
+  set->count = 0;
+}
+
+PositionSetStatus insertPositionSet(PositionSet *set, const uint64_t hash) {
+#ifndef NDEBUG
+  assert(set != NULL);
+  assert(set->keys != NULL);
+#endif /* ifndef NDEBUG */
+
+  if (hash == 0) {
+    const bool seen = set->hasZero;
+
+    set->hasZero = true;
+    return seen ? POSITION_DUPLICATE : POSITION_ADDED;
+  }
+
+  // Zobrist keys are uniform, the low bits pick the slot as they are
+  uint64_t slot = hash & set->mask;
+  for (; set->keys[slot] != 0; slot = (slot + 1) & set->mask) {
+    if (set->keys[slot] == hash) {
+      return POSITION_DUPLICATE;
+    }
+  }
+
+  if (set->count >= set->mask - (set->mask >> 4)) {
+    return POSITION_SET_FULL;
+  }
+  set->keys[slot] = hash;
+  set->count++;
+  return POSITION_ADDED;
+}
+
+static bool flushDataset(DatasetWriter *writer) {
+  const uint32_t buffered = writer->buffered;
+
+  writer->buffered = 0;
+  return fwrite(writer->buffer, sizeof(PackedPosition), buffered,
+                writer->file) == buffered;
+}
+
+bool openDatasetWriter(DatasetWriter *writer, const char *path,
+                       PositionSet *set) {
+#ifndef NDEBUG
+  assert(writer != NULL);
+  assert(path != NULL);
+#endif /* ifndef NDEBUG */
+
+  memset(writer, 0, sizeof(*writer));
+  writer->set = set;
+  writer->buffer = malloc(DATASET_BUFFER_RECORDS * sizeof(PackedPosition));
+  if (!writer->buffer) {
+    return false;
+  }
+
+  writer->file = fopen(path, "wb");
+  if (!writer->file) {
+    free(writer->buffer);
+    writer->buffer = NULL;
+    return false;
+  }
+
+  DatasetHeader header = {
+      .version = DATASET_VERSION,
+      .recordSize = sizeof(PackedPosition),
+  };
+  memcpy(header.magic, DATASET_MAGIC, sizeof(header.magic));
+  if (fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+    (void)fclose(writer->file);
+    free(writer->buffer);
+    memset(writer, 0, sizeof(*writer));
+    return false;
+  }
+
+  return true;
+}
+
+bool writeDatasetPosition(DatasetWriter *writer, const Position *position) {
+#ifndef NDEBUG
+  assert(writer != NULL);
+  assert(writer->file != NULL);
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  // Packed before it gets recorded as seen, a position that can't be written
+  // mustn't turn its later copies into duplicates. A duplicate's record is
+  // left in the free slot for the next one to overwrite.
+  if (!packPosition(position, &writer->buffer[writer->buffered])) {
+    return false;
+  }
+
+  if (writer->set) {
+    const PositionSetStatus status =
+        insertPositionSet(writer->set, position->hash);
+
+    if (status == POSITION_DUPLICATE) {
+      writer->duplicates++;
+      return true;
+    }
+    writer->unchecked += status == POSITION_SET_FULL;
+  }
+
+  writer->buffered++;
+  writer->written++;
+
+  return writer->buffered < DATASET_BUFFER_RECORDS || flushDataset(writer);
+}
+
+bool closeDatasetWriter(DatasetWriter *writer) {
+#ifndef NDEBUG
+  assert(writer != NULL);
+#endif /* ifndef NDEBUG */
+
+  bool succeeded = writer->file != NULL;
+  if (writer->file) {
+    succeeded = flushDataset(writer);
+    succeeded = !ferror(writer->file) && succeeded;
+    succeeded = fclose(writer->file) == 0 && succeeded;
+  }
+
+  free(writer->buffer);
+  writer->file = NULL;
+  writer->buffer = NULL;
+  return succeeded;
+}
+
+bool openDataset(DatasetReader *reader, const char *path) {
+#ifndef NDEBUG
+  assert(reader != NULL);
+  assert(path != NULL);
+#endif /* ifndef NDEBUG */
+
+  memset(reader, 0, sizeof(*reader));
+
+  const char *data;
+  size_t size;
+  if (!mapFile(path, &data, &size)) {
+    return false;
+  }
+
+  // Even an empty dataset has its header, and the records fill the rest
+  const DatasetHeader *header = (const DatasetHeader *)data;
+  if (size < sizeof(DatasetHeader) ||
+      (size - sizeof(DatasetHeader)) % sizeof(PackedPosition) != 0 ||
+      memcmp(header->magic, DATASET_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != DATASET_VERSION ||
+      header->recordSize != sizeof(PackedPosition)) {
+    unmapFile(data, size);
+    return false;
+  }
+
+  reader->data = data;
+  reader->size = size;
+  reader->count = (size - sizeof(DatasetHeader)) / sizeof(PackedPosition);
+  return true;
+}
+
+void closeDataset(DatasetReader *reader) {
+#ifndef NDEBUG
+  assert(reader != NULL);
+#endif /* ifndef NDEBUG */
+
+  unmapFile(reader->data, reader->size);
+  memset(reader, 0, sizeof(*reader));
+}
+
+DatasetStatus readDataset(DatasetReader *reader, Position *position) {
+#ifndef NDEBUG
+  assert(reader != NULL);
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  if (reader->next >= reader->count) {
+    return DATASET_END;
+  }
+
+  // The header is record sized, so the records stay aligned in the mapping
+  const PackedPosition *records =
+      (const PackedPosition *)(reader->data + sizeof(DatasetHeader));
+  return unpackPosition(&records[reader->next++], position) ? DATASET_RECORD
+                                                             : DATASET_INVALID;
+}
@@ -0,0 +1,68 @@
+#include "epd.h"
+#include "mapping.h"
+#include "position.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+bool openEpd(EpdReader *reader, const char *path) {
+#ifndef NDEBUG
+  assert(reader != NULL);
+  assert(path != NULL);
+#endif /* ifndef NDEBUG */
+
+  memset(reader, 0, sizeof(*reader));
+  return mapFile(path, &reader->data, &reader->size);
+}
+
+void closeEpd(EpdReader *reader) {
+#ifndef NDEBUG
+  assert(reader != NULL);
+#endif /* ifndef NDEBUG */
+
+  unmapFile(reader->data, reader->size);
+  memset(reader, 0, sizeof(*reader));
+}
+
+EpdStatus readEpd(EpdReader *reader, EpdRecord *record) {
+#ifndef NDEBUG
+  assert(reader != NULL);
+  assert(record != NULL);
+#endif /* ifndef NDEBUG */
+
+  const char *line;
+  size_t length;
+
+  do {
+    if (reader->offset >= reader->size) {
+      return EPD_END;
+    }
+
+    line = reader->data + reader->offset;
+    const size_t remaining = reader->size - reader->offset;
+    const char *newline = memchr(line, '\n', remaining);
+
+    length = newline ? (size_t)(newline - line) : remaining;
+    reader->offset += newline ? length + 1 : length;
+    reader->line++;
+
+    if (length > 0 && line[length - 1] == '\r') {
+      length--;
+    }
+  } while (length == 0);
+
+  const size_t consumed = parseFenSpan(&record->position, line, length);
+  if (consumed == 0) {
+    return EPD_INVALID;
+  }
+
+  record->operations = line + consumed;
+  record->operationsLength = length - consumed;
+  while (record->operationsLength > 0 && *record->operations == ' ') {
+    record->operations++;
+    record->operationsLength--;
+  }
+
+  return EPD_RECORD;
+}
@@ -0,0 +1,97 @@
+#include "evaluate.h"
+#include "bitboard.h"
+#include "position.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Each minor piece weighs 1, a rook 2 and a queen 4: 24 with all of them on
+#define MAX_PHASE 24
+#define TEMPO_BONUS 10
+
+static const uint8_t PHASE_WEIGHTS[PIECE_TYPES] = {0, 1, 1, 2, 4, 0};
+
+typedef struct {
+  int32_t midgame, endgame;
+} Score;
+
+// 0 on the four center squares, 3 on the edges
+static inline int8_t getCenterDistance(const int8_t square) {
+  const int8_t file = square % BOARD_LENGTH, rank = square / BOARD_LENGTH;
+  const int8_t fileDistance = (int8_t)(file < 4 ? 3 - file : file - 4);
+  const int8_t rankDistance = (int8_t)(rank < 4 ? 3 - rank : rank - 4);
+
+  return fileDistance > rankDistance ? fileDistance : rankDistance;
+}
+
+// Placement bonus of a piece, `rank` counted from its own side of the board
+static Score getPlacement(const Piece piece, const int8_t square,
+                          const int8_t rank) {
+  const int8_t center = getCenterDistance(square);
+  const int8_t file = square % BOARD_LENGTH;
+
+  switch (piece) {
+  case PAWN: {
+    // Central pawns are worth pushing early, any pawn late
+    const bool central = file == 3 || file == 4;
+    return (Score){(rank - 1) * (central ? 8 : 3), (rank - 1) * 12};
+  }
+  case KNIGHT:
+    return (Score){-12 * center, -10 * center};
+  case BISHOP:
+    return (Score){-6 * center, -5 * center};
+  case ROOK:
+    return (Score){rank == 6 ? 20 : 0, rank == 6 ? 25 : 0};
+  case QUEEN:
+    return (Score){-2 * center, -6 * center};
+  case KING:
+    // Tucked away behind its pawns, then in the middle once queens are off
+    return (Score){-24 * rank - (center < 2 ? 20 : 0), -14 * center};
+  default:
+    return (Score){0, 0};
+  }
+}
+
+int16_t evaluate(const Position *position) {
+#ifndef NDEBUG
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  Score scores[COLORS] = {{0, 0}, {0, 0}};
+  int32_t phase = 0;
+
+  for (Color color = WHITE; color < COLORS; color++) {
+    for (Piece piece = PAWN; piece < NOTHING; piece++) {
+      for (uint64_t pieces = position->pieces[color][piece]; pieces;
+           pieces &= pieces - 1) {
+        const int8_t square = (int8_t)__builtin_ctzll(pieces);
+        const int8_t rank = (int8_t)(color == WHITE
+                                         ? square / BOARD_LENGTH
+                                         : 7 - (square / BOARD_LENGTH));
+        const Score placement = getPlacement(piece, square, rank);
+
+        scores[color].midgame += MIDGAME_VALUES[piece] + placement.midgame;
+        scores[color].endgame += ENDGAME_VALUES[piece] + placement.endgame;
+        phase += PHASE_WEIGHTS[piece];
+      }
+    }
+
+    if (__builtin_popcountll(position->pieces[color][BISHOP]) >= 2) {
+      scores[color].midgame += 30;
+      scores[color].endgame += 50;
+    }
+  }
+
+  // Promotions can push it past the opening count
+  if (phase > MAX_PHASE) {
+    phase = MAX_PHASE;
+  }
+
+  const Color us = position->sideToMove;
+  const int32_t midgame = scores[us].midgame - scores[!us].midgame;
+  const int32_t endgame = scores[us].endgame - scores[!us].endgame;
+
+  return (int16_t)((((midgame * phase) + (endgame * (MAX_PHASE - phase))) /
+                    MAX_PHASE) +
+                   TEMPO_BONUS);
+}
@@ -0,0 +1,432 @@
+#include "fill.h"
+#include "position.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static const uint64_t ALL_SQUARES = 0xFFFFFFFFFFFFFFFF;
+
+// Directions as shift amounts. The left ones (towards h8) are north, east,
+// north-east and north-west, the right ones (towards a1) their opposites in
+// the same order. Orthogonal first, diagonal last.
+#define NORTH_SHIFT 8
+#define EAST_SHIFT 1
+#define NORTH_EAST_SHIFT 9
+#define NORTH_WEST_SHIFT 7
+
+static FillKernel fillKernel = FILL_SCALAR;
+
+static bool isKernelSupported(const FillKernel kernel) {
+  switch (kernel) {
+  case FILL_SCALAR:
+    return true;
+#if defined(__x86_64__)
+  case FILL_AVX2:
+    return __builtin_cpu_supports("avx2");
+  case FILL_AVX512:
+    return __builtin_cpu_supports("avx512f");
+#else
+  case FILL_AVX2:
+  case FILL_AVX512:
+    return false;
+#endif
+  }
+
+  return false;
+}
+
+// Runs once when the library gets loaded, before any fill. AVX-512 has to be
+// asked for: a whole side takes as long as with AVX2 since the dependency
+// chain is as long, and on older Intel parts it lowers the clock.
+__attribute__((constructor)) static void initFillKernel(void) {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+#endif
+
+  if (isKernelSupported(FILL_AVX2)) {
+    fillKernel = FILL_AVX2;
+  }
+}
+
+FillKernel getFillKernel(void) { return fillKernel; }
+
+bool setFillKernel(const FillKernel kernel) {
+  if (!isKernelSupported(kernel)) {
+    return false;
+  }
+
+  fillKernel = kernel;
+  return true;
+}
+
+// Kogge-Stone occluded fill: the sliders spread over the empty squares in
+// log2(7) doubling steps, `propagator` keeping track of the runs of empty
+// squares they can cross. One more step reaches the blockers.
+static inline uint64_t fillLeft(uint64_t generator, const uint64_t empty,
+                                const uint8_t shift, const uint64_t noWrap) {
+  uint64_t propagator = empty & noWrap;
+
+  generator |= propagator & (generator << shift);
+  propagator &= propagator << shift;
+  generator |= propagator & (generator << (2 * shift));
+  propagator &= propagator << (2 * shift);
+  generator |= propagator & (generator << (4 * shift));
+
+  return (generator << shift) & noWrap;
+}
+
+static inline uint64_t fillRight(uint64_t generator, const uint64_t empty,
+                                 const uint8_t shift, const uint64_t noWrap) {
+  uint64_t propagator = empty & noWrap;
+
+  generator |= propagator & (generator >> shift);
+  propagator &= propagator >> shift;
+  generator |= propagator & (generator >> (2 * shift));
+  propagator &= propagator >> (2 * shift);
+  generator |= propagator & (generator >> (4 * shift));
+
+  return (generator >> shift) & noWrap;
+}
+
+static uint64_t fillScalar(const uint64_t orthogonal, const uint64_t diagonal,
+                           const uint64_t empty) {
+  return fillLeft(orthogonal, empty, NORTH_SHIFT, ALL_SQUARES) |
+         fillLeft(orthogonal, empty, EAST_SHIFT, NOT_FILE_A) |
+         fillLeft(diagonal, empty, NORTH_EAST_SHIFT, NOT_FILE_A) |
+         fillLeft(diagonal, empty, NORTH_WEST_SHIFT, NOT_FILE_H) |
+         fillRight(orthogonal, empty, NORTH_SHIFT, ALL_SQUARES) |
+         fillRight(orthogonal, empty, EAST_SHIFT, NOT_FILE_H) |
+         fillRight(diagonal, empty, NORTH_EAST_SHIFT, NOT_FILE_H) |
+         fillRight(diagonal, empty, NORTH_WEST_SHIFT, NOT_FILE_A);
+}
+
+#if defined(__x86_64__)
+#define AVX2_LANES 4
+#define AVX512_LANES 8
+
+// One direction per lane, each lane shifting by its own amount
+__attribute__((target("avx2"))) static inline __m256i
+fillLeftAvx2(__m256i generator, const __m256i empty, const __m256i shift,
+             const __m256i noWrap) {
+  const __m256i shift2 = _mm256_add_epi64(shift, shift);
+  const __m256i shift4 = _mm256_add_epi64(shift2, shift2);
+  __m256i propagator = _mm256_and_si256(empty, noWrap);
+
+  generator = _mm256_or_si256(
+      generator,
+      _mm256_and_si256(propagator, _mm256_sllv_epi64(generator, shift)));
+  propagator =
+      _mm256_and_si256(propagator, _mm256_sllv_epi64(propagator, shift));
+  generator = _mm256_or_si256(
+      generator,
+      _mm256_and_si256(propagator, _mm256_sllv_epi64(generator, shift2)));
+  propagator =
+      _mm256_and_si256(propagator, _mm256_sllv_epi64(propagator, shift2));
+  generator = _mm256_or_si256(
+      generator,
+      _mm256_and_si256(propagator, _mm256_sllv_epi64(generator, shift4)));
+
+  return _mm256_and_si256(_mm256_sllv_epi64(generator, shift), noWrap);
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+fillRightAvx2(__m256i generator, const __m256i empty, const __m256i shift,
+              const __m256i noWrap) {
+  const __m256i shift2 = _mm256_add_epi64(shift, shift);
+  const __m256i shift4 = _mm256_add_epi64(shift2, shift2);
+  __m256i propagator = _mm256_and_si256(empty, noWrap);
+
+  generator = _mm256_or_si256(
+      generator,
+      _mm256_and_si256(propagator, _mm256_srlv_epi64(generator, shift)));
+  propagator =
+      _mm256_and_si256(propagator, _mm256_srlv_epi64(propagator, shift));
+  generator = _mm256_or_si256(
+      generator,
+      _mm256_and_si256(propagator, _mm256_srlv_epi64(generator, shift2)));
+  propagator =
+      _mm256_and_si256(propagator, _mm256_srlv_epi64(propagator, shift2));
+  generator = _mm256_or_si256(
+      generator,
+      _mm256_and_si256(propagator, _mm256_srlv_epi64(generator, shift4)));
+
+  return _mm256_and_si256(_mm256_srlv_epi64(generator, shift), noWrap);
+}
+
+// The 4 left directions in one vector and the 4 right ones in another
+__attribute__((target("avx2"))) static uint64_t
+fillAvx2(const uint64_t orthogonal, const uint64_t diagonal,
+         const uint64_t empty) {
+  const __m256i generator = _mm256_set_epi64x(
+      (long long)diagonal, (long long)diagonal, (long long)orthogonal,
+      (long long)orthogonal);
+  const __m256i shift = _mm256_set_epi64x(NORTH_WEST_SHIFT, NORTH_EAST_SHIFT,
+                                          EAST_SHIFT, NORTH_SHIFT);
+  const __m256i emptyVector = _mm256_set1_epi64x((long long)empty);
+
+  const __m256i left = fillLeftAvx2(
+      generator, emptyVector, shift,
+      _mm256_set_epi64x((long long)NOT_FILE_H, (long long)NOT_FILE_A,
+                        (long long)NOT_FILE_A, (long long)ALL_SQUARES));
+  const __m256i right = fillRightAvx2(
+      generator, emptyVector, shift,
+      _mm256_set_epi64x((long long)NOT_FILE_A, (long long)NOT_FILE_H,
+                        (long long)NOT_FILE_H, (long long)ALL_SQUARES));
+
+  const __m256i both = _mm256_or_si256(left, right);
+  const __m128i half = _mm_or_si128(_mm256_castsi256_si128(both),
+                                    _mm256_extracti128_si256(both, 1));
+  return (uint64_t)(_mm_cvtsi128_si64(half) | _mm_extract_epi64(half, 1));
+}
+
+// One piece per lane, all lanes going the same direction
+#define FILL_PIECES_AVX2(shiftOp, generator, empty, shift, noWrap)            \
+  do {                                                                         \
+    __m256i propagator = _mm256_and_si256(empty, noWrap);                      \
+    generator = _mm256_or_si256(                                               \
+        generator,                                                             \
+        _mm256_and_si256(propagator, shiftOp(generator, shift)));              \
+    propagator = _mm256_and_si256(propagator, shiftOp(propagator, shift));     \
+    generator = _mm256_or_si256(                                               \
+        generator,                                                             \
+        _mm256_and_si256(propagator, shiftOp(generator, 2 * (shift))));        \
+    propagator =                                                               \
+        _mm256_and_si256(propagator, shiftOp(propagator, 2 * (shift)));        \
+    generator = _mm256_or_si256(                                               \
+        generator,                                                             \
+        _mm256_and_si256(propagator, shiftOp(generator, 4 * (shift))));        \
+    generator = _mm256_and_si256(shiftOp(generator, shift), noWrap);           \
+  } while (0)
+
+__attribute__((target("avx2"))) static void
+fillPiecesAvx2(const uint64_t *orthogonal, const uint64_t *diagonal,
+               const uint64_t empty, uint64_t *attacks) {
+  const __m256i orthogonalVector =
+      _mm256_loadu_si256((const __m256i *)orthogonal);
+  const __m256i diagonalVector = _mm256_loadu_si256((const __m256i *)diagonal);
+  const __m256i emptyVector = _mm256_set1_epi64x((long long)empty);
+  const __m256i all = _mm256_set1_epi64x((long long)ALL_SQUARES);
+  const __m256i notFileA = _mm256_set1_epi64x((long long)NOT_FILE_A);
+  const __m256i notFileH = _mm256_set1_epi64x((long long)NOT_FILE_H);
+
+  __m256i north = orthogonalVector, south = orthogonalVector;
+  __m256i east = orthogonalVector, west = orthogonalVector;
+  __m256i northEast = diagonalVector, southWest = diagonalVector;
+  __m256i northWest = diagonalVector, southEast = diagonalVector;
+
+  FILL_PIECES_AVX2(_mm256_slli_epi64, north, emptyVector, NORTH_SHIFT, all);
+  FILL_PIECES_AVX2(_mm256_srli_epi64, south, emptyVector, NORTH_SHIFT, all);
+  FILL_PIECES_AVX2(_mm256_slli_epi64, east, emptyVector, EAST_SHIFT, notFileA);
+  FILL_PIECES_AVX2(_mm256_srli_epi64, west, emptyVector, EAST_SHIFT, notFileH);
+  FILL_PIECES_AVX2(_mm256_slli_epi64, northEast, emptyVector, NORTH_EAST_SHIFT,
+                   notFileA);
+  FILL_PIECES_AVX2(_mm256_srli_epi64, southWest, emptyVector, NORTH_EAST_SHIFT,
+                   notFileH);
+  FILL_PIECES_AVX2(_mm256_slli_epi64, northWest, emptyVector, NORTH_WEST_SHIFT,
+                   notFileH);
+  FILL_PIECES_AVX2(_mm256_srli_epi64, southEast, emptyVector, NORTH_WEST_SHIFT,
+                   notFileA);
+
+  const __m256i orthogonalAttacks = _mm256_or_si256(
+      _mm256_or_si256(north, south), _mm256_or_si256(east, west));
+  const __m256i diagonalAttacks =
+      _mm256_or_si256(_mm256_or_si256(northEast, southWest),
+                      _mm256_or_si256(northWest, southEast));
+  _mm256_storeu_si256((__m256i *)attacks,
+                      _mm256_or_si256(orthogonalAttacks, diagonalAttacks));
+}
+
+// Left directions in the low 4 lanes, right ones in the high 4
+__attribute__((target("avx512f"))) static inline __m512i
+shiftAvx512(const __m512i bitboards, const __m512i shift) {
+  return _mm512_mask_srlv_epi64(_mm512_sllv_epi64(bitboards, shift), 0xF0,
+                                bitboards, shift);
+}
+
+__attribute__((target("avx512f"))) static uint64_t
+fillAvx512(const uint64_t orthogonal, const uint64_t diagonal,
+           const uint64_t empty) {
+  const __m512i shift = _mm512_set_epi64(
+      NORTH_WEST_SHIFT, NORTH_EAST_SHIFT, EAST_SHIFT, NORTH_SHIFT,
+      NORTH_WEST_SHIFT, NORTH_EAST_SHIFT, EAST_SHIFT, NORTH_SHIFT);
+  const __m512i shift2 = _mm512_add_epi64(shift, shift);
+  const __m512i shift4 = _mm512_add_epi64(shift2, shift2);
+  const __m512i noWrap = _mm512_set_epi64(
+      (long long)NOT_FILE_A, (long long)NOT_FILE_H, (long long)NOT_FILE_H,
+      (long long)ALL_SQUARES, (long long)NOT_FILE_H, (long long)NOT_FILE_A,
+      (long long)NOT_FILE_A, (long long)ALL_SQUARES);
+  __m512i generator = _mm512_set_epi64(
+      (long long)diagonal, (long long)diagonal, (long long)orthogonal,
+      (long long)orthogonal, (long long)diagonal, (long long)diagonal,
+      (long long)orthogonal, (long long)orthogonal);
+  __m512i propagator =
+      _mm512_and_si512(_mm512_set1_epi64((long long)empty), noWrap);
+
+  generator = _mm512_or_si512(
+      generator, _mm512_and_si512(propagator, shiftAvx512(generator, shift)));
+  propagator = _mm512_and_si512(propagator, shiftAvx512(propagator, shift));
+  generator = _mm512_or_si512(
+      generator, _mm512_and_si512(propagator, shiftAvx512(generator, shift2)));
+  propagator = _mm512_and_si512(propagator, shiftAvx512(propagator, shift2));
+  generator = _mm512_or_si512(
+      generator, _mm512_and_si512(propagator, shiftAvx512(generator, shift4)));
+
+  return (uint64_t)_mm512_reduce_or_epi64(
+      _mm512_and_si512(shiftAvx512(generator, shift), noWrap));
+}
+
+#define FILL_PIECES_AVX512(shiftOp, generator, empty, shift, noWrap)          \
+  do {                                                                         \
+    __m512i propagator = _mm512_and_si512(empty, noWrap);                      \
+    generator = _mm512_or_si512(                                               \
+        generator,                                                             \
+        _mm512_and_si512(propagator, shiftOp(generator, shift)));              \
+    propagator = _mm512_and_si512(propagator, shiftOp(propagator, shift));     \
+    generator = _mm512_or_si512(                                               \
+        generator,                                                             \
+        _mm512_and_si512(propagator, shiftOp(generator, 2 * (shift))));        \
+    propagator =                                                               \
+        _mm512_and_si512(propagator, shiftOp(propagator, 2 * (shift)));        \
+    generator = _mm512_or_si512(                                               \
+        generator,                                                             \
+        _mm512_and_si512(propagator, shiftOp(generator, 4 * (shift))));        \
+    generator = _mm512_and_si512(shiftOp(generator, shift), noWrap);           \
+  } while (0)
+
+__attribute__((target("avx512f"))) static void
+fillPiecesAvx512(const uint64_t *orthogonal, const uint64_t *diagonal,
+                 const uint64_t empty, uint64_t *attacks) {
+  const __m512i orthogonalVector = _mm512_loadu_si512(orthogonal);
+  const __m512i diagonalVector = _mm512_loadu_si512(diagonal);
+  const __m512i emptyVector = _mm512_set1_epi64((long long)empty);
+  const __m512i all = _mm512_set1_epi64((long long)ALL_SQUARES);
+  const __m512i notFileA = _mm512_set1_epi64((long long)NOT_FILE_A);
+  const __m512i notFileH = _mm512_set1_epi64((long long)NOT_FILE_H);
+
+  __m512i north = orthogonalVector, south = orthogonalVector;
+  __m512i east = orthogonalVector, west = orthogonalVector;
+  __m512i northEast = diagonalVector, southWest = diagonalVector;
+  __m512i northWest = diagonalVector, southEast = diagonalVector;
+
+  FILL_PIECES_AVX512(_mm512_slli_epi64, north, emptyVector, NORTH_SHIFT, all);
+  FILL_PIECES_AVX512(_mm512_srli_epi64, south, emptyVector, NORTH_SHIFT, all);
+  FILL_PIECES_AVX512(_mm512_slli_epi64, east, emptyVector, EAST_SHIFT,
+                     notFileA);
+  FILL_PIECES_AVX512(_mm512_srli_epi64, west, emptyVector, EAST_SHIFT,
+                     notFileH);
+  FILL_PIECES_AVX512(_mm512_slli_epi64, northEast, emptyVector,
+                     NORTH_EAST_SHIFT, notFileA);
+  FILL_PIECES_AVX512(_mm512_srli_epi64, southWest, emptyVector,
+                     NORTH_EAST_SHIFT, notFileH);
+  FILL_PIECES_AVX512(_mm512_slli_epi64, northWest, emptyVector,
+                     NORTH_WEST_SHIFT, notFileH);
+  FILL_PIECES_AVX512(_mm512_srli_epi64, southEast, emptyVector,
+                     NORTH_WEST_SHIFT, notFileA);
+
+  const __m512i orthogonalAttacks = _mm512_or_si512(
+      _mm512_or_si512(north, south), _mm512_or_si512(east, west));
+  const __m512i diagonalAttacks =
+      _mm512_or_si512(_mm512_or_si512(northEast, southWest),
+                      _mm512_or_si512(northWest, southEast));
+  _mm512_storeu_si512(attacks,
+                      _mm512_or_si512(orthogonalAttacks, diagonalAttacks));
+}
+#endif
+
+uint64_t fillSliderAttacks(const uint64_t orthogonal, const uint64_t diagonal,
+                           const uint64_t occupancy) {
+  switch (fillKernel) {
+#if defined(__x86_64__)
+  case FILL_AVX512:
+    return fillAvx512(orthogonal, diagonal, ~occupancy);
+  case FILL_AVX2:
+    return fillAvx2(orthogonal, diagonal, ~occupancy);
+#endif
+  default:
+    return fillScalar(orthogonal, diagonal, ~occupancy);
+  }
+}
+
+void fillSliderAttacksPerPiece(const uint64_t *orthogonal,
+                               const uint64_t *diagonal, const size_t count,
+                               const uint64_t occupancy, uint64_t *attacks) {
+#ifndef NDEBUG
+  assert((orthogonal != NULL && diagonal != NULL && attacks != NULL) ||
+         count == 0);
+#endif /* ifndef NDEBUG */
+
+  const uint64_t empty = ~occupancy;
+  size_t index = 0;
+
+#if defined(__x86_64__)
+  if (fillKernel == FILL_AVX512) {
+    for (; index + AVX512_LANES <= count; index += AVX512_LANES) {
+      fillPiecesAvx512(&orthogonal[index], &diagonal[index], empty,
+                       &attacks[index]);
+    }
+  }
+  if (fillKernel >= FILL_AVX2) {
+    for (; index + AVX2_LANES <= count; index += AVX2_LANES) {
+      fillPiecesAvx2(&orthogonal[index], &diagonal[index], empty,
+                     &attacks[index]);
+    }
+  }
+#endif
+
+  // Whatever doesn't fill a whole vector
+  for (; index < count; index++) {
+    attacks[index] = fillScalar(orthogonal[index], diagonal[index], empty);
+  }
+}
+
+uint64_t getSliderAttacksBySide(const Position *position, const Color color) {
+#ifndef NDEBUG
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  const uint64_t *pieces = position->pieces[color];
+
+  return fillSliderAttacks(pieces[ROOK] | pieces[QUEEN],
+                           pieces[BISHOP] | pieces[QUEEN],
+                           getOccupancy(position));
+}
+
+uint8_t getSliderAttacksPerPiece(const Position *position, const Color color,
+                                 int8_t squares[MAX_SLIDERS],
+                                 uint64_t attacks[MAX_SLIDERS]) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(squares != NULL);
+  assert(attacks != NULL);
+#endif /* ifndef NDEBUG */
+
+  const uint64_t *pieces = position->pieces[color];
+  const uint64_t orthogonalSliders = pieces[ROOK] | pieces[QUEEN];
+  const uint64_t diagonalSliders = pieces[BISHOP] | pieces[QUEEN];
+  uint64_t orthogonal[MAX_SLIDERS];
+  uint64_t diagonal[MAX_SLIDERS];
+  uint8_t count = 0;
+
+  for (uint64_t sliders = orthogonalSliders | diagonalSliders; sliders;
+       sliders &= sliders - 1) {
+#ifndef NDEBUG
+    assert(count < MAX_SLIDERS);
+#endif /* ifndef NDEBUG */
+
+    const uint64_t slider = sliders & -sliders;
+
+    squares[count] = (int8_t)__builtin_ctzll(sliders);
+    orthogonal[count] = slider & orthogonalSliders;
+    diagonal[count] = slider & diagonalSliders;
+    count++;
+  }
+
+  fillSliderAttacksPerPiece(orthogonal, diagonal, count,
+                            getOccupancy(position), attacks);
+  return count;
+}
@@ -0,0 +1,180 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "hashtable.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Relaxed atomics: no ordering is needed since the XOR check catches torn
+// entries, they only keep the compiler from splitting or caching the accesses
+static inline uint64_t loadWord(const uint64_t *word) {
+  return __atomic_load_n(word, __ATOMIC_RELAXED);
+}
+
+static inline void storeWord(uint64_t *word, const uint64_t value) {
+  __atomic_store_n(word, value, __ATOMIC_RELAXED);
+}
+
+bool initTable(TranspositionTable *table, const size_t megabytes,
+               const ReplacementPolicy policy) {
+#ifndef NDEBUG
+  assert(table != NULL);
+#endif /* ifndef NDEBUG */
+
+  const size_t bytes = megabytes << 20;
+  uint64_t buckets = 1;
+  while ((buckets << 1) * sizeof(TableBucket) <= bytes) {
+    buckets <<= 1;
+  }
+
+  void *memory = NULL;
+  if (posix_memalign(&memory, CACHE_LINE_SIZE,
+                     buckets * sizeof(TableBucket)) != 0) {
+    return false;
+  }
+
+  table->buckets = memory;
+  table->mask = buckets - 1;
+  table->policy = policy;
+  clearTable(table);
+
+  return true;
+}
+
+void freeTable(TranspositionTable *table) {
+#ifndef NDEBUG
+  assert(table != NULL);
+#endif /* ifndef NDEBUG */
+
+  free(table->buckets);
+  table->buckets = NULL;
+  table->mask = 0;
+}
+
+void clearTable(TranspositionTable *table) {
+#ifndef NDEBUG
+  assert(table != NULL);
+#endif /* ifndef NDEBUG */
+
+  memset(table->buckets, 0, (table->mask + 1) * sizeof(TableBucket));
+  table->generation = 0;
+}
+
+void ageTable(TranspositionTable *table) {
+#ifndef NDEBUG
+  assert(table != NULL);
+#endif /* ifndef NDEBUG */
+
+  table->generation++;
+}
+
+bool probeTable(const TranspositionTable *table, const uint64_t hash,
+                uint64_t *data, TableStats *stats) {
+#ifndef NDEBUG
+  assert(table != NULL);
+  assert(data != NULL);
+#endif /* ifndef NDEBUG */
+
+  TableEntry *entries = getBucket(table, hash)->entries;
+
+  if (stats) {
+    stats->probes++;
+  }
+
+  for (uint8_t entryIndex = 0; entryIndex < BUCKET_ENTRIES; entryIndex++) {
+    const uint64_t entryData = loadWord(&entries[entryIndex].data);
+    const uint64_t entryKey = loadWord(&entries[entryIndex].key);
+
+    if (entryData != 0 && (entryKey ^ entryData) == hash) {
+      *data = entryData;
+      if (stats) {
+        stats->hits++;
+      }
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Lower scores get evicted first
+static int16_t getReplacementScore(const TranspositionTable *table,
+                                   const uint64_t data) {
+  if (data == 0) {
+    return INT16_MIN; // Empty slots always go first
+  }
+
+  if (table->policy == REPLACE_SHALLOWEST) {
+    return getEntryDepth(data);
+  }
+
+  const uint8_t age = (uint8_t)(table->generation - getEntryGeneration(data));
+
+  // Each generation of age weighs as much as 8 plies of depth
+  return (int16_t)(getEntryDepth(data) - (8 * age));
+}
+
+void storeTable(TranspositionTable *table, const uint64_t hash,
+                const uint8_t depth, const uint64_t payload,
+                TableStats *stats) {
+#ifndef NDEBUG
+  assert(table != NULL);
+#endif /* ifndef NDEBUG */
+
+  TableEntry *entries = getBucket(table, hash)->entries;
+  TableEntry *victim = &entries[0];
+  int16_t victimScore = INT16_MAX;
+
+  for (uint8_t entryIndex = 0; entryIndex < BUCKET_ENTRIES; entryIndex++) {
+    TableEntry *entry = &entries[entryIndex];
+    const uint64_t entryData = loadWord(&entry->data);
+
+    // Same position: refresh it in place instead of keeping two copies
+    if ((loadWord(&entry->key) ^ entryData) == hash) {
+      victim = entry;
+      victimScore = INT16_MIN;
+      break;
+    }
+
+    const int16_t score = getReplacementScore(table, entryData);
+    if (score < victimScore) {
+      victim = entry;
+      victimScore = score;
+    }
+  }
+
+  const uint64_t data = (uint64_t)depth | ((uint64_t)table->generation << 8) |
+                        (payload << (64 - TABLE_PAYLOAD_BITS));
+
+  if (stats) {
+    stats->stores++;
+    if (victimScore != INT16_MIN) {
+      stats->evictions++;
+    }
+  }
+
+  storeWord(&victim->key, hash ^ data);
+  storeWord(&victim->data, data);
+}
+
+uint16_t getTableUsage(const TranspositionTable *table) {
+#ifndef NDEBUG
+  assert(table != NULL);
+#endif /* ifndef NDEBUG */
+
+  const uint64_t sampledBuckets =
+      (table->mask + 1) < 250 ? (table->mask + 1) : 250;
+  uint64_t used = 0;
+
+  for (uint64_t bucketIndex = 0; bucketIndex < sampledBuckets; bucketIndex++) {
+    for (uint8_t entryIndex = 0; entryIndex < BUCKET_ENTRIES; entryIndex++) {
+      const uint64_t data =
+          loadWord(&table->buckets[bucketIndex].entries[entryIndex].data);
+
+      used += data != 0 && getEntryGeneration(data) == table->generation;
+    }
+  }
+
+  return (uint16_t)((used * 1000) / (sampledBuckets * BUCKET_ENTRIES));
+}
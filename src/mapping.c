@@ -0,0 +1,56 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "mapping.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool mapFile(const char *path, const char **data, size_t *size) {
+#ifndef NDEBUG
+  assert(path != NULL);
+  assert(data != NULL);
+  assert(size != NULL);
+#endif /* ifndef NDEBUG */
+
+  *data = NULL;
+  *size = 0;
+
+  const int descriptor = open(path, O_RDONLY);
+  if (descriptor < 0) {
+    return false;
+  }
+
+  struct stat status;
+  if (fstat(descriptor, &status) != 0) {
+    close(descriptor);
+    return false;
+  }
+
+  if (status.st_size > 0) {
+    void *mapping = mmap(NULL, (size_t)status.st_size, PROT_READ,
+                         MAP_PRIVATE, descriptor, 0);
+    if (mapping == MAP_FAILED) {
+      close(descriptor);
+      return false;
+    }
+
+    (void)posix_madvise(mapping, (size_t)status.st_size,
+                        POSIX_MADV_SEQUENTIAL);
+    *data = mapping;
+    *size = (size_t)status.st_size;
+  }
+
+  // The mapping outlives the descriptor
+  close(descriptor);
+  return true;
+}
+
+void unmapFile(const char *data, const size_t size) {
+  if (data) {
+    munmap((void *)data, size);
+  }
+}
@@ -0,0 +1,430 @@
+#include "mobility.h"
+#include "generators.h"
+#include "position.h"
+#include "sysifus.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lookups of one kind a position can need: one per slider of either color,
+// which stand on distinct squares, and two from the king
+#define LANE_LOOKUPS (BOARD_AREA + 2)
+
+// Ranks pawns promote on, for both colors
+static const uint64_t LAST_RANKS = 0xFF000000000000FF;
+
+// The castles generateLegalMoves knows, in CastlingRight order
+typedef struct {
+  CastlingRight right;
+  int8_t king, rook;
+  uint64_t empty; // Squares between the king and the rook
+  uint64_t safe;  // Squares the king crosses or lands on
+} CastlePath;
+
+static const CastlePath CASTLE_PATHS[] = {
+    {WHITE_KINGSIDE, 4, 7, 0x60, 0x60},
+    {WHITE_QUEENSIDE, 4, 0, 0xE, 0xC},
+    {BLACK_KINGSIDE, 60, 63, 0x60ULL << 56, 0x60ULL << 56},
+    {BLACK_QUEENSIDE, 60, 56, 0xEULL << 56, 0xCULL << 56},
+};
+
+// Sliding lookups of one kind for a whole group of positions, in the order
+// they got queued. The loop making them has no branch and no lookup waits on
+// another, so the CPU keeps several misses in flight at once.
+typedef struct {
+  int8_t squares[MOBILITY_LANES * LANE_LOOKUPS];
+  uint64_t bits[MOBILITY_LANES * LANE_LOOKUPS]; // Occupancy in, attacks out
+  uint16_t count;
+} Lookups;
+
+// A position of the group, with where its lookups start. Each kind gets the
+// friendly sliders' in square order, then for the legal moves the enemy
+// sliders' without the friendly king and the king's own two.
+typedef struct {
+  uint64_t friendly, enemy;
+  uint64_t ours[PIECE_TYPES], theirs[PIECE_TYPES];
+  Color us;
+  uint8_t castlingRights;
+  int8_t enPassant;
+  uint16_t diagonals, orthogonals;
+} Lane;
+
+typedef struct {
+  uint64_t pinned, rays;
+} LanePins;
+
+static inline void queueLookups(Lookups *lookups, uint64_t sliders,
+                                const uint64_t occupancy) {
+  for (; sliders; sliders &= sliders - 1) {
+    lookups->squares[lookups->count] = (int8_t)__builtin_ctzll(sliders);
+    lookups->bits[lookups->count++] = occupancy;
+  }
+}
+
+static void loadLane(const PositionBatch *batch, const size_t index,
+                     const bool legal, Lane *lane, Lookups *diagonal,
+                     Lookups *orthogonal) {
+  lane->friendly = batch->friendly[index];
+  lane->enemy = batch->enemy[index];
+  for (Piece type = PAWN; type < PIECE_TYPES; type++) {
+    lane->ours[type] = batch->pieces[type][index] & lane->friendly;
+    lane->theirs[type] = batch->pieces[type][index] & lane->enemy;
+  }
+  lane->us = (Color)batch->sideToMove[index];
+  lane->castlingRights =
+      batch->castlingRights ? batch->castlingRights[index] : 0;
+  lane->enPassant = batch->enPassant ? batch->enPassant[index] : NO_SQUARE;
+  lane->diagonals = diagonal->count;
+  lane->orthogonals = orthogonal->count;
+
+  const uint64_t occupancy = lane->friendly | lane->enemy;
+  const uint64_t *ours = lane->ours, *theirs = lane->theirs;
+
+  queueLookups(diagonal, ours[BISHOP] | ours[QUEEN], occupancy);
+  queueLookups(orthogonal, ours[ROOK] | ours[QUEEN], occupancy);
+  if (!legal) {
+    return;
+  }
+
+#ifndef NDEBUG
+  assert(ours[KING] != 0);
+#endif /* ifndef NDEBUG */
+
+  // The king is lifted off the board so it can't step back along the ray of
+  // the slider checking it
+  const uint64_t king = ours[KING] & -ours[KING];
+  queueLookups(diagonal, theirs[BISHOP] | theirs[QUEEN], occupancy ^ king);
+  queueLookups(orthogonal, theirs[ROOK] | theirs[QUEEN], occupancy ^ king);
+  // Checkers over the whole board, snipers looking through enemy pieces only
+  queueLookups(diagonal, king, occupancy);
+  queueLookups(diagonal, king, lane->enemy);
+  queueLookups(orthogonal, king, occupancy);
+  queueLookups(orthogonal, king, lane->enemy);
+}
+
+static void lookUpDiagonals(Lookups *lookups) {
+  for (uint16_t index = 0; index < lookups->count; index++) {
+    lookups->bits[index] =
+        getDiagonalAttacks(lookups->squares[index], lookups->bits[index]);
+  }
+}
+
+static void lookUpOrthogonals(Lookups *lookups) {
+  for (uint16_t index = 0; index < lookups->count; index++) {
+    lookups->bits[index] =
+        getOrthogonalAttacks(lookups->squares[index], lookups->bits[index]);
+  }
+}
+
+// Squares strictly between a king and a slider on one of its lines of the
+// given kind
+static inline uint64_t getRayBetween(const int8_t king, const int8_t slider,
+                                     const bool diagonal) {
+  return diagonal ? getDiagonalAttacks(king, 1ULL << slider) &
+                        getDiagonalAttacks(slider, 1ULL << king)
+                  : getOrthogonalAttacks(king, 1ULL << slider) &
+                        getOrthogonalAttacks(slider, 1ULL << king);
+}
+
+// Same pins as generateLegalMoves finds. Snipers are rare, their rays get
+// looked up on the spot.
+static LanePins findPins(const int8_t king, uint64_t snipers,
+                         const uint64_t friendly, const uint64_t occupancy,
+                         const bool diagonal) {
+  LanePins pins = {0, 0};
+
+  for (; snipers; snipers &= snipers - 1) {
+    const int8_t sniper = (int8_t)__builtin_ctzll(snipers);
+    const uint64_t ray = getRayBetween(king, sniper, diagonal);
+    const uint64_t blockers = ray & occupancy;
+
+    if ((blockers & friendly) && !(blockers & (blockers - 1))) {
+      pins.pinned |= blockers;
+      pins.rays |= ray | (1ULL << sniper);
+    }
+  }
+
+  return pins;
+}
+
+// Moves generatePawnMoves would append, four for each promotion
+static inline uint16_t countPawnMoves(const Color us, const uint64_t pawns,
+                                      const uint64_t empty,
+                                      const uint64_t enemy,
+                                      const uint64_t targetMask) {
+  const uint64_t singlePushes = shiftForward(pawns, us) & empty;
+  const uint64_t doublePushes =
+      shiftForward(singlePushes & (us == WHITE ? RANK_3 : RANK_6), us) &
+      empty & targetMask;
+  const uint64_t leftCaptures =
+      (shiftForward(pawns & NOT_FILE_A, us) >> 1) & enemy & targetMask;
+  const uint64_t rightCaptures =
+      (shiftForward(pawns & NOT_FILE_H, us) << 1) & enemy & targetMask;
+  const uint64_t pushes = singlePushes & targetMask;
+
+  return (uint16_t)(__builtin_popcountll(pushes) +
+                    __builtin_popcountll(doublePushes) +
+                    __builtin_popcountll(leftCaptures) +
+                    __builtin_popcountll(rightCaptures) +
+                    3 * (__builtin_popcountll(pushes & LAST_RANKS) +
+                         __builtin_popcountll(leftCaptures & LAST_RANKS) +
+                         __builtin_popcountll(rightCaptures & LAST_RANKS)));
+}
+
+// Whether taking en passant from `from` leaves the king safe, with the
+// king's attackers looked up again on the board after the capture
+static bool isLaneEnPassantLegal(const Lane *lane, const int8_t from,
+                                 const int8_t king) {
+  const uint64_t toBit = 1ULL << lane->enPassant;
+  const uint64_t capturedBit = shiftForward(toBit, (Color)!lane->us);
+  const uint64_t occupancy =
+      ((lane->friendly | lane->enemy) ^ (1ULL << from) ^ capturedBit) | toBit;
+  const uint64_t kingBit = 1ULL << king;
+  const uint64_t *theirs = lane->theirs;
+
+  return !((getPawnCapturesOf(kingBit, lane->us) & theirs[PAWN] &
+            ~capturedBit) |
+           (getKnightAttacksOf(kingBit) & theirs[KNIGHT]) |
+           (getKingAttacksOf(kingBit) & theirs[KING]) |
+           (getDiagonalAttacks(king, occupancy) &
+            (theirs[BISHOP] | theirs[QUEEN])) |
+           (getOrthogonalAttacks(king, occupancy) &
+            (theirs[ROOK] | theirs[QUEEN])));
+}
+
+// Same steps as generateLegalMoves, with popcounts instead of move lists
+static uint16_t countLegalMoves(const Lane *lane, const uint64_t *diagonal,
+                                const uint64_t *orthogonal) {
+  const Color us = lane->us;
+  const uint64_t friendly = lane->friendly, enemy = lane->enemy;
+  const uint64_t occupancy = friendly | enemy;
+  const uint64_t *ours = lane->ours, *theirs = lane->theirs;
+  const uint64_t theirDiagonals = theirs[BISHOP] | theirs[QUEEN];
+  const uint64_t theirOrthogonals = theirs[ROOK] | theirs[QUEEN];
+  const int8_t king = (int8_t)__builtin_ctzll(ours[KING]);
+  const uint64_t kingBit = 1ULL << king;
+
+  // The enemy attacks come first in each kind's lookups, the king's last
+  const uint8_t ourDiagonalCount =
+      (uint8_t)__builtin_popcountll(ours[BISHOP] | ours[QUEEN]);
+  const uint8_t ourOrthogonalCount =
+      (uint8_t)__builtin_popcountll(ours[ROOK] | ours[QUEEN]);
+  const uint8_t theirDiagonalCount =
+      (uint8_t)__builtin_popcountll(theirDiagonals);
+  const uint8_t theirOrthogonalCount =
+      (uint8_t)__builtin_popcountll(theirOrthogonals);
+  uint64_t attacked = getPawnCapturesOf(theirs[PAWN], (Color)!us) |
+                      getKnightAttacksOf(theirs[KNIGHT]) |
+                      getKingAttacksOf(theirs[KING]);
+
+  for (uint8_t slider = 0; slider < theirDiagonalCount; slider++) {
+    attacked |= diagonal[ourDiagonalCount + slider];
+  }
+  for (uint8_t slider = 0; slider < theirOrthogonalCount; slider++) {
+    attacked |= orthogonal[ourOrthogonalCount + slider];
+  }
+
+  const uint64_t *kingDiagonals = &diagonal[ourDiagonalCount +
+                                            theirDiagonalCount];
+  const uint64_t *kingOrthogonals =
+      &orthogonal[ourOrthogonalCount + theirOrthogonalCount];
+  uint16_t count = (uint16_t)__builtin_popcountll(
+      getKingAttacksOf(kingBit) & ~friendly & ~attacked);
+
+  const uint64_t checkers =
+      (getPawnCapturesOf(kingBit, us) & theirs[PAWN]) |
+      (getKnightAttacksOf(kingBit) & theirs[KNIGHT]) |
+      (getKingAttacksOf(kingBit) & theirs[KING]) |
+      (kingDiagonals[0] & theirDiagonals) |
+      (kingOrthogonals[0] & theirOrthogonals);
+
+  // Only the king can get out of a double check
+  if (checkers & (checkers - 1)) {
+    return count;
+  }
+
+  if (!checkers && lane->castlingRights) {
+    for (uint8_t side = 0; side < 2; side++) {
+      const CastlePath *path = &CASTLE_PATHS[2 * us + side];
+
+      count += (lane->castlingRights & path->right) &&
+               (ours[KING] & (1ULL << path->king)) &&
+               (ours[ROOK] & (1ULL << path->rook)) &&
+               !(occupancy & path->empty) &&
+               !(attacked & (path->safe | (1ULL << path->king)));
+    }
+  }
+  if (lane->enPassant != NO_SQUARE) {
+    for (uint64_t capturers =
+             getPawnCapturesOf(1ULL << lane->enPassant, (Color)!us) &
+             ours[PAWN];
+         capturers; capturers &= capturers - 1) {
+      count += isLaneEnPassantLegal(lane, (int8_t)__builtin_ctzll(capturers),
+                                    king);
+    }
+  }
+
+  // Single check: the rest of the moves have to capture the checker or block
+  // its ray, which only a slider has
+  uint64_t checkMask = ~0ULL;
+  if (checkers) {
+    const int8_t checker = (int8_t)__builtin_ctzll(checkers);
+
+    checkMask = checkers;
+    if (checkers & (theirDiagonals | theirOrthogonals)) {
+      checkMask |= getRayBetween(king, checker,
+                                 (kingDiagonals[0] & checkers) != 0);
+    }
+  }
+  const uint64_t targets = ~friendly & checkMask;
+
+  const LanePins diagonalPins =
+      findPins(king, kingDiagonals[1] & theirDiagonals, friendly, occupancy,
+               true);
+  const LanePins orthogonalPins =
+      findPins(king, kingOrthogonals[1] & theirOrthogonals, friendly,
+               occupancy, false);
+  const uint64_t pinned = diagonalPins.pinned | orthogonalPins.pinned;
+
+  count += countPawnMoves(us, ours[PAWN] & ~pinned, ~occupancy, enemy,
+                          checkMask);
+  count += countPawnMoves(us, ours[PAWN] & orthogonalPins.pinned,
+                          ~occupancy, 0, checkMask & orthogonalPins.rays);
+  count += countPawnMoves(us, ours[PAWN] & diagonalPins.pinned, 0, enemy,
+                          checkMask & diagonalPins.rays);
+
+  for (uint64_t knights = ours[KNIGHT] & ~pinned; knights;
+       knights &= knights - 1) {
+    count += (uint16_t)__builtin_popcountll(
+        getKnightAttacksOf(knights & -knights) & targets);
+  }
+
+  // A slider pinned on a ray of the other kind has no moves at all, and one
+  // pinned on a ray of its own kind can't leave the pin rays
+  uint8_t slider = 0;
+  for (uint64_t sliders = ours[BISHOP] | ours[QUEEN]; sliders;
+       sliders &= sliders - 1, slider++) {
+    const uint64_t bit = sliders & -sliders;
+
+    if (!(orthogonalPins.pinned & bit)) {
+      count += (uint16_t)__builtin_popcountll(
+          diagonal[slider] & targets &
+          ((diagonalPins.pinned & bit) ? diagonalPins.rays : ~0ULL));
+    }
+  }
+  slider = 0;
+  for (uint64_t sliders = ours[ROOK] | ours[QUEEN]; sliders;
+       sliders &= sliders - 1, slider++) {
+    const uint64_t bit = sliders & -sliders;
+
+    if (!(diagonalPins.pinned & bit)) {
+      count += (uint16_t)__builtin_popcountll(
+          orthogonal[slider] & targets &
+          ((orthogonalPins.pinned & bit) ? orthogonalPins.rays : ~0ULL));
+    }
+  }
+
+  return count;
+}
+
+// Pseudo-legal targets and attacks of the side to move, out of the friendly
+// sliders' lookups
+static void countLaneMobility(const Lane *lane, const uint64_t *diagonal,
+                              const uint64_t *orthogonal,
+                              const MobilityBatch *results,
+                              const size_t index) {
+  const Color us = lane->us;
+  const uint64_t *ours = lane->ours;
+  const uint64_t targets = ~lane->friendly;
+  const uint64_t empty = ~(lane->friendly | lane->enemy);
+  const uint64_t leftCaptures = shiftForward(ours[PAWN] & NOT_FILE_A, us) >> 1;
+  const uint64_t rightCaptures = shiftForward(ours[PAWN] & NOT_FILE_H, us)
+                                 << 1;
+  uint64_t attacks = leftCaptures | rightCaptures |
+                     getKnightAttacksOf(ours[KNIGHT]) |
+                     getKingAttacksOf(ours[KING]);
+  uint16_t mobility[PIECE_TYPES] = {0};
+
+  // Captures to the left and to the right apart, two pawns can take on the
+  // same square
+  mobility[PAWN] = (uint16_t)(
+      __builtin_popcountll(getPawnPushesOf(ours[PAWN], empty, us)) +
+      __builtin_popcountll(leftCaptures & lane->enemy) +
+      __builtin_popcountll(rightCaptures & lane->enemy));
+  for (uint64_t knights = ours[KNIGHT]; knights; knights &= knights - 1) {
+    mobility[KNIGHT] += (uint16_t)__builtin_popcountll(
+        getKnightAttacksOf(knights & -knights) & targets);
+  }
+  mobility[KING] =
+      (uint16_t)__builtin_popcountll(getKingAttacksOf(ours[KING]) & targets);
+
+  // A queen's two lookups never share a square, their counts add up
+  uint8_t slider = 0;
+  for (uint64_t sliders = ours[BISHOP] | ours[QUEEN]; sliders;
+       sliders &= sliders - 1, slider++) {
+    const Piece type = (ours[QUEEN] & sliders & -sliders) ? QUEEN : BISHOP;
+
+    attacks |= diagonal[slider];
+    mobility[type] +=
+        (uint16_t)__builtin_popcountll(diagonal[slider] & targets);
+  }
+  slider = 0;
+  for (uint64_t sliders = ours[ROOK] | ours[QUEEN]; sliders;
+       sliders &= sliders - 1, slider++) {
+    const Piece type = (ours[QUEEN] & sliders & -sliders) ? QUEEN : ROOK;
+
+    attacks |= orthogonal[slider];
+    mobility[type] +=
+        (uint16_t)__builtin_popcountll(orthogonal[slider] & targets);
+  }
+
+  for (Piece type = PAWN; type < PIECE_TYPES; type++) {
+    if (results->mobility[type]) {
+      results->mobility[type][index] = mobility[type];
+    }
+  }
+  if (results->attacks) {
+    results->attacks[index] = attacks;
+  }
+}
+
+void countMobility(const PositionBatch *batch, const size_t count,
+                   const MobilityBatch *results) {
+#ifndef NDEBUG
+  assert(batch != NULL);
+  assert(results != NULL);
+#endif /* ifndef NDEBUG */
+
+  const bool legal = results->legalMoves != NULL;
+  Lane lanes[MOBILITY_LANES];
+  Lookups diagonal, orthogonal;
+
+  for (size_t first = 0; first < count; first += MOBILITY_LANES) {
+    const uint8_t width = count - first < MOBILITY_LANES
+                              ? (uint8_t)(count - first)
+                              : MOBILITY_LANES;
+
+    // Every lookup of the group gets queued before the first one is made
+    diagonal.count = 0;
+    orthogonal.count = 0;
+    for (uint8_t lane = 0; lane < width; lane++) {
+      loadLane(batch, first + lane, legal, &lanes[lane], &diagonal,
+               &orthogonal);
+    }
+    lookUpDiagonals(&diagonal);
+    lookUpOrthogonals(&orthogonal);
+
+    for (uint8_t lane = 0; lane < width; lane++) {
+      const uint64_t *diagonals = &diagonal.bits[lanes[lane].diagonals];
+      const uint64_t *orthogonals = &orthogonal.bits[lanes[lane].orthogonals];
+
+      countLaneMobility(&lanes[lane], diagonals, orthogonals, results,
+                        first + lane);
+      if (legal) {
+        results->legalMoves[first + lane] =
+            countLegalMoves(&lanes[lane], diagonals, orthogonals);
+      }
+    }
+  }
+}
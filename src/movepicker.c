@@ -0,0 +1,189 @@
+#include "movepicker.h"
+#include "position.h"
+#include "sysifus.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+void initMovePicker(MovePicker *picker, const Position *position,
+                    const PackedMove hashMove,
+                    const PackedMove killers[KILLER_MOVES]) {
+#ifndef NDEBUG
+  assert(picker != NULL);
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  picker->position = position;
+  picker->hashMove = hashMove;
+  if (killers) {
+    memcpy(picker->killers, killers, sizeof(picker->killers));
+  } else {
+    memset(picker->killers, 0, sizeof(picker->killers));
+  }
+  // A killer repeated would come out twice
+  for (uint8_t killerIndex = 1; killerIndex < KILLER_MOVES; killerIndex++) {
+    for (uint8_t earlier = 0; earlier < killerIndex; earlier++) {
+      if (picker->killers[killerIndex] == picker->killers[earlier]) {
+        picker->killers[killerIndex] = NO_MOVE;
+      }
+    }
+  }
+  picker->history = NULL;
+  picker->stage = STAGE_HASH_MOVE;
+  picker->capturesOnly = false;
+  picker->killerIndex = 0;
+  picker->index = 0;
+  picker->list.count = 0;
+}
+
+void initCapturePicker(MovePicker *picker, const Position *position) {
+  initMovePicker(picker, position, NO_MOVE, NULL);
+  picker->capturesOnly = true;
+}
+
+int16_t getMvvLvaScore(const Position *position, const PackedMove move) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(!isQuiet(move));
+#endif /* ifndef NDEBUG */
+
+  const Piece attacker = (Piece)position->board[getMoveFrom(move)];
+  int16_t score = (int16_t)(KING - attacker);
+
+  // En passant lands on an empty square, behind the pawn it takes
+  if (isCapture(move)) {
+    const Piece victim =
+        isEnPassant(move) ? PAWN : (Piece)position->board[getMoveTo(move)];
+    score += (int16_t)((victim + 1) * PIECE_TYPES);
+  }
+  // A queen promotion counts like taking a queen, under promotions less
+  if (isPromotion(move)) {
+    score += (int16_t)(getPromotionPiece(move) * PIECE_TYPES);
+  }
+
+  return score;
+}
+
+static bool isKiller(const MovePicker *picker, const PackedMove move) {
+  for (uint8_t killerIndex = 0; killerIndex < KILLER_MOVES; killerIndex++) {
+    if (picker->killers[killerIndex] == move) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Selection sort done lazily: a cutoff after the first few moves leaves the
+// rest unsorted
+static PackedMove pickBest(MovePicker *picker) {
+  while (picker->index < picker->list.count) {
+    uint16_t best = picker->index;
+    for (uint16_t moveIndex = best + 1; moveIndex < picker->list.count;
+         moveIndex++) {
+      if (picker->scores[moveIndex] > picker->scores[best]) {
+        best = moveIndex;
+      }
+    }
+
+    const PackedMove move = picker->list.moves[best];
+    picker->list.moves[best] = picker->list.moves[picker->index];
+    picker->scores[best] = picker->scores[picker->index];
+    picker->index++;
+
+    // Killers came out before the quiets, but captures never match one
+    if (move != picker->hashMove &&
+        (picker->stage != STAGE_QUIETS || !isKiller(picker, move))) {
+      return move;
+    }
+  }
+
+  return NO_MOVE;
+}
+
+PackedMove nextMove(MovePicker *picker) {
+#ifndef NDEBUG
+  assert(picker != NULL);
+#endif /* ifndef NDEBUG */
+
+  const Position *position = picker->position;
+  PackedMove move;
+
+  switch (picker->stage) {
+  case STAGE_HASH_MOVE:
+    picker->stage = STAGE_GENERATE_CAPTURES;
+    if (picker->hashMove != NO_MOVE &&
+        isMoveLegal(position, picker->hashMove)) {
+      return picker->hashMove;
+    }
+    picker->hashMove = NO_MOVE;
+    // fall through
+  case STAGE_GENERATE_CAPTURES:
+    generateLegalCaptures(position, &picker->list);
+    for (uint16_t moveIndex = 0; moveIndex < picker->list.count;
+         moveIndex++) {
+      picker->scores[moveIndex] =
+          getMvvLvaScore(position, picker->list.moves[moveIndex]);
+    }
+    picker->index = 0;
+    picker->stage = STAGE_CAPTURES;
+    // fall through
+  case STAGE_CAPTURES:
+    move = pickBest(picker);
+    if (move != NO_MOVE) {
+      return move;
+    }
+    if (picker->capturesOnly) {
+      picker->stage = STAGE_DONE;
+      break;
+    }
+    picker->stage = STAGE_KILLERS;
+    // fall through
+  case STAGE_KILLERS:
+    // Captures and promotions already came out, a killer that would be one is
+    // skipped
+    while (picker->killerIndex < KILLER_MOVES) {
+      move = picker->killers[picker->killerIndex++];
+      if (move != NO_MOVE && move != picker->hashMove && isQuiet(move) &&
+          isMoveLegal(position, move)) {
+        return move;
+      }
+    }
+    picker->stage = STAGE_GENERATE_QUIETS;
+    // fall through
+  case STAGE_GENERATE_QUIETS:
+    generateLegalQuiets(position, &picker->list);
+    if (picker->history) {
+      for (uint16_t moveIndex = 0; moveIndex < picker->list.count;
+           moveIndex++) {
+        const PackedMove quiet = picker->list.moves[moveIndex];
+
+        picker->scores[moveIndex] =
+            picker->history[getMoveFrom(quiet)][getMoveTo(quiet)];
+      }
+    }
+    picker->index = 0;
+    picker->stage = STAGE_QUIETS;
+    // fall through
+  case STAGE_QUIETS:
+    if (picker->history) {
+      move = pickBest(picker);
+      if (move != NO_MOVE) {
+        return move;
+      }
+    }
+    while (picker->index < picker->list.count) {
+      move = picker->list.moves[picker->index++];
+      if (move != picker->hashMove && !isKiller(picker, move)) {
+        return move;
+      }
+    }
+    picker->stage = STAGE_DONE;
+    // fall through
+  case STAGE_DONE:
+    break;
+  }
+
+  return NO_MOVE;
+}
@@ -0,0 +1,468 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "nnue.h"
+#include "position.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define NETWORK_VERSION 1
+#define NNUE_SSE2_LANES 8
+#define NNUE_AVX2_LANES 16
+// Columns summed in one pass over the accumulator: every piece a legal
+// position can have. A move takes at most two pieces off and puts two on.
+#define MAX_ACTIVE_FEATURES 32
+#define MAX_CHANGED_FEATURES 2
+
+static const char NETWORK_MAGIC[8] = "SYSNNUE";
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t hidden;
+} NetworkHeader;
+
+typedef struct {
+  Color color;
+  Piece type;
+  int8_t square;
+} PieceChange;
+
+static NnueKernel nnueKernel = NNUE_SCALAR;
+
+static bool isNnueKernelSupported(const NnueKernel kernel) {
+  switch (kernel) {
+  case NNUE_SCALAR:
+    return true;
+#if defined(__x86_64__)
+  case NNUE_SSE2:
+    return true;
+  case NNUE_AVX2:
+    return __builtin_cpu_supports("avx2");
+#else
+  case NNUE_SSE2:
+  case NNUE_AVX2:
+    return false;
+#endif
+  }
+
+  return false;
+}
+
+// Runs once when the library gets loaded, before any evaluation
+__attribute__((constructor)) static void initNnueKernel(void) {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+#endif
+
+  if (isNnueKernelSupported(NNUE_AVX2)) {
+    nnueKernel = NNUE_AVX2;
+  } else if (isNnueKernelSupported(NNUE_SSE2)) {
+    nnueKernel = NNUE_SSE2;
+  }
+}
+
+NnueKernel getNnueKernel(void) { return nnueKernel; }
+
+bool setNnueKernel(const NnueKernel kernel) {
+  if (!isNnueKernelSupported(kernel)) {
+    return false;
+  }
+
+  nnueKernel = kernel;
+  return true;
+}
+
+// One perspective: `output` gets `input` plus the `added` columns minus the
+// `removed` ones. Lanes wrap around like int16 additions do, so the order the
+// columns come in never changes the result. `output` can be `input`.
+static void accumulateScalar(const int16_t *input, int16_t *output,
+                             const int16_t *const *added,
+                             const uint8_t addedCount,
+                             const int16_t *const *removed,
+                             const uint8_t removedCount) {
+  for (uint16_t index = 0; index < NNUE_HIDDEN; index++) {
+    int16_t value = input[index];
+
+    for (uint8_t feature = 0; feature < addedCount; feature++) {
+      value = (int16_t)(value + added[feature][index]);
+    }
+    for (uint8_t feature = 0; feature < removedCount; feature++) {
+      value = (int16_t)(value - removed[feature][index]);
+    }
+    output[index] = value;
+  }
+}
+
+static inline int16_t clipActivation(const int16_t value) {
+  return value < 0 ? 0 : value > NNUE_QA ? NNUE_QA : value;
+}
+
+// Output layer before its bias: clipped ReLU of both accumulators dotted with
+// their halves of the output weights
+static int32_t forwardScalar(const int16_t *us, const int16_t *them,
+                             const int16_t weights[COLORS][NNUE_HIDDEN]) {
+  int32_t sum = 0;
+
+  for (uint16_t index = 0; index < NNUE_HIDDEN; index++) {
+    sum += (clipActivation(us[index]) * weights[0][index]) +
+           (clipActivation(them[index]) * weights[1][index]);
+  }
+
+  return sum;
+}
+
+#if defined(__x86_64__)
+// Each lane of the output is loaded and stored once, whatever the number of
+// columns
+static void accumulateSse2(const int16_t *input, int16_t *output,
+                           const int16_t *const *added,
+                           const uint8_t addedCount,
+                           const int16_t *const *removed,
+                           const uint8_t removedCount) {
+  for (uint16_t index = 0; index < NNUE_HIDDEN; index += NNUE_SSE2_LANES) {
+    __m128i value = _mm_loadu_si128((const __m128i *)&input[index]);
+
+    for (uint8_t feature = 0; feature < addedCount; feature++) {
+      value = _mm_add_epi16(
+          value, _mm_loadu_si128((const __m128i *)&added[feature][index]));
+    }
+    for (uint8_t feature = 0; feature < removedCount; feature++) {
+      value = _mm_sub_epi16(
+          value, _mm_loadu_si128((const __m128i *)&removed[feature][index]));
+    }
+    _mm_storeu_si128((__m128i *)&output[index], value);
+  }
+}
+
+static inline int32_t sumLanesSse2(__m128i sum) {
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+
+  return _mm_cvtsi128_si32(sum);
+}
+
+// madd multiplies the 16-bit lanes and adds neighbouring products into 32
+// bits, and the bounded output weights keep the total within 32 bits as well
+static int32_t forwardSse2(const int16_t *us, const int16_t *them,
+                           const int16_t weights[COLORS][NNUE_HIDDEN]) {
+  const __m128i floor = _mm_setzero_si128();
+  const __m128i ceiling = _mm_set1_epi16(NNUE_QA);
+  __m128i sum = _mm_setzero_si128();
+
+  for (uint16_t index = 0; index < NNUE_HIDDEN; index += NNUE_SSE2_LANES) {
+    const __m128i ours = _mm_min_epi16(
+        _mm_max_epi16(_mm_loadu_si128((const __m128i *)&us[index]), floor),
+        ceiling);
+    const __m128i theirs = _mm_min_epi16(
+        _mm_max_epi16(_mm_loadu_si128((const __m128i *)&them[index]), floor),
+        ceiling);
+
+    sum = _mm_add_epi32(
+        sum, _mm_madd_epi16(
+                 ours, _mm_loadu_si128((const __m128i *)&weights[0][index])));
+    sum = _mm_add_epi32(
+        sum, _mm_madd_epi16(
+                 theirs, _mm_loadu_si128((const __m128i *)&weights[1][index])));
+  }
+
+  return sumLanesSse2(sum);
+}
+
+__attribute__((target("avx2"))) static void
+accumulateAvx2(const int16_t *input, int16_t *output,
+               const int16_t *const *added, const uint8_t addedCount,
+               const int16_t *const *removed, const uint8_t removedCount) {
+  for (uint16_t index = 0; index < NNUE_HIDDEN; index += NNUE_AVX2_LANES) {
+    __m256i value = _mm256_loadu_si256((const __m256i *)&input[index]);
+
+    for (uint8_t feature = 0; feature < addedCount; feature++) {
+      value = _mm256_add_epi16(
+          value, _mm256_loadu_si256((const __m256i *)&added[feature][index]));
+    }
+    for (uint8_t feature = 0; feature < removedCount; feature++) {
+      value = _mm256_sub_epi16(
+          value,
+          _mm256_loadu_si256((const __m256i *)&removed[feature][index]));
+    }
+    _mm256_storeu_si256((__m256i *)&output[index], value);
+  }
+}
+
+__attribute__((target("avx2"))) static int32_t
+forwardAvx2(const int16_t *us, const int16_t *them,
+            const int16_t weights[COLORS][NNUE_HIDDEN]) {
+  const __m256i floor = _mm256_setzero_si256();
+  const __m256i ceiling = _mm256_set1_epi16(NNUE_QA);
+  __m256i sum = _mm256_setzero_si256();
+
+  for (uint16_t index = 0; index < NNUE_HIDDEN; index += NNUE_AVX2_LANES) {
+    const __m256i ours = _mm256_min_epi16(
+        _mm256_max_epi16(_mm256_loadu_si256((const __m256i *)&us[index]),
+                         floor),
+        ceiling);
+    const __m256i theirs = _mm256_min_epi16(
+        _mm256_max_epi16(_mm256_loadu_si256((const __m256i *)&them[index]),
+                         floor),
+        ceiling);
+
+    sum = _mm256_add_epi32(
+        sum,
+        _mm256_madd_epi16(
+            ours, _mm256_loadu_si256((const __m256i *)&weights[0][index])));
+    sum = _mm256_add_epi32(
+        sum,
+        _mm256_madd_epi16(
+            theirs, _mm256_loadu_si256((const __m256i *)&weights[1][index])));
+  }
+
+  return sumLanesSse2(_mm_add_epi32(_mm256_castsi256_si128(sum),
+                                    _mm256_extracti128_si256(sum, 1)));
+}
+#endif
+
+static void accumulate(const int16_t *input, int16_t *output,
+                       const int16_t *const *added, const uint8_t addedCount,
+                       const int16_t *const *removed,
+                       const uint8_t removedCount) {
+  switch (nnueKernel) {
+#if defined(__x86_64__)
+  case NNUE_AVX2:
+    accumulateAvx2(input, output, added, addedCount, removed, removedCount);
+    return;
+  case NNUE_SSE2:
+    accumulateSse2(input, output, added, addedCount, removed, removedCount);
+    return;
+#endif
+  default:
+    accumulateScalar(input, output, added, addedCount, removed, removedCount);
+  }
+}
+
+static int32_t forward(const int16_t *us, const int16_t *them,
+                       const int16_t weights[COLORS][NNUE_HIDDEN]) {
+  switch (nnueKernel) {
+#if defined(__x86_64__)
+  case NNUE_AVX2:
+    return forwardAvx2(us, them, weights);
+  case NNUE_SSE2:
+    return forwardSse2(us, them, weights);
+#endif
+  default:
+    return forwardScalar(us, them, weights);
+  }
+}
+
+// Column of the piece's input from `perspective`'s side of the board
+static inline const int16_t *getColumn(const Network *network,
+                                       const Color perspective,
+                                       const PieceChange change) {
+  const int8_t flip = perspective == WHITE ? 0 : BOARD_AREA - BOARD_LENGTH;
+  const uint8_t type =
+      (uint8_t)(((change.color != perspective) * PIECE_TYPES) + change.type);
+
+  return network->featureWeights[(type * BOARD_AREA) + (change.square ^ flip)];
+}
+
+static bool readValues(FILE *file, int16_t *values, const size_t count) {
+  return fread(values, sizeof(int16_t), count, file) == count;
+}
+
+static bool writeValues(FILE *file, const int16_t *values,
+                        const size_t count) {
+  return fwrite(values, sizeof(int16_t), count, file) == count;
+}
+
+Network *loadNetwork(const char *path) {
+#ifndef NDEBUG
+  assert(path != NULL);
+#endif /* ifndef NDEBUG */
+
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    return NULL;
+  }
+
+  NetworkHeader header;
+  void *memory = NULL;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, NETWORK_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != NETWORK_VERSION || header.hidden != NNUE_HIDDEN ||
+      posix_memalign(&memory, NNUE_ALIGNMENT, sizeof(Network)) != 0) {
+    (void)fclose(file);
+    return NULL;
+  }
+
+  Network *network = memory;
+  const bool isValid =
+      readValues(file, &network->featureWeights[0][0],
+                 (size_t)NNUE_INPUTS * NNUE_HIDDEN) &&
+      readValues(file, network->featureBiases, NNUE_HIDDEN) &&
+      readValues(file, &network->outputWeights[0][0], COLORS * NNUE_HIDDEN) &&
+      readValues(file, &network->outputBias, 1) && fgetc(file) == EOF;
+  (void)fclose(file);
+  bool isBounded = true;
+  for (Color color = WHITE; color < COLORS; color++) {
+    for (uint16_t index = 0; index < NNUE_HIDDEN; index++) {
+      const int16_t weight = network->outputWeights[color][index];
+
+      isBounded &= weight >= -NNUE_MAX_OUTPUT_WEIGHT &&
+                   weight <= NNUE_MAX_OUTPUT_WEIGHT;
+    }
+  }
+  if (!isValid || !isBounded) {
+    free(network);
+    return NULL;
+  }
+
+  return network;
+}
+
+bool saveNetwork(const Network *network, const char *path) {
+#ifndef NDEBUG
+  assert(network != NULL);
+  assert(path != NULL);
+#endif /* ifndef NDEBUG */
+
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+
+  NetworkHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, NETWORK_MAGIC, sizeof(header.magic));
+  header.version = NETWORK_VERSION;
+  header.hidden = NNUE_HIDDEN;
+
+  const bool isWritten =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      writeValues(file, &network->featureWeights[0][0],
+                  (size_t)NNUE_INPUTS * NNUE_HIDDEN) &&
+      writeValues(file, network->featureBiases, NNUE_HIDDEN) &&
+      writeValues(file, &network->outputWeights[0][0],
+                  COLORS * NNUE_HIDDEN) &&
+      writeValues(file, &network->outputBias, 1);
+
+  return fclose(file) == 0 && isWritten;
+}
+
+void freeNetwork(Network *network) { free(network); }
+
+void refreshAccumulator(const Network *network, const Position *position,
+                        Accumulator *accumulator) {
+#ifndef NDEBUG
+  assert(network != NULL);
+  assert(position != NULL);
+  assert(accumulator != NULL);
+#endif /* ifndef NDEBUG */
+
+  for (Color perspective = WHITE; perspective < COLORS; perspective++) {
+    const int16_t *columns[MAX_ACTIVE_FEATURES];
+    const int16_t *input = network->featureBiases;
+    int16_t *output = accumulator->values[perspective];
+    uint8_t count = 0;
+
+    for (Color color = WHITE; color < COLORS; color++) {
+      for (Piece type = PAWN; type < NOTHING; type++) {
+        for (uint64_t pieces = position->pieces[color][type]; pieces;
+             pieces &= pieces - 1) {
+          const PieceChange piece = {color, type,
+                                     (int8_t)__builtin_ctzll(pieces)};
+
+          columns[count++] = getColumn(network, perspective, piece);
+          // Boards set up by hand can hold more pieces than a game
+          if (count == MAX_ACTIVE_FEATURES) {
+            accumulate(input, output, columns, count, NULL, 0);
+            input = output;
+            count = 0;
+          }
+        }
+      }
+    }
+
+    accumulate(input, output, columns, count, NULL, 0);
+  }
+}
+
+void updateAccumulator(const Network *network, const Position *position,
+                       const PackedMove move, const Accumulator *before,
+                       Accumulator *after) {
+#ifndef NDEBUG
+  assert(network != NULL);
+  assert(position != NULL);
+  assert(before != NULL);
+  assert(after != NULL);
+  assert(position->board[getMoveFrom(move)] != NOTHING);
+#endif /* ifndef NDEBUG */
+
+  const Color us = position->sideToMove;
+  const int8_t from = getMoveFrom(move);
+  const int8_t to = getMoveTo(move);
+  const Piece moved = (Piece)position->board[from];
+  PieceChange added[MAX_CHANGED_FEATURES], removed[MAX_CHANGED_FEATURES];
+  uint8_t addedCount = 0, removedCount = 0;
+
+  removed[removedCount++] = (PieceChange){us, moved, from};
+  added[addedCount++] = (PieceChange){
+      us, isPromotion(move) ? getPromotionPiece(move) : moved, to};
+  if (isEnPassant(move)) {
+    removed[removedCount++] = (PieceChange){
+        (Color)!us, PAWN,
+        (int8_t)(us == WHITE ? to - BOARD_LENGTH : to + BOARD_LENGTH)};
+  } else if (isCapture(move)) {
+    removed[removedCount++] =
+        (PieceChange){(Color)!us, (Piece)position->board[to], to};
+  } else if (isCastling(move)) {
+    const bool isKingside = getMoveFlags(move) == KING_CASTLE;
+
+    removed[removedCount++] =
+        (PieceChange){us, ROOK, (int8_t)(isKingside ? to + 1 : to - 2)};
+    added[addedCount++] =
+        (PieceChange){us, ROOK, (int8_t)(isKingside ? to - 1 : to + 1)};
+  }
+
+  for (Color perspective = WHITE; perspective < COLORS; perspective++) {
+    const int16_t *addedColumns[MAX_CHANGED_FEATURES];
+    const int16_t *removedColumns[MAX_CHANGED_FEATURES];
+
+    for (uint8_t change = 0; change < addedCount; change++) {
+      addedColumns[change] = getColumn(network, perspective, added[change]);
+    }
+    for (uint8_t change = 0; change < removedCount; change++) {
+      removedColumns[change] =
+          getColumn(network, perspective, removed[change]);
+    }
+
+    accumulate(before->values[perspective], after->values[perspective],
+               addedColumns, addedCount, removedColumns, removedCount);
+  }
+}
+
+int16_t evaluateNetwork(const Network *network, const Position *position,
+                        const Accumulator *accumulator) {
+#ifndef NDEBUG
+  assert(network != NULL);
+  assert(position != NULL);
+  assert(accumulator != NULL);
+#endif /* ifndef NDEBUG */
+
+  const Color us = position->sideToMove;
+  const int32_t sum =
+      forward(accumulator->values[us], accumulator->values[!us],
+              network->outputWeights);
+  const int64_t score = ((int64_t)sum + network->outputBias) * NNUE_SCALE /
+                        (NNUE_QA * NNUE_QB);
+
+  return (int16_t)(score > NNUE_MAX_SCORE    ? NNUE_MAX_SCORE
+                   : score < -NNUE_MAX_SCORE ? -NNUE_MAX_SCORE
+                                             : score);
+}
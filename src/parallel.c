@@ -0,0 +1,353 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "parallel.h"
+#include "hashtable.h"
+#include "perft.h"
+#include "position.h"
+#include "sysifus.h"
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Splitting is depth first, so a deque only ever holds a few moves lists
+#define DEQUE_CAPACITY 1024
+
+typedef struct {
+  Position position;
+  uint32_t root; // Which count the subtree adds up to
+  uint8_t depth;
+} PerftTask;
+
+// The owner pushes and pops at the bottom, thieves take from the top, which
+// holds the biggest subtrees. Tasks are coarse enough for a plain lock.
+typedef struct {
+  pthread_mutex_t lock;
+  uint32_t top, bottom;
+  PerftTask tasks[DEQUE_CAPACITY];
+} TaskDeque;
+
+typedef struct {
+  TaskDeque deque;
+  PerftPool *pool;
+  pthread_t thread;
+  uint16_t index;
+  // Only written by the owner, read back once the run is over
+  uint64_t tasks, steals;
+  TableStats tableStats;
+} PerftWorker;
+
+struct PerftPool {
+  PerftWorker *workers;
+  uint16_t threads;
+
+  pthread_mutex_t lock;
+  pthread_cond_t wake, done;
+  uint64_t run;    // Bumped to wake the workers up for a new run
+  uint16_t active; // Workers yet to leave the current run
+  bool quit;
+
+  // Current run
+  const Position *roots;
+  size_t rootCount, nextRoot;
+  uint8_t depth;
+  TranspositionTable *table;
+  uint64_t *counts;
+  uint64_t pending; // Tasks untaken, queued or running. The run ends at 0.
+};
+
+static inline bool isDequeEmpty(const TaskDeque *deque) {
+  return __atomic_load_n(&deque->top, __ATOMIC_RELAXED) ==
+         __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+}
+
+static bool pushTask(TaskDeque *deque, const PerftTask *task) {
+  pthread_mutex_lock(&deque->lock);
+
+  const bool hasRoom = deque->bottom - deque->top < DEQUE_CAPACITY;
+  if (hasRoom) {
+    deque->tasks[deque->bottom % DEQUE_CAPACITY] = *task;
+    __atomic_store_n(&deque->bottom, deque->bottom + 1, __ATOMIC_RELAXED);
+  }
+
+  pthread_mutex_unlock(&deque->lock);
+  return hasRoom;
+}
+
+static bool popTask(TaskDeque *deque, PerftTask *task) {
+  if (isDequeEmpty(deque)) {
+    return false;
+  }
+  pthread_mutex_lock(&deque->lock);
+
+  const bool hasTask = deque->bottom != deque->top;
+  if (hasTask) {
+    __atomic_store_n(&deque->bottom, deque->bottom - 1, __ATOMIC_RELAXED);
+    *task = deque->tasks[deque->bottom % DEQUE_CAPACITY];
+  }
+
+  pthread_mutex_unlock(&deque->lock);
+  return hasTask;
+}
+
+static bool stealTask(TaskDeque *deque, PerftTask *task) {
+  if (isDequeEmpty(deque)) {
+    return false;
+  }
+  pthread_mutex_lock(&deque->lock);
+
+  const bool hasTask = deque->bottom != deque->top;
+  if (hasTask) {
+    *task = deque->tasks[deque->top % DEQUE_CAPACITY];
+    __atomic_store_n(&deque->top, deque->top + 1, __ATOMIC_RELAXED);
+  }
+
+  pthread_mutex_unlock(&deque->lock);
+  return hasTask;
+}
+
+// Roots are handed out one at a time from a shared cursor, so a batch of any
+// size needs no room in the deques
+static bool takeRoot(PerftPool *pool, PerftTask *task) {
+  const size_t rootIndex =
+      __atomic_fetch_add(&pool->nextRoot, 1, __ATOMIC_RELAXED);
+
+  if (rootIndex >= pool->rootCount) {
+    return false;
+  }
+
+  task->position = pool->roots[rootIndex];
+  task->root = (uint32_t)rootIndex;
+  task->depth = pool->depth;
+  return true;
+}
+
+static bool stealFromOthers(PerftWorker *worker, PerftTask *task) {
+  const PerftPool *pool = worker->pool;
+
+  for (uint16_t offset = 1; offset < pool->threads; offset++) {
+    PerftWorker *victim =
+        &pool->workers[(worker->index + offset) % pool->threads];
+
+    if (stealTask(&victim->deque, task)) {
+      worker->steals++;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static void finishTasks(PerftPool *pool, const uint64_t finished) {
+  __atomic_sub_fetch(&pool->pending, finished, __ATOMIC_ACQ_REL);
+}
+
+static void countSubtree(PerftWorker *worker, PerftTask *task) {
+  PerftPool *pool = worker->pool;
+  const uint64_t nodes =
+      pool->table ? perftHashed(&task->position, task->depth, pool->table,
+                                &worker->tableStats)
+                  : perft(&task->position, task->depth);
+
+  __atomic_fetch_add(&pool->counts[task->root], nodes, __ATOMIC_RELAXED);
+}
+
+static void runTask(PerftWorker *worker, PerftTask *task) {
+  PerftPool *pool = worker->pool;
+
+  worker->tasks++;
+  if (task->depth <= SEQUENTIAL_PERFT_DEPTH) {
+    countSubtree(worker, task);
+    finishTasks(pool, 1);
+    return;
+  }
+
+  MoveList list;
+  generateLegalMoves(&task->position, &list);
+
+  // Children become pending before their parent stops being so, the count
+  // can't touch 0 while there is work left
+  __atomic_add_fetch(&pool->pending, list.count, __ATOMIC_RELAXED);
+
+  uint64_t countedInline = 1;
+  for (uint16_t moveIndex = 0; moveIndex < list.count; moveIndex++) {
+    PerftTask child = {
+        .position = task->position,
+        .root = task->root,
+        .depth = (uint8_t)(task->depth - 1),
+    };
+    UndoInfo undo;
+
+    makeMove(&child.position, list.moves[moveIndex], &undo);
+    if (!pushTask(&worker->deque, &child)) {
+      countSubtree(worker, &child);
+      countedInline++;
+    }
+  }
+
+  finishTasks(pool, countedInline);
+}
+
+static void workUntilDone(PerftWorker *worker) {
+  PerftPool *pool = worker->pool;
+  PerftTask task;
+
+  while (__atomic_load_n(&pool->pending, __ATOMIC_ACQUIRE) > 0) {
+    if (popTask(&worker->deque, &task) || takeRoot(pool, &task) ||
+        stealFromOthers(worker, &task)) {
+      runTask(worker, &task);
+    } else {
+      sched_yield();
+    }
+  }
+}
+
+static void *runWorker(void *argument) {
+  PerftWorker *worker = argument;
+  PerftPool *pool = worker->pool;
+  uint64_t lastRun = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->quit && pool->run == lastRun) {
+      pthread_cond_wait(&pool->wake, &pool->lock);
+    }
+    if (pool->quit) {
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    lastRun = pool->run;
+    pthread_mutex_unlock(&pool->lock);
+
+    workUntilDone(worker);
+
+    // The run only ends once nobody can touch its fields any more
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->active == 0) {
+      pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+PerftPool *createPerftPool(const uint16_t threads) {
+  if (threads == 0) {
+    return NULL;
+  }
+
+  PerftPool *pool = calloc(1, sizeof(PerftPool));
+  if (!pool) {
+    return NULL;
+  }
+
+  pool->workers = calloc(threads, sizeof(PerftWorker));
+  if (!pool->workers) {
+    free(pool);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  for (; pool->threads < threads; pool->threads++) {
+    PerftWorker *worker = &pool->workers[pool->threads];
+
+    pthread_mutex_init(&worker->deque.lock, NULL);
+    worker->pool = pool;
+    worker->index = pool->threads;
+    if (pthread_create(&worker->thread, NULL, runWorker, worker) != 0) {
+      pthread_mutex_destroy(&worker->deque.lock);
+      destroyPerftPool(pool);
+      return NULL;
+    }
+  }
+
+  return pool;
+}
+
+void destroyPerftPool(PerftPool *pool) {
+  if (!pool) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->wake);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (uint16_t workerIndex = 0; workerIndex < pool->threads; workerIndex++) {
+    pthread_join(pool->workers[workerIndex].thread, NULL);
+    pthread_mutex_destroy(&pool->workers[workerIndex].deque.lock);
+  }
+
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->wake);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->workers);
+  free(pool);
+}
+
+uint16_t getPerftPoolThreads(const PerftPool *pool) {
+#ifndef NDEBUG
+  assert(pool != NULL);
+#endif /* ifndef NDEBUG */
+
+  return pool->threads;
+}
+
+void runParallelPerft(PerftPool *pool, const Position *roots,
+                      const size_t rootCount, const uint8_t depth,
+                      TranspositionTable *table, uint64_t *counts,
+                      ParallelPerftStats *stats) {
+#ifndef NDEBUG
+  assert(pool != NULL);
+  assert(roots != NULL || rootCount == 0);
+  assert(counts != NULL || rootCount == 0);
+  assert(rootCount <= UINT32_MAX);
+#endif /* ifndef NDEBUG */
+
+  memset(counts, 0, rootCount * sizeof(uint64_t));
+  for (uint16_t workerIndex = 0; workerIndex < pool->threads; workerIndex++) {
+    PerftWorker *worker = &pool->workers[workerIndex];
+
+    worker->tasks = 0;
+    worker->steals = 0;
+    memset(&worker->tableStats, 0, sizeof(worker->tableStats));
+  }
+
+  // Every worker is asleep between runs, the lock publishes the new one
+  pthread_mutex_lock(&pool->lock);
+  pool->roots = roots;
+  pool->rootCount = rootCount;
+  pool->depth = depth;
+  pool->table = table;
+  pool->counts = counts;
+  pool->nextRoot = 0;
+  pool->pending = rootCount;
+  pool->active = pool->threads;
+  pool->run++;
+  pthread_cond_broadcast(&pool->wake);
+  while (pool->active > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  if (!stats) {
+    return;
+  }
+
+  memset(stats, 0, sizeof(*stats));
+  for (uint16_t workerIndex = 0; workerIndex < pool->threads; workerIndex++) {
+    const PerftWorker *worker = &pool->workers[workerIndex];
+
+    stats->tasks += worker->tasks;
+    stats->steals += worker->steals;
+    stats->table.probes += worker->tableStats.probes;
+    stats->table.hits += worker->tableStats.hits;
+    stats->table.stores += worker->tableStats.stores;
+    stats->table.evictions += worker->tableStats.evictions;
+  }
+}
@@ -0,0 +1,61 @@
+#include "perft.h"
+#include "hashtable.h"
+#include "position.h"
+#include "sysifus.h"
+#include <stdint.h>
+
+uint64_t perft(Position *position, const uint8_t depth) {
+  if (depth == 0) {
+    return 1;
+  }
+
+  MoveList list;
+  generateLegalMoves(position, &list);
+
+  if (depth == 1) {
+    return list.count;
+  }
+
+  uint64_t nodes = 0;
+  for (uint16_t moveIndex = 0; moveIndex < list.count; moveIndex++) {
+    UndoInfo undo;
+
+    makeMove(position, list.moves[moveIndex], &undo);
+    nodes += perft(position, (uint8_t)(depth - 1));
+    unmakeMove(position, list.moves[moveIndex], &undo);
+  }
+
+  return nodes;
+}
+
+uint64_t perftHashed(Position *position, const uint8_t depth,
+                     TranspositionTable *table, TableStats *stats) {
+  // Bulk counted leaves are cheaper than a probe
+  if (depth <= 1) {
+    return perft(position, depth);
+  }
+
+  uint64_t data;
+  if (probeTable(table, position->hash, &data, stats) &&
+      getEntryDepth(data) == depth) {
+    return getEntryPayload(data);
+  }
+
+  MoveList list;
+  generateLegalMoves(position, &list);
+
+  uint64_t nodes = 0;
+  for (uint16_t moveIndex = 0; moveIndex < list.count; moveIndex++) {
+    UndoInfo undo;
+
+    if (depth > 2) {
+      prefetchTable(table, getHashAfterMove(position, list.moves[moveIndex]));
+    }
+    makeMove(position, list.moves[moveIndex], &undo);
+    nodes += perftHashed(position, (uint8_t)(depth - 1), table, stats);
+    unmakeMove(position, list.moves[moveIndex], &undo);
+  }
+
+  storeTable(table, position->hash, depth, nodes, stats);
+  return nodes;
+}
@@ -0,0 +1,666 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "pgn.h"
+#include "mapping.h"
+#include "position.h"
+#include "sysifus.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Shards are taken from a shared cursor, several per thread so the ones
+// holding longer games don't leave the others idle at the end
+#define PGN_SHARDS_PER_THREAD 16
+
+#define PGN_STARTING_FEN                                                       \
+  "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+static const char PIECE_LETTERS[] = "PNBRQK";
+static const uint64_t FILE_A_MASK = 0x0101010101010101ULL;
+static const uint64_t RANK_1_MASK = 0xFFULL;
+
+typedef struct {
+  const char *data;
+  size_t size;
+  uint32_t shards;
+  uint32_t nextShard;
+  PgnVisitor visitor;
+  void *context;
+} PgnJob;
+
+typedef struct {
+  PgnJob *job;
+  pthread_t thread;
+  uint16_t index;
+  PgnStats stats;
+} PgnWorker;
+
+bool openPgn(PgnReader *reader, const char *path) {
+#ifndef NDEBUG
+  assert(reader != NULL);
+  assert(path != NULL);
+#endif /* ifndef NDEBUG */
+
+  memset(reader, 0, sizeof(*reader));
+  return mapFile(path, &reader->data, &reader->size);
+}
+
+void closePgn(PgnReader *reader) {
+#ifndef NDEBUG
+  assert(reader != NULL);
+#endif /* ifndef NDEBUG */
+
+  unmapFile(reader->data, reader->size);
+  memset(reader, 0, sizeof(*reader));
+}
+
+static inline bool isBlank(const char character) {
+  return character == ' ' || character == '\t' || character == '\r' ||
+         character == '\n';
+}
+
+// Offset right after the line starting at `offset`
+static size_t skipLine(const char *data, const size_t size,
+                       const size_t offset) {
+  const char *newline = memchr(data + offset, '\n', size - offset);
+
+  return newline ? (size_t)(newline - data) + 1 : size;
+}
+
+static bool isBlankLine(const char *data, const size_t size, size_t offset) {
+  for (; offset < size && data[offset] != '\n'; offset++) {
+    if (!isBlank(data[offset])) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+PgnStatus readPgnGame(PgnReader *reader, PgnGame *game) {
+#ifndef NDEBUG
+  assert(reader != NULL);
+  assert(game != NULL);
+#endif /* ifndef NDEBUG */
+
+  const char *data = reader->data;
+  const size_t size = reader->size;
+
+  while (reader->offset < size &&
+         (data[reader->offset] == '%' ||
+          isBlankLine(data, size, reader->offset))) {
+    reader->offset = skipLine(data, size, reader->offset);
+  }
+  if (reader->offset >= size) {
+    return PGN_END;
+  }
+
+  const size_t tags = reader->offset;
+  while (reader->offset < size && data[reader->offset] == '[') {
+    reader->offset = skipLine(data, size, reader->offset);
+  }
+
+  const size_t movetext = reader->offset;
+  while (reader->offset < size && data[reader->offset] != '[') {
+    reader->offset = skipLine(data, size, reader->offset);
+  }
+
+  game->tags = data + tags;
+  game->tagsLength = movetext - tags;
+  game->movetext = data + movetext;
+  game->movetextLength = reader->offset - movetext;
+  return PGN_FOUND;
+}
+
+bool findPgnTag(const PgnGame *game, const char *name, const char **value,
+                size_t *length) {
+#ifndef NDEBUG
+  assert(game != NULL);
+  assert(name != NULL);
+  assert(value != NULL);
+  assert(length != NULL);
+#endif /* ifndef NDEBUG */
+
+  const size_t nameLength = strlen(name);
+  const char *tags = game->tags;
+  const size_t size = game->tagsLength;
+
+  for (size_t offset = 0; offset < size;
+       offset = skipLine(tags, size, offset)) {
+    size_t cursor = offset + 1;
+
+    if (tags[offset] != '[' || size - cursor <= nameLength ||
+        memcmp(tags + cursor, name, nameLength) != 0 ||
+        !isBlank(tags[cursor + nameLength])) {
+      continue;
+    }
+
+    cursor += nameLength;
+    while (cursor < size && isBlank(tags[cursor]) && tags[cursor] != '\n') {
+      cursor++;
+    }
+    if (cursor >= size || tags[cursor] != '"') {
+      continue;
+    }
+
+    const size_t start = ++cursor;
+    while (cursor < size && tags[cursor] != '"' && tags[cursor] != '\n') {
+      cursor += tags[cursor] == '\\' ? 2 : 1;
+    }
+    if (cursor >= size || tags[cursor] != '"') {
+      continue;
+    }
+
+    *value = tags + start;
+    *length = cursor - start;
+    return true;
+  }
+
+  return false;
+}
+
+PgnStatus startPgnReplay(PgnReplay *replay, const PgnGame *game) {
+#ifndef NDEBUG
+  assert(replay != NULL);
+  assert(game != NULL);
+#endif /* ifndef NDEBUG */
+
+  const char *fen;
+  size_t fenLength;
+
+  replay->cursor = game->movetext;
+  replay->end = game->movetext + game->movetextLength;
+  replay->san = NULL;
+  replay->sanLength = 0;
+
+  if (findPgnTag(game, "FEN", &fen, &fenLength)) {
+    return parseFenSpan(&replay->position, fen, fenLength) > 0 ? PGN_FOUND
+                                                                : PGN_INVALID;
+  }
+
+  (void)parseFen(&replay->position, PGN_STARTING_FEN);
+  return PGN_FOUND;
+}
+
+static inline bool isDelimiter(const char character) {
+  return isBlank(character) || character == '{' || character == '}' ||
+         character == '(' || character == ')' || character == ';' ||
+         character == '$';
+}
+
+static inline bool isDigit(const char character) {
+  return character >= '0' && character <= '9';
+}
+
+static bool isResult(const char *token, const size_t length) {
+  return (length == 1 && token[0] == '*') ||
+         (length == 3 && (memcmp(token, "1-0", 3) == 0 ||
+                          memcmp(token, "0-1", 3) == 0)) ||
+         (length == 7 && memcmp(token, "1/2-1/2", 7) == 0);
+}
+
+// Past the variation opening at `cursor`, its own variations and comments
+// included
+static const char *skipVariation(const char *cursor, const char *end) {
+  uint32_t depth = 0;
+
+  for (; cursor < end; cursor++) {
+    if (*cursor == '(') {
+      depth++;
+    } else if (*cursor == ')' && --depth == 0) {
+      return cursor + 1;
+    } else if (*cursor == '{') {
+      const char *close = memchr(cursor, '}', (size_t)(end - cursor));
+
+      if (!close) {
+        return end;
+      }
+      cursor = close;
+    }
+  }
+
+  return end;
+}
+
+PgnStatus readPgnMove(PgnReplay *replay, PackedMove *move) {
+#ifndef NDEBUG
+  assert(replay != NULL);
+  assert(move != NULL);
+#endif /* ifndef NDEBUG */
+
+  const char *end = replay->end;
+
+  while (replay->cursor < end) {
+    const char *cursor = replay->cursor;
+
+    if (*cursor == '{' || *cursor == ';') {
+      const char *close = memchr(cursor, *cursor == '{' ? '}' : '\n',
+                                 (size_t)(end - cursor));
+      replay->cursor = close ? close + 1 : end;
+      continue;
+    }
+    if (*cursor == '(') {
+      replay->cursor = skipVariation(cursor, end);
+      continue;
+    }
+    if (*cursor == '$') {
+      for (cursor++; cursor < end && isDigit(*cursor); cursor++) {
+      }
+      replay->cursor = cursor;
+      continue;
+    }
+    if (isDelimiter(*cursor)) {
+      replay->cursor++;
+      continue;
+    }
+
+    const char *token = cursor;
+    for (; cursor < end && !isDelimiter(*cursor); cursor++) {
+    }
+    replay->cursor = cursor;
+
+    // Move numbers, "12." and "12...", sometimes glued to the move
+    const char *san = token;
+    for (; san < cursor && isDigit(*san); san++) {
+    }
+    if (san > token && san < cursor && *san == '.') {
+      for (; san < cursor && *san == '.'; san++) {
+      }
+    } else {
+      san = token;
+    }
+    if (san == cursor) {
+      continue;
+    }
+
+    const size_t length = (size_t)(cursor - san);
+    if (isResult(san, length)) {
+      replay->cursor = end;
+      return PGN_END;
+    }
+
+    replay->san = san;
+    replay->sanLength = length;
+    *move = parseSan(&replay->position, san, length);
+    return *move != NO_MOVE ? PGN_FOUND : PGN_INVALID;
+  }
+
+  return PGN_END;
+}
+
+static inline bool isFile(const char character) {
+  return character >= 'a' && character <= 'h';
+}
+
+static inline bool isRank(const char character) {
+  return character >= '1' && character <= '8';
+}
+
+static Piece getPieceOfLetter(const char letter) {
+  const char *found = strchr(PIECE_LETTERS + 1, letter);
+
+  return found && letter != '\0' ? (Piece)(found - PIECE_LETTERS) : NOTHING;
+}
+
+static PackedMove parseCastling(const Position *position, const char *san,
+                                const size_t length) {
+  const bool kingside = (length == 3 && (memcmp(san, "O-O", 3) == 0 ||
+                                         memcmp(san, "0-0", 3) == 0));
+  const bool queenside = (length == 5 && (memcmp(san, "O-O-O", 5) == 0 ||
+                                          memcmp(san, "0-0-0", 5) == 0));
+  if (!kingside && !queenside) {
+    return NO_MOVE;
+  }
+
+  const int8_t king = (int8_t)__builtin_ctzll(
+      position->pieces[position->sideToMove][KING]);
+  const PackedMove move =
+      kingside ? packMove(king, (int8_t)(king + 2), KING_CASTLE)
+               : packMove(king, (int8_t)(king - 2), QUEEN_CASTLE);
+
+  return isMoveLegal(position, move) ? move : NO_MOVE;
+}
+
+PackedMove parseSan(const Position *position, const char *san,
+                    size_t length) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(san != NULL || length == 0);
+#endif /* ifndef NDEBUG */
+
+  const Color us = position->sideToMove;
+  if (!position->pieces[us][KING]) {
+    return NO_MOVE;
+  }
+
+  while (length > 0 && (san[length - 1] == '+' || san[length - 1] == '#' ||
+                        san[length - 1] == '!' || san[length - 1] == '?')) {
+    length--;
+  }
+  if (length < 2) {
+    return NO_MOVE;
+  }
+  if (san[0] == 'O' || san[0] == '0') {
+    return parseCastling(position, san, length);
+  }
+
+  size_t index = 0;
+  Piece type = PAWN;
+  if (san[0] >= 'A' && san[0] <= 'Z') {
+    type = getPieceOfLetter(san[0]);
+    if (type == NOTHING || type == PAWN) {
+      return NO_MOVE;
+    }
+    index++;
+  }
+
+  // "e8=Q", or "e8Q" as some exports write it
+  Piece promotion = NOTHING;
+  if (type == PAWN && san[length - 1] >= 'A' && san[length - 1] <= 'Z') {
+    promotion = getPieceOfLetter(san[length - 1]);
+    if (promotion == NOTHING || promotion == KING) {
+      return NO_MOVE;
+    }
+    length -= san[length - 2] == '=' ? 2 : 1;
+  }
+
+  if (length < index + 2 || !isFile(san[length - 2]) ||
+      !isRank(san[length - 1])) {
+    return NO_MOVE;
+  }
+  const int8_t to = (int8_t)((san[length - 1] - '1') * BOARD_LENGTH +
+                             (san[length - 2] - 'a'));
+  const uint64_t toBit = 1ULL << to;
+
+  // Origin file and rank when given, and the capture mark
+  int8_t fromFile = NO_SQUARE, fromRank = NO_SQUARE;
+  for (length -= 2; index < length; index++) {
+    if (isFile(san[index]) && fromFile == NO_SQUARE) {
+      fromFile = (int8_t)(san[index] - 'a');
+    } else if (isRank(san[index]) && fromRank == NO_SQUARE) {
+      fromRank = (int8_t)(san[index] - '1');
+    } else if (san[index] != 'x' && san[index] != ':') {
+      return NO_MOVE;
+    }
+  }
+
+  const uint64_t enemy = position->occupancy[!us];
+  const uint64_t occupancy = getOccupancy(position);
+  const uint64_t pawns = position->pieces[us][PAWN];
+  const int8_t forward = us == WHITE ? BOARD_LENGTH : -BOARD_LENGTH;
+  uint64_t candidates;
+  MoveFlag flags = (enemy & toBit) ? CAPTURE : QUIET_MOVE;
+
+  if (type == PAWN) {
+    const int8_t behind = (int8_t)(to - forward);
+
+    if (behind < 0 || behind >= BOARD_AREA) {
+      return NO_MOVE;
+    }
+
+    if (fromFile != NO_SQUARE) {
+      const int8_t fileDistance = (int8_t)(fromFile - to % BOARD_LENGTH);
+
+      if (fileDistance != 1 && fileDistance != -1) {
+        return NO_MOVE;
+      }
+      candidates = pawns & (1ULL << (behind + fileDistance));
+      if (to == position->enPassant) {
+        flags = EN_PASSANT_CAPTURE;
+      }
+    } else if (pawns & (1ULL << behind)) {
+      candidates = 1ULL << behind;
+    } else {
+      const int8_t start = (int8_t)(behind - forward);
+
+      candidates = 0;
+      if (start >= 0 && start < BOARD_AREA && !(occupancy & (1ULL << behind))) {
+        candidates = pawns & (1ULL << start);
+        flags = DOUBLE_PAWN_PUSH;
+      }
+    }
+
+    if (promotion != NOTHING) {
+      flags = (MoveFlag)((flags & CAPTURE) | KNIGHT_PROMOTION |
+                         (promotion - KNIGHT));
+    }
+  } else {
+    candidates =
+        attackersTo(position, to, occupancy) & position->pieces[us][type];
+    if (fromFile != NO_SQUARE) {
+      candidates &= FILE_A_MASK << fromFile;
+    }
+  }
+  if (fromRank != NO_SQUARE) {
+    candidates &= RANK_1_MASK << (fromRank * BOARD_LENGTH);
+  }
+
+  // Pinned pieces drop out here, more than one left is ambiguous
+  PackedMove found = NO_MOVE;
+  for (; candidates; candidates &= candidates - 1) {
+    const PackedMove move =
+        packMove((int8_t)__builtin_ctzll(candidates), to, flags);
+
+    if (isMoveLegal(position, move)) {
+      if (found != NO_MOVE) {
+        return NO_MOVE;
+      }
+      found = move;
+    }
+  }
+
+  return found;
+}
+
+size_t writeSan(const Position *position, const PackedMove move,
+                char out[SAN_MAX_LENGTH]) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(out != NULL);
+  assert(isMoveLegal(position, move));
+#endif /* ifndef NDEBUG */
+
+  const Color us = position->sideToMove;
+  const int8_t from = getMoveFrom(move), to = getMoveTo(move);
+  const Piece type = (Piece)position->board[from];
+  size_t length = 0;
+
+  if (isCastling(move)) {
+    const char *castling =
+        getMoveFlags(move) == KING_CASTLE ? "O-O" : "O-O-O";
+
+    length = strlen(castling);
+    memcpy(out, castling, length);
+  } else if (type == PAWN) {
+    if (isCapture(move)) {
+      out[length++] = (char)('a' + from % BOARD_LENGTH);
+      out[length++] = 'x';
+    }
+  } else {
+    out[length++] = PIECE_LETTERS[type];
+
+    // The other pieces of the type that could move there as legally
+    uint64_t others = attackersTo(position, to, getOccupancy(position)) &
+                      position->pieces[us][type] & ~(1ULL << from);
+    for (uint64_t rest = others; rest; rest &= rest - 1) {
+      const int8_t other = (int8_t)__builtin_ctzll(rest);
+
+      if (!isMoveLegal(position, packMove(other, to, getMoveFlags(move)))) {
+        others &= ~(1ULL << other);
+      }
+    }
+
+    if (others) {
+      if (!(others & (FILE_A_MASK << (from % BOARD_LENGTH)))) {
+        out[length++] = (char)('a' + from % BOARD_LENGTH);
+      } else if (!(others & (RANK_1_MASK << (from / BOARD_LENGTH *
+                                             BOARD_LENGTH)))) {
+        out[length++] = (char)('1' + from / BOARD_LENGTH);
+      } else {
+        out[length++] = (char)('a' + from % BOARD_LENGTH);
+        out[length++] = (char)('1' + from / BOARD_LENGTH);
+      }
+    }
+    if (isCapture(move)) {
+      out[length++] = 'x';
+    }
+  }
+
+  if (!isCastling(move)) {
+    out[length++] = (char)('a' + to % BOARD_LENGTH);
+    out[length++] = (char)('1' + to / BOARD_LENGTH);
+  }
+  if (isPromotion(move)) {
+    out[length++] = '=';
+    out[length++] = PIECE_LETTERS[getPromotionPiece(move)];
+  }
+
+  Position after = *position;
+  UndoInfo undo;
+  makeMove(&after, move, &undo);
+  if (isSquareAttacked(&after,
+                       (int8_t)__builtin_ctzll(after.pieces[!us][KING]), us)) {
+    MoveList list;
+
+    generateLegalMoves(&after, &list);
+    out[length++] = list.count ? '+' : '#';
+  }
+
+  out[length] = '\0';
+  return length;
+}
+
+// Start of the first game at or after `offset`: a line opening with '['
+// right after a blank line. Shards on both sides of a cut find the same one.
+static size_t findGameStart(const char *data, const size_t size,
+                            const size_t offset) {
+  if (offset == 0 || offset >= size) {
+    return offset < size ? offset : size;
+  }
+
+  for (size_t line = skipLine(data, size, offset - 1); line < size;
+       line = skipLine(data, size, line)) {
+    if (data[line] != '[') {
+      continue;
+    }
+
+    size_t previous = line - 1; // The newline ending the line before
+    while (previous > 0 && isBlank(data[previous - 1]) &&
+           data[previous - 1] != '\n') {
+      previous--;
+    }
+    if (previous == 0 || data[previous - 1] == '\n') {
+      return line;
+    }
+  }
+
+  return size;
+}
+
+static void replayShard(PgnWorker *worker, const size_t start,
+                        const size_t end) {
+  const PgnJob *job = worker->job;
+  PgnReader reader = {.data = job->data + start, .size = end - start};
+  PgnGame game;
+
+  while (readPgnGame(&reader, &game) == PGN_FOUND) {
+    PgnReplay replay;
+    PgnStatus status = startPgnReplay(&replay, &game);
+    PackedMove move;
+
+    while (status == PGN_FOUND &&
+           (status = readPgnMove(&replay, &move)) == PGN_FOUND) {
+      UndoInfo undo;
+
+      if (job->visitor) {
+        job->visitor(job->context, worker->index, &replay.position, move);
+      }
+      makeMove(&replay.position, move, &undo);
+      worker->stats.positions++;
+    }
+
+    worker->stats.games++;
+    worker->stats.invalidGames += status == PGN_INVALID;
+  }
+}
+
+static void *runPgnWorker(void *argument) {
+  PgnWorker *worker = argument;
+  PgnJob *job = worker->job;
+
+  for (;;) {
+    const uint32_t shard =
+        __atomic_fetch_add(&job->nextShard, 1, __ATOMIC_RELAXED);
+    if (shard >= job->shards) {
+      return NULL;
+    }
+
+    const uint64_t size = job->size;
+    const size_t start = findGameStart(
+        job->data, job->size, (size_t)(size * shard / job->shards));
+    const size_t end = findGameStart(
+        job->data, job->size, (size_t)(size * (shard + 1) / job->shards));
+    if (start < end) {
+      replayShard(worker, start, end);
+    }
+  }
+}
+
+bool replayPgn(const char *path, const uint16_t threads,
+               const PgnVisitor visitor, void *context, PgnStats *stats) {
+#ifndef NDEBUG
+  assert(path != NULL);
+  assert(stats != NULL);
+#endif /* ifndef NDEBUG */
+
+  PgnReader reader;
+  memset(stats, 0, sizeof(*stats));
+  if (threads == 0 || !openPgn(&reader, path)) {
+    return false;
+  }
+
+  PgnWorker *workers = calloc(threads, sizeof(PgnWorker));
+  if (!workers) {
+    closePgn(&reader);
+    return false;
+  }
+
+  PgnJob job = {
+      .data = reader.data,
+      .size = reader.size,
+      .shards = (uint32_t)threads * PGN_SHARDS_PER_THREAD,
+      .visitor = visitor,
+      .context = context,
+  };
+  // Threads read the shards all over the file, not front to back
+  if (reader.size > 0) {
+    (void)posix_madvise((void *)reader.data, reader.size, POSIX_MADV_WILLNEED);
+  }
+
+  uint16_t started = 0;
+  for (; started < threads; started++) {
+    workers[started].job = &job;
+    workers[started].index = started;
+    if (pthread_create(&workers[started].thread, NULL, runPgnWorker,
+                       &workers[started]) != 0) {
+      break;
+    }
+  }
+
+  // The shards of threads that couldn't start were taken by the others
+  for (uint16_t index = 0; index < started; index++) {
+    pthread_join(workers[index].thread, NULL);
+    stats->games += workers[index].stats.games;
+    stats->positions += workers[index].stats.positions;
+    stats->invalidGames += workers[index].stats.invalidGames;
+  }
+
+  free(workers);
+  closePgn(&reader);
+  return started > 0;
+}
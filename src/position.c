@@ -0,0 +1,630 @@
+#include "position.h"
+#include "bitboard.h"
+#include "luts.h"
+#include "sysifus.h"
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+// Rights lost when a piece leaves or lands on each square
+static const uint8_t CASTLING_RIGHTS_LOST[BOARD_AREA] = {
+    [0] = WHITE_QUEENSIDE,
+    [4] = WHITE_KINGSIDE | WHITE_QUEENSIDE,
+    [7] = WHITE_KINGSIDE,
+    [56] = BLACK_QUEENSIDE,
+    [60] = BLACK_KINGSIDE | BLACK_QUEENSIDE,
+    [63] = BLACK_KINGSIDE,
+};
+
+// Square of the pawn taken en passant, behind the one the capturer lands on
+static inline int8_t getEnPassantVictim(const int8_t to, const Color us) {
+  return (int8_t)(us == WHITE ? to - BOARD_LENGTH : to + BOARD_LENGTH);
+}
+
+// Where the rook starts and ends when the king castles to `to`
+static inline void getCastlingRook(const PackedMove move, int8_t *from,
+                                   int8_t *to) {
+  const int8_t king = getMoveTo(move);
+
+  *from = (int8_t)(getMoveFlags(move) == KING_CASTLE ? king + 1 : king - 2);
+  *to = (int8_t)(getMoveFlags(move) == KING_CASTLE ? king - 1 : king + 1);
+}
+
+static Piece pieceFromChar(const char symbol) {
+  switch (symbol | 0x20) { // Lowercase it, both colors share the letter
+  case 'p':
+    return PAWN;
+  case 'n':
+    return KNIGHT;
+  case 'b':
+    return BISHOP;
+  case 'r':
+    return ROOK;
+  case 'q':
+    return QUEEN;
+  case 'k':
+    return KING;
+  default:
+    return NOTHING;
+  }
+}
+
+void clearPosition(Position *position) {
+#ifndef NDEBUG
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  memset(position, 0, sizeof(*position));
+  memset(position->board, NOTHING, sizeof(position->board));
+  position->enPassant = NO_SQUARE;
+  position->fullmoveNumber = 1;
+  position->hash = ZOBRIST_CASTLING_KEYS[0];
+}
+
+// Flips a piece on or off the bitboards and the hash, the mailbox is left to
+// the caller
+static inline void togglePiece(Position *position, const Color color,
+                               const Piece type, const int8_t square) {
+  const uint64_t bit = 1ULL << square;
+
+  position->pieces[color][type] ^= bit;
+  position->occupancy[color] ^= bit;
+  position->hash ^= ZOBRIST_PIECE_KEYS[color][type][square];
+}
+
+void putPiece(Position *position, const Color color, const Piece type,
+              const int8_t square) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(position->board[square] == NOTHING);
+#endif /* ifndef NDEBUG */
+
+  togglePiece(position, color, type, square);
+  position->board[square] = (uint8_t)type;
+}
+
+uint64_t computeHash(const Position *position) {
+#ifndef NDEBUG
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  uint64_t hash = ZOBRIST_CASTLING_KEYS[position->castlingRights];
+
+  for (Color color = WHITE; color < COLORS; color++) {
+    for (Piece type = PAWN; type < NOTHING; type++) {
+      for (uint64_t pieces = position->pieces[color][type]; pieces;
+           pieces &= pieces - 1) {
+        hash ^= ZOBRIST_PIECE_KEYS[color][type][__builtin_ctzll(pieces)];
+      }
+    }
+  }
+  if (position->enPassant != NO_SQUARE) {
+    hash ^= ZOBRIST_EN_PASSANT_KEYS[position->enPassant % BOARD_LENGTH];
+  }
+  if (position->sideToMove == BLACK) {
+    hash ^= ZOBRIST_SIDE_KEY;
+  }
+
+  return hash;
+}
+
+static const char *parseCounter(const char *fen, const char *end,
+                                uint16_t *counter) {
+  while (fen < end && *fen == ' ') {
+    fen++;
+  }
+  if (fen == end || *fen < '0' || *fen > '9') {
+    return NULL;
+  }
+
+  uint32_t value = 0;
+  for (; fen < end && *fen >= '0' && *fen <= '9'; fen++) {
+    value = (value * 10) + (uint32_t)(*fen - '0');
+    if (value > UINT16_MAX) {
+      return NULL;
+    }
+  }
+  *counter = (uint16_t)value;
+
+  return fen;
+}
+
+// Whether the next field, after the spaces, starts with a digit
+static bool hasCounter(const char *fen, const char *end) {
+  while (fen < end && *fen == ' ') {
+    fen++;
+  }
+
+  return fen < end && *fen >= '0' && *fen <= '9';
+}
+
+size_t parseFenSpan(Position *position, const char *fen, const size_t length) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(fen != NULL || length == 0);
+#endif /* ifndef NDEBUG */
+
+  const char *start = fen;
+  const char *end = fen + length;
+
+  clearPosition(position);
+
+  // FEN starts on the 8th rank and goes down to the 1st
+  int8_t rank = BOARD_LENGTH - 1;
+  int8_t file = 0;
+
+  for (; fen < end && *fen != ' '; fen++) {
+    if (*fen == '/') {
+      if (file != BOARD_LENGTH || rank == 0) {
+        return 0;
+      }
+      rank--;
+      file = 0;
+    } else if (*fen >= '1' && *fen <= '8') {
+      file = (int8_t)(file + (*fen - '0'));
+    } else {
+      const Piece type = pieceFromChar(*fen);
+      const Coordinate coord = {rank, file};
+
+      if (type == NOTHING || !isCoordValid(coord)) {
+        return 0;
+      }
+      putPiece(position, (*fen >= 'a') ? BLACK : WHITE, type,
+               coordToSquare(coord));
+      file++;
+    }
+
+    if (file > BOARD_LENGTH) {
+      return 0;
+    }
+  }
+
+  // Side to move, castling rights and en passant square take at least 6 more
+  // bytes, checking once keeps the field parsing below free of bound checks
+  // until the optional counters
+  if (rank != 0 || file != BOARD_LENGTH || end - fen < 6) {
+    return 0;
+  }
+  fen++;
+
+  switch (*fen++) {
+  case 'w':
+    position->sideToMove = WHITE;
+    break;
+  case 'b':
+    position->sideToMove = BLACK;
+    break;
+  default:
+    return 0;
+  }
+
+  if (*fen++ != ' ') {
+    return 0;
+  }
+  if (*fen == '-') {
+    fen++;
+  } else {
+    for (; fen < end && *fen != ' '; fen++) {
+      switch (*fen) {
+      case 'K':
+        position->castlingRights |= WHITE_KINGSIDE;
+        break;
+      case 'Q':
+        position->castlingRights |= WHITE_QUEENSIDE;
+        break;
+      case 'k':
+        position->castlingRights |= BLACK_KINGSIDE;
+        break;
+      case 'q':
+        position->castlingRights |= BLACK_QUEENSIDE;
+        break;
+      default:
+        return 0;
+      }
+    }
+  }
+
+  if (end - fen < 2 || *fen++ != ' ') {
+    return 0;
+  }
+  if (*fen == '-') {
+    fen++;
+  } else {
+    if (end - fen < 2) {
+      return 0;
+    }
+
+    const Coordinate coord = {(int8_t)(fen[1] - '1'), (int8_t)(fen[0] - 'a')};
+    if (!isCoordValid(coord)) {
+      return 0;
+    }
+    position->enPassant = coordToSquare(coord);
+    fen += 2;
+  }
+
+  // Plenty of EPD-like strings stop right after the en passant square, and
+  // EPD follows it with operations instead
+  if (hasCounter(fen, end)) {
+    uint16_t halfmoveClock;
+
+    fen = parseCounter(fen, end, &halfmoveClock);
+    if (!fen || halfmoveClock > UINT8_MAX) {
+      return 0;
+    }
+    position->halfmoveClock = (uint8_t)halfmoveClock;
+
+    fen = parseCounter(fen, end, &position->fullmoveNumber);
+    if (!fen) {
+      return 0;
+    }
+  }
+
+  if (!isPositionValid(position)) {
+    return 0;
+  }
+
+  // The pieces are already hashed by putPiece, only the state keys are left
+  position->hash ^= ZOBRIST_CASTLING_KEYS[0] ^
+                    ZOBRIST_CASTLING_KEYS[position->castlingRights];
+  if (position->enPassant != NO_SQUARE) {
+    position->hash ^=
+        ZOBRIST_EN_PASSANT_KEYS[position->enPassant % BOARD_LENGTH];
+  }
+  if (position->sideToMove == BLACK) {
+    position->hash ^= ZOBRIST_SIDE_KEY;
+  }
+
+  return (size_t)(fen - start);
+}
+
+bool isEnPassantSquareValid(const Position *position) {
+#ifndef NDEBUG
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  const int8_t square = position->enPassant;
+  if (square == NO_SQUARE) {
+    return true;
+  }
+
+  const Color us = position->sideToMove;
+  const int8_t rank = us == WHITE ? 5 : 2;
+  const int8_t pawn =
+      (int8_t)(us == WHITE ? square - BOARD_LENGTH : square + BOARD_LENGTH);
+
+  return square >= 0 && square < BOARD_AREA &&
+         square / BOARD_LENGTH == rank && position->board[square] == NOTHING &&
+         ((position->pieces[!us][PAWN] >> pawn) & 1);
+}
+
+bool isPositionValid(const Position *position) {
+#ifndef NDEBUG
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  for (Color color = WHITE; color < COLORS; color++) {
+    if (__builtin_popcountll(position->pieces[color][KING]) != 1 ||
+        __builtin_popcountll(position->occupancy[color]) > MAX_SIDE_PIECES) {
+      return false;
+    }
+  }
+
+  const Color us = position->sideToMove;
+  const int8_t theirKing =
+      (int8_t)__builtin_ctzll(position->pieces[!us][KING]);
+
+  return !isSquareAttacked(position, theirKing, us) &&
+         isEnPassantSquareValid(position);
+}
+
+bool parseFen(Position *position, const char *fen) {
+#ifndef NDEBUG
+  assert(fen != NULL);
+#endif /* ifndef NDEBUG */
+
+  return parseFenSpan(position, fen, strlen(fen)) != 0;
+}
+
+static char *writeCounter(char *out, uint16_t counter) {
+  char digits[5];
+  uint8_t count = 0;
+
+  do {
+    digits[count++] = (char)('0' + (counter % 10));
+    counter /= 10;
+  } while (counter);
+
+  while (count) {
+    *out++ = digits[--count];
+  }
+  return out;
+}
+
+size_t writeFen(const Position *position, char out[FEN_MAX_LENGTH]) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(out != NULL);
+#endif /* ifndef NDEBUG */
+
+  static const char PIECE_CHARS[COLORS][PIECE_TYPES] = {
+      {'P', 'N', 'B', 'R', 'Q', 'K'}, {'p', 'n', 'b', 'r', 'q', 'k'}};
+  char *cursor = out;
+
+  for (int8_t rank = BOARD_LENGTH - 1; rank >= 0; rank--) {
+    uint8_t emptySquares = 0;
+
+    for (int8_t file = 0; file < BOARD_LENGTH; file++) {
+      const int8_t square = coordToSquare((Coordinate){rank, file});
+      const uint8_t type = position->board[square];
+
+      if (type == NOTHING) {
+        emptySquares++;
+        continue;
+      }
+      if (emptySquares) {
+        *cursor++ = (char)('0' + emptySquares);
+        emptySquares = 0;
+      }
+      *cursor++ =
+          PIECE_CHARS[(position->occupancy[BLACK] >> square) & 1][type];
+    }
+
+    if (emptySquares) {
+      *cursor++ = (char)('0' + emptySquares);
+    }
+    if (rank > 0) {
+      *cursor++ = '/';
+    }
+  }
+
+  *cursor++ = ' ';
+  *cursor++ = position->sideToMove == WHITE ? 'w' : 'b';
+
+  *cursor++ = ' ';
+  if (position->castlingRights == 0) {
+    *cursor++ = '-';
+  } else {
+    static const char CASTLING_CHARS[] = {'K', 'Q', 'k', 'q'};
+
+    for (uint8_t right = 0; right < 4; right++) {
+      if (position->castlingRights & (1 << right)) {
+        *cursor++ = CASTLING_CHARS[right];
+      }
+    }
+  }
+
+  *cursor++ = ' ';
+  if (position->enPassant == NO_SQUARE) {
+    *cursor++ = '-';
+  } else {
+    *cursor++ = (char)('a' + (position->enPassant % BOARD_LENGTH));
+    *cursor++ = (char)('1' + (position->enPassant / BOARD_LENGTH));
+  }
+
+  *cursor++ = ' ';
+  cursor = writeCounter(cursor, position->halfmoveClock);
+  *cursor++ = ' ';
+  cursor = writeCounter(cursor, position->fullmoveNumber);
+  *cursor = '\0';
+
+  return (size_t)(cursor - out);
+}
+
+void makeMove(Position *position, const PackedMove move, UndoInfo *undo) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(undo != NULL);
+#endif /* ifndef NDEBUG */
+
+  const Color us = position->sideToMove;
+  const Color them = (Color)!us;
+  const int8_t from = getMoveFrom(move);
+  const int8_t to = getMoveTo(move);
+  const MoveFlag flags = getMoveFlags(move);
+  const Piece moved = (Piece)position->board[from];
+
+#ifndef NDEBUG
+  assert(moved != NOTHING);
+#endif /* ifndef NDEBUG */
+
+  undo->hash = position->hash;
+  undo->castlingRights = position->castlingRights;
+  undo->enPassant = position->enPassant;
+  undo->halfmoveClock = position->halfmoveClock;
+  undo->captured = NOTHING;
+
+  if (position->enPassant != NO_SQUARE) {
+    position->hash ^=
+        ZOBRIST_EN_PASSANT_KEYS[position->enPassant % BOARD_LENGTH];
+    position->enPassant = NO_SQUARE;
+  }
+
+  position->halfmoveClock++;
+  if (isCapture(move)) {
+    const int8_t victim = isEnPassant(move) ? getEnPassantVictim(to, us) : to;
+    undo->captured = position->board[victim];
+
+#ifndef NDEBUG
+    assert(undo->captured != NOTHING);
+#endif /* ifndef NDEBUG */
+
+    togglePiece(position, them, (Piece)undo->captured, victim);
+    position->board[victim] = NOTHING;
+    position->halfmoveClock = 0;
+  }
+
+  const Piece placed = isPromotion(move) ? getPromotionPiece(move) : moved;
+  togglePiece(position, us, moved, from);
+  togglePiece(position, us, placed, to);
+  position->board[from] = NOTHING;
+  position->board[to] = (uint8_t)placed;
+
+  if (isCastling(move)) {
+    int8_t rookFrom, rookTo;
+    getCastlingRook(move, &rookFrom, &rookTo);
+
+    togglePiece(position, us, ROOK, rookFrom);
+    togglePiece(position, us, ROOK, rookTo);
+    position->board[rookFrom] = NOTHING;
+    position->board[rookTo] = ROOK;
+  }
+
+  if (moved == PAWN) {
+    position->halfmoveClock = 0;
+  }
+  if (flags == DOUBLE_PAWN_PUSH) {
+    position->enPassant = (int8_t)((from + to) / 2);
+    position->hash ^= ZOBRIST_EN_PASSANT_KEYS[from % BOARD_LENGTH];
+  }
+
+  const uint8_t lost = CASTLING_RIGHTS_LOST[from] | CASTLING_RIGHTS_LOST[to];
+  if (position->castlingRights & lost) {
+    position->hash ^= ZOBRIST_CASTLING_KEYS[position->castlingRights];
+    position->castlingRights &= (uint8_t)~lost;
+    position->hash ^= ZOBRIST_CASTLING_KEYS[position->castlingRights];
+  }
+
+  if (us == BLACK) {
+    position->fullmoveNumber++;
+  }
+  position->sideToMove = them;
+  position->hash ^= ZOBRIST_SIDE_KEY;
+}
+
+void unmakeMove(Position *position, const PackedMove move,
+                const UndoInfo *undo) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(undo != NULL);
+#endif /* ifndef NDEBUG */
+
+  const Color them = position->sideToMove;
+  const Color us = (Color)!them;
+  const int8_t from = getMoveFrom(move);
+  const int8_t to = getMoveTo(move);
+  const Piece placed = (Piece)position->board[to];
+  const Piece moved = isPromotion(move) ? PAWN : placed;
+
+  togglePiece(position, us, placed, to);
+  togglePiece(position, us, moved, from);
+  position->board[to] = NOTHING;
+  position->board[from] = (uint8_t)moved;
+
+  if (undo->captured != NOTHING) {
+    const int8_t victim = isEnPassant(move) ? getEnPassantVictim(to, us) : to;
+
+    togglePiece(position, them, (Piece)undo->captured, victim);
+    position->board[victim] = undo->captured;
+  }
+
+  if (isCastling(move)) {
+    int8_t rookFrom, rookTo;
+    getCastlingRook(move, &rookFrom, &rookTo);
+
+    togglePiece(position, us, ROOK, rookTo);
+    togglePiece(position, us, ROOK, rookFrom);
+    position->board[rookTo] = NOTHING;
+    position->board[rookFrom] = ROOK;
+  }
+
+  if (us == BLACK) {
+    position->fullmoveNumber--;
+  }
+  position->sideToMove = us;
+  // The toggles above scrambled the hash, the saved one is the right one
+  position->hash = undo->hash;
+  position->castlingRights = undo->castlingRights;
+  position->enPassant = undo->enPassant;
+  position->halfmoveClock = undo->halfmoveClock;
+}
+
+void makeNullMove(Position *position, UndoInfo *undo) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(undo != NULL);
+#endif /* ifndef NDEBUG */
+
+  undo->hash = position->hash;
+  undo->castlingRights = position->castlingRights;
+  undo->enPassant = position->enPassant;
+  undo->halfmoveClock = position->halfmoveClock;
+  undo->captured = NOTHING;
+
+  if (position->enPassant != NO_SQUARE) {
+    position->hash ^=
+        ZOBRIST_EN_PASSANT_KEYS[position->enPassant % BOARD_LENGTH];
+    position->enPassant = NO_SQUARE;
+  }
+
+  position->halfmoveClock++;
+  position->sideToMove = (Color)!position->sideToMove;
+  position->hash ^= ZOBRIST_SIDE_KEY;
+}
+
+void unmakeNullMove(Position *position, const UndoInfo *undo) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(undo != NULL);
+#endif /* ifndef NDEBUG */
+
+  position->sideToMove = (Color)!position->sideToMove;
+  position->hash = undo->hash;
+  position->enPassant = undo->enPassant;
+  position->halfmoveClock = undo->halfmoveClock;
+}
+
+uint64_t getHashAfterMove(const Position *position, const PackedMove move) {
+#ifndef NDEBUG
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  const Color us = position->sideToMove;
+  const int8_t from = getMoveFrom(move);
+  const int8_t to = getMoveTo(move);
+  const Piece moved = (Piece)position->board[from];
+  const Piece placed = isPromotion(move) ? getPromotionPiece(move) : moved;
+  uint64_t hash = position->hash ^ ZOBRIST_SIDE_KEY ^
+                  ZOBRIST_PIECE_KEYS[us][moved][from] ^
+                  ZOBRIST_PIECE_KEYS[us][placed][to];
+
+  if (isCapture(move)) {
+    const int8_t victim = isEnPassant(move) ? getEnPassantVictim(to, us) : to;
+
+    hash ^= ZOBRIST_PIECE_KEYS[!us][position->board[victim]][victim];
+  }
+  if (isCastling(move)) {
+    int8_t rookFrom, rookTo;
+    getCastlingRook(move, &rookFrom, &rookTo);
+
+    hash ^= ZOBRIST_PIECE_KEYS[us][ROOK][rookFrom] ^
+            ZOBRIST_PIECE_KEYS[us][ROOK][rookTo];
+  }
+  if (position->enPassant != NO_SQUARE) {
+    hash ^= ZOBRIST_EN_PASSANT_KEYS[position->enPassant % BOARD_LENGTH];
+  }
+  if (getMoveFlags(move) == DOUBLE_PAWN_PUSH) {
+    hash ^= ZOBRIST_EN_PASSANT_KEYS[from % BOARD_LENGTH];
+  }
+
+  const uint8_t rights = position->castlingRights &
+                         (uint8_t)~(CASTLING_RIGHTS_LOST[from] |
+                                    CASTLING_RIGHTS_LOST[to]);
+  return hash ^ ZOBRIST_CASTLING_KEYS[position->castlingRights] ^
+         ZOBRIST_CASTLING_KEYS[rights];
+}
+
+void moveToString(const PackedMove move, char *out) {
+#ifndef NDEBUG
+  assert(out != NULL);
+#endif /* ifndef NDEBUG */
+
+  const int8_t from = getMoveFrom(move);
+  const int8_t to = getMoveTo(move);
+
+  out[0] = (char)('a' + (from % BOARD_LENGTH));
+  out[1] = (char)('1' + (from / BOARD_LENGTH));
+  out[2] = (char)('a' + (to % BOARD_LENGTH));
+  out[3] = (char)('1' + (to / BOARD_LENGTH));
+  out[4] = isPromotion(move) ? "nbrq"[getPromotionPiece(move) - KNIGHT] : '\0';
+  out[5] = '\0';
+}
@@ -0,0 +1,888 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "search.h"
+#include "evaluate.h"
+#include "hashtable.h"
+#include "movepicker.h"
+#include "nnue.h"
+#include "position.h"
+#include "see.h"
+#include "sysifus.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Power of two, the node counter doubles as the polling countdown
+#define NODES_BETWEEN_POLLS 2048
+// Positions older than the last 100 halfmoves can't repeat the current one,
+// the fifty move rule would have ended the game first
+#define REPETITION_WINDOW 100
+#define ASPIRATION_MIN_DEPTH 5
+#define ASPIRATION_WINDOW 25
+#define NULL_MOVE_MIN_DEPTH 3
+#define REVERSE_FUTILITY_MAX_DEPTH 6
+#define REVERSE_FUTILITY_MARGIN 80
+#define REDUCTION_MIN_DEPTH 3
+#define REDUCTION_MIN_MOVES 4
+#define MAX_HISTORY 16384
+#define MAX_QUIETS_TRIED 64
+
+// Helper threads skip some iterations so they spread over several depths
+// instead of all searching the one the main thread is on. Helper i follows
+// pattern (i - 1) % SKIP_PATTERNS and skips a depth when
+// (depth + phase) / size is odd.
+#define SKIP_PATTERNS 20
+static const uint8_t SKIP_SIZES[SKIP_PATTERNS] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                                  3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+static const uint8_t SKIP_PHASES[SKIP_PATTERNS] = {
+    0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+// Everything a thread writes while searching. Aligned so two threads never
+// write to the same cache line, the shared hash table aside.
+typedef struct {
+  Searcher *searcher;
+  pthread_t thread;
+  uint16_t index; // 0 is the thread runSearch was called on
+  Position position;
+  uint64_t nodes; // Only written by its thread, summed up by the others
+  uint8_t selectiveDepth;
+  // Hashes from the oldest position that can still repeat up to the current
+  // one, the last entry
+  uint16_t keyCount;
+  uint64_t keys[REPETITION_WINDOW + MAX_PLY + 1];
+  // With a network, the accumulator of each position from the root to the
+  // current one, the last entry. Null moves don't push one.
+  uint8_t accumulatorCount;
+  Accumulator accumulators[MAX_PLY + 1];
+  PackedMove killers[MAX_PLY][KILLER_MOVES];
+  // Indexed [side to move][from][to], moves that caused cutoffs score higher
+  int16_t history[COLORS][BOARD_AREA][BOARD_AREA];
+  // Triangular table: line `ply` holds the best line found from that ply
+  uint8_t pvLength[MAX_PLY + 1];
+  PackedMove pv[MAX_PLY + 1][MAX_PLY];
+} __attribute__((aligned(CACHE_LINE_SIZE))) SearchThread;
+
+struct Searcher {
+  TranspositionTable table;
+  SearchThread *threads;
+  uint16_t threadCount;
+
+  pthread_mutex_t lock;
+  pthread_cond_t wake, done;
+  uint64_t run;    // Bumped to wake the helpers up for a new search
+  uint16_t active; // Helpers yet to leave the current search
+  bool quit;
+
+  // Current search, set before the helpers wake up
+  SearchLimits limits;
+  uint64_t startNanoseconds; // Accessed atomically, so is `pondering`
+  bool pondering;
+  uint8_t maxDepth;
+  const Network *network;
+  SearchReport report;
+  void *reportContext;
+
+  // Read at every node by every thread, on a line of its own so the writes
+  // above don't invalidate it
+  bool stop __attribute__((aligned(CACHE_LINE_SIZE)));
+};
+
+static uint64_t getMonotonicNanoseconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return ((uint64_t)now.tv_sec * 1000000000) + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t getElapsedMilliseconds(const Searcher *searcher) {
+  return (getMonotonicNanoseconds() -
+          __atomic_load_n(&searcher->startNanoseconds, __ATOMIC_RELAXED)) /
+         1000000;
+}
+
+static inline bool isPondering(const Searcher *searcher) {
+  return __atomic_load_n(&searcher->pondering, __ATOMIC_RELAXED);
+}
+
+static inline bool isStopped(const Searcher *searcher) {
+  return __atomic_load_n(&searcher->stop, __ATOMIC_RELAXED);
+}
+
+static uint64_t getTotalNodes(const Searcher *searcher) {
+  uint64_t nodes = 0;
+
+  for (uint16_t threadIndex = 0; threadIndex < searcher->threadCount;
+       threadIndex++) {
+    nodes += __atomic_load_n(&searcher->threads[threadIndex].nodes,
+                             __ATOMIC_RELAXED);
+  }
+
+  return nodes;
+}
+
+static void pollLimits(SearchThread *thread) {
+  Searcher *searcher = thread->searcher;
+  const SearchLimits *limits = &searcher->limits;
+
+  if (isPondering(searcher)) {
+    return;
+  }
+  if ((limits->nodes && getTotalNodes(searcher) >= limits->nodes) ||
+      (limits->milliseconds &&
+       getElapsedMilliseconds(searcher) >= limits->milliseconds)) {
+    __atomic_store_n(&searcher->stop, true, __ATOMIC_RELAXED);
+  }
+}
+
+// Counts the node and every so often looks at the limits. Returns whether the
+// search has to unwind.
+static inline bool enterNode(SearchThread *thread, const uint8_t ply) {
+  __atomic_store_n(&thread->nodes, thread->nodes + 1, __ATOMIC_RELAXED);
+  thread->pvLength[ply] = 0;
+  if (ply > thread->selectiveDepth) {
+    thread->selectiveDepth = ply;
+  }
+  if ((thread->nodes & (NODES_BETWEEN_POLLS - 1)) == 0) {
+    pollLimits(thread);
+  }
+
+  return isStopped(thread->searcher);
+}
+
+static inline bool isInCheck(const Position *position) {
+  const Color us = position->sideToMove;
+
+  return isSquareAttacked(
+      position, (int8_t)__builtin_ctzll(position->pieces[us][KING]),
+      (Color)!us);
+}
+
+// Mates are stored as distances from the node rather than from the root, so
+// they stay right when the position comes back at another ply
+static inline int16_t scoreToTable(const int16_t score, const uint8_t ply) {
+  if (score >= SCORE_MATE_BOUND) {
+    return (int16_t)(score + ply);
+  }
+  if (score <= -SCORE_MATE_BOUND) {
+    return (int16_t)(score - ply);
+  }
+  return score;
+}
+
+static inline int16_t scoreFromTable(const int16_t score, const uint8_t ply) {
+  if (score >= SCORE_MATE_BOUND) {
+    return (int16_t)(score - ply);
+  }
+  if (score <= -SCORE_MATE_BOUND) {
+    return (int16_t)(score + ply);
+  }
+  return score;
+}
+
+static bool hasInsufficientMaterial(const Position *position) {
+  const uint64_t(*pieces)[PIECE_TYPES] = position->pieces;
+  const uint64_t minors = pieces[WHITE][KNIGHT] | pieces[WHITE][BISHOP] |
+                          pieces[BLACK][KNIGHT] | pieces[BLACK][BISHOP];
+
+  return !(pieces[WHITE][PAWN] | pieces[BLACK][PAWN] | pieces[WHITE][ROOK] |
+           pieces[BLACK][ROOK] | pieces[WHITE][QUEEN] | pieces[BLACK][QUEEN]) &&
+         __builtin_popcountll(minors) <= 1;
+}
+
+// A position seen once before in the game or the search already counts as a
+// draw, the side repeating it couldn't do better the first time either
+static bool isDraw(const SearchThread *thread) {
+  const Position *position = &thread->position;
+
+  if (position->halfmoveClock >= 100 || hasInsufficientMaterial(position)) {
+    return true;
+  }
+
+  const uint64_t hash = thread->keys[thread->keyCount - 1];
+  const int32_t oldest =
+      (int32_t)thread->keyCount - 1 - position->halfmoveClock;
+  for (int32_t keyIndex = (int32_t)thread->keyCount - 5;
+       keyIndex >= 0 && keyIndex >= oldest; keyIndex -= 2) {
+    if (thread->keys[keyIndex] == hash) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// The child's accumulator gets derived from the parent's before the move is
+// made, it needs the pieces the move takes off. Taking the move back only
+// drops it.
+static inline void playMove(SearchThread *thread, const PackedMove move,
+                            UndoInfo *undo) {
+  const Network *network = thread->searcher->network;
+
+  if (network) {
+    const uint8_t count = thread->accumulatorCount++;
+
+    updateAccumulator(network, &thread->position, move,
+                      &thread->accumulators[count - 1],
+                      &thread->accumulators[count]);
+  }
+  makeMove(&thread->position, move, undo);
+  thread->keys[thread->keyCount++] = thread->position.hash;
+}
+
+static inline void takeBack(SearchThread *thread, const PackedMove move,
+                            const UndoInfo *undo) {
+  thread->keyCount--;
+  thread->accumulatorCount -= thread->searcher->network != NULL;
+  unmakeMove(&thread->position, move, undo);
+}
+
+static inline int16_t evaluateThread(const SearchThread *thread) {
+  const Network *network = thread->searcher->network;
+
+  if (!network) {
+    return evaluate(&thread->position);
+  }
+
+  return evaluateNetwork(
+      network, &thread->position,
+      &thread->accumulators[thread->accumulatorCount - 1]);
+}
+
+static bool hasNonPawnMaterial(const Position *position) {
+  const uint64_t *pieces = position->pieces[position->sideToMove];
+
+  return (pieces[KNIGHT] | pieces[BISHOP] | pieces[ROOK] | pieces[QUEEN]) != 0;
+}
+
+static inline void updatePv(SearchThread *thread, const uint8_t ply,
+                            const PackedMove move) {
+  const uint8_t childLength = thread->pvLength[ply + 1];
+
+  thread->pv[ply][0] = move;
+  memcpy(&thread->pv[ply][1], thread->pv[ply + 1],
+         childLength * sizeof(PackedMove));
+  thread->pvLength[ply] = (uint8_t)(childLength + 1);
+}
+
+// Moves towards `bonus` by a share of the distance left, so scores stay
+// within MAX_HISTORY and recent cutoffs outweigh old ones
+static inline void updateHistory(int16_t *entry, const int32_t bonus) {
+  const int32_t magnitude = bonus < 0 ? -bonus : bonus;
+
+  *entry = (int16_t)(*entry + bonus - ((*entry * magnitude) / MAX_HISTORY));
+}
+
+static void rewardQuiet(SearchThread *thread, const uint8_t ply,
+                        const uint8_t depth, const PackedMove move,
+                        const PackedMove *quietsTried,
+                        const uint8_t quietCount) {
+  const Color us = thread->position.sideToMove;
+  const int32_t bonus = depth > 10 ? 1600 : 16 * depth * depth;
+
+  if (thread->killers[ply][0] != move) {
+    memmove(&thread->killers[ply][1], &thread->killers[ply][0],
+            (KILLER_MOVES - 1) * sizeof(PackedMove));
+    thread->killers[ply][0] = move;
+  }
+
+  updateHistory(&thread->history[us][getMoveFrom(move)][getMoveTo(move)],
+                bonus);
+  for (uint8_t quietIndex = 0; quietIndex < quietCount; quietIndex++) {
+    const PackedMove quiet = quietsTried[quietIndex];
+
+    updateHistory(&thread->history[us][getMoveFrom(quiet)][getMoveTo(quiet)],
+                  -bonus);
+  }
+}
+
+// floor(log2(value)) for value > 0
+static inline uint8_t getLog2(const uint32_t value) {
+  return (uint8_t)(31 - __builtin_clz(value));
+}
+
+// Only captures and promotions that don't lose material, until the position
+// is quiet enough for the static evaluation to be trusted
+static int16_t quiescence(SearchThread *thread, int16_t alpha,
+                          const int16_t beta, const uint8_t ply) {
+  Position *position = &thread->position;
+
+  if (enterNode(thread, ply)) {
+    return 0;
+  }
+  if (ply >= MAX_PLY - 1) {
+    return evaluateThread(thread);
+  }
+
+  // In check every evasion has to be looked at, standing pat isn't an option
+  const bool inCheck = isInCheck(position);
+  int16_t bestScore = (int16_t)(-SCORE_MATE + ply);
+  MovePicker picker;
+
+  if (inCheck) {
+    initMovePicker(&picker, position, NO_MOVE, NULL);
+  } else {
+    bestScore = evaluateThread(thread);
+    if (bestScore >= beta) {
+      return bestScore;
+    }
+    if (bestScore > alpha) {
+      alpha = bestScore;
+    }
+    initCapturePicker(&picker, position);
+  }
+
+  for (PackedMove move; (move = nextMove(&picker)) != NO_MOVE;) {
+    if (!inCheck &&
+        ((isPromotion(move) && getPromotionPiece(move) != QUEEN) ||
+         !seeGE(position, move, 0))) {
+      continue;
+    }
+
+    UndoInfo undo;
+    playMove(thread, move, &undo);
+    const int16_t score =
+        (int16_t)-quiescence(thread, (int16_t)-beta, (int16_t)-alpha,
+                             (uint8_t)(ply + 1));
+    takeBack(thread, move, &undo);
+
+    if (isStopped(thread->searcher)) {
+      return 0;
+    }
+    if (score > bestScore) {
+      bestScore = score;
+      if (score > alpha) {
+        alpha = score;
+        if (score >= beta) {
+          break;
+        }
+      }
+    }
+  }
+
+  return bestScore;
+}
+
+static int16_t searchNode(SearchThread *thread, int16_t alpha, int16_t beta,
+                          int8_t depth, const uint8_t ply,
+                          const bool nullAllowed) {
+  if (depth <= 0) {
+    return quiescence(thread, alpha, beta, ply);
+  }
+
+  Searcher *searcher = thread->searcher;
+  Position *position = &thread->position;
+  const bool pvNode = beta - alpha > 1;
+
+  if (enterNode(thread, ply)) {
+    return 0;
+  }
+
+  if (ply > 0) {
+    if (isDraw(thread)) {
+      return SCORE_DRAW;
+    }
+    if (ply >= MAX_PLY - 1) {
+      return evaluateThread(thread);
+    }
+
+    // No line from here can beat a mate already found closer to the root
+    if (alpha < -SCORE_MATE + ply) {
+      alpha = (int16_t)(-SCORE_MATE + ply);
+    }
+    if (beta > SCORE_MATE - ply - 1) {
+      beta = (int16_t)(SCORE_MATE - ply - 1);
+    }
+    if (alpha >= beta) {
+      return alpha;
+    }
+  }
+
+  const int16_t originalAlpha = alpha;
+  PackedMove hashMove = NO_MOVE;
+  uint64_t data;
+
+  if (probeTable(&searcher->table, position->hash, &data, NULL)) {
+    const SearchEntry entry = unpackSearchEntry(data);
+    const int16_t score = scoreFromTable(entry.score, ply);
+
+    hashMove = entry.move;
+    if (!pvNode && entry.depth >= depth &&
+        (entry.bound == BOUND_EXACT ||
+         (entry.bound == BOUND_LOWER && score >= beta) ||
+         (entry.bound == BOUND_UPPER && score <= alpha))) {
+      return score;
+    }
+  }
+
+  const bool inCheck = isInCheck(position);
+  if (inCheck) {
+    depth++;
+  }
+
+  if (!pvNode && !inCheck) {
+    const int16_t staticEval = evaluateThread(thread);
+
+    // So far above beta that a few plies won't bring it back
+    if (depth <= REVERSE_FUTILITY_MAX_DEPTH && beta < SCORE_MATE_BOUND &&
+        staticEval - (REVERSE_FUTILITY_MARGIN * depth) >= beta) {
+      return staticEval;
+    }
+
+    // Passing is almost never the best move, if even that fails high a real
+    // move will too. Without pieces zugzwang makes passing too good.
+    if (nullAllowed && depth >= NULL_MOVE_MIN_DEPTH && staticEval >= beta &&
+        hasNonPawnMaterial(position)) {
+      const int8_t reduction = (int8_t)(3 + (depth / 4));
+      UndoInfo undo;
+
+      makeNullMove(position, &undo);
+      thread->keys[thread->keyCount++] = position->hash;
+      const int16_t score = (int16_t)-searchNode(
+          thread, (int16_t)-beta, (int16_t)(-beta + 1),
+          (int8_t)(depth - 1 - reduction), (uint8_t)(ply + 1), false);
+      thread->keyCount--;
+      unmakeNullMove(position, &undo);
+
+      if (isStopped(searcher)) {
+        return 0;
+      }
+      if (score >= beta) {
+        return score >= SCORE_MATE_BOUND ? beta : score;
+      }
+    }
+  }
+
+  MovePicker picker;
+  PackedMove quietsTried[MAX_QUIETS_TRIED];
+  uint8_t quietCount = 0;
+  int16_t bestScore = -SCORE_INFINITE;
+  PackedMove bestMove = NO_MOVE;
+  uint16_t movesTried = 0;
+
+  initMovePicker(&picker, position, hashMove, thread->killers[ply]);
+  picker.history = thread->history[position->sideToMove];
+
+  for (PackedMove move; (move = nextMove(&picker)) != NO_MOVE;) {
+    const bool quiet = isQuiet(move);
+    const int8_t newDepth = (int8_t)(depth - 1);
+    UndoInfo undo;
+    int16_t score;
+
+    prefetchTable(&searcher->table, getHashAfterMove(position, move));
+    playMove(thread, move, &undo);
+    movesTried++;
+
+    if (movesTried == 1) {
+      score = (int16_t)-searchNode(thread, (int16_t)-beta, (int16_t)-alpha,
+                                   newDepth, (uint8_t)(ply + 1), true);
+    } else {
+      // Late quiet moves rarely turn out best, they get a shallower look
+      // first and only a full one if they beat alpha
+      int8_t reduction = 0;
+      if (depth >= REDUCTION_MIN_DEPTH && movesTried >= REDUCTION_MIN_MOVES &&
+          quiet && !inCheck) {
+        reduction =
+            (int8_t)((getLog2(depth) * getLog2(movesTried)) / 3 + !pvNode);
+        if (reduction > newDepth - 1) {
+          reduction = (int8_t)(newDepth - 1);
+        }
+        if (reduction < 0) {
+          reduction = 0;
+        }
+      }
+
+      score = (int16_t)-searchNode(
+          thread, (int16_t)(-alpha - 1), (int16_t)-alpha,
+          (int8_t)(newDepth - reduction), (uint8_t)(ply + 1), true);
+      if (score > alpha && reduction > 0) {
+        score = (int16_t)-searchNode(thread, (int16_t)(-alpha - 1),
+                                     (int16_t)-alpha, newDepth,
+                                     (uint8_t)(ply + 1), true);
+      }
+      if (score > alpha && score < beta) {
+        score = (int16_t)-searchNode(thread, (int16_t)-beta, (int16_t)-alpha,
+                                     newDepth, (uint8_t)(ply + 1), true);
+      }
+    }
+
+    takeBack(thread, move, &undo);
+    if (isStopped(searcher)) {
+      return 0;
+    }
+
+    if (score > bestScore) {
+      bestScore = score;
+      if (score > alpha) {
+        bestMove = move;
+        alpha = score;
+        updatePv(thread, ply, move);
+        if (score >= beta) {
+          if (quiet) {
+            rewardQuiet(thread, ply, (uint8_t)depth, move, quietsTried,
+                        quietCount);
+          }
+          break;
+        }
+      }
+    }
+    if (quiet && quietCount < MAX_QUIETS_TRIED) {
+      quietsTried[quietCount++] = move;
+    }
+  }
+
+  if (movesTried == 0) {
+    return inCheck ? (int16_t)(-SCORE_MATE + ply) : SCORE_DRAW;
+  }
+
+  // A fail low has no best move, the previous one is still the best guess
+  const SearchEntry entry = {
+      .move = bestMove != NO_MOVE ? bestMove : hashMove,
+      .score = scoreToTable(bestScore, ply),
+      .bound = bestScore >= beta             ? BOUND_LOWER
+               : bestScore > originalAlpha ? BOUND_EXACT
+                                           : BOUND_UPPER,
+  };
+  storeTable(&searcher->table, position->hash, (uint8_t)depth,
+             packSearchEntry(&entry), NULL);
+
+  return bestScore;
+}
+
+// Narrow window around the previous score, widened on the failing side until
+// the score falls inside
+static int16_t searchRoot(SearchThread *thread, const uint8_t depth,
+                          const int16_t previousScore) {
+  int16_t window = ASPIRATION_WINDOW;
+  int16_t alpha = -SCORE_INFINITE, beta = SCORE_INFINITE;
+
+  if (depth >= ASPIRATION_MIN_DEPTH) {
+    alpha = (int16_t)(previousScore - window > -SCORE_INFINITE
+                          ? previousScore - window
+                          : -SCORE_INFINITE);
+    beta = (int16_t)(previousScore + window < SCORE_INFINITE
+                         ? previousScore + window
+                         : SCORE_INFINITE);
+  }
+
+  for (;;) {
+    const int16_t score =
+        searchNode(thread, alpha, beta, (int8_t)depth, 0, false);
+
+    if (isStopped(thread->searcher)) {
+      return score;
+    }
+    if (score <= alpha && alpha > -SCORE_INFINITE) {
+      alpha = (int16_t)(score - window > -SCORE_INFINITE ? score - window
+                                                         : -SCORE_INFINITE);
+    } else if (score >= beta && beta < SCORE_INFINITE) {
+      beta = (int16_t)(score + window < SCORE_INFINITE ? score + window
+                                                       : SCORE_INFINITE);
+    } else {
+      return score;
+    }
+    window = (int16_t)(window < SCORE_INFINITE / 4 ? window * 2 : window);
+  }
+}
+
+// Whether a helper leaves this iteration to the other threads
+static bool isDepthSkipped(const SearchThread *thread, const uint8_t depth) {
+  if (thread->index == 0) {
+    return false;
+  }
+
+  const uint8_t pattern = (uint8_t)((thread->index - 1) % SKIP_PATTERNS);
+  return ((depth + SKIP_PHASES[pattern]) / SKIP_SIZES[pattern]) % 2 != 0;
+}
+
+// Iterative deepening up to the depth limit or until the search is stopped.
+// `result` keeps the last completed iteration. Only the main thread reports.
+static void iterate(SearchThread *thread, SearchResult *result) {
+  Searcher *searcher = thread->searcher;
+
+  for (uint8_t depth = 1; depth <= searcher->maxDepth; depth++) {
+    if (isDepthSkipped(thread, depth)) {
+      continue;
+    }
+
+    const int16_t score = searchRoot(thread, depth, result->score);
+
+    // A partial iteration can't be trusted, the previous one stands
+    if (isStopped(searcher) || thread->pvLength[0] == 0) {
+      break;
+    }
+
+    result->bestMove = thread->pv[0][0];
+    result->score = score;
+    result->depth = depth;
+    result->selectiveDepth = thread->selectiveDepth;
+    result->pvLength = thread->pvLength[0];
+    memcpy(result->pv, thread->pv[0], result->pvLength * sizeof(PackedMove));
+    if (thread->index == 0 && searcher->report) {
+      result->nodes = getTotalNodes(searcher);
+      result->milliseconds = getElapsedMilliseconds(searcher);
+      searcher->report(result, searcher->reportContext);
+    }
+
+    // A mate this close is the shortest there is, deeper won't change it
+    if ((score >= SCORE_MATE_BOUND || score <= -SCORE_MATE_BOUND) &&
+        SCORE_MATE - abs(score) <= depth) {
+      break;
+    }
+    // The next iteration would likely not finish in the time left
+    if (thread->index == 0 && searcher->limits.optimalMilliseconds &&
+        !isPondering(searcher) &&
+        getElapsedMilliseconds(searcher) >=
+            searcher->limits.optimalMilliseconds) {
+      break;
+    }
+  }
+}
+
+static void *runHelper(void *argument) {
+  SearchThread *thread = argument;
+  Searcher *searcher = thread->searcher;
+  uint64_t lastRun = 0;
+
+  for (;;) {
+    pthread_mutex_lock(&searcher->lock);
+    while (!searcher->quit && searcher->run == lastRun) {
+      pthread_cond_wait(&searcher->wake, &searcher->lock);
+    }
+    if (searcher->quit) {
+      pthread_mutex_unlock(&searcher->lock);
+      return NULL;
+    }
+    lastRun = searcher->run;
+    pthread_mutex_unlock(&searcher->lock);
+
+    // Helpers only fill the hash table, their own results go unused
+    SearchResult result = {0};
+    iterate(thread, &result);
+
+    // The search only ends once nobody can touch its fields any more
+    pthread_mutex_lock(&searcher->lock);
+    if (--searcher->active == 0) {
+      pthread_cond_broadcast(&searcher->done);
+    }
+    pthread_mutex_unlock(&searcher->lock);
+  }
+}
+
+Searcher *createSearcher(const size_t hashMegabytes, const uint16_t threads) {
+  if (threads == 0) {
+    return NULL;
+  }
+
+  void *memory = NULL;
+  if (posix_memalign(&memory, CACHE_LINE_SIZE, sizeof(Searcher)) != 0) {
+    return NULL;
+  }
+  Searcher *searcher = memset(memory, 0, sizeof(Searcher));
+
+  memory = NULL;
+  if (posix_memalign(&memory, CACHE_LINE_SIZE,
+                     threads * sizeof(SearchThread)) != 0 ||
+      !initTable(&searcher->table, hashMegabytes, REPLACE_DEPTH_AGE)) {
+    free(memory);
+    free(searcher);
+    return NULL;
+  }
+  searcher->threads = memset(memory, 0, threads * sizeof(SearchThread));
+  pthread_mutex_init(&searcher->lock, NULL);
+  pthread_cond_init(&searcher->wake, NULL);
+  pthread_cond_init(&searcher->done, NULL);
+
+  // The main thread is the one calling runSearch, only helpers get started
+  searcher->threads[0].searcher = searcher;
+  for (searcher->threadCount = 1; searcher->threadCount < threads;
+       searcher->threadCount++) {
+    SearchThread *thread = &searcher->threads[searcher->threadCount];
+
+    thread->searcher = searcher;
+    thread->index = searcher->threadCount;
+    if (pthread_create(&thread->thread, NULL, runHelper, thread) != 0) {
+      destroySearcher(searcher);
+      return NULL;
+    }
+  }
+
+  return searcher;
+}
+
+void destroySearcher(Searcher *searcher) {
+  if (!searcher) {
+    return;
+  }
+
+  pthread_mutex_lock(&searcher->lock);
+  searcher->quit = true;
+  pthread_cond_broadcast(&searcher->wake);
+  pthread_mutex_unlock(&searcher->lock);
+
+  for (uint16_t threadIndex = 1; threadIndex < searcher->threadCount;
+       threadIndex++) {
+    pthread_join(searcher->threads[threadIndex].thread, NULL);
+  }
+
+  pthread_cond_destroy(&searcher->done);
+  pthread_cond_destroy(&searcher->wake);
+  pthread_mutex_destroy(&searcher->lock);
+  freeTable(&searcher->table);
+  free(searcher->threads);
+  free(searcher);
+}
+
+uint16_t getSearchThreads(const Searcher *searcher) {
+#ifndef NDEBUG
+  assert(searcher != NULL);
+#endif /* ifndef NDEBUG */
+
+  return searcher->threadCount;
+}
+
+void clearSearcher(Searcher *searcher) {
+#ifndef NDEBUG
+  assert(searcher != NULL);
+#endif /* ifndef NDEBUG */
+
+  clearTable(&searcher->table);
+  for (uint16_t threadIndex = 0; threadIndex < searcher->threadCount;
+       threadIndex++) {
+    SearchThread *thread = &searcher->threads[threadIndex];
+
+    memset(thread->killers, 0, sizeof(thread->killers));
+    memset(thread->history, 0, sizeof(thread->history));
+  }
+}
+
+void setSearchNetwork(Searcher *searcher, const Network *network) {
+#ifndef NDEBUG
+  assert(searcher != NULL);
+#endif /* ifndef NDEBUG */
+
+  searcher->network = network;
+}
+
+void setSearchReport(Searcher *searcher, const SearchReport report,
+                     void *context) {
+#ifndef NDEBUG
+  assert(searcher != NULL);
+#endif /* ifndef NDEBUG */
+
+  searcher->report = report;
+  searcher->reportContext = context;
+}
+
+void ponderHit(Searcher *searcher) {
+#ifndef NDEBUG
+  assert(searcher != NULL);
+#endif /* ifndef NDEBUG */
+
+  __atomic_store_n(&searcher->startNanoseconds, getMonotonicNanoseconds(),
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&searcher->pondering, false, __ATOMIC_RELAXED);
+}
+
+uint16_t getSearchTableUsage(const Searcher *searcher) {
+#ifndef NDEBUG
+  assert(searcher != NULL);
+#endif /* ifndef NDEBUG */
+
+  return getTableUsage(&searcher->table);
+}
+
+void stopSearch(Searcher *searcher) {
+#ifndef NDEBUG
+  assert(searcher != NULL);
+#endif /* ifndef NDEBUG */
+
+  __atomic_store_n(&searcher->stop, true, __ATOMIC_RELAXED);
+}
+
+// Only the positions since the last capture or pawn move can repeat
+static void loadKeys(SearchThread *thread, const uint64_t *history,
+                     const size_t historyLength) {
+  const Position *position = &thread->position;
+  const size_t kept = historyLength < REPETITION_WINDOW
+                          ? historyLength
+                          : REPETITION_WINDOW;
+
+  if (kept > 0) {
+    memcpy(thread->keys, history + (historyLength - kept),
+           kept * sizeof(uint64_t));
+  }
+  thread->keyCount = (uint16_t)kept;
+  thread->keys[thread->keyCount++] = position->hash;
+}
+
+void runSearch(Searcher *searcher, const Position *position,
+               const uint64_t *history, const size_t historyLength,
+               const SearchLimits *limits, SearchResult *result) {
+#ifndef NDEBUG
+  assert(searcher != NULL);
+  assert(position != NULL);
+  assert(history != NULL || historyLength == 0);
+  assert(limits != NULL);
+  assert(result != NULL);
+#endif /* ifndef NDEBUG */
+
+  searcher->limits = *limits;
+  searcher->maxDepth =
+      limits->depth && limits->depth < MAX_PLY ? limits->depth : MAX_PLY - 1;
+  __atomic_store_n(&searcher->startNanoseconds, getMonotonicNanoseconds(),
+                   __ATOMIC_RELAXED);
+  __atomic_store_n(&searcher->pondering, limits->ponder, __ATOMIC_RELAXED);
+  __atomic_store_n(&searcher->stop, false, __ATOMIC_RELAXED);
+  ageTable(&searcher->table);
+
+  for (uint16_t threadIndex = 0; threadIndex < searcher->threadCount;
+       threadIndex++) {
+    SearchThread *thread = &searcher->threads[threadIndex];
+
+    thread->position = *position;
+    thread->nodes = 0;
+    thread->selectiveDepth = 0;
+    memset(thread->killers, 0, sizeof(thread->killers));
+    loadKeys(thread, history, historyLength);
+    thread->accumulatorCount = 0;
+    if (searcher->network) {
+      refreshAccumulator(searcher->network, position,
+                         &thread->accumulators[thread->accumulatorCount++]);
+    }
+  }
+
+  // Whatever happens there is a move to play, even if the first iteration
+  // gets cut short
+  MoveList legal;
+  generateLegalMoves(position, &legal);
+  memset(result, 0, sizeof(*result));
+  if (legal.count == 0) {
+    result->score = isInCheck(position) ? -SCORE_MATE : SCORE_DRAW;
+    return;
+  }
+  result->bestMove = legal.moves[0];
+
+  // Every helper is asleep between searches, the lock publishes the new one
+  pthread_mutex_lock(&searcher->lock);
+  searcher->active = (uint16_t)(searcher->threadCount - 1);
+  searcher->run++;
+  pthread_cond_broadcast(&searcher->wake);
+  pthread_mutex_unlock(&searcher->lock);
+
+  iterate(&searcher->threads[0], result);
+
+  // Helpers don't know the main thread is done unless told
+  stopSearch(searcher);
+  pthread_mutex_lock(&searcher->lock);
+  while (searcher->active > 0) {
+    pthread_cond_wait(&searcher->done, &searcher->lock);
+  }
+  pthread_mutex_unlock(&searcher->lock);
+
+  result->nodes = getTotalNodes(searcher);
+  result->milliseconds = getElapsedMilliseconds(searcher);
+}
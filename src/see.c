@@ -0,0 +1,195 @@
+#include "see.h"
+#include "position.h"
+#include "sysifus.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Exchanges can't be longer than the pieces able to reach one square
+#define MAX_EXCHANGE_LENGTH 32
+
+// Piece of `side` the exchange continues with, NOTHING if it has none left.
+// `from` gets its square.
+static Piece getLeastValuableAttacker(const Position *position,
+                                      const uint64_t attackers,
+                                      const Color side, uint64_t *from) {
+  for (Piece piece = PAWN; piece <= KING; piece++) {
+    const uint64_t candidates = attackers & position->pieces[side][piece];
+
+    if (candidates) {
+      *from = candidates & -candidates;
+      return piece;
+    }
+  }
+
+  return NOTHING;
+}
+
+// Sliders behind a piece that just left the line to the target square
+static uint64_t getRevealedAttackers(const Position *position,
+                                     const int8_t square, const Piece removed,
+                                     const uint64_t occupancy) {
+  const uint64_t(*pieces)[PIECE_TYPES] = position->pieces;
+  uint64_t revealed = 0;
+
+  if (removed == PAWN || removed == BISHOP || removed == QUEEN) {
+    revealed |= getDiagonalAttacks(square, occupancy) &
+                (pieces[WHITE][BISHOP] | pieces[BLACK][BISHOP] |
+                 pieces[WHITE][QUEEN] | pieces[BLACK][QUEEN]);
+  }
+  if (removed == ROOK || removed == QUEEN) {
+    revealed |= getOrthogonalAttacks(square, occupancy) &
+                (pieces[WHITE][ROOK] | pieces[BLACK][ROOK] |
+                 pieces[WHITE][QUEEN] | pieces[BLACK][QUEEN]);
+  }
+
+  return revealed;
+}
+
+// What the move itself takes, and the piece it leaves on the target square
+static int16_t getFirstGain(const Position *position, const PackedMove move,
+                            Piece *standing) {
+  int16_t gain = 0;
+
+  *standing = (Piece)position->board[getMoveFrom(move)];
+  if (isEnPassant(move)) {
+    gain = SEE_PIECE_VALUES[PAWN];
+  } else if (isCapture(move)) {
+    gain = SEE_PIECE_VALUES[position->board[getMoveTo(move)]];
+  }
+  if (isPromotion(move)) {
+    *standing = getPromotionPiece(move);
+    gain += SEE_PIECE_VALUES[*standing] - SEE_PIECE_VALUES[PAWN];
+  }
+
+  return gain;
+}
+
+// Board once the move is made: the mover left its square, and a pawn taken en
+// passant isn't on the target square
+static uint64_t getOccupancyAfter(const Position *position,
+                                  const PackedMove move) {
+  const int8_t to = getMoveTo(move);
+  uint64_t occupancy = getOccupancy(position) ^ (1ULL << getMoveFrom(move));
+
+  if (isEnPassant(move)) {
+    occupancy ^= 1ULL << (position->sideToMove == WHITE ? to - BOARD_LENGTH
+                                                        : to + BOARD_LENGTH);
+  }
+
+  return occupancy | (1ULL << to);
+}
+
+int16_t see(const Position *position, const PackedMove move) {
+#ifndef NDEBUG
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  if (isCastling(move)) {
+    return 0;
+  }
+
+  const int8_t to = getMoveTo(move);
+  int16_t gains[MAX_EXCHANGE_LENGTH];
+  Piece standing;
+  uint64_t occupancy = getOccupancyAfter(position, move);
+  uint64_t attackers = attackersTo(position, to, occupancy) & occupancy;
+  Color side = (Color)!position->sideToMove;
+  uint8_t depth = 0;
+
+  gains[0] = getFirstGain(position, move, &standing);
+  for (;;) {
+    uint64_t from;
+    const Piece capturer =
+        getLeastValuableAttacker(position, attackers, side, &from);
+
+    if (capturer == NOTHING || depth + 1 >= MAX_EXCHANGE_LENGTH) {
+      break;
+    }
+    // The king can't take if the other side would take it back
+    if (capturer == KING && (attackers & position->occupancy[!side])) {
+      break;
+    }
+
+    depth++;
+    gains[depth] = (int16_t)(SEE_PIECE_VALUES[standing] - gains[depth - 1]);
+    standing = capturer;
+    occupancy ^= from;
+    attackers = (attackers |
+                 getRevealedAttackers(position, to, capturer, occupancy)) &
+                occupancy;
+    side = (Color)!side;
+  }
+
+  // Each side can stop capturing whenever going on would lose material
+  while (depth > 0) {
+    depth--;
+    if (-gains[depth + 1] < gains[depth]) {
+      gains[depth] = (int16_t)-gains[depth + 1];
+    }
+  }
+
+  return gains[0];
+}
+
+bool seeGE(const Position *position, const PackedMove move,
+           const int16_t threshold) {
+#ifndef NDEBUG
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  if (isCastling(move)) {
+    return threshold <= 0;
+  }
+
+  const int8_t to = getMoveTo(move);
+  Piece standing;
+
+  // Even if nothing takes back, the move doesn't reach the threshold
+  int32_t balance = getFirstGain(position, move, &standing) - threshold;
+  if (balance < 0) {
+    return false;
+  }
+
+  // Even if the piece that moved gets taken for nothing, it still does
+  balance = SEE_PIECE_VALUES[standing] - balance;
+  if (balance <= 0) {
+    return true;
+  }
+
+  uint64_t occupancy = getOccupancyAfter(position, move);
+  uint64_t attackers = attackersTo(position, to, occupancy) & occupancy;
+  Color side = position->sideToMove;
+  bool reached = true;
+
+  // `balance` is what the side about to capture has to win back, with
+  // `reached` telling whether the threshold is met if it stops there
+  for (;;) {
+    side = (Color)!side;
+
+    uint64_t from;
+    const Piece capturer =
+        getLeastValuableAttacker(position, attackers, side, &from);
+    if (capturer == NOTHING) {
+      break;
+    }
+
+    reached = !reached;
+    if (capturer == KING) {
+      // Taking with the king only works if nothing can take it back
+      return (attackers & position->occupancy[!side]) ? !reached : reached;
+    }
+
+    balance = SEE_PIECE_VALUES[capturer] - balance;
+    if (balance < reached) {
+      break;
+    }
+
+    occupancy ^= from;
+    attackers = (attackers |
+                 getRevealedAttackers(position, to, capturer, occupancy)) &
+                occupancy;
+  }
+
+  return reached;
+}
@@ -1,10 +1,24 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "sysifus.h"
 #include "bitboard.h"
-#include "luts.h"
+#include "generators.h"
+#include "lutblob.h"
+#include "slidingluts.h"
 #include <assert.h>
-#include <immintrin.h>
+#include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
 uint64_t generatePawnPushes(const Coordinate coord,
                             const uint64_t blockedSquares, const bool isWhite) {
@@ -60,319 +74,259 @@ uint64_t generatePawnCaptures(const Coordinate coord, const uint64_t enemy,
   return captures & enemy;
 }
 
-static uint64_t generateJumpingAttack(const Coordinate offsets[JUMPING_OFFSETS],
-                                      const int8_t square) {
-#ifndef NDEBUG
-  assert(offsets != NULL);
-#endif /* ifndef  NDEBUG */
-
-  Coordinate coord = {
-      .rank = (int8_t)(square / BOARD_LENGTH),
-      .file = (int8_t)(square % BOARD_LENGTH),
-  };
-  uint64_t attack = 0;
+#if defined(__x86_64__)
+static inline uint64_t extractBits(const uint64_t bits, const uint64_t mask) {
+#if defined(__BMI2__)
+  return _pext_u64(bits, mask);
+#else
+  // Same instruction, without requiring the whole library to target BMI2
+  uint64_t extracted;
+  __asm__("pextq %2, %1, %0" : "=r"(extracted) : "r"(bits), "rm"(mask));
+  return extracted;
+#endif
+}
 
-  for (int8_t offsetIndex = 0; offsetIndex < JUMPING_OFFSETS; offsetIndex++) {
-    const Coordinate attackedCoord = {
-        (int8_t)(coord.rank + offsets[offsetIndex].rank),
-        (int8_t)(coord.file + offsets[offsetIndex].file),
-    };
+// BMI2 is there since Haswell and Zen 1, but Zen 1 and 2 run pext in microcode
+// at tens of cycles per lookup, much slower than a magic multiplication
+static bool isPextFast(void) {
+  unsigned int eax, ebx, ecx, edx;
 
-    if (isCoordValid(attackedCoord)) {
-      attack |= 1ULL << coordToSquare(attackedCoord);
-    }
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_BMI2)) {
+    return false;
   }
 
-  return attack;
-}
-
-static uint64_t generateOccupancyMask(const Coordinate coord) {
-  // 01111110
-  // 11111111
-  // 11111111
-  // 11111111
-  // 11111111
-  // 11111111
-  // 11111111
-  // 01111110
-  const uint64_t baseMask = 0x7EFFFFFFFFFFFF7E;
-
-  uint64_t mask = baseMask;
-  if (coord.rank != 0) {
-    // 11111111
-    // 11111111
-    // 11111111
-    // 11111111
-    // 11111111
-    // 11111111
-    // 11111111
-    // 00000000
-    const uint64_t rank1 = 0xFFFFFFFFFFFFFF00;
-    mask &= rank1;
-  }
-  if (coord.rank != BOARD_LENGTH - 1) {
-    // 00000000
-    // 11111111
-    // 11111111
-    // 11111111
-    // 11111111
-    // 11111111
-    // 11111111
-    // 11111111
-    const uint64_t rank8 = 0xFFFFFFFFFFFFFF;
-    mask &= rank8;
-  }
-  if (coord.file != 0) {
-    // 11111110
-    // 11111110
-    // 11111110
-    // 11111110
-    // 11111110
-    // 11111110
-    // 11111110
-    // 11111110
-    const uint64_t file8 = 0xFEFEFEFEFEFEFEFE;
-    mask &= file8;
-  }
-  if (coord.file != BOARD_LENGTH - 1) {
-
-    // 01111111
-    // 01111111
-    // 01111111
-    // 01111111
-    // 01111111
-    // 01111111
-    // 01111111
-    // 01111111
-    const uint64_t file1 = 0x7F7F7F7F7F7F7F7F;
-    mask &= file1;
-  }
-
-  return mask;
-}
-
-static uint64_t
-generateSlidingAttack(const uint64_t occupancy,
-                      const Coordinate directions[SLIDING_DIRECTIONS],
-                      const int8_t square) {
-#ifndef NDEBUG
-  assert(directions != NULL);
-#endif /* ifndef  NDEBUG */
-
-  Coordinate coord = {
-      .rank = (int8_t)(square / BOARD_LENGTH),
-      .file = (int8_t)(square % BOARD_LENGTH),
-  };
-  uint64_t attack = 0;
-
-  for (int8_t directionIndex = 0; directionIndex < SLIDING_DIRECTIONS;
-       directionIndex++) {
-    uint64_t ray = 0;
-
-    for (Coordinate attackedCoord =
-             {(int8_t)(coord.rank + directions[directionIndex].rank),
-              (int8_t)(coord.file + directions[directionIndex].file)};
-         isCoordValid(attackedCoord);
-         attackedCoord = (Coordinate){
-             (int8_t)(attackedCoord.rank + directions[directionIndex].rank),
-             (int8_t)(attackedCoord.file + directions[directionIndex].file),
-         }) {
-      ray |= 1ULL << coordToSquare(attackedCoord);
-
-      if (isSet(attackedCoord, occupancy)) {
-        break;
-      }
-    }
-
-    attack |= ray;
+  __get_cpuid(0, &eax, &ebx, &ecx, &edx);
+  if (ebx != signature_AMD_ebx || ecx != signature_AMD_ecx ||
+      edx != signature_AMD_edx) {
+    return true;
   }
 
-  return attack;
+  __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+  const unsigned int family = ((eax >> 8) & 0xF) + ((eax >> 20) & 0xFF);
+  return family >= 0x19; // Zen 3
 }
-
-typedef struct {
-  uint64_t mask;
-} RelevantMask;
-
-static void generateOccupancyVariants(const RelevantMask relevantMask,
-                                      const uint16_t possibleVariants,
-                                      uint64_t variants[possibleVariants]) {
-#ifndef NDEBUG
-  assert(variants != NULL);
 #endif
 
-  for (uint16_t variantIndex = 0; variantIndex < possibleVariants;
-       variantIndex++) {
-    // Iterate over bits of the variant index Brian Kernighan's way
-    // https://www.geeksforgeeks.org/count-set-bits-in-an-integer/
-    uint64_t variantIndexTemp = variantIndex;
-    uint64_t relevantMaskTemp = relevantMask.mask;
-    uint64_t occupancy = 0;
-
-    while (variantIndexTemp) {
-      // This a & -a just isolate the least significant bit of number
-      const uint64_t relevantMaskLSB = relevantMaskTemp & -relevantMaskTemp;
-      const bool isCurrentBitSet = variantIndexTemp & 1;
-
-      if (isCurrentBitSet) {
-        occupancy |= relevantMaskLSB; // Append the relevant  mask's lsb
-      }
-
-      // Delete the lsb from the relevant mask
-      relevantMaskTemp &= ~relevantMaskLSB;
-      variantIndexTemp >>= 1; // Move one bit forward
-    }
+static SlidingIndexing slidingIndexing = INDEX_BY_MAGIC;
 
-    variants[variantIndex] = occupancy;
+// Runs once when the library gets loaded, before any lookup
+__attribute__((constructor)) static void initSlidingIndexing(void) {
+#if defined(__x86_64__)
+  if (isPextFast()) {
+    slidingIndexing = INDEX_BY_PEXT;
   }
+#endif
 }
 
-static uint16_t getVariantIndex(const uint64_t occupancy,
-                                const RelevantMask relevantMask) {
-  // Filter only relevant bits and compress them to LSB positions
-  const uint64_t occupied = occupancy & relevantMask.mask;
+SlidingIndexing getSlidingIndexing(void) { return slidingIndexing; }
 
-// Use pext instruction if available (Intel/AMD CPUs with BMI2)
-#if defined(__BMI2__)
-  return _pext_u64(occupied, relevantMask.mask);
+bool setSlidingIndexing(const SlidingIndexing indexing) {
+#if defined(__x86_64__)
+  unsigned int eax, ebx, ecx, edx;
+  const bool hasPext = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+                       (ebx & bit_BMI2);
 #else
-  // Fallback: Multiply-and-mask technique for bit compression
-  const uint64_t spacedBits = occupied * relevantMask.mask;
-  return (spacedBits >>
-          (BOARD_AREA - __builtin_popcountll(relevantMask.mask))) &
-         ((1 << __builtin_popcountll(relevantMask.mask)) - 1);
+  const bool hasPext = false;
 #endif
+
+  if (indexing == INDEX_BY_PEXT && !hasPext) {
+    return false;
+  }
+
+  slidingIndexing = indexing;
+  return true;
 }
 
-static void
-generateSlidingRelevantMasksLUT(const Coordinate directions[SLIDING_DIRECTIONS],
-                                uint64_t lut[BOARD_AREA]) {
-  for (int8_t square = 0; square < BOARD_AREA; square++) {
-    lut[square] = generateSlidingAttack(0, directions, square) &
-                  generateOccupancyMask((Coordinate){
-                      .rank = (int8_t)(square / BOARD_LENGTH),
-                      .file = (int8_t)(square % BOARD_LENGTH),
-                  });
-  }
-}
-
-static void writeHeader(FILE *fptr) {
-  (void)fprintf(fptr, "// This file stores generated LUTs. DO NOT MODIFY!\n\n");
-  (void)fprintf(fptr, "#pragma once\n\n");
-  (void)fprintf(fptr, "#include \"bitboard.h\"\n\n");
-}
-
-static void writeJumpingAttackMap(FILE *fptr, const char *name,
-                                  const Coordinate offsets[JUMPING_OFFSETS]) {
-  (void)fprintf(fptr, "static const uint64_t %s[BOARD_AREA] = {", name);
-  for (int8_t square = 0; square < BOARD_AREA; square++) {
-    (void)fprintf(fptr, (square < BOARD_AREA - 1) ? "0x%016lx, " : "0x%016lx",
-                  generateJumpingAttack(offsets, square));
-  }
-  (void)fprintf(fptr, "};\n");
-}
-
-static void writeSlidingRelevantMask(FILE *fptr, const char *name,
-                                     const uint64_t lut[BOARD_AREA]) {
-  (void)fprintf(fptr, "static const uint64_t %s[BOARD_AREA] = {", name);
-  for (int8_t square = 0; square < BOARD_AREA; square++) {
-    (void)fprintf(fptr, (square < BOARD_AREA - 1) ? "0x%016lx, " : "0x%016lx",
-                  lut[square]);
-  }
-  (void)fprintf(fptr, "};\n");
-}
-
-static void
-writeSlidingAttackMap(FILE *fptr, const char *name,
-                      const uint64_t relevantMasks[BOARD_AREA],
-                      const uint16_t possibleVariants,
-                      const Coordinate directions[SLIDING_DIRECTIONS]) {
-  (void)fprintf(fptr, "static const uint64_t %s[BOARD_AREA][%d] = {", name,
-                possibleVariants);
-  for (int8_t square = 0; square < BOARD_AREA; square++) {
-    uint64_t occupancyVariants[possibleVariants];
-    generateOccupancyVariants((RelevantMask){relevantMasks[square]},
-                              possibleVariants, occupancyVariants);
-
-    (void)fprintf(fptr, "{");
-    for (uint16_t variantIndex = 0; variantIndex < possibleVariants;
-         variantIndex++) {
-      (void)fprintf(fptr,
-                    (variantIndex < possibleVariants - 1) ? "0x%016lx, "
-                                                          : "0x%016lx",
-                    generateSlidingAttack(occupancyVariants[variantIndex],
-                                          directions, square));
+// The attack maps lookups go through: the compiled-in ones, or the ones of a
+// luts.bin mapped by mapLuts
+typedef struct {
+  const uint64_t *bishopAttacks, *bishopMagicAttacks;
+  const uint64_t *rookAttacks, *rookMagicAttacks;
+} SlidingMaps;
+
+static SlidingMaps slidingMaps = {
+    BISHOP_ATTACK_MAP,
+    BISHOP_MAGIC_ATTACK_MAP,
+    ROOK_ATTACK_MAP,
+    ROOK_MAGIC_ATTACK_MAP,
+};
+static void *lutBlob = NULL;
+static size_t lutBlobSize = 0;
+
+static bool isLutBlobValid(const LutBlobHeader *header, const size_t size) {
+  const uint32_t entries[LUT_BLOB_MAPS] = {
+      [BISHOP_PEXT_MAP] = BISHOP_ATTACK_ENTRIES,
+      [BISHOP_MAGIC_MAP] = BISHOP_ATTACK_ENTRIES,
+      [ROOK_PEXT_MAP] = ROOK_ATTACK_ENTRIES,
+      [ROOK_MAGIC_MAP] = ROOK_ATTACK_ENTRIES,
+  };
+
+  if (memcmp(header->magic, LUT_BLOB_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != LUT_BLOB_VERSION ||
+      header->checksum != LUT_CHECKSUM || header->size != size) {
+    return false;
+  }
+
+  for (uint8_t map = 0; map < LUT_BLOB_MAPS; map++) {
+    if (header->entries[map] != entries[map] ||
+        header->offsets[map] % LUT_BLOB_ALIGNMENT != 0 ||
+        header->offsets[map] > size ||
+        (size - header->offsets[map]) / sizeof(uint64_t) < entries[map]) {
+      return false;
     }
-    (void)fprintf(fptr, (square < BOARD_AREA - 1) ? "}, " : "}");
   }
-  (void)fprintf(fptr, "};\n");
+
+  return true;
 }
 
-static uint64_t BISHOP_RELEVANT_MASK_TEMP[BOARD_AREA];
-static uint64_t ROOK_RELEVANT_MASK_TEMP[BOARD_AREA];
+bool mapLuts(const char *path) {
+  const int descriptor = open(path, O_RDONLY);
+  if (descriptor < 0) {
+    return false;
+  }
 
-void bake(void) {
-  FILE *fptr = fopen("luts.h", "w");
-  if (!fptr) {
-    perror("Error opening LUTs file");
-    return;
+  struct stat status;
+  if (fstat(descriptor, &status) != 0 ||
+      (size_t)status.st_size < sizeof(LutBlobHeader)) {
+    close(descriptor);
+    return false;
+  }
+
+  // Shared, so it is the page cache's copy every process reads
+  const size_t size = (size_t)status.st_size;
+  void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, descriptor, 0);
+  close(descriptor);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  const LutBlobHeader *header = data;
+  if (!isLutBlobValid(header, size)) {
+    munmap(data, size);
+    return false;
   }
+  (void)posix_madvise(data, size, POSIX_MADV_WILLNEED);
+
+  unmapLuts();
+  const char *bytes = data;
+  slidingMaps = (SlidingMaps){
+      (const uint64_t *)(bytes + header->offsets[BISHOP_PEXT_MAP]),
+      (const uint64_t *)(bytes + header->offsets[BISHOP_MAGIC_MAP]),
+      (const uint64_t *)(bytes + header->offsets[ROOK_PEXT_MAP]),
+      (const uint64_t *)(bytes + header->offsets[ROOK_MAGIC_MAP]),
+  };
+  lutBlob = data;
+  lutBlobSize = size;
+  return true;
+}
 
-  generateSlidingRelevantMasksLUT(BISHOP_DIRECTIONS, BISHOP_RELEVANT_MASK_TEMP);
-  generateSlidingRelevantMasksLUT(ROOK_DIRECTIONS, ROOK_RELEVANT_MASK_TEMP);
+void unmapLuts(void) {
+  slidingMaps = (SlidingMaps){
+      BISHOP_ATTACK_MAP,
+      BISHOP_MAGIC_ATTACK_MAP,
+      ROOK_ATTACK_MAP,
+      ROOK_MAGIC_ATTACK_MAP,
+  };
+  if (lutBlob) {
+    munmap(lutBlob, lutBlobSize);
+    lutBlob = NULL;
+    lutBlobSize = 0;
+  }
+}
 
-  writeHeader(fptr);
+bool areLutsMapped(void) { return lutBlob != NULL; }
 
-  writeJumpingAttackMap(fptr, "KNIGHT_ATTACK_MAP", KNIGHT_OFFSETS);
-  writeJumpingAttackMap(fptr, "KING_ATTACK_MAP", KING_OFFSETS);
-  writeSlidingRelevantMask(fptr, "BISHOP_RELEVANT_MASK",
-                           BISHOP_RELEVANT_MASK_TEMP);
-  writeSlidingRelevantMask(fptr, "ROOK_RELEVANT_MASK", ROOK_RELEVANT_MASK_TEMP);
-  writeSlidingAttackMap(fptr, "BISHOP_ATTACK_MAP", BISHOP_RELEVANT_MASK_TEMP,
-                        (uint16_t)BISHOP_POSSIBLE_VARIANTS, BISHOP_DIRECTIONS);
-  writeSlidingAttackMap(fptr, "ROOK_ATTACK_MAP", ROOK_RELEVANT_MASK_TEMP,
-                        (uint16_t)ROOK_POSSIBLE_VARIANTS, ROOK_DIRECTIONS);
+// Runs once when the library gets loaded, before any lookup. A blob that
+// can't be used only costs the memory it would have saved.
+__attribute__((constructor)) static void initLuts(void) {
+  const char *path = getenv("SYSIFUS_LUTS");
 
-  if (ferror(fptr)) {
-    perror("Error writing to LUTs file");
-    fclose(fptr);
-    return;
+  if (path && *path && !mapLuts(path)) {
+    (void)fprintf(stderr, "sysifus: can't map %s, using compiled-in LUTs\n",
+                  path);
   }
+}
 
-  if (fclose(fptr) != 0) {
-    perror("Error closing LUTs file");
-    return;
+// Both indexings give each square the same slice of its attack map, only the
+// order of the entries inside the slice differs
+static inline uint64_t
+getSlidingAttacks(const int8_t square, const uint64_t occupancy,
+                  const uint64_t relevantMasks[BOARD_AREA],
+                  const uint64_t magics[BOARD_AREA],
+                  const uint32_t offsets[BOARD_AREA],
+                  const uint8_t shifts[BOARD_AREA], const uint64_t *pextAttacks,
+                  const uint64_t *magicAttacks) {
+  const uint64_t occupied = occupancy & relevantMasks[square];
+
+#if defined(__x86_64__)
+  if (slidingIndexing == INDEX_BY_PEXT) {
+    return pextAttacks[offsets[square] +
+                       extractBits(occupied, relevantMasks[square])];
   }
+#else
+  (void)pextAttacks;
+#endif
+
+  return magicAttacks[offsets[square] +
+                      ((occupied * magics[square]) >> shifts[square])];
 }
 
-uint64_t getAttackByOccupancy(const int8_t square,
-                              const uint64_t relevantMask[BOARD_AREA],
-                              const uint16_t possibleVariants,
-                              const uint64_t lut[BOARD_AREA][possibleVariants],
-                              const uint64_t friendly, const uint64_t enemy) {
+static inline uint64_t getBishopAttacks(const int8_t square,
+                                        const uint64_t occupancy) {
+  return getSlidingAttacks(square, occupancy, BISHOP_RELEVANT_MASK,
+                           BISHOP_MAGIC, BISHOP_ATTACK_OFFSET,
+                           BISHOP_ATTACK_SHIFT, slidingMaps.bishopAttacks,
+                           slidingMaps.bishopMagicAttacks);
+}
+
+static inline uint64_t getRookAttacks(const int8_t square,
+                                      const uint64_t occupancy) {
+  return getSlidingAttacks(square, occupancy, ROOK_RELEVANT_MASK, ROOK_MAGIC,
+                           ROOK_ATTACK_OFFSET, ROOK_ATTACK_SHIFT,
+                           slidingMaps.rookAttacks,
+                           slidingMaps.rookMagicAttacks);
+}
+
+uint64_t getDiagonalAttacks(const int8_t square, const uint64_t occupancy) {
+#ifndef NDEBUG
+  assert(square >= 0 && square < BOARD_AREA);
+#endif /* ifndef NDEBUG */
+
+  return getBishopAttacks(square, occupancy);
+}
+
+uint64_t getOrthogonalAttacks(const int8_t square, const uint64_t occupancy) {
 #ifndef NDEBUG
-  assert(lut != NULL);
-  assert(relevantMask != NULL);
+  assert(square >= 0 && square < BOARD_AREA);
 #endif /* ifndef NDEBUG */
 
+  return getRookAttacks(square, occupancy);
+}
+
+uint64_t getAttackByOccupancy(const int8_t square, const Piece slider,
+                              const uint64_t friendly, const uint64_t enemy) {
   if (square < 0 || square >= BOARD_AREA) {
     return 0;
   }
 
-  const uint16_t variantIndex =
-      getVariantIndex(friendly | enemy, (RelevantMask){relevantMask[square]});
+  const uint64_t occupancy = friendly | enemy;
+  uint64_t attacks = 0;
 
-#ifndef NDEBUG
-  assert(variantIndex < possibleVariants);
-#endif /* ifndef NDEBUG */
+  if (slider == BISHOP || slider == QUEEN) {
+    attacks |= getBishopAttacks(square, occupancy);
+  }
+  if (slider == ROOK || slider == QUEEN) {
+    attacks |= getRookAttacks(square, occupancy);
+  }
 
-  return lut[square][variantIndex] & ~friendly;
+  return attacks & ~friendly;
 }
 
 // WARNING: For king pseudo-legal you need to delete the attacked squares, you
-// can do it in the following way: kingAttacks & ~attackedSquares.
-// WARNING: For the pawn moves, it doesn't calculate the pawn promotions or en
-// passant, you have to handle them yourself.
+// can do it in the following way: kingAttacks & ~attackedBy(position, enemy).
+// Or let generateLegalMoves do it for the whole position.
+// WARNING: Squares only, so promotions, en passant and castling are left out.
+// generateMoves and generateLegalMoves produce them.
 Move getPseudoLegal(const Piece type, const Coordinate coord,
                     const uint64_t friendly, const bool isWhite,
                     const uint64_t enemy) {
@@ -380,36 +334,26 @@ Move getPseudoLegal(const Piece type, const Coordinate coord,
   const int8_t square = coordToSquare(coord);
   const uint64_t blocked = friendly | enemy;
 
+  if (!isCoordValid(coord)) {
+    return move;
+  }
+
   switch (type) {
   case PAWN:
-    move.quiet = generatePawnPushes(coord, blocked, isWhite);
-    move.kills = generatePawnCaptures(coord, enemy, isWhite);
-    break;
+    return isWhite ? getWhitePawnMoves(square, friendly, enemy)
+                   : getBlackPawnMoves(square, friendly, enemy);
   case KNIGHT:
     move.quiet = KNIGHT_ATTACK_MAP[square] & ~blocked;
     move.kills = KNIGHT_ATTACK_MAP[square] & enemy;
     break;
-  case BISHOP: {
-    const uint64_t attacks = getAttackByOccupancy(
-        square, BISHOP_RELEVANT_MASK, BISHOP_POSSIBLE_VARIANTS,
-        BISHOP_ATTACK_MAP, friendly, enemy);
-    move.quiet = attacks & ~friendly;
-    move.kills = attacks & enemy;
-  } break;
-  case ROOK: {
-    const uint64_t attacks =
-        getAttackByOccupancy(square, ROOK_RELEVANT_MASK, ROOK_POSSIBLE_VARIANTS,
-                             ROOK_ATTACK_MAP, friendly, enemy);
+  // A queen is one lookup of each kind, not a bishop and a rook
+  case BISHOP:
+  case ROOK:
+  case QUEEN: {
+    const uint64_t attacks = getAttackByOccupancy(square, type, friendly, enemy);
     move.quiet = attacks & ~friendly;
     move.kills = attacks & enemy;
   } break;
-  case QUEEN: {
-    const Move rook = getPseudoLegal(ROOK, coord, friendly, isWhite, enemy);
-    const Move bishop = getPseudoLegal(BISHOP, coord, friendly, isWhite, enemy);
-
-    move.quiet = rook.quiet | bishop.quiet;
-    move.kills = rook.kills | bishop.kills;
-  } break;
   case KING:
     move.quiet = KING_ATTACK_MAP[square] & ~blocked;
     move.kills = KING_ATTACK_MAP[square] & enemy;
@@ -420,3 +364,576 @@ Move getPseudoLegal(const Piece type, const Coordinate coord,
 
   return move;
 }
+
+static inline void appendMoves(MoveList *list, const int8_t from,
+                               uint64_t targets, const uint64_t enemy) {
+  while (targets) {
+    const int8_t to = (int8_t)__builtin_ctzll(targets);
+    const MoveFlag flags = (enemy & (1ULL << to)) ? CAPTURE : QUIET_MOVE;
+
+    list->moves[list->count++] = packMove(from, to, flags);
+    targets &= targets - 1; // Pop the lsb
+  }
+}
+
+// Every target in the set came from the square `offset` squares behind it
+static inline void appendPawnMoves(MoveList *list, uint64_t targets,
+                                   const int8_t offset, const MoveFlag flags) {
+  while (targets) {
+    const int8_t to = (int8_t)__builtin_ctzll(targets);
+
+    list->moves[list->count++] = packMove((int8_t)(to - offset), to, flags);
+    targets &= targets - 1;
+  }
+}
+
+// Same with one move per piece a pawn can promote to, queen first. `flags` is
+// KNIGHT_PROMOTION or KNIGHT_PROMOTION_CAPTURE.
+static inline void appendPromotions(MoveList *list, uint64_t targets,
+                                    const int8_t offset, const MoveFlag flags) {
+  while (targets) {
+    const int8_t to = (int8_t)__builtin_ctzll(targets);
+    const int8_t from = (int8_t)(to - offset);
+
+    for (int8_t piece = QUEEN - KNIGHT; piece >= 0; piece--) {
+      list->moves[list->count++] =
+          packMove(from, to, (MoveFlag)(flags | piece));
+    }
+    targets &= targets - 1;
+  }
+}
+
+// 11111111
+// 00000000
+// 00000000
+// 00000000
+// 00000000
+// 00000000
+// 00000000
+// 11111111
+static const uint64_t PROMOTION_RANKS = 0xFF000000000000FF;
+
+static inline uint64_t getPawnAttacks(const uint64_t pawns, const Color color) {
+  if (color == WHITE) {
+    return ((pawns & NOT_FILE_A) << (BOARD_LENGTH - 1)) |
+           ((pawns & NOT_FILE_H) << (BOARD_LENGTH + 1));
+  }
+
+  return ((pawns & NOT_FILE_A) >> (BOARD_LENGTH + 1)) |
+         ((pawns & NOT_FILE_H) >> (BOARD_LENGTH - 1));
+}
+
+// Pushes go to `empty` squares and captures to `enemy` ones, every target
+// outside `targetMask` is dropped. Double pushes are derived before masking
+// since the single push square only has to be empty.
+static void generatePawnMoves(MoveList *list, const Color us,
+                              const uint64_t pawns, const uint64_t empty,
+                              const uint64_t enemy,
+                              const uint64_t targetMask) {
+  uint64_t singlePushes, doublePushes, leftCaptures, rightCaptures;
+  int8_t forward;
+
+  if (us == WHITE) {
+    forward = BOARD_LENGTH;
+    singlePushes = (pawns << BOARD_LENGTH) & empty;
+    doublePushes = ((singlePushes & RANK_3) << BOARD_LENGTH) & empty;
+    leftCaptures = ((pawns & NOT_FILE_A) << (BOARD_LENGTH - 1)) & enemy;
+    rightCaptures = ((pawns & NOT_FILE_H) << (BOARD_LENGTH + 1)) & enemy;
+  } else {
+    forward = -BOARD_LENGTH;
+    singlePushes = (pawns >> BOARD_LENGTH) & empty;
+    doublePushes = ((singlePushes & RANK_6) >> BOARD_LENGTH) & empty;
+    leftCaptures = ((pawns & NOT_FILE_A) >> (BOARD_LENGTH + 1)) & enemy;
+    rightCaptures = ((pawns & NOT_FILE_H) >> (BOARD_LENGTH - 1)) & enemy;
+  }
+
+  // Pawns only ever reach the far rank, so both ranks can be masked at once
+  singlePushes &= targetMask;
+  leftCaptures &= targetMask;
+  rightCaptures &= targetMask;
+
+  appendPawnMoves(list, singlePushes & ~PROMOTION_RANKS, forward, QUIET_MOVE);
+  appendPawnMoves(list, doublePushes & targetMask, (int8_t)(2 * forward),
+                  DOUBLE_PAWN_PUSH);
+  appendPawnMoves(list, leftCaptures & ~PROMOTION_RANKS, (int8_t)(forward - 1),
+                  CAPTURE);
+  appendPawnMoves(list, rightCaptures & ~PROMOTION_RANKS,
+                  (int8_t)(forward + 1), CAPTURE);
+
+  appendPromotions(list, singlePushes & PROMOTION_RANKS, forward,
+                   KNIGHT_PROMOTION);
+  appendPromotions(list, leftCaptures & PROMOTION_RANKS, (int8_t)(forward - 1),
+                   KNIGHT_PROMOTION_CAPTURE);
+  appendPromotions(list, rightCaptures & PROMOTION_RANKS,
+                   (int8_t)(forward + 1), KNIGHT_PROMOTION_CAPTURE);
+}
+
+// Our pawns that could take en passant, they stand next to the pawn that just
+// double pushed
+static inline uint64_t getEnPassantCapturers(const Position *position) {
+  if (position->enPassant == NO_SQUARE) {
+    return 0;
+  }
+
+  const Color us = position->sideToMove;
+  return getPawnAttacks(1ULL << position->enPassant, (Color)!us) &
+         position->pieces[us][PAWN];
+}
+
+// Squares of the king, the rook and what lies between them for each castling
+// right, in CastlingRight order
+typedef struct {
+  CastlingRight right;
+  MoveFlag flags;
+  int8_t king, to, rook;
+  uint64_t empty; // Squares between the king and the rook
+  uint64_t safe;  // Squares the king crosses or lands on
+} Castling;
+
+static const Castling CASTLINGS[] = {
+    {WHITE_KINGSIDE, KING_CASTLE, 4, 6, 7, 0x60, 0x60},
+    {WHITE_QUEENSIDE, QUEEN_CASTLE, 4, 2, 0, 0xE, 0xC},
+    {BLACK_KINGSIDE, KING_CASTLE, 60, 62, 63, 0x60ULL << 56, 0x60ULL << 56},
+    {BLACK_QUEENSIDE, QUEEN_CASTLE, 60, 58, 56, 0xEULL << 56, 0xCULL << 56},
+};
+
+// Castles of the side to move with the path empty and no square of it, the
+// king's one included, in `attacked`
+static void appendCastles(MoveList *list, const Position *position,
+                          const uint64_t attacked) {
+  const Color us = position->sideToMove;
+  const uint64_t occupancy = getOccupancy(position);
+  const uint64_t *pieces = position->pieces[us];
+
+  for (uint8_t side = 0; side < 2; side++) {
+    const Castling *castling = &CASTLINGS[2 * us + side];
+
+    if ((position->castlingRights & castling->right) &&
+        (pieces[KING] & (1ULL << castling->king)) &&
+        (pieces[ROOK] & (1ULL << castling->rook)) &&
+        !(occupancy & castling->empty) &&
+        !(attacked & (castling->safe | (1ULL << castling->king)))) {
+      list->moves[list->count++] =
+          packMove(castling->king, castling->to, castling->flags);
+    }
+  }
+}
+
+// Whether taking en passant from `from` leaves our king safe. Two pieces leave
+// the king's lines at once, so the pins computed up front can't tell: the
+// king's attackers get looked up again on the board after the capture.
+static bool isEnPassantLegal(const Position *position, const int8_t from,
+                             const int8_t king) {
+  const Color us = position->sideToMove;
+  const int8_t to = position->enPassant;
+  const uint64_t capturedBit =
+      1ULL << (us == WHITE ? to - BOARD_LENGTH : to + BOARD_LENGTH);
+  const uint64_t occupancy =
+      (getOccupancy(position) ^ (1ULL << from) ^ capturedBit) | (1ULL << to);
+
+  return !(attackersTo(position, king, occupancy) &
+           position->occupancy[!us] & ~capturedBit);
+}
+
+void generateMoves(const Position *position, MoveList *list) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(list != NULL);
+#endif /* ifndef NDEBUG */
+
+  const Color us = position->sideToMove;
+  const uint64_t friendly = position->occupancy[us];
+  const uint64_t enemy = position->occupancy[!us];
+  const uint64_t occupancy = friendly | enemy;
+  const uint64_t *pieces = position->pieces[us];
+
+  list->count = 0;
+  generatePawnMoves(list, us, pieces[PAWN], ~occupancy, enemy, ~0ULL);
+  for (uint64_t capturers = getEnPassantCapturers(position); capturers;
+       capturers &= capturers - 1) {
+    list->moves[list->count++] =
+        packMove((int8_t)__builtin_ctzll(capturers), position->enPassant,
+                 EN_PASSANT_CAPTURE);
+  }
+
+  for (uint64_t knights = pieces[KNIGHT]; knights; knights &= knights - 1) {
+    const int8_t from = (int8_t)__builtin_ctzll(knights);
+    appendMoves(list, from, KNIGHT_ATTACK_MAP[from] & ~friendly, enemy);
+  }
+
+  for (uint64_t bishops = pieces[BISHOP]; bishops; bishops &= bishops - 1) {
+    const int8_t from = (int8_t)__builtin_ctzll(bishops);
+    appendMoves(list, from, getBishopAttacks(from, occupancy) & ~friendly,
+                enemy);
+  }
+
+  for (uint64_t rooks = pieces[ROOK]; rooks; rooks &= rooks - 1) {
+    const int8_t from = (int8_t)__builtin_ctzll(rooks);
+    appendMoves(list, from, getRookAttacks(from, occupancy) & ~friendly,
+                enemy);
+  }
+
+  for (uint64_t queens = pieces[QUEEN]; queens; queens &= queens - 1) {
+    const int8_t from = (int8_t)__builtin_ctzll(queens);
+    const uint64_t attacks =
+        getBishopAttacks(from, occupancy) | getRookAttacks(from, occupancy);
+    appendMoves(list, from, attacks & ~friendly, enemy);
+  }
+
+  for (uint64_t kings = pieces[KING]; kings; kings &= kings - 1) {
+    const int8_t from = (int8_t)__builtin_ctzll(kings);
+    appendMoves(list, from, KING_ATTACK_MAP[from] & ~friendly, enemy);
+  }
+
+  // Castling out of or through check is never legal, unlike other king moves
+  // it gets checked here
+  const uint8_t ourRights = us == WHITE ? WHITE_KINGSIDE | WHITE_QUEENSIDE
+                                        : BLACK_KINGSIDE | BLACK_QUEENSIDE;
+  if (position->castlingRights & ourRights) {
+    appendCastles(list, position, attackedBy(position, (Color)!us));
+  }
+}
+
+// Squares strictly between two squares sharing a line, 0 if they don't
+static inline uint64_t getBetween(const int8_t from, const int8_t to) {
+  const uint64_t fromBit = 1ULL << from;
+  const uint64_t toBit = 1ULL << to;
+
+  if (slidingMaps.rookAttacks[ROOK_ATTACK_OFFSET[from]] & toBit) {
+    return getRookAttacks(from, toBit) & getRookAttacks(to, fromBit);
+  }
+  if (slidingMaps.bishopAttacks[BISHOP_ATTACK_OFFSET[from]] & toBit) {
+    return getBishopAttacks(from, toBit) & getBishopAttacks(to, fromBit);
+  }
+
+  return 0;
+}
+
+static uint64_t getAttackedSquares(const Position *position,
+                                   const Color attacker,
+                                   const uint64_t occupancy) {
+  const uint64_t *pieces = position->pieces[attacker];
+  uint64_t attacked = getPawnAttacks(pieces[PAWN], attacker);
+
+  for (uint64_t knights = pieces[KNIGHT]; knights; knights &= knights - 1) {
+    attacked |= KNIGHT_ATTACK_MAP[__builtin_ctzll(knights)];
+  }
+  for (uint64_t diagonals = pieces[BISHOP] | pieces[QUEEN]; diagonals;
+       diagonals &= diagonals - 1) {
+    attacked |= getBishopAttacks((int8_t)__builtin_ctzll(diagonals), occupancy);
+  }
+  for (uint64_t orthogonals = pieces[ROOK] | pieces[QUEEN]; orthogonals;
+       orthogonals &= orthogonals - 1) {
+    attacked |= getRookAttacks((int8_t)__builtin_ctzll(orthogonals), occupancy);
+  }
+  for (uint64_t kings = pieces[KING]; kings; kings &= kings - 1) {
+    attacked |= KING_ATTACK_MAP[__builtin_ctzll(kings)];
+  }
+
+  return attacked;
+}
+
+// Attacks are symmetric: a piece on `square` would attack the pieces of the
+// same type attacking it, pawns aside, whose captures point the other way
+uint64_t attackersTo(const Position *position, const int8_t square,
+                     const uint64_t occupancy) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(square >= 0 && square < BOARD_AREA);
+#endif /* ifndef NDEBUG */
+
+  const uint64_t(*pieces)[PIECE_TYPES] = position->pieces;
+  const uint64_t squareBit = 1ULL << square;
+
+  return (getPawnAttacks(squareBit, BLACK) & pieces[WHITE][PAWN]) |
+         (getPawnAttacks(squareBit, WHITE) & pieces[BLACK][PAWN]) |
+         (KNIGHT_ATTACK_MAP[square] &
+          (pieces[WHITE][KNIGHT] | pieces[BLACK][KNIGHT])) |
+         (KING_ATTACK_MAP[square] &
+          (pieces[WHITE][KING] | pieces[BLACK][KING])) |
+         (getBishopAttacks(square, occupancy) &
+          (pieces[WHITE][BISHOP] | pieces[BLACK][BISHOP] |
+           pieces[WHITE][QUEEN] | pieces[BLACK][QUEEN])) |
+         (getRookAttacks(square, occupancy) &
+          (pieces[WHITE][ROOK] | pieces[BLACK][ROOK] | pieces[WHITE][QUEEN] |
+           pieces[BLACK][QUEEN]));
+}
+
+// Cheapest lookups first, stopping at the first attacker found
+bool isSquareAttacked(const Position *position, const int8_t square,
+                      const Color attacker) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(square >= 0 && square < BOARD_AREA);
+#endif /* ifndef NDEBUG */
+
+  const uint64_t *pieces = position->pieces[attacker];
+  const uint64_t squareBit = 1ULL << square;
+  const uint64_t occupancy = getOccupancy(position);
+
+  return (getPawnAttacks(squareBit, (Color)!attacker) & pieces[PAWN]) ||
+         (KNIGHT_ATTACK_MAP[square] & pieces[KNIGHT]) ||
+         (KING_ATTACK_MAP[square] & pieces[KING]) ||
+         (getBishopAttacks(square, occupancy) &
+          (pieces[BISHOP] | pieces[QUEEN])) ||
+         (getRookAttacks(square, occupancy) & (pieces[ROOK] | pieces[QUEEN]));
+}
+
+uint64_t attackedBy(const Position *position, const Color side) {
+#ifndef NDEBUG
+  assert(position != NULL);
+#endif /* ifndef NDEBUG */
+
+  return getAttackedSquares(position, side, getOccupancy(position));
+}
+
+typedef struct {
+  uint64_t pinned, rays;
+} Pins;
+
+// Our pieces standing alone between the king and an enemy slider. `rays` holds
+// the squares from the king up to and including the pinners, which is where
+// the pinned pieces are still allowed to go.
+static Pins getPins(const int8_t king, uint64_t snipers,
+                    const uint64_t friendly, const uint64_t occupancy) {
+  Pins pins = {0, 0};
+
+  for (; snipers; snipers &= snipers - 1) {
+    const int8_t sniper = (int8_t)__builtin_ctzll(snipers);
+    const uint64_t ray = getBetween(king, sniper);
+    const uint64_t blockers = ray & occupancy;
+
+    if ((blockers & friendly) && !(blockers & (blockers - 1))) {
+      pins.pinned |= blockers;
+      pins.rays |= ray | (1ULL << sniper);
+    }
+  }
+
+  return pins;
+}
+
+// Captures land on `captureTargets`, quiet moves on `quietTargets` and pawn
+// pushes on `pushTargets`, so promotions can go with either kind. A kind of
+// move with no targets is left out, en passant with the captures and castling
+// with the quiet moves.
+static void generateLegal(const Position *position, MoveList *list,
+                          const uint64_t captureTargets,
+                          const uint64_t quietTargets,
+                          const uint64_t pushTargets) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(list != NULL);
+  assert(position->pieces[position->sideToMove][KING] != 0);
+#endif /* ifndef NDEBUG */
+
+  const Color us = position->sideToMove;
+  const Color them = (Color)!us;
+  const uint64_t friendly = position->occupancy[us];
+  const uint64_t enemy = position->occupancy[them];
+  const uint64_t occupancy = friendly | enemy;
+  const uint64_t *pieces = position->pieces[us];
+  const uint64_t *theirs = position->pieces[them];
+  const uint64_t theirDiagonals = theirs[BISHOP] | theirs[QUEEN];
+  const uint64_t theirOrthogonals = theirs[ROOK] | theirs[QUEEN];
+  const int8_t king = (int8_t)__builtin_ctzll(pieces[KING]);
+
+  list->count = 0;
+
+  // The king is lifted off the board so it can't step back along the ray of
+  // the slider checking it
+  const uint64_t attacked =
+      getAttackedSquares(position, them, occupancy ^ pieces[KING]);
+  appendMoves(list, king,
+              KING_ATTACK_MAP[king] & (captureTargets | quietTargets) &
+                  ~attacked,
+              enemy);
+
+  const uint64_t checkers = attackersTo(position, king, occupancy) & enemy;
+
+  // Only the king can get out of a double check
+  if (checkers & (checkers - 1)) {
+    return;
+  }
+
+  if (!checkers && quietTargets) {
+    appendCastles(list, position, attacked);
+  }
+  if (captureTargets) {
+    for (uint64_t capturers = getEnPassantCapturers(position); capturers;
+         capturers &= capturers - 1) {
+      const int8_t from = (int8_t)__builtin_ctzll(capturers);
+
+      if (isEnPassantLegal(position, from, king)) {
+        list->moves[list->count++] =
+            packMove(from, position->enPassant, EN_PASSANT_CAPTURE);
+      }
+    }
+  }
+
+  // Single check: the rest of the moves have to capture the checker or block
+  // its ray
+  const uint64_t checkMask =
+      checkers ? checkers | getBetween(king, (int8_t)__builtin_ctzll(checkers))
+               : ~0ULL;
+  const uint64_t targets = (captureTargets | quietTargets) & checkMask;
+
+  // Looking only through enemy pieces keeps our own blockers transparent
+  const Pins diagonal = getPins(king, getBishopAttacks(king, enemy) &
+                                          theirDiagonals,
+                                friendly, occupancy);
+  const Pins orthogonal = getPins(king, getRookAttacks(king, enemy) &
+                                            theirOrthogonals,
+                                  friendly, occupancy);
+  const uint64_t pinned = diagonal.pinned | orthogonal.pinned;
+
+  // Orthogonally pinned pawns can only push along a file, diagonally pinned
+  // ones only capture their pinner
+  generatePawnMoves(list, us, pieces[PAWN] & ~pinned, pushTargets,
+                    captureTargets, checkMask);
+  generatePawnMoves(list, us, pieces[PAWN] & orthogonal.pinned, pushTargets,
+                    0, checkMask & orthogonal.rays);
+  generatePawnMoves(list, us, pieces[PAWN] & diagonal.pinned, 0,
+                    captureTargets, checkMask & diagonal.rays);
+
+  // Pinned knights can never stay on the pin ray
+  for (uint64_t knights = pieces[KNIGHT] & ~pinned; knights;
+       knights &= knights - 1) {
+    const int8_t from = (int8_t)__builtin_ctzll(knights);
+    appendMoves(list, from, KNIGHT_ATTACK_MAP[from] & targets, enemy);
+  }
+
+  // A slider pinned on a ray of the other kind has no moves at all, and one
+  // pinned on a ray of its own kind can't leave the pin rays
+  for (uint64_t diagonals = (pieces[BISHOP] | pieces[QUEEN]) & ~orthogonal.pinned;
+       diagonals; diagonals &= diagonals - 1) {
+    const int8_t from = (int8_t)__builtin_ctzll(diagonals);
+    uint64_t attacks = getBishopAttacks(from, occupancy) & targets;
+
+    if (diagonal.pinned & (1ULL << from)) {
+      attacks &= diagonal.rays;
+    }
+    appendMoves(list, from, attacks, enemy);
+  }
+
+  for (uint64_t orthogonals = (pieces[ROOK] | pieces[QUEEN]) & ~diagonal.pinned;
+       orthogonals; orthogonals &= orthogonals - 1) {
+    const int8_t from = (int8_t)__builtin_ctzll(orthogonals);
+    uint64_t attacks = getRookAttacks(from, occupancy) & targets;
+
+    if (orthogonal.pinned & (1ULL << from)) {
+      attacks &= orthogonal.rays;
+    }
+    appendMoves(list, from, attacks, enemy);
+  }
+}
+
+void generateLegalMoves(const Position *position, MoveList *list) {
+  const uint64_t enemy = position->occupancy[!position->sideToMove];
+  const uint64_t empty = ~getOccupancy(position);
+
+  generateLegal(position, list, enemy, empty, empty);
+}
+
+void generateLegalCaptures(const Position *position, MoveList *list) {
+  const uint64_t enemy = position->occupancy[!position->sideToMove];
+  const uint64_t empty = ~getOccupancy(position);
+
+  generateLegal(position, list, enemy, 0, empty & PROMOTION_RANKS);
+}
+
+void generateLegalQuiets(const Position *position, MoveList *list) {
+  const uint64_t empty = ~getOccupancy(position);
+
+  generateLegal(position, list, 0, empty, empty & ~PROMOTION_RANKS);
+}
+
+// Checks the move the way the generators would have produced it, so a move
+// from a hash table or a killer slot, possibly stored for another position,
+// can be played without generating the whole list
+bool isMoveLegal(const Position *position, const PackedMove move) {
+#ifndef NDEBUG
+  assert(position != NULL);
+  assert(position->pieces[position->sideToMove][KING] != 0);
+#endif /* ifndef NDEBUG */
+
+  const Color us = position->sideToMove;
+  const uint64_t friendly = position->occupancy[us];
+  const uint64_t enemy = position->occupancy[!us];
+  const uint64_t occupancy = friendly | enemy;
+  const int8_t from = getMoveFrom(move);
+  const int8_t to = getMoveTo(move);
+  const uint64_t fromBit = 1ULL << from, toBit = 1ULL << to;
+  const int8_t king = (int8_t)__builtin_ctzll(position->pieces[us][KING]);
+
+  if (!(friendly & fromBit)) {
+    return false;
+  }
+
+  // Rare enough to be checked the slow way
+  if (isCastling(move)) {
+    MoveList castles = {.count = 0};
+
+    appendCastles(&castles, position,
+                  getAttackedSquares(position, (Color)!us,
+                                     occupancy ^ position->pieces[us][KING]));
+    for (uint16_t moveIndex = 0; moveIndex < castles.count; moveIndex++) {
+      if (castles.moves[moveIndex] == move) {
+        return true;
+      }
+    }
+    return false;
+  }
+  if (isEnPassant(move)) {
+    return to == position->enPassant &&
+           (getEnPassantCapturers(position) & fromBit) &&
+           isEnPassantLegal(position, from, king);
+  }
+
+  if ((friendly & toBit) || isCapture(move) != ((enemy & toBit) != 0)) {
+    return false;
+  }
+
+  const Piece moved = (Piece)position->board[from];
+  // Promotions come down to the push or capture they are made with
+  const MoveFlag flags =
+      isPromotion(move) ? getMoveFlags(move) & CAPTURE : getMoveFlags(move);
+  uint64_t reachable;
+  if (moved == PAWN) {
+    // Same shifts as generatePawnMoves, pawns on the last rank included
+    const uint64_t singlePush =
+        (us == WHITE ? fromBit << BOARD_LENGTH : fromBit >> BOARD_LENGTH) &
+        ~occupancy;
+
+    if (isPromotion(move) != ((toBit & PROMOTION_RANKS) != 0)) {
+      return false;
+    }
+    if (flags == CAPTURE) {
+      reachable = getPawnAttacks(fromBit, us);
+    } else if (flags == DOUBLE_PAWN_PUSH) {
+      reachable = (us == WHITE ? (singlePush & RANK_3) << BOARD_LENGTH
+                               : (singlePush & RANK_6) >> BOARD_LENGTH) &
+                  ~occupancy;
+    } else if (flags == QUIET_MOVE) {
+      reachable = singlePush;
+    } else {
+      return false;
+    }
+  } else {
+    if (getMoveFlags(move) != QUIET_MOVE && getMoveFlags(move) != CAPTURE) {
+      return false;
+    }
+    reachable = moved == KNIGHT ? KNIGHT_ATTACK_MAP[from]
+                : moved == KING ? KING_ATTACK_MAP[from]
+                                : getAttackByOccupancy(from, moved, friendly,
+                                                       enemy);
+  }
+  if (!(reachable & toBit)) {
+    return false;
+  }
+
+  // Attackers of our king once the move is made: sliders see through the
+  // vacated square and a captured piece attacks nothing any more
+  return !(attackersTo(position, moved == KING ? to : king,
+                       (occupancy & ~fromBit) | toBit) &
+           enemy & ~toBit);
+}
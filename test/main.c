@@ -1,11 +1,31 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "bitboard.h"
-#include "luts.h"
+#include "dataset.h"
+#include "epd.h"
+#include "evaluate.h"
+#include "fill.h"
+#include "generators.h"
+#include "hashtable.h"
+#include "slidingluts.h"
+#include "mobility.h"
+#include "movepicker.h"
+#include "nnue.h"
+#include "parallel.h"
+#include "perft.h"
+#include "pgn.h"
+#include "position.h"
+#include "search.h"
+#include "see.h"
 #include "sysifus.h"
 #include <check.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #define TESTS_ITERATIONS 100
 #define VERBOSE_LOG
@@ -168,19 +188,8 @@ START_TEST(slidingAttackMap) {
     const uint64_t friendly = generateRandomOccupancy(8);
     const uint64_t enemy = generateRandomOccupancy(8);
     const bool isBishop = rand() % 2;
-    const uint64_t *relevantMask = isBishop
-                                       ? (const uint64_t *)BISHOP_RELEVANT_MASK
-                                       : (const uint64_t *)ROOK_RELEVANT_MASK;
-    uint64_t moves;
-    if (isBishop) {
-      moves = getAttackByOccupancy(square, relevantMask,
-                                   (uint16_t)BISHOP_POSSIBLE_VARIANTS,
-                                   BISHOP_ATTACK_MAP, friendly, enemy);
-    } else {
-      moves = getAttackByOccupancy(square, relevantMask,
-                                   (uint16_t)ROOK_POSSIBLE_VARIANTS,
-                                   ROOK_ATTACK_MAP, friendly, enemy);
-    }
+    const uint64_t moves = getAttackByOccupancy(
+        square, isBishop ? BISHOP : ROOK, friendly, enemy);
 
 #ifdef VERBOSE_LOG
     printf("=== Test log ===\n");
@@ -200,12 +209,12 @@ START_TEST(slidingAttackMap) {
 
     if (isBishop) {
       ck_assert_msg(
-          (moves & ~BISHOP_ATTACK_MAP[square][0]) == 0,
+          (moves & ~BISHOP_ATTACK_MAP[BISHOP_ATTACK_OFFSET[square]]) == 0,
           "Blocked board has more moves than empty board for %s at %d ",
           isBishop ? "bishop" : "rook", square);
     } else {
       ck_assert_msg(
-          (moves & ~ROOK_ATTACK_MAP[square][0]) == 0,
+          (moves & ~ROOK_ATTACK_MAP[ROOK_ATTACK_OFFSET[square]]) == 0,
           "Blocked board has more moves than empty board for %s at %d ",
           isBishop ? "bishop" : "rook", square);
     }
@@ -213,17 +222,1816 @@ START_TEST(slidingAttackMap) {
 }
 END_TEST
 
-Suite *moveGeneration(void) {
-  Suite *suite = suite_create("Pseudo-legal move generation test suite");
+static uint64_t
+walkSlidingRays(const int8_t square, const uint64_t occupancy,
+                const Coordinate directions[SLIDING_DIRECTIONS]) {
+  uint64_t attacks = 0;
 
-  TCase *pawns = tcase_create("Pawn moves");
-  tcase_add_test(pawns, pawnPushesProps);
-  tcase_add_test(pawns, pawnCapturesProps);
-  suite_add_tcase(suite, pawns);
+  for (uint8_t directionIndex = 0; directionIndex < SLIDING_DIRECTIONS;
+       directionIndex++) {
+    Coordinate coord = {(int8_t)(square / BOARD_LENGTH),
+                        (int8_t)(square % BOARD_LENGTH)};
 
-  TCase *sliding = tcase_create("Sliding moves");
-  tcase_add_test(sliding, slidingAttackMap);
-  suite_add_tcase(suite, sliding);
+    for (;;) {
+      coord.rank = (int8_t)(coord.rank + directions[directionIndex].rank);
+      coord.file = (int8_t)(coord.file + directions[directionIndex].file);
+      if (!isCoordValid(coord)) {
+        break;
+      }
+
+      attacks |= 1ULL << coordToSquare(coord);
+      if (isSet(coord, occupancy)) {
+        break;
+      }
+    }
+  }
+
+  return attacks;
+}
+
+/*
+ * Every square of the packed attack maps owns exactly 2^relevant bits entries,
+ * laid back to back, and the entry looked up for any occupancy is the attack
+ * set found by walking the rays.
+ */
+START_TEST(packedAttackMapsMatchRayWalk) {
+  uint32_t bishopEntries = 0;
+  uint32_t rookEntries = 0;
+
+  for (int8_t square = 0; square < BOARD_AREA; square++) {
+    ck_assert_uint_eq(BISHOP_ATTACK_OFFSET[square], bishopEntries);
+    ck_assert_uint_eq(ROOK_ATTACK_OFFSET[square], rookEntries);
+    ck_assert_uint_eq(BISHOP_ATTACK_SHIFT[square],
+                      BOARD_AREA -
+                          __builtin_popcountll(BISHOP_RELEVANT_MASK[square]));
+    ck_assert_uint_eq(ROOK_ATTACK_SHIFT[square],
+                      BOARD_AREA -
+                          __builtin_popcountll(ROOK_RELEVANT_MASK[square]));
+
+    bishopEntries += 1U << (BOARD_AREA - BISHOP_ATTACK_SHIFT[square]);
+    rookEntries += 1U << (BOARD_AREA - ROOK_ATTACK_SHIFT[square]);
+  }
+  ck_assert_uint_eq(bishopEntries, BISHOP_ATTACK_ENTRIES);
+  ck_assert_uint_eq(rookEntries, ROOK_ATTACK_ENTRIES);
+
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    const int8_t square = (int8_t)(rand() % BOARD_AREA);
+    const uint64_t occupancy = generateRandomOccupancy(4);
+
+    ck_assert_uint_eq(getAttackByOccupancy(square, BISHOP, 0, occupancy),
+                      walkSlidingRays(square, occupancy, BISHOP_DIRECTIONS));
+    ck_assert_uint_eq(getAttackByOccupancy(square, ROOK, 0, occupancy),
+                      walkSlidingRays(square, occupancy, ROOK_DIRECTIONS));
+  }
+}
+END_TEST
+
+/*
+ * Magic indexing looks up the attacks found by walking the rays, and pext
+ * indexing, when the CPU has it, looks up the same ones.
+ */
+START_TEST(magicAndPextIndexingAgree) {
+  const SlidingIndexing initial = getSlidingIndexing();
+
+  // An empty board indexes the start of the slice either way
+  for (int8_t square = 0; square < BOARD_AREA; square++) {
+    ck_assert_uint_eq(BISHOP_MAGIC_ATTACK_MAP[BISHOP_ATTACK_OFFSET[square]],
+                      BISHOP_ATTACK_MAP[BISHOP_ATTACK_OFFSET[square]]);
+    ck_assert_uint_eq(ROOK_MAGIC_ATTACK_MAP[ROOK_ATTACK_OFFSET[square]],
+                      ROOK_ATTACK_MAP[ROOK_ATTACK_OFFSET[square]]);
+  }
+
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    const int8_t square = (int8_t)(rand() % BOARD_AREA);
+    const uint64_t occupancy = generateRandomOccupancy(4);
+
+    ck_assert(setSlidingIndexing(INDEX_BY_MAGIC));
+    const uint64_t magicAttacks =
+        getAttackByOccupancy(square, QUEEN, 0, occupancy);
+    ck_assert_uint_eq(magicAttacks,
+                      walkSlidingRays(square, occupancy, BISHOP_DIRECTIONS) |
+                          walkSlidingRays(square, occupancy, ROOK_DIRECTIONS));
+
+    if (setSlidingIndexing(INDEX_BY_PEXT)) {
+      ck_assert_uint_eq(getAttackByOccupancy(square, QUEEN, 0, occupancy),
+                        magicAttacks);
+    }
+  }
+
+  ck_assert(setSlidingIndexing(initial));
+}
+END_TEST
+
+/*
+ * A freshly baked luts.bin maps, and lookups through it give the same attacks
+ * as the compiled-in maps with either indexing. Files that aren't a blob of
+ * this bake are refused and leave the lookups alone.
+ */
+START_TEST(lutBlobMatchesCompiledMaps) {
+  const SlidingIndexing initial = getSlidingIndexing();
+  char directory[] = "/tmp/sysifusLutsXXXXXX";
+  char blobPath[64], headerPath[64], slidingHeaderPath[64];
+
+  ck_assert_ptr_nonnull(mkdtemp(directory));
+  ck_assert(bakeLuts(directory));
+  (void)snprintf(blobPath, sizeof(blobPath), "%s/luts.bin", directory);
+  (void)snprintf(headerPath, sizeof(headerPath), "%s/luts.h", directory);
+  (void)snprintf(slidingHeaderPath, sizeof(slidingHeaderPath),
+                 "%s/slidingluts.h", directory);
+
+  unmapLuts();
+  ck_assert(!mapLuts(headerPath));
+  ck_assert(!mapLuts("/nonexistent/luts.bin"));
+  ck_assert(!areLutsMapped());
+
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    const int8_t square = (int8_t)(rand() % BOARD_AREA);
+    const uint64_t occupancy = generateRandomOccupancy(4);
+
+    for (SlidingIndexing indexing = INDEX_BY_PEXT; indexing <= INDEX_BY_MAGIC;
+         indexing++) {
+      if (!setSlidingIndexing(indexing)) {
+        continue;
+      }
+
+      unmapLuts();
+      const uint64_t diagonal = getDiagonalAttacks(square, occupancy);
+      const uint64_t orthogonal = getOrthogonalAttacks(square, occupancy);
+
+      ck_assert(mapLuts(blobPath));
+      ck_assert(areLutsMapped());
+      ck_assert_uint_eq(getDiagonalAttacks(square, occupancy), diagonal);
+      ck_assert_uint_eq(getOrthogonalAttacks(square, occupancy), orthogonal);
+    }
+  }
+
+  unmapLuts();
+  ck_assert(setSlidingIndexing(initial));
+  ck_assert_int_eq(unlink(blobPath), 0);
+  ck_assert_int_eq(unlink(headerPath), 0);
+  ck_assert_int_eq(unlink(slidingHeaderPath), 0);
+  ck_assert_int_eq(rmdir(directory), 0);
+}
+END_TEST
+
+static Position generateRandomPosition(void) {
+  Position position;
+  clearPosition(&position);
+
+  for (int8_t square = 0; square < BOARD_AREA; square++) {
+    // Same 1/16 spreading as the random occupancies, split between both colors
+    const uint8_t denominator = 16;
+
+    if ((rand() % denominator) == 1) {
+      putPiece(&position, (Color)(rand() % COLORS),
+               (Piece)(rand() % PIECE_TYPES), square);
+    }
+  }
+  position.sideToMove = (Color)(rand() % COLORS);
+  position.hash = computeHash(&position);
+
+  return position;
+}
+
+static int comparePackedMoves(const void *lhs, const void *rhs) {
+  return (int)*(const PackedMove *)lhs - (int)*(const PackedMove *)rhs;
+}
+
+static bool containsMove(const MoveList *list, const PackedMove move) {
+  for (uint16_t moveIndex = 0; moveIndex < list->count; moveIndex++) {
+    if (list->moves[moveIndex] == move) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+ * Consistency: For every piece of the side to move, the moves generateMoves
+ * emits from its square should be exactly the targets getPseudoLegal returns
+ * for it, with the captures flagged as such
+ * Uniqueness: No move should be generated twice, and a promotion to the queen
+ * comes with the three underpromotions
+ */
+START_TEST(generateMovesMatchesPseudoLegal) {
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    const Position position = generateRandomPosition();
+    const Color us = position.sideToMove;
+    MoveList list;
+    generateMoves(&position, &list);
+
+    uint64_t quiet[BOARD_AREA] = {0};
+    uint64_t kills[BOARD_AREA] = {0};
+    for (uint16_t moveIndex = 0; moveIndex < list.count; moveIndex++) {
+      const PackedMove move = list.moves[moveIndex];
+      const uint64_t target = 1ULL << getMoveTo(move);
+
+      if (isPromotion(move)) {
+        for (Piece piece = KNIGHT; piece < QUEEN; piece++) {
+          const MoveFlag flags =
+              (MoveFlag)((getMoveFlags(move) & ~3) | (piece - KNIGHT));
+
+          ck_assert(containsMove(
+              &list, packMove(getMoveFrom(move), getMoveTo(move), flags)));
+        }
+        if (getPromotionPiece(move) != QUEEN) {
+          continue;
+        }
+      }
+      ck_assert_msg(((quiet[getMoveFrom(move)] | kills[getMoveFrom(move)]) &
+                     target) == 0,
+                    "Move %d -> %d generated twice", getMoveFrom(move),
+                    getMoveTo(move));
+      if (isCapture(move)) {
+        kills[getMoveFrom(move)] |= target;
+      } else {
+        quiet[getMoveFrom(move)] |= target;
+      }
+    }
+
+    for (int8_t square = 0; square < BOARD_AREA; square++) {
+      Piece type = NOTHING;
+      for (Piece piece = PAWN; piece < NOTHING; piece++) {
+        if (position.pieces[us][piece] & (1ULL << square)) {
+          type = piece;
+        }
+      }
+
+      const Move expected = getPseudoLegal(
+          type,
+          (Coordinate){(int8_t)(square / BOARD_LENGTH),
+                       (int8_t)(square % BOARD_LENGTH)},
+          position.occupancy[us], us == WHITE, position.occupancy[!us]);
+      // Sliders report their captures in the quiet set too
+      ck_assert_uint_eq(quiet[square] | kills[square],
+                        expected.quiet | expected.kills);
+      ck_assert_uint_eq(kills[square], expected.kills);
+    }
+  }
+}
+END_TEST
+
+// Reference check detection by asking every enemy piece for its captures
+static bool isKingAttackedSlow(const Position *position, const Color color) {
+  const Color them = (Color)!color;
+
+  for (int8_t square = 0; square < BOARD_AREA; square++) {
+    for (Piece type = PAWN; type < NOTHING; type++) {
+      if (!(position->pieces[them][type] & (1ULL << square))) {
+        continue;
+      }
+
+      const Move move = getPseudoLegal(
+          type,
+          (Coordinate){(int8_t)(square / BOARD_LENGTH),
+                       (int8_t)(square % BOARD_LENGTH)},
+          position->occupancy[them], them == WHITE, position->occupancy[color]);
+      if (move.kills & position->pieces[color][KING]) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+// One king per side, and the side that just moved can't be left in check
+static Position generateRandomPositionWithKings(void) {
+  Position position;
+
+  do {
+    clearPosition(&position);
+    for (Color color = WHITE; color < COLORS; color++) {
+      int8_t square;
+      do {
+        square = (int8_t)(rand() % BOARD_AREA);
+      } while (position.board[square] != NOTHING);
+      putPiece(&position, color, KING, square);
+    }
+
+    for (int8_t square = 0; square < BOARD_AREA; square++) {
+      const uint8_t denominator = 16;
+
+      if (position.board[square] == NOTHING && (rand() % denominator) == 1) {
+        putPiece(&position, (Color)(rand() % COLORS),
+                 (Piece)(rand() % KING), square);
+      }
+    }
+    position.sideToMove = (Color)(rand() % COLORS);
+    position.hash = computeHash(&position);
+  } while (isKingAttackedSlow(&position, (Color)!position.sideToMove));
+
+  return position;
+}
+
+/*
+ * The attackers of a square are exactly the pieces whose pseudo-legal
+ * captures would take a piece standing on it, and a side attacks a square
+ * iff it has an attacker there.
+ */
+START_TEST(attackersToMatchesPseudoLegal) {
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    const Position position = generateRandomPosition();
+    const uint64_t occupancy = getOccupancy(&position);
+    const uint64_t attacked[COLORS] = {attackedBy(&position, WHITE),
+                                       attackedBy(&position, BLACK)};
+
+    for (int8_t square = 0; square < BOARD_AREA; square++) {
+      const uint64_t squareBit = 1ULL << square;
+      const uint64_t attackers = attackersTo(&position, square, occupancy);
+      uint64_t expected = 0;
+
+      for (int8_t from = 0; from < BOARD_AREA; from++) {
+        const Piece type = (Piece)position.board[from];
+        if (type == NOTHING) {
+          continue;
+        }
+
+        const Coordinate coord = {(int8_t)(from / BOARD_LENGTH),
+                                  (int8_t)(from % BOARD_LENGTH)};
+        const bool isWhite = (position.occupancy[WHITE] >> from) & 1;
+        const Move move =
+            getPseudoLegal(type, coord, 0, isWhite, occupancy | squareBit);
+
+        if (move.kills & squareBit) {
+          expected |= 1ULL << from;
+        }
+      }
+
+      ck_assert_uint_eq(attackers, expected);
+      for (Color color = WHITE; color < COLORS; color++) {
+        const bool isAttacked = attackers & position.occupancy[color];
+
+        ck_assert_int_eq(isSquareAttacked(&position, square, color),
+                         isAttacked);
+        ck_assert_int_eq((attacked[color] & squareBit) != 0, isAttacked);
+      }
+    }
+  }
+}
+END_TEST
+
+/*
+ * Legality: generateLegalMoves should return exactly the pseudo-legal moves
+ * that don't leave the own king attacked once played, including positions in
+ * check, double check and with pinned pieces
+ */
+START_TEST(legalMovesMatchFilteredPseudoLegal) {
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    const Position position = generateRandomPositionWithKings();
+    MoveList pseudoLegal, legal, filtered = {.count = 0};
+
+    generateMoves(&position, &pseudoLegal);
+    for (uint16_t moveIndex = 0; moveIndex < pseudoLegal.count; moveIndex++) {
+      Position child = position;
+      UndoInfo undo;
+
+      makeMove(&child, pseudoLegal.moves[moveIndex], &undo);
+      if (!isKingAttackedSlow(&child, position.sideToMove)) {
+        filtered.moves[filtered.count++] = pseudoLegal.moves[moveIndex];
+      }
+    }
+    generateLegalMoves(&position, &legal);
+
+    qsort(filtered.moves, filtered.count, sizeof(PackedMove),
+          comparePackedMoves);
+    qsort(legal.moves, legal.count, sizeof(PackedMove), comparePackedMoves);
+    ck_assert_uint_eq(legal.count, filtered.count);
+    for (uint16_t moveIndex = 0; moveIndex < legal.count; moveIndex++) {
+      ck_assert_uint_eq(legal.moves[moveIndex], filtered.moves[moveIndex]);
+    }
+  }
+}
+END_TEST
+
+/*
+ * Captures and quiet moves split the legal moves in two: every legal move is
+ * in exactly one of them, promotions with the captures. isMoveLegal accepts
+ * exactly the legal moves, even for random 16-bit values.
+ */
+START_TEST(capturesAndQuietsSplitLegalMoves) {
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    const Position position = generateRandomPositionWithKings();
+    MoveList legal, captures, quiets;
+
+    generateLegalMoves(&position, &legal);
+    generateLegalCaptures(&position, &captures);
+    generateLegalQuiets(&position, &quiets);
+
+    ck_assert_uint_eq(captures.count + quiets.count, legal.count);
+    for (uint16_t moveIndex = 0; moveIndex < legal.count; moveIndex++) {
+      const PackedMove move = legal.moves[moveIndex];
+
+      ck_assert_int_eq(containsMove(&captures, move), !isQuiet(move));
+      ck_assert_int_eq(containsMove(&quiets, move), isQuiet(move));
+      ck_assert(isMoveLegal(&position, move));
+    }
+
+    for (int tries = 0; tries < 1000; tries++) {
+      const PackedMove move = (PackedMove)rand();
+
+      ck_assert_int_eq(isMoveLegal(&position, move),
+                       containsMove(&legal, move));
+    }
+  }
+}
+END_TEST
+
+/*
+ * The picker hands out every legal move exactly once: the hash move first if
+ * it is legal, then captures and promotions in non-increasing MVV-LVA order,
+ * then the legal killers, then the remaining quiet moves
+ */
+START_TEST(movePickerOrdersLegalMoves) {
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    const Position position = generateRandomPositionWithKings();
+    MoveList legal;
+    generateLegalMoves(&position, &legal);
+
+    // Half the time legal moves, the other half likely garbage
+    PackedMove pickedMoves[1 + KILLER_MOVES];
+    for (uint8_t pick = 0; pick < 1 + KILLER_MOVES; pick++) {
+      pickedMoves[pick] = legal.count > 0 && rand() % 2
+                              ? legal.moves[rand() % legal.count]
+                              : (PackedMove)rand();
+    }
+    const PackedMove hashMove = pickedMoves[0];
+    const PackedMove *killers = &pickedMoves[1];
+
+    MovePicker picker;
+    MoveList picked = {.count = 0};
+    PackedMove move;
+    initMovePicker(&picker, &position, hashMove, killers);
+    while ((move = nextMove(&picker)) != NO_MOVE) {
+      ck_assert(!containsMove(&picked, move));
+      ck_assert(containsMove(&legal, move));
+      picked.moves[picked.count++] = move;
+    }
+    ck_assert_uint_eq(picked.count, legal.count);
+
+    uint16_t moveIndex = 0;
+    if (containsMove(&legal, hashMove)) {
+      ck_assert_uint_eq(picked.moves[moveIndex], hashMove);
+      moveIndex++;
+    }
+    for (; moveIndex < picked.count && !isQuiet(picked.moves[moveIndex]);
+         moveIndex++) {
+      if (moveIndex > 0 && !isQuiet(picked.moves[moveIndex - 1]) &&
+          picked.moves[moveIndex - 1] != hashMove) {
+        ck_assert_int_ge(getMvvLvaScore(&position, picked.moves[moveIndex - 1]),
+                         getMvvLvaScore(&position, picked.moves[moveIndex]));
+      }
+    }
+    for (uint8_t killerIndex = 0; killerIndex < KILLER_MOVES; killerIndex++) {
+      const PackedMove killer = killers[killerIndex];
+
+      if (killer != hashMove && isQuiet(killer) &&
+          containsMove(&legal, killer) &&
+          (killerIndex == 0 || killer != killers[0])) {
+        ck_assert_uint_eq(picked.moves[moveIndex], killer);
+        moveIndex++;
+      }
+    }
+    for (; moveIndex < picked.count; moveIndex++) {
+      ck_assert(isQuiet(picked.moves[moveIndex]));
+    }
+  }
+}
+END_TEST
+
+/*
+ * Static exchange evaluation: Hand checked exchanges, with x-rays, en passant,
+ * promotions, quiet moves into attack and kings that can't recapture
+ */
+START_TEST(seeKnownExchanges) {
+  const struct {
+    const char *fen;
+    PackedMove move;
+    int16_t value;
+  } cases[] = {
+      {"1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1",
+       packMove(4, 36, CAPTURE), 100},
+      {"1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1",
+       packMove(19, 36, CAPTURE), -200},
+      {"4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1",
+       packMove(36, 43, EN_PASSANT_CAPTURE), 100},
+      {"1r2k3/P7/8/8/8/8/8/4K3 w - - 0 1", packMove(48, 56, QUEEN_PROMOTION),
+       -100},
+      {"1r2k3/P7/8/8/8/8/8/4K3 w - - 0 1",
+       packMove(48, 57, QUEEN_PROMOTION_CAPTURE), 1300},
+      {"4k3/8/8/3p4/8/2N5/8/4K3 w - - 0 1", packMove(18, 28, QUIET_MOVE),
+       -300},
+      {"3rk3/8/8/3p4/8/8/3R4/3RK3 w - - 0 1", packMove(11, 35, CAPTURE), 100},
+      {"8/8/8/3pk3/8/3R4/8/4K3 w - - 0 1", packMove(19, 35, CAPTURE), -400},
+      {"8/8/8/3pk3/8/3R4/8/3RK3 w - - 0 1", packMove(19, 35, CAPTURE), 100},
+  };
+
+  for (size_t caseIndex = 0; caseIndex < sizeof(cases) / sizeof(cases[0]);
+       caseIndex++) {
+    Position position;
+
+    ck_assert(parseFen(&position, cases[caseIndex].fen));
+    ck_assert_int_eq(see(&position, cases[caseIndex].move),
+                     cases[caseIndex].value);
+    ck_assert(seeGE(&position, cases[caseIndex].move, cases[caseIndex].value));
+    ck_assert(!seeGE(&position, cases[caseIndex].move,
+                     (int16_t)(cases[caseIndex].value + 1)));
+  }
+}
+END_TEST
+
+/*
+ * Threshold SEE: Stopping early should never change the answer, seeGE tells
+ * whether see reaches the threshold for any move and threshold
+ */
+START_TEST(seeGEMatchesSee) {
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    const Position position = generateRandomPositionWithKings();
+    MoveList legal;
+    generateLegalMoves(&position, &legal);
+
+    for (uint16_t moveIndex = 0; moveIndex < legal.count; moveIndex++) {
+      const PackedMove move = legal.moves[moveIndex];
+      const int16_t value = see(&position, move);
+      const int16_t threshold = (int16_t)(rand() % 2001 - 1000);
+
+      ck_assert(seeGE(&position, move, value));
+      ck_assert(!seeGE(&position, move, (int16_t)(value + 1)));
+      ck_assert(seeGE(&position, move, threshold) == (value >= threshold));
+    }
+  }
+}
+END_TEST
+
+// Same position with the colors swapped and the board flipped vertically
+static Position mirrorPosition(const Position *position) {
+  Position mirrored;
+
+  clearPosition(&mirrored);
+  for (int8_t square = 0; square < BOARD_AREA; square++) {
+    const Piece piece = (Piece)position->board[square];
+
+    if (piece != NOTHING) {
+      const bool white =
+          (position->occupancy[WHITE] & (1ULL << square)) != 0;
+      putPiece(&mirrored, white ? BLACK : WHITE, piece, (int8_t)(square ^ 56));
+    }
+  }
+  mirrored.sideToMove = (Color)!position->sideToMove;
+  mirrored.hash = computeHash(&mirrored);
+
+  return mirrored;
+}
+
+/*
+ * Evaluation: Swapping the colors along with the side to move shouldn't
+ * change the score, neither side gets a bonus the other can't have
+ */
+START_TEST(evaluateIsColorSymmetric) {
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    const Position position = generateRandomPositionWithKings();
+    const Position mirrored = mirrorPosition(&position);
+
+    ck_assert_int_eq(evaluate(&position), evaluate(&mirrored));
+  }
+}
+END_TEST
+
+/*
+ * Search: Mates within the depth are found and reported with their distance,
+ * and positions without a legal move come back mated or drawn, whether
+ * helper threads share the hash table or not
+ */
+START_TEST(searchFindsMates) {
+  const struct {
+    const char *fen;
+    PackedMove move;
+    int16_t score;
+  } cases[] = {
+      {"6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - 0 1", packMove(0, 56, QUIET_MOVE),
+       SCORE_MATE - 1},
+      {"k7/8/1K6/8/8/8/8/7R w - - 0 1", packMove(7, 63, QUIET_MOVE),
+       SCORE_MATE - 1},
+      {"k6R/8/1K6/8/8/8/8/8 b - - 0 1", NO_MOVE, -SCORE_MATE},
+      {"k7/8/1Q6/8/8/8/8/7K b - - 0 1", NO_MOVE, SCORE_DRAW},
+  };
+  const uint16_t threadCounts[] = {1, 4};
+  const SearchLimits limits = {.depth = 6};
+
+  for (size_t countIndex = 0;
+       countIndex < sizeof(threadCounts) / sizeof(threadCounts[0]);
+       countIndex++) {
+    Searcher *searcher = createSearcher(1, threadCounts[countIndex]);
+
+    ck_assert(searcher != NULL);
+    ck_assert_uint_eq(getSearchThreads(searcher), threadCounts[countIndex]);
+    for (size_t caseIndex = 0; caseIndex < sizeof(cases) / sizeof(cases[0]);
+         caseIndex++) {
+      Position position;
+      SearchResult result;
+
+      ck_assert(parseFen(&position, cases[caseIndex].fen));
+      runSearch(searcher, &position, NULL, 0, &limits, &result);
+      ck_assert_int_eq(result.score, cases[caseIndex].score);
+      if (cases[caseIndex].move != NO_MOVE) {
+        ck_assert_uint_eq(result.bestMove, cases[caseIndex].move);
+      }
+      if (result.score > -SCORE_MATE && result.score != SCORE_DRAW) {
+        ck_assert(isMoveLegal(&position, result.bestMove));
+      }
+    }
+    destroySearcher(searcher);
+  }
+}
+END_TEST
+
+/*
+ * Search: A cleared searcher with a depth limit visits the same nodes every
+ * time, and a node limit stops it within one polling interval
+ */
+START_TEST(searchIsReproducible) {
+  Searcher *searcher = createSearcher(1, 1);
+  const SearchLimits depthLimit = {.depth = 5};
+  const SearchLimits nodeLimit = {.nodes = 20000};
+
+  ck_assert(searcher != NULL);
+  for (int i = 0; i < TESTS_ITERATIONS / 10; i++) {
+    const Position position = generateRandomPositionWithKings();
+    SearchResult first, second;
+
+    clearSearcher(searcher);
+    runSearch(searcher, &position, NULL, 0, &depthLimit, &first);
+    clearSearcher(searcher);
+    runSearch(searcher, &position, NULL, 0, &depthLimit, &second);
+    ck_assert_uint_eq(first.nodes, second.nodes);
+    ck_assert_uint_eq(first.bestMove, second.bestMove);
+    ck_assert_int_eq(first.score, second.score);
+
+    runSearch(searcher, &position, NULL, 0, &nodeLimit, &first);
+    ck_assert_uint_le(first.nodes, nodeLimit.nodes + 2048);
+    if (first.bestMove != NO_MOVE) {
+      ck_assert(isMoveLegal(&position, first.bestMove));
+    }
+  }
+  destroySearcher(searcher);
+}
+END_TEST
+
+static bool isPositionConsistent(const Position *position) {
+  for (Color color = WHITE; color < COLORS; color++) {
+    uint64_t occupancy = 0;
+
+    for (Piece type = PAWN; type < NOTHING; type++) {
+      occupancy |= position->pieces[color][type];
+      for (uint64_t pieces = position->pieces[color][type]; pieces;
+           pieces &= pieces - 1) {
+        if (position->board[__builtin_ctzll(pieces)] != type) {
+          return false;
+        }
+      }
+    }
+    if (occupancy != position->occupancy[color]) {
+      return false;
+    }
+  }
+
+  return position->hash == computeHash(position);
+}
+
+#define RANDOM_GAME_PLIES 64
+
+/*
+ * Incremental state: After every move of a random game the mailbox, the
+ * occupancies and the hash should match the ones computed from scratch, and
+ * the hash should be the one getHashAfterMove predicted
+ * Reversibility: Taking back every move should give the original position
+ * back
+ */
+START_TEST(makeUnmakeRoundTrip) {
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    Position original = generateRandomPositionWithKings();
+    // Every other game starts with all the castling rights to lose
+    if (i % 2) {
+      ck_assert(parseFen(&original, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/"
+                                    "2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"));
+    }
+    Position position = original;
+    PackedMove played[RANDOM_GAME_PLIES];
+    UndoInfo undo[RANDOM_GAME_PLIES];
+    uint8_t ply = 0;
+
+    for (; ply < RANDOM_GAME_PLIES; ply++) {
+      MoveList list;
+      generateLegalMoves(&position, &list);
+      if (list.count == 0) {
+        break;
+      }
+
+      // Passing the turn has to come back to the same position too
+      if (ply % 4 == 3) {
+        UndoInfo nullUndo;
+        const uint64_t hash = position.hash;
+
+        makeNullMove(&position, &nullUndo);
+        ck_assert_uint_eq(position.hash, computeHash(&position));
+        unmakeNullMove(&position, &nullUndo);
+        ck_assert_uint_eq(position.hash, hash);
+      }
+
+      played[ply] = list.moves[rand() % list.count];
+      const uint64_t predictedHash = getHashAfterMove(&position, played[ply]);
+      makeMove(&position, played[ply], &undo[ply]);
+      ck_assert_msg(isPositionConsistent(&position),
+                    "Position out of sync after %d plies", ply + 1);
+      ck_assert_uint_eq(position.hash, predictedHash);
+    }
+
+    while (ply > 0) {
+      ply--;
+      unmakeMove(&position, played[ply], &undo[ply]);
+    }
+    ck_assert(memcmp(position.pieces, original.pieces,
+                     sizeof(original.pieces)) == 0);
+    ck_assert(memcmp(position.board, original.board, sizeof(original.board)) ==
+              0);
+    ck_assert_uint_eq(position.hash, original.hash);
+    ck_assert_uint_eq(position.sideToMove, original.sideToMove);
+    ck_assert_uint_eq(position.castlingRights, original.castlingRights);
+    ck_assert_int_eq(position.enPassant, original.enPassant);
+    ck_assert_uint_eq(position.halfmoveClock, original.halfmoveClock);
+    ck_assert_uint_eq(position.fullmoveNumber, original.fullmoveNumber);
+  }
+}
+END_TEST
+
+// Small weights, so the accumulators don't wrap and the output isn't clamped
+static Network *createRandomNetwork(void) {
+  void *memory = NULL;
+  if (posix_memalign(&memory, NNUE_ALIGNMENT, sizeof(Network)) != 0) {
+    return NULL;
+  }
+  Network *network = memory;
+
+  for (uint16_t feature = 0; feature < NNUE_INPUTS; feature++) {
+    for (uint16_t index = 0; index < NNUE_HIDDEN; index++) {
+      network->featureWeights[feature][index] = (int16_t)((rand() % 33) - 16);
+    }
+  }
+  for (uint16_t index = 0; index < NNUE_HIDDEN; index++) {
+    network->featureBiases[index] = (int16_t)(rand() % 128);
+    network->outputWeights[WHITE][index] = (int16_t)((rand() % 129) - 64);
+    network->outputWeights[BLACK][index] = (int16_t)((rand() % 129) - 64);
+  }
+  network->outputBias = (int16_t)((rand() % 2001) - 1000);
+
+  return network;
+}
+
+/*
+ * Deriving each accumulator from the previous one along a random game gives
+ * the same values as summing every piece again, promotions, en passant and
+ * castling included. Every kernel the CPU runs evaluates alike, and mirrored
+ * positions evaluate the same.
+ */
+START_TEST(networkUpdatesMatchRefresh) {
+  const NnueKernel initial = getNnueKernel();
+  Network *network = createRandomNetwork();
+  ck_assert_ptr_nonnull(network);
+
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    Position position = generateRandomPositionWithKings();
+    if (i % 2) {
+      ck_assert(parseFen(&position, "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/"
+                                    "q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"));
+    }
+    Accumulator incremental, refreshed;
+    refreshAccumulator(network, &position, &incremental);
+
+    for (uint8_t ply = 0; ply < RANDOM_GAME_PLIES; ply++) {
+      MoveList list;
+      UndoInfo undo;
+      generateLegalMoves(&position, &list);
+      if (list.count == 0) {
+        break;
+      }
+
+      const PackedMove move = list.moves[rand() % list.count];
+      updateAccumulator(network, &position, move, &incremental, &incremental);
+      makeMove(&position, move, &undo);
+      refreshAccumulator(network, &position, &refreshed);
+      ck_assert_msg(memcmp(incremental.values, refreshed.values,
+                           sizeof(refreshed.values)) == 0,
+                    "Accumulator out of sync after %d plies", ply + 1);
+    }
+
+    refreshAccumulator(network, &position, &refreshed);
+    const int16_t score = evaluateNetwork(network, &position, &refreshed);
+    for (NnueKernel kernel = NNUE_SCALAR; kernel <= NNUE_AVX2; kernel++) {
+      if (!setNnueKernel(kernel)) {
+        continue;
+      }
+
+      refreshAccumulator(network, &position, &refreshed);
+      ck_assert_int_eq(evaluateNetwork(network, &position, &refreshed), score);
+    }
+
+    const Position mirrored = mirrorPosition(&position);
+    refreshAccumulator(network, &mirrored, &refreshed);
+    ck_assert_int_eq(evaluateNetwork(network, &mirrored, &refreshed), score);
+  }
+
+  ck_assert(setNnueKernel(initial));
+  freeNetwork(network);
+}
+END_TEST
+
+/*
+ * A saved network loads back unchanged, and files that are cut short, too
+ * long, have another header or an output weight out of range are refused.
+ */
+START_TEST(networkFileRoundTrip) {
+  Network *network = createRandomNetwork();
+  ck_assert_ptr_nonnull(network);
+  char path[] = "/tmp/sysifusNetworkXXXXXX";
+  const int descriptor = mkstemp(path);
+  ck_assert_int_ge(descriptor, 0);
+  close(descriptor);
+
+  ck_assert(saveNetwork(network, path));
+  Network *loaded = loadNetwork(path);
+  ck_assert_ptr_nonnull(loaded);
+  ck_assert(memcmp(loaded->featureWeights, network->featureWeights,
+                   sizeof(network->featureWeights)) == 0);
+  ck_assert(memcmp(loaded->featureBiases, network->featureBiases,
+                   sizeof(network->featureBiases)) == 0);
+  ck_assert(memcmp(loaded->outputWeights, network->outputWeights,
+                   sizeof(network->outputWeights)) == 0);
+  ck_assert_int_eq(loaded->outputBias, network->outputBias);
+  freeNetwork(loaded);
+
+  FILE *file = fopen(path, "ab");
+  ck_assert_ptr_nonnull(file);
+  ck_assert_int_eq(fputc(0, file), 0);
+  ck_assert_int_eq(fclose(file), 0);
+  ck_assert_ptr_null(loadNetwork(path));
+
+  struct stat status;
+  ck_assert_int_eq(stat(path, &status), 0);
+  ck_assert_int_eq(truncate(path, status.st_size - 2), 0);
+  ck_assert_ptr_null(loadNetwork(path));
+
+  file = fopen(path, "r+b");
+  ck_assert_ptr_nonnull(file);
+  ck_assert_int_eq(fputc('X', file), 'X');
+  ck_assert_int_eq(fclose(file), 0);
+  ck_assert_int_eq(truncate(path, status.st_size - 1), 0);
+  ck_assert_ptr_null(loadNetwork(path));
+
+  // Past the bound that keeps the output layer within 32 bits
+  network->outputWeights[BLACK][0] = NNUE_MAX_OUTPUT_WEIGHT + 1;
+  ck_assert(saveNetwork(network, path));
+  ck_assert_ptr_null(loadNetwork(path));
+
+  ck_assert_ptr_null(loadNetwork("/nonexistent/network.nnue"));
+  unlink(path);
+  freeNetwork(network);
+}
+END_TEST
+
+/*
+ * Perft: The starting position should reach the reference node counts
+ */
+START_TEST(perftStartingPosition) {
+  const uint64_t expected[] = {1, 20, 400, 8902, 197281, 4865609};
+  Position position;
+
+  ck_assert(parseFen(
+      &position, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"));
+  for (uint8_t depth = 0; depth < sizeof(expected) / sizeof(expected[0]);
+       depth++) {
+    ck_assert_uint_eq(perft(&position, depth), expected[depth]);
+  }
+}
+END_TEST
+
+/*
+ * Perft: Positions built around castling, en passant, promotions and pins
+ * should reach the reference node counts
+ */
+START_TEST(perftSpecialMoves) {
+  const struct {
+    const char *fen;
+    uint8_t depth;
+    uint64_t nodes;
+  } cases[] = {
+      {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+       3, 97862},
+      {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5, 674624},
+      {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 3,
+       9467},
+      {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3, 62379},
+  };
+
+  for (size_t caseIndex = 0; caseIndex < sizeof(cases) / sizeof(cases[0]);
+       caseIndex++) {
+    Position position;
+
+    ck_assert(parseFen(&position, cases[caseIndex].fen));
+    ck_assert_uint_eq(perft(&position, cases[caseIndex].depth),
+                      cases[caseIndex].nodes);
+  }
+}
+END_TEST
+
+/*
+ * Hashed perft: Reading subtree counts back from the table should give the
+ * same counts as walking the tree, even with a table small enough to evict
+ */
+START_TEST(perftHashedMatchesPerft) {
+  const char *fens[] = {
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+  };
+  TranspositionTable table;
+
+  ck_assert(initTable(&table, 1, REPLACE_SHALLOWEST));
+  for (size_t fenIndex = 0; fenIndex < sizeof(fens) / sizeof(fens[0]);
+       fenIndex++) {
+    Position position;
+
+    ck_assert(parseFen(&position, fens[fenIndex]));
+    clearTable(&table);
+    ck_assert_uint_eq(perftHashed(&position, 5, &table, NULL),
+                      perft(&position, 5));
+  }
+  freeTable(&table);
+}
+END_TEST
+
+/*
+ * Specialization: Each generators.h entry point should give the targets
+ * getPseudoLegal gives for its piece and color, captures apart from the quiet
+ * moves, and the shift-based knight and king attacks of several pieces should
+ * be the union of their lookup tables
+ */
+START_TEST(specializedGeneratorsMatchPseudoLegal) {
+  typedef Move (*Generator)(int8_t square, uint64_t friendly, uint64_t enemy);
+  const Generator generators[PIECE_TYPES] = {
+      NULL, getKnightMoves, getBishopMoves, getRookMoves, getQueenMoves,
+      getKingMoves};
+
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    const uint64_t occupancy = generateRandomOccupancy(4);
+    const uint64_t friendly = occupancy & generateRandomOccupancy(2);
+    const uint64_t enemy = occupancy & ~friendly;
+    uint64_t knights = 0, kings = 0, knightAttacks = 0, kingAttacks = 0;
+
+    for (int8_t square = 0; square < BOARD_AREA; square++) {
+      const Coordinate coord = {(int8_t)(square / BOARD_LENGTH),
+                                (int8_t)(square % BOARD_LENGTH)};
+
+      for (Piece piece = PAWN; piece < NOTHING; piece++) {
+        for (Color color = WHITE; color < COLORS; color++) {
+          const Move expected =
+              getPseudoLegal(piece, coord, friendly, color == WHITE, enemy);
+          const Move move =
+              piece != PAWN ? generators[piece](square, friendly, enemy)
+              : color == WHITE ? getWhitePawnMoves(square, friendly, enemy)
+                               : getBlackPawnMoves(square, friendly, enemy);
+
+          ck_assert_uint_eq(move.kills, expected.kills);
+          ck_assert_uint_eq(move.quiet, expected.quiet & ~enemy);
+        }
+      }
+
+      if (rand() % 8 == 0) {
+        knights |= 1ULL << square;
+        knightAttacks |= KNIGHT_ATTACK_MAP[square];
+      }
+      if (rand() % 8 == 0) {
+        kings |= 1ULL << square;
+        kingAttacks |= KING_ATTACK_MAP[square];
+      }
+    }
+
+    ck_assert_uint_eq(getKnightAttacksOf(knights), knightAttacks);
+    ck_assert_uint_eq(getKingAttacksOf(kings), kingAttacks);
+  }
+}
+END_TEST
+
+// Targets of getPseudoLegal added up over the side to move's pieces of each
+// type
+static void getPerCallMobility(const Position *position,
+                               uint16_t mobility[PIECE_TYPES]) {
+  const Color us = position->sideToMove;
+
+  memset(mobility, 0, PIECE_TYPES * sizeof(uint16_t));
+  for (uint64_t ours = position->occupancy[us]; ours; ours &= ours - 1) {
+    const int8_t square = (int8_t)__builtin_ctzll(ours);
+    const Coordinate coord = {(int8_t)(square / BOARD_LENGTH),
+                              (int8_t)(square % BOARD_LENGTH)};
+    const Move move = getPseudoLegal((Piece)position->board[square], coord,
+                                     position->occupancy[us], us == WHITE,
+                                     position->occupancy[!us]);
+
+    mobility[position->board[square]] +=
+        (uint16_t)__builtin_popcountll(move.quiet | move.kills);
+  }
+}
+
+/*
+ * Batched mobility: over positions of random games, castling and en passant
+ * included, countMobility gives every position the legal move count of
+ * generateLegalMoves, the getPseudoLegal targets of each piece type and the
+ * attacks of attackedBy, whichever lane of a group it lands in.
+ */
+START_TEST(batchedMobilityMatchesPerCall) {
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    Position positions[RANDOM_GAME_PLIES];
+    uint64_t friendly[RANDOM_GAME_PLIES], enemy[RANDOM_GAME_PLIES];
+    uint64_t pieces[PIECE_TYPES][RANDOM_GAME_PLIES];
+    uint8_t sideToMove[RANDOM_GAME_PLIES], castlingRights[RANDOM_GAME_PLIES];
+    int8_t enPassant[RANDOM_GAME_PLIES];
+    uint16_t legalMoves[RANDOM_GAME_PLIES];
+    uint16_t mobility[PIECE_TYPES][RANDOM_GAME_PLIES];
+    uint64_t attacks[RANDOM_GAME_PLIES];
+    uint8_t count = 0;
+
+    Position position = generateRandomPositionWithKings();
+    if (i % 2) {
+      ck_assert(parseFen(&position, "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/"
+                                    "q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"));
+    }
+    for (; count < RANDOM_GAME_PLIES; count++) {
+      MoveList list;
+      UndoInfo undo;
+
+      positions[count] = position;
+      generateLegalMoves(&position, &list);
+      if (list.count == 0) {
+        count++;
+        break;
+      }
+      makeMove(&position, list.moves[rand() % list.count], &undo);
+    }
+
+    for (uint8_t index = 0; index < count; index++) {
+      const Position *current = &positions[index];
+      const Color us = current->sideToMove;
+
+      friendly[index] = current->occupancy[us];
+      enemy[index] = current->occupancy[!us];
+      for (Piece type = PAWN; type < PIECE_TYPES; type++) {
+        pieces[type][index] =
+            current->pieces[WHITE][type] | current->pieces[BLACK][type];
+      }
+      sideToMove[index] = (uint8_t)us;
+      castlingRights[index] = current->castlingRights;
+      enPassant[index] = current->enPassant;
+    }
+
+    const PositionBatch batch = {
+        friendly,
+        enemy,
+        {pieces[PAWN], pieces[KNIGHT], pieces[BISHOP], pieces[ROOK],
+         pieces[QUEEN], pieces[KING]},
+        sideToMove,
+        castlingRights,
+        enPassant,
+    };
+    MobilityBatch results = {
+        legalMoves,
+        {mobility[PAWN], mobility[KNIGHT], mobility[BISHOP], mobility[ROOK],
+         mobility[QUEEN], mobility[KING]},
+        attacks,
+    };
+    countMobility(&batch, count, &results);
+
+    for (uint8_t index = 0; index < count; index++) {
+      const Position *current = &positions[index];
+      uint16_t expected[PIECE_TYPES];
+      MoveList list;
+
+      getPerCallMobility(current, expected);
+      generateLegalMoves(current, &list);
+
+      ck_assert_uint_eq(legalMoves[index], list.count);
+      ck_assert_uint_eq(attacks[index],
+                        attackedBy(current, current->sideToMove));
+      for (Piece type = PAWN; type < PIECE_TYPES; type++) {
+        ck_assert_uint_eq(mobility[type][index], expected[type]);
+      }
+    }
+
+    // Without the legal move counts the rest stays the same
+    const uint64_t expectedAttacks = attacks[count - 1];
+    results.legalMoves = NULL;
+    attacks[count - 1] = 0;
+    countMobility(&batch, count, &results);
+    ck_assert_uint_eq(attacks[count - 1], expectedAttacks);
+  }
+
+  // Boards set up by hand, past what parseFen accepts, can give a piece type
+  // more targets than a byte holds: queens all around the edge
+  Position position;
+  uint16_t expected[PIECE_TYPES], mobility[PIECE_TYPES];
+  clearPosition(&position);
+  putPiece(&position, WHITE, KING, 0);
+  putPiece(&position, BLACK, KING, BOARD_LENGTH - 1);
+  for (int8_t square = 1; square < BOARD_AREA; square++) {
+    const int8_t rank = square / BOARD_LENGTH, file = square % BOARD_LENGTH;
+
+    if (square != BOARD_LENGTH - 1 &&
+        (rank == 0 || rank == BOARD_LENGTH - 1 || file == 0 ||
+         file == BOARD_LENGTH - 1)) {
+      putPiece(&position, WHITE, QUEEN, square);
+    }
+  }
+  getPerCallMobility(&position, expected);
+  ck_assert_uint_gt(expected[QUEEN], UINT8_MAX);
+
+  const uint64_t pieces[PIECE_TYPES] = {
+      0, 0, 0, 0, position.pieces[WHITE][QUEEN],
+      position.pieces[WHITE][KING] | position.pieces[BLACK][KING]};
+  const uint8_t sideToMove = WHITE;
+  const PositionBatch batch = {
+      &position.occupancy[WHITE],
+      &position.occupancy[BLACK],
+      {&pieces[PAWN], &pieces[KNIGHT], &pieces[BISHOP], &pieces[ROOK],
+       &pieces[QUEEN], &pieces[KING]},
+      &sideToMove,
+      NULL,
+      NULL,
+  };
+  const MobilityBatch results = {
+      NULL,
+      {&mobility[PAWN], &mobility[KNIGHT], &mobility[BISHOP], &mobility[ROOK],
+       &mobility[QUEEN], &mobility[KING]},
+      NULL,
+  };
+  countMobility(&batch, 1, &results);
+  for (Piece type = PAWN; type < PIECE_TYPES; type++) {
+    ck_assert_uint_eq(mobility[type], expected[type]);
+  }
+}
+END_TEST
+
+/*
+ * Every fill kernel the CPU supports gives, per piece and for the whole side,
+ * the same attacks as the table lookups.
+ */
+START_TEST(fillKernelsMatchLookups) {
+  const FillKernel initial = getFillKernel();
+  const FillKernel kernels[] = {FILL_SCALAR, FILL_AVX2, FILL_AVX512};
+
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    const Position position = generateRandomPosition();
+    const uint64_t occupancy = getOccupancy(&position);
+
+    for (size_t kernelIndex = 0;
+         kernelIndex < sizeof(kernels) / sizeof(kernels[0]); kernelIndex++) {
+      if (!setFillKernel(kernels[kernelIndex])) {
+        continue;
+      }
+
+      for (Color color = WHITE; color < COLORS; color++) {
+        int8_t squares[MAX_SLIDERS];
+        uint64_t attacks[MAX_SLIDERS];
+        const uint8_t count =
+            getSliderAttacksPerPiece(&position, color, squares, attacks);
+        uint64_t sideAttacks = 0;
+
+        for (uint8_t sliderIndex = 0; sliderIndex < count; sliderIndex++) {
+          const int8_t square = squares[sliderIndex];
+          const uint64_t expected = getAttackByOccupancy(
+              square, (Piece)position.board[square], 0, occupancy);
+
+          ck_assert_uint_eq(attacks[sliderIndex], expected);
+          sideAttacks |= expected;
+        }
+        ck_assert_uint_eq(
+            count, __builtin_popcountll(position.pieces[color][BISHOP] |
+                                        position.pieces[color][ROOK] |
+                                        position.pieces[color][QUEEN]));
+        ck_assert_uint_eq(getSliderAttacksBySide(&position, color),
+                          sideAttacks);
+      }
+
+      // Enough pieces for a full AVX-512 batch, an AVX2 one and a leftover
+      uint64_t orthogonal[13], diagonal[13], attacks[13];
+      Piece sliders[13];
+      int8_t squares[13];
+      for (uint8_t sliderIndex = 0; sliderIndex < 13; sliderIndex++) {
+        squares[sliderIndex] = (int8_t)(rand() % BOARD_AREA);
+        sliders[sliderIndex] = (Piece)(BISHOP + (rand() % 3));
+        orthogonal[sliderIndex] =
+            sliders[sliderIndex] != BISHOP ? 1ULL << squares[sliderIndex] : 0;
+        diagonal[sliderIndex] =
+            sliders[sliderIndex] != ROOK ? 1ULL << squares[sliderIndex] : 0;
+      }
+      fillSliderAttacksPerPiece(orthogonal, diagonal, 13, occupancy, attacks);
+      for (uint8_t sliderIndex = 0; sliderIndex < 13; sliderIndex++) {
+        ck_assert_uint_eq(attacks[sliderIndex],
+                          getAttackByOccupancy(squares[sliderIndex],
+                                               sliders[sliderIndex], 0,
+                                               occupancy));
+      }
+    }
+  }
+
+  ck_assert(setFillKernel(initial));
+}
+END_TEST
+
+/*
+ * Parallel perft on the children of a position adds up to the sequential
+ * count of each, whatever the thread count and with or without a table.
+ */
+START_TEST(parallelPerftMatchesPerft) {
+  Position position;
+  ck_assert(parseFen(
+      &position,
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"));
+
+  MoveList list;
+  generateLegalMoves(&position, &list);
+
+  Position children[MAX_MOVES];
+  uint64_t expected[MAX_MOVES];
+  for (uint16_t moveIndex = 0; moveIndex < list.count; moveIndex++) {
+    UndoInfo undo;
+
+    children[moveIndex] = position;
+    makeMove(&children[moveIndex], list.moves[moveIndex], &undo);
+    expected[moveIndex] = perft(&children[moveIndex], 4);
+  }
+
+  TranspositionTable table;
+  ck_assert(initTable(&table, 1, REPLACE_SHALLOWEST));
+
+  const uint16_t threadCounts[] = {1, 3, 4};
+  for (size_t countIndex = 0;
+       countIndex < sizeof(threadCounts) / sizeof(threadCounts[0]);
+       countIndex++) {
+    PerftPool *pool = createPerftPool(threadCounts[countIndex]);
+    ck_assert_ptr_nonnull(pool);
+
+    for (uint8_t hashed = 0; hashed < 2; hashed++) {
+      uint64_t counts[MAX_MOVES];
+      ParallelPerftStats stats;
+
+      clearTable(&table);
+      runParallelPerft(pool, children, list.count, 4, hashed ? &table : NULL,
+                       counts, &stats);
+      ck_assert_uint_ge(stats.tasks, list.count);
+      for (uint16_t moveIndex = 0; moveIndex < list.count; moveIndex++) {
+        ck_assert_uint_eq(counts[moveIndex], expected[moveIndex]);
+      }
+    }
+
+    destroyPerftPool(pool);
+  }
+  freeTable(&table);
+}
+END_TEST
+
+/*
+ * Writing a parsed FEN gives back the same string, and a position written and
+ * parsed again is the same position. Parsing never reads past the span it's
+ * given, whatever follows it.
+ */
+START_TEST(fenRoundTrip) {
+  const char *fens[] = {
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+      "rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2",
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R b Kq - 12 345",
+      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 255 65535",
+  };
+  char written[FEN_MAX_LENGTH];
+  Position position;
+
+  for (size_t fenIndex = 0; fenIndex < sizeof(fens) / sizeof(fens[0]);
+       fenIndex++) {
+    const size_t length = strlen(fens[fenIndex]);
+
+    ck_assert(parseFen(&position, fens[fenIndex]));
+    ck_assert_uint_eq(position.hash, computeHash(&position));
+    ck_assert_uint_eq(writeFen(&position, written), length);
+    ck_assert_str_eq(written, fens[fenIndex]);
+
+    // Followed by garbage instead of a NUL
+    char buffer[FEN_MAX_LENGTH + 8];
+    memcpy(buffer, fens[fenIndex], length);
+    memset(buffer + length, '7', sizeof(buffer) - length);
+    ck_assert_uint_eq(parseFenSpan(&position, buffer, length), length);
+
+    // Cut anywhere, it's either rejected or read up to the cut at most
+    for (size_t cut = 0; cut < length; cut++) {
+      ck_assert_uint_le(parseFenSpan(&position, fens[fenIndex], cut), cut);
+    }
+  }
+
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    Position original = generateRandomPositionWithKings();
+
+    for (uint8_t ply = 0; ply < RANDOM_GAME_PLIES / 4; ply++) {
+      MoveList list;
+      UndoInfo undo;
+
+      generateLegalMoves(&original, &list);
+      if (list.count == 0) {
+        break;
+      }
+      makeMove(&original, list.moves[rand() % list.count], &undo);
+    }
+
+    writeFen(&original, written);
+    ck_assert(parseFen(&position, written));
+    ck_assert_msg(memcmp(position.pieces, original.pieces,
+                         sizeof(original.pieces)) == 0 &&
+                      memcmp(position.board, original.board,
+                             sizeof(original.board)) == 0 &&
+                      position.hash == original.hash &&
+                      position.sideToMove == original.sideToMove &&
+                      position.castlingRights == original.castlingRights &&
+                      position.enPassant == original.enPassant &&
+                      position.halfmoveClock == original.halfmoveClock &&
+                      position.fullmoveNumber == original.fullmoveNumber,
+                  "%s didn't parse back to the same position", written);
+  }
+
+  const char *malformed[] = {
+      "",
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR",
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBN w KQkq - 0 1",
+      "rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1",
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQxq - 0 1",
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq i9 0 1",
+      // En passant squares no pawn could have skipped
+      "4k3/8/8/8/8/4P3/3R4/4K3 w - d4 0 1",
+      "rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e3 0 2",
+      "rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2",
+      "rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e6 0 2",
+      // Positions the generators can't run on
+      "4k3/8/8/8/8/8/8/8 w - - 0 1",
+      "4k3/8/8/8/8/8/8/K6K w - - 0 1",
+      "4k3/4R3/8/8/8/8/8/4K3 w - - 0 1",
+      "4k3/8/8/8/PPPPPPPP/8/1NNNNNNN/1NNNNNNK w - - 0 1",
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 256 1",
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0",
+  };
+  for (size_t fenIndex = 0;
+       fenIndex < sizeof(malformed) / sizeof(malformed[0]); fenIndex++) {
+    ck_assert_msg(!parseFen(&position, malformed[fenIndex]),
+                  "Accepted malformed FEN %s", malformed[fenIndex]);
+  }
+}
+END_TEST
+
+/*
+ * The EPD reader yields every non-empty line in order, with its operations,
+ * whatever the line endings, and keeps going after an invalid line.
+ */
+START_TEST(epdReaderStreamsLines) {
+  const char contents[] =
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - "
+      "bm e4; id \"a\";\r\n"
+      "\n"
+      "not a position\n"
+      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 3 40\n"
+      "8/8/8/8/8/8/8/K6k b - -";
+  char path[] = "/tmp/sysifusEpdXXXXXX";
+  const int descriptor = mkstemp(path);
+  ck_assert_int_ge(descriptor, 0);
+  ck_assert_int_eq(write(descriptor, contents, sizeof(contents) - 1),
+                   sizeof(contents) - 1);
+  close(descriptor);
+
+  EpdReader reader;
+  EpdRecord record;
+  ck_assert(openEpd(&reader, path));
+  unlink(path);
+
+  ck_assert_int_eq(readEpd(&reader, &record), EPD_RECORD);
+  ck_assert_uint_eq(reader.line, 1);
+  ck_assert_uint_eq(record.position.castlingRights, 15);
+  ck_assert_uint_eq(record.operationsLength, strlen("bm e4; id \"a\";"));
+  ck_assert(memcmp(record.operations, "bm e4; id \"a\";",
+                   record.operationsLength) == 0);
+
+  ck_assert_int_eq(readEpd(&reader, &record), EPD_INVALID);
+  ck_assert_uint_eq(reader.line, 3);
+
+  ck_assert_int_eq(readEpd(&reader, &record), EPD_RECORD);
+  ck_assert_uint_eq(record.position.fullmoveNumber, 40);
+  ck_assert_uint_eq(record.operationsLength, 0);
+
+  ck_assert_int_eq(readEpd(&reader, &record), EPD_RECORD);
+  ck_assert_uint_eq(reader.line, 5);
+  ck_assert_int_eq(record.position.sideToMove, BLACK);
+
+  ck_assert_int_eq(readEpd(&reader, &record), EPD_END);
+  closeEpd(&reader);
+}
+END_TEST
+
+/*
+ * Every legal move written in SAN resolves back to itself, so the notation
+ * written is never ambiguous and the resolver finds the right piece, pinned
+ * ones, promotions, en passant and castling included.
+ */
+START_TEST(sanRoundTrip) {
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    Position position = generateRandomPositionWithKings();
+    if (i % 2) {
+      ck_assert(parseFen(&position, "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/"
+                                    "q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"));
+    }
+
+    for (uint8_t ply = 0; ply < RANDOM_GAME_PLIES; ply++) {
+      MoveList list;
+      UndoInfo undo;
+      generateLegalMoves(&position, &list);
+      if (list.count == 0) {
+        break;
+      }
+
+      for (uint16_t moveIndex = 0; moveIndex < list.count; moveIndex++) {
+        char san[SAN_MAX_LENGTH];
+        const size_t length = writeSan(&position, list.moves[moveIndex], san);
+
+        ck_assert_uint_eq(length, strlen(san));
+        ck_assert_msg(parseSan(&position, san, length) ==
+                          list.moves[moveIndex],
+                      "%s doesn't resolve back", san);
+      }
+
+      makeMove(&position, list.moves[rand() % list.count], &undo);
+    }
+  }
+}
+END_TEST
+
+#define PGN_GAMES                                                              \
+  "[Event \"Test\"]\r\n"                                                       \
+  "[White \"A\"]\r\n"                                                          \
+  "\r\n"                                                                       \
+  "1. e4 {King's pawn} e6 2. e5 d5 3. exd6 $1 (3. d4 c5 (3... b6)) 3... "      \
+  "Bxd6 4. Nf3 Nf6 5. d4 O-O 6. Nbd2 c5 7. b3 Nc6 8. Bb2 Qc7 9. Qe2 Bd7\r\n"   \
+  "10. O-O-O Rfd8 ; the other rook\r\n"                                        \
+  "11. dxc5! Bxc5 1-0\r\n"                                                     \
+  "\r\n"                                                                       \
+  "% Escaped line\n"                                                           \
+  "[Event \"Promotions\"]\n"                                                   \
+  "[FEN \"8/P6k/8/8/8/8/6pK/8 w - - 0 1\"]\n"                                  \
+  "\n"                                                                         \
+  "1.a8=Q g1=Q+ 2.Kxg1 Kg6 *\n"                                                \
+  "\n"                                                                         \
+  "[Event \"Illegal\"]\n"                                                      \
+  "\n"                                                                         \
+  "1. e4 e5 2. Ke3 Nc6 *\n"                                                    \
+  "\n"
+
+static const char *const PGN_GAME_MOVES[] = {
+    "e2e4 e7e6 e4e5 d7d5 e5d6 f8d6 g1f3 g8f6 d2d4 e8g8 b1d2 c7c5 b2b3 b8c6 "
+    "c1b2 d8c7 d1e2 c8d7 e1c1 f8d8 d4c5 d6c5",
+    "a7a8q g2g1q h2g1 h7g6",
+    "e2e4 e7e5",
+};
+
+typedef struct {
+  uint64_t legal[4];
+} PgnCounts;
+
+static void countLegalPgnMoves(void *context, const uint16_t thread,
+                               const Position *position,
+                               const PackedMove move) {
+  PgnCounts *counts = context;
+
+  counts->legal[thread] += isMoveLegal(position, move);
+}
+
+/*
+ * Games replay move by move through comments, variations, NAGs, escaped
+ * lines and glued move numbers, from their FEN tag when they have one, and
+ * stop at the first move that can't be resolved. Any number of threads
+ * replays a file to the same counts.
+ */
+START_TEST(pgnReplayerResolvesGames) {
+  const char contents[] = PGN_GAMES;
+  char path[] = "/tmp/sysifusPgnXXXXXX";
+  const int descriptor = mkstemp(path);
+  ck_assert_int_ge(descriptor, 0);
+  ck_assert_int_eq(write(descriptor, contents, sizeof(contents) - 1),
+                   sizeof(contents) - 1);
+  close(descriptor);
+
+  PgnReader reader;
+  PgnGame game;
+  ck_assert(openPgn(&reader, path));
+  unlink(path);
+
+  const char *event;
+  size_t eventLength;
+  ck_assert_int_eq(readPgnGame(&reader, &game), PGN_FOUND);
+  ck_assert(findPgnTag(&game, "Event", &event, &eventLength));
+  ck_assert_uint_eq(eventLength, 4);
+  ck_assert(memcmp(event, "Test", 4) == 0);
+  ck_assert(!findPgnTag(&game, "Even", &event, &eventLength));
+
+  for (size_t gameIndex = 0; gameIndex < 3; gameIndex++) {
+    if (gameIndex > 0) {
+      ck_assert_int_eq(readPgnGame(&reader, &game), PGN_FOUND);
+    }
+
+    PgnReplay replay;
+    PackedMove move;
+    PgnStatus status;
+    char moves[256] = "";
+    ck_assert_int_eq(startPgnReplay(&replay, &game), PGN_FOUND);
+    while ((status = readPgnMove(&replay, &move)) == PGN_FOUND) {
+      UndoInfo undo;
+      char moveString[6];
+
+      moveToString(move, moveString);
+      if (moves[0] != '\0') {
+        strcat(moves, " ");
+      }
+      strcat(moves, moveString);
+      makeMove(&replay.position, move, &undo);
+    }
+
+    ck_assert_str_eq(moves, PGN_GAME_MOVES[gameIndex]);
+    ck_assert_int_eq(status, gameIndex == 2 ? PGN_INVALID : PGN_END);
+  }
+  ck_assert_int_eq(readPgnGame(&reader, &game), PGN_END);
+  closePgn(&reader);
+
+  // Enough copies for every thread to get several shards
+  char manyPath[] = "/tmp/sysifusPgnXXXXXX";
+  const int manyDescriptor = mkstemp(manyPath);
+  ck_assert_int_ge(manyDescriptor, 0);
+  for (int copy = 0; copy < 200; copy++) {
+    ck_assert_int_eq(write(manyDescriptor, contents, sizeof(contents) - 1),
+                     sizeof(contents) - 1);
+  }
+  close(manyDescriptor);
+
+  for (uint16_t threads = 1; threads <= 4; threads++) {
+    PgnCounts counts = {{0}};
+    PgnStats stats;
+
+    ck_assert(replayPgn(manyPath, threads, countLegalPgnMoves, &counts,
+                        &stats));
+    ck_assert_uint_eq(stats.games, 600);
+    ck_assert_uint_eq(stats.invalidGames, 200);
+    ck_assert_uint_eq(stats.positions, 200 * (22 + 4 + 2));
+    ck_assert_uint_eq(counts.legal[0] + counts.legal[1] + counts.legal[2] +
+                          counts.legal[3],
+                      stats.positions);
+  }
+  unlink(manyPath);
+}
+END_TEST
+
+/*
+ * Packing a position into 32 bytes and back gives the same position, hash
+ * and mailbox included, as long as it has at most 32 pieces. Records with
+ * a piece code or field out of range are refused.
+ */
+START_TEST(packedPositionRoundTrip) {
+  ck_assert_uint_eq(sizeof(PackedPosition), 32);
+  ck_assert_uint_eq(sizeof(DatasetHeader), sizeof(PackedPosition));
+
+  for (int i = 0; i < TESTS_ITERATIONS; i++) {
+    Position position = generateRandomPositionWithKings();
+    if (i % 2) {
+      ck_assert(parseFen(&position, "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/"
+                                    "q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"));
+    }
+
+    for (uint8_t ply = 0; ply < RANDOM_GAME_PLIES; ply++) {
+      PackedPosition packed;
+      Position unpacked;
+      char fen[FEN_MAX_LENGTH], unpackedFen[FEN_MAX_LENGTH];
+      const bool fits =
+          __builtin_popcountll(getOccupancy(&position)) <= PACKED_MAX_PIECES;
+
+      ck_assert(packPosition(&position, &packed) == fits);
+      if (fits) {
+        ck_assert(unpackPosition(&packed, &unpacked));
+        ck_assert_uint_eq(unpacked.hash, position.hash);
+        ck_assert(memcmp(unpacked.pieces, position.pieces,
+                         sizeof(position.pieces)) == 0);
+        ck_assert(memcmp(unpacked.board, position.board,
+                         sizeof(position.board)) == 0);
+        (void)writeFen(&position, fen);
+        (void)writeFen(&unpacked, unpackedFen);
+        ck_assert_str_eq(unpackedFen, fen);
+      }
+
+      MoveList list;
+      UndoInfo undo;
+      generateLegalMoves(&position, &list);
+      if (list.count == 0) {
+        break;
+      }
+      makeMove(&position, list.moves[rand() % list.count], &undo);
+    }
+  }
+
+  Position position;
+  PackedPosition packed;
+  ck_assert(parseFen(&position, "4k3/8/8/8/8/8/8/4K3 w - - 0 1"));
+  ck_assert(packPosition(&position, &packed));
+  packed.pieces[0] |= 0xF;
+  ck_assert(!unpackPosition(&packed, &position));
+  ck_assert(packPosition(&position, &packed));
+  packed.castlingRights = CASTLING_RIGHTS_VARIANTS;
+  ck_assert(!unpackPosition(&packed, &position));
+
+  // On the board but no pawn could have skipped it
+  ck_assert(parseFen(&position, "4k3/8/8/8/8/4P3/3R4/4K3 w - - 0 1"));
+  ck_assert(packPosition(&position, &packed));
+  packed.enPassant = 27;
+  ck_assert(!unpackPosition(&packed, &position));
+  ck_assert(parseFen(&position, "4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1"));
+  ck_assert(packPosition(&position, &packed));
+  ck_assert(unpackPosition(&packed, &position));
+  packed.sideToMove = BLACK;
+  ck_assert(!unpackPosition(&packed, &position));
+
+  // Positions the generators can't run on: the white king turned black, and
+  // the side not to move in check
+  ck_assert(parseFen(&position, "4k3/4R3/8/8/8/8/8/4K3 b - - 0 1"));
+  ck_assert(packPosition(&position, &packed));
+  ck_assert(unpackPosition(&packed, &position));
+  packed.sideToMove = WHITE;
+  ck_assert(!unpackPosition(&packed, &position));
+  packed.sideToMove = BLACK;
+  packed.pieces[0] =
+      (uint8_t)((packed.pieces[0] & 0xF0) | (PIECE_TYPES + KING));
+  ck_assert(!unpackPosition(&packed, &position));
+}
+END_TEST
+
+/*
+ * The writer skips the positions its set already holds and the reader
+ * yields the others back in order. The set tells every key apart and stops
+ * adding when full, and files of another format are refused.
+ */
+START_TEST(datasetWriterDeduplicates) {
+  PositionSet set;
+  ck_assert(initPositionSet(&set, 1));
+  for (uint64_t key = 0; key < 1000; key++) {
+    ck_assert_int_eq(insertPositionSet(&set, key * 0x9E3779B97F4A7C15ULL),
+                     POSITION_ADDED);
+  }
+  for (uint64_t key = 0; key < 1000; key++) {
+    ck_assert_int_eq(insertPositionSet(&set, key * 0x9E3779B97F4A7C15ULL),
+                     POSITION_DUPLICATE);
+  }
+  ck_assert_uint_eq(set.count, 999);
+  freePositionSet(&set);
+
+  ck_assert(initPositionSet(&set, 0));
+  ck_assert_int_eq(insertPositionSet(&set, 1), POSITION_SET_FULL);
+  freePositionSet(&set);
+
+  char path[] = "/tmp/sysifusDatasetXXXXXX";
+  const int descriptor = mkstemp(path);
+  ck_assert_int_ge(descriptor, 0);
+  close(descriptor);
+
+  // Every position of the game twice, more than a buffer's worth
+  DatasetWriter writer;
+  Position position, expected[RANDOM_GAME_PLIES];
+  uint16_t count = 0;
+  ck_assert(initPositionSet(&set, 1));
+  ck_assert(openDatasetWriter(&writer, path, &set));
+  ck_assert(parseFen(&position, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/"
+                                "PPPBBPPP/R3K2R w KQkq - 0 1"));
+  for (uint8_t ply = 0; ply < RANDOM_GAME_PLIES; ply++) {
+    MoveList list;
+    UndoInfo undo;
+
+    for (uint8_t copy = 0; copy < 2; copy++) {
+      ck_assert(writeDatasetPosition(&writer, &position));
+    }
+    expected[count++] = position;
+
+    generateLegalMoves(&position, &list);
+    if (list.count == 0) {
+      break;
+    }
+    makeMove(&position, list.moves[rand() % list.count], &undo);
+  }
+  for (uint32_t copy = 0; copy < DATASET_BUFFER_RECORDS; copy++) {
+    ck_assert(writeDatasetPosition(&writer, &expected[0]));
+  }
+  // Too many pieces to pack, it isn't taken for a duplicate the second time
+  Position crowded;
+  clearPosition(&crowded);
+  for (int8_t square = 0; square <= PACKED_MAX_PIECES; square++) {
+    putPiece(&crowded, WHITE, KNIGHT, square);
+  }
+  for (uint8_t copy = 0; copy < 2; copy++) {
+    ck_assert(!writeDatasetPosition(&writer, &crowded));
+  }
+  ck_assert_uint_eq(writer.written + writer.duplicates,
+                    2 * count + DATASET_BUFFER_RECORDS);
+  ck_assert(closeDatasetWriter(&writer));
+  freePositionSet(&set);
+
+  // Repetitions are the same position, only the first one gets written
+  DatasetReader reader;
+  Position read;
+  uint16_t readCount = 0;
+  ck_assert(openDataset(&reader, path));
+  for (uint16_t index = 0; index < count; index++) {
+    bool repeated = false;
+    for (uint16_t earlier = 0; earlier < index; earlier++) {
+      repeated |= expected[earlier].hash == expected[index].hash;
+    }
+    if (repeated) {
+      continue;
+    }
+
+    char fen[FEN_MAX_LENGTH], readFen[FEN_MAX_LENGTH];
+    ck_assert_int_eq(readDataset(&reader, &read), DATASET_RECORD);
+    (void)writeFen(&expected[index], fen);
+    (void)writeFen(&read, readFen);
+    ck_assert_str_eq(readFen, fen);
+    readCount++;
+  }
+  ck_assert_int_eq(readDataset(&reader, &read), DATASET_END);
+  ck_assert_uint_eq(reader.count, readCount);
+  closeDataset(&reader);
+
+  // Cut in the middle of a record
+  ck_assert_int_eq(truncate(path, sizeof(DatasetHeader) + 1), 0);
+  ck_assert(!openDataset(&reader, path));
+  // Sized like a dataset, without its header
+  char text[2 * sizeof(PackedPosition)];
+  memset(text, 'x', sizeof(text));
+  FILE *file = fopen(path, "wb");
+  ck_assert_ptr_nonnull(file);
+  ck_assert_uint_eq(fwrite(text, 1, sizeof(text), file), sizeof(text));
+  ck_assert_int_eq(fclose(file), 0);
+  ck_assert(!openDataset(&reader, path));
+  unlink(path);
+}
+END_TEST
+
+Suite *moveGeneration(void) {
+  Suite *suite = suite_create("Pseudo-legal move generation test suite");
+
+  TCase *pawns = tcase_create("Pawn moves");
+  tcase_add_test(pawns, pawnPushesProps);
+  tcase_add_test(pawns, pawnCapturesProps);
+  suite_add_tcase(suite, pawns);
+
+  TCase *sliding = tcase_create("Sliding moves");
+  tcase_add_test(sliding, slidingAttackMap);
+  tcase_add_test(sliding, packedAttackMapsMatchRayWalk);
+  tcase_add_test(sliding, magicAndPextIndexingAgree);
+  tcase_add_test(sliding, lutBlobMatchesCompiledMaps);
+  tcase_add_test(sliding, fillKernelsMatchLookups);
+  tcase_add_test(sliding, specializedGeneratorsMatchPseudoLegal);
+  suite_add_tcase(suite, sliding);
+
+  TCase *position = tcase_create("Whole position moves");
+  tcase_add_test(position, generateMovesMatchesPseudoLegal);
+  tcase_add_test(position, legalMovesMatchFilteredPseudoLegal);
+  tcase_add_test(position, attackersToMatchesPseudoLegal);
+  tcase_add_test(position, batchedMobilityMatchesPerCall);
+  tcase_add_test(position, capturesAndQuietsSplitLegalMoves);
+  tcase_add_test(position, movePickerOrdersLegalMoves);
+  tcase_add_test(position, seeKnownExchanges);
+  tcase_add_test(position, seeGEMatchesSee);
+  tcase_add_test(position, evaluateIsColorSymmetric);
+  tcase_add_test(position, searchFindsMates);
+  tcase_add_test(position, searchIsReproducible);
+  tcase_add_test(position, makeUnmakeRoundTrip);
+  tcase_add_test(position, networkUpdatesMatchRefresh);
+  tcase_add_test(position, networkFileRoundTrip);
+  tcase_add_test(position, perftStartingPosition);
+  tcase_add_test(position, perftSpecialMoves);
+  tcase_add_test(position, perftHashedMatchesPerft);
+  tcase_add_test(position, parallelPerftMatchesPerft);
+  suite_add_tcase(suite, position);
+
+  TCase *notation = tcase_create("Notation");
+  tcase_add_test(notation, fenRoundTrip);
+  tcase_add_test(notation, epdReaderStreamsLines);
+  tcase_add_test(notation, sanRoundTrip);
+  tcase_add_test(notation, pgnReplayerResolvesGames);
+  tcase_add_test(notation, packedPositionRoundTrip);
+  tcase_add_test(notation, datasetWriterDeduplicates);
+  suite_add_tcase(suite, notation);
 
   return suite;
 }
@@ -0,0 +1,586 @@
+#define _POSIX_C_SOURCE 200809L
+
+#ifdef SYSIFUS_HEADER_ONLY
+#include "amalgamation.h"
+#endif /* ifdef SYSIFUS_HEADER_ONLY */
+
+#include "nnue.h"
+#include "position.h"
+#include "search.h"
+#include "sysifus.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ENGINE_NAME "Sysifus"
+#define ENGINE_AUTHOR "P1X3R"
+#define STARTING_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+#define DEFAULT_HASH 16
+#define MAX_HASH 65536
+#define DEFAULT_THREADS 1
+#define MAX_THREADS 1024
+#define DEFAULT_MOVE_OVERHEAD 30
+#define MAX_MOVE_OVERHEAD 5000
+// Loaded at startup when it's there, the classical evaluation plays otherwise
+#define DEFAULT_EVAL_FILE "sysifus.nnue"
+// Moves the remaining time gets split between when the GUI doesn't say
+#define DEFAULT_MOVES_TO_GO 30
+
+// Lines read ahead of the command loop. The GUI waits for our answers most
+// of the time, so this never fills up in practice.
+#define INPUT_QUEUE_CAPACITY 64
+
+typedef struct {
+  char *lines[INPUT_QUEUE_CAPACITY];
+  uint32_t head, count;
+  bool closed; // stdin reached its end
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+} InputQueue;
+
+// What the GUI last asked of the running search, the most urgent first
+typedef enum { REQUEST_NONE, REQUEST_PONDERHIT, REQUEST_STOP } Request;
+
+// Hashes of the positions before the current one, for repetitions
+typedef struct {
+  uint64_t *hashes;
+  size_t length, capacity;
+} GameHistory;
+
+typedef struct {
+  Searcher *searcher;
+  size_t hashMegabytes;
+  uint16_t threads;
+  uint64_t moveOverhead;
+  Network *network; // NULL for the classical evaluation
+
+  Position position;
+  GameHistory history;
+
+  InputQueue input;
+  // Guards `searcher` against the input thread while it gets replaced
+  pthread_mutex_t searcherLock;
+  // Set by the input thread as soon as it reads go, cleared once the move is
+  // out
+  bool searching;
+  // Request from the input thread, and the last one the search got. One
+  // read before runSearch started is passed on again from the report.
+  Request request, applied;
+} Engine;
+
+static pthread_mutex_t outputLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Both threads answer the GUI, a line never gets split by the other's
+static void respond(const char *format, ...) {
+  va_list arguments;
+
+  pthread_mutex_lock(&outputLock);
+  va_start(arguments, format);
+  (void)vprintf(format, arguments);
+  va_end(arguments);
+  (void)putchar('\n');
+  (void)fflush(stdout);
+  pthread_mutex_unlock(&outputLock);
+}
+
+static void pushLine(InputQueue *queue, char *line) {
+  pthread_mutex_lock(&queue->lock);
+  if (queue->count < INPUT_QUEUE_CAPACITY) {
+    queue->lines[(queue->head + queue->count) % INPUT_QUEUE_CAPACITY] = line;
+    queue->count++;
+    pthread_cond_signal(&queue->ready);
+  } else {
+    free(line);
+  }
+  pthread_mutex_unlock(&queue->lock);
+}
+
+// Next line to handle, NULL once stdin is closed and every line was taken.
+// The caller frees it.
+static char *popLine(InputQueue *queue) {
+  pthread_mutex_lock(&queue->lock);
+  while (queue->count == 0 && !queue->closed) {
+    pthread_cond_wait(&queue->ready, &queue->lock);
+  }
+
+  char *line = NULL;
+  if (queue->count > 0) {
+    line = queue->lines[queue->head];
+    queue->head = (queue->head + 1) % INPUT_QUEUE_CAPACITY;
+    queue->count--;
+  }
+  pthread_mutex_unlock(&queue->lock);
+
+  return line;
+}
+
+static bool isCommand(const char *line, const char *command) {
+  const size_t length = strlen(command);
+
+  return strncmp(line, command, length) == 0 &&
+         (line[length] == '\0' || line[length] == ' ');
+}
+
+static void withSearcher(Engine *engine, void (*action)(Searcher *)) {
+  pthread_mutex_lock(&engine->searcherLock);
+  if (engine->searcher) {
+    action(engine->searcher);
+  }
+  pthread_mutex_unlock(&engine->searcherLock);
+}
+
+// Reads stdin while the command loop searches, acting on what can't wait for
+// the search to end. Every other line goes through the queue, in order.
+static void *readInput(void *argument) {
+  Engine *engine = argument;
+  char *line = NULL;
+  size_t capacity = 0;
+  ssize_t length;
+
+  while ((length = getline(&line, &capacity, stdin)) >= 0) {
+    while (length > 0 &&
+           (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+      line[--length] = '\0';
+    }
+
+    if (isCommand(line, "go")) {
+      __atomic_store_n(&engine->request, REQUEST_NONE, __ATOMIC_RELEASE);
+      __atomic_store_n(&engine->searching, true, __ATOMIC_RELEASE);
+    } else if (isCommand(line, "stop") || isCommand(line, "quit")) {
+      __atomic_store_n(&engine->request, REQUEST_STOP, __ATOMIC_RELEASE);
+      withSearcher(engine, stopSearch);
+    } else if (isCommand(line, "ponderhit")) {
+      Request expected = REQUEST_NONE;
+      (void)__atomic_compare_exchange_n(&engine->request, &expected,
+                                        REQUEST_PONDERHIT, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+      withSearcher(engine, ponderHit);
+    } else if (isCommand(line, "isready") &&
+               __atomic_load_n(&engine->searching, __ATOMIC_ACQUIRE)) {
+      respond("readyok");
+      continue;
+    }
+
+    char *copy = strdup(line);
+    if (copy) {
+      pushLine(&engine->input, copy);
+    }
+    if (isCommand(line, "quit")) {
+      break;
+    }
+  }
+  free(line);
+
+  // Without a GUI there is nothing left to do but quit
+  __atomic_store_n(&engine->request, REQUEST_STOP, __ATOMIC_RELEASE);
+  withSearcher(engine, stopSearch);
+  pthread_mutex_lock(&engine->input.lock);
+  engine->input.closed = true;
+  pthread_cond_signal(&engine->input.ready);
+  pthread_mutex_unlock(&engine->input.lock);
+
+  return NULL;
+}
+
+// Recreates the searcher with the current options, keeping the old one if
+// the new one can't be set up
+static void resizeSearcher(Engine *engine) {
+  Searcher *searcher = createSearcher(engine->hashMegabytes, engine->threads);
+
+  if (!searcher) {
+    respond("info string Can't start %d threads with %zu MB of hash",
+            engine->threads, engine->hashMegabytes);
+    return;
+  }
+
+  setSearchNetwork(searcher, engine->network);
+  pthread_mutex_lock(&engine->searcherLock);
+  Searcher *old = engine->searcher;
+  engine->searcher = searcher;
+  pthread_mutex_unlock(&engine->searcherLock);
+  destroySearcher(old);
+}
+
+static void printScore(char *out, const size_t size, const int16_t score) {
+  if (score >= SCORE_MATE_BOUND) {
+    (void)snprintf(out, size, "mate %d", (SCORE_MATE - score + 1) / 2);
+  } else if (score <= -SCORE_MATE_BOUND) {
+    (void)snprintf(out, size, "mate -%d", (SCORE_MATE + score) / 2);
+  } else {
+    (void)snprintf(out, size, "cp %d", score);
+  }
+}
+
+// A stop or ponderhit read before runSearch started got lost when the search
+// reset its flags, the report runs inside the search and passes it on again
+static void applyRequest(Engine *engine) {
+  const Request request =
+      __atomic_load_n(&engine->request, __ATOMIC_ACQUIRE);
+
+  if (request == engine->applied) {
+    return;
+  }
+  if (request == REQUEST_STOP) {
+    stopSearch(engine->searcher);
+  } else if (request == REQUEST_PONDERHIT) {
+    ponderHit(engine->searcher);
+  }
+  engine->applied = request;
+}
+
+static void reportIteration(const SearchResult *result, void *context) {
+  Engine *engine = context;
+  char score[16];
+  // Each move takes at most 5 characters and a space
+  char pv[(MAX_PLY * 6) + 1] = "";
+  char *cursor = pv;
+
+  printScore(score, sizeof(score), result->score);
+  for (uint8_t pvIndex = 0; pvIndex < result->pvLength; pvIndex++) {
+    *cursor++ = ' ';
+    moveToString(result->pv[pvIndex], cursor);
+    cursor += strlen(cursor);
+  }
+
+  respond("info depth %d seldepth %d score %s nodes %" PRIu64 " nps %" PRIu64
+          " time %" PRIu64 " hashfull %d pv%s",
+          result->depth, result->selectiveDepth, score, result->nodes,
+          result->milliseconds ? result->nodes * 1000 / result->milliseconds
+                               : result->nodes,
+          result->milliseconds, getSearchTableUsage(engine->searcher), pv);
+  applyRequest(engine);
+}
+
+static bool pushHistory(GameHistory *history, const uint64_t hash) {
+  if (history->length == history->capacity) {
+    const size_t capacity = history->capacity ? history->capacity * 2 : 256;
+    uint64_t *hashes = realloc(history->hashes, capacity * sizeof(uint64_t));
+
+    if (!hashes) {
+      return false;
+    }
+    history->hashes = hashes;
+    history->capacity = capacity;
+  }
+
+  history->hashes[history->length++] = hash;
+  return true;
+}
+
+// Legal move written as `text` in coordinate notation, NO_MOVE if none
+static PackedMove findMove(const Position *position, const char *text) {
+  MoveList list;
+  generateLegalMoves(position, &list);
+
+  for (uint16_t moveIndex = 0; moveIndex < list.count; moveIndex++) {
+    char moveString[6];
+
+    moveToString(list.moves[moveIndex], moveString);
+    if (strcmp(moveString, text) == 0) {
+      return list.moves[moveIndex];
+    }
+  }
+
+  return NO_MOVE;
+}
+
+// position [startpos | fen <fen>] [moves <move>...]
+static void setPosition(Engine *engine, char *arguments) {
+  char *moves = strstr(arguments, "moves");
+  if (moves) {
+    moves[-1] = '\0';
+    moves += strlen("moves");
+  }
+
+  Position position;
+  const bool parsed =
+      isCommand(arguments, "startpos")
+          ? parseFen(&position, STARTING_FEN)
+          : isCommand(arguments, "fen") &&
+                parseFen(&position, arguments + strlen("fen "));
+  if (!parsed) {
+    respond("info string Invalid position: %s", arguments);
+    return;
+  }
+
+  // Played on copies, the engine keeps its position unless every move
+  // resolves
+  GameHistory history = {NULL, 0, 0};
+  char *save = NULL;
+  for (char *text = moves ? strtok_r(moves, " ", &save) : NULL; text;
+       text = strtok_r(NULL, " ", &save)) {
+    const PackedMove move = findMove(&position, text);
+    UndoInfo undo;
+
+    if (move == NO_MOVE) {
+      respond("info string Illegal move: %s", text);
+      free(history.hashes);
+      return;
+    }
+    if (!pushHistory(&history, position.hash)) {
+      respond("info string Out of memory for the game history");
+      free(history.hashes);
+      return;
+    }
+    makeMove(&position, move, &undo);
+  }
+
+  free(engine->history.hashes);
+  engine->history = history;
+  engine->position = position;
+}
+
+static uint64_t parseCount(const char *text) {
+  const long long value = text ? strtoll(text, NULL, 10) : 0;
+
+  return value > 0 ? (uint64_t)value : 0;
+}
+
+// Splits the clock between the moves left, keeping the move overhead aside
+// for the GUI and the network. The search aims for the optimal time and only
+// goes past it to finish an iteration, up to the hard limit.
+static void allocateTime(const Engine *engine, const uint64_t remaining,
+                         const uint64_t increment, const uint64_t movesToGo,
+                         SearchLimits *limits) {
+  const uint64_t usable = remaining > engine->moveOverhead
+                              ? remaining - engine->moveOverhead
+                              : 1;
+  const uint64_t moves = movesToGo ? movesToGo : DEFAULT_MOVES_TO_GO;
+  uint64_t optimal = (usable / moves) + (increment * 3 / 4);
+  uint64_t maximum = optimal * 3;
+
+  if (maximum > usable * 4 / 5) {
+    maximum = usable * 4 / 5;
+  }
+  if (optimal > maximum) {
+    optimal = maximum;
+  }
+  limits->milliseconds = maximum ? maximum : 1;
+  limits->optimalMilliseconds = optimal ? optimal : 1;
+}
+
+// go [depth N] [nodes N] [movetime ms] [wtime ms] [btime ms] [winc ms]
+// [binc ms] [movestogo N] [infinite] [ponder]
+static void go(Engine *engine, char *arguments) {
+  const Color us = engine->position.sideToMove;
+  SearchLimits limits = {0};
+  uint64_t time[COLORS] = {0}, increment[COLORS] = {0};
+  uint64_t moveTime = 0, movesToGo = 0;
+  bool infinite = false, timed = false;
+  char *save = NULL;
+
+  for (char *token = strtok_r(arguments, " ", &save); token;
+       token = strtok_r(NULL, " ", &save)) {
+    if (strcmp(token, "infinite") == 0) {
+      infinite = true;
+    } else if (strcmp(token, "ponder") == 0) {
+      limits.ponder = true;
+    } else {
+      const uint64_t value = parseCount(strtok_r(NULL, " ", &save));
+
+      if (strcmp(token, "depth") == 0) {
+        limits.depth = (uint8_t)(value < MAX_PLY ? value : MAX_PLY - 1);
+      } else if (strcmp(token, "nodes") == 0) {
+        limits.nodes = value;
+      } else if (strcmp(token, "movetime") == 0) {
+        moveTime = value;
+      } else if (strcmp(token, "wtime") == 0 || strcmp(token, "btime") == 0) {
+        time[token[0] == 'w' ? WHITE : BLACK] = value;
+        timed |= (token[0] == 'w') == (us == WHITE);
+      } else if (strcmp(token, "winc") == 0 || strcmp(token, "binc") == 0) {
+        increment[token[0] == 'w' ? WHITE : BLACK] = value;
+      } else if (strcmp(token, "movestogo") == 0) {
+        movesToGo = value;
+      }
+    }
+  }
+
+  if (moveTime) {
+    limits.milliseconds = moveTime > engine->moveOverhead
+                              ? moveTime - engine->moveOverhead
+                              : 1;
+  } else if (timed && !infinite) {
+    allocateTime(engine, time[us], increment[us], movesToGo, &limits);
+  }
+
+  SearchResult result;
+  engine->applied = REQUEST_NONE;
+  setSearchReport(engine->searcher, reportIteration, engine);
+  runSearch(engine->searcher, &engine->position, engine->history.hashes,
+            engine->history.length, &limits, &result);
+
+  // The GUI expects no move out of an infinite or ponder search before it
+  // says stop or ponderhit, even if the depth limit got reached
+  if (infinite || limits.ponder) {
+    pthread_mutex_lock(&engine->input.lock);
+    while (__atomic_load_n(&engine->request, __ATOMIC_ACQUIRE) ==
+               REQUEST_NONE &&
+           !engine->input.closed) {
+      pthread_cond_wait(&engine->input.ready, &engine->input.lock);
+    }
+    pthread_mutex_unlock(&engine->input.lock);
+  }
+
+  char best[6] = "0000", ponder[6];
+  if (result.bestMove != NO_MOVE) {
+    moveToString(result.bestMove, best);
+  }
+  if (result.pvLength > 1) {
+    moveToString(result.pv[1], ponder);
+    respond("bestmove %s ponder %s", best, ponder);
+  } else {
+    respond("bestmove %s", best);
+  }
+  __atomic_store_n(&engine->searching, false, __ATOMIC_RELEASE);
+}
+
+// An empty path goes back to the classical evaluation. No search runs while
+// commands get handled, so the old network can go right away.
+static void setEvalFile(Engine *engine, const char *path) {
+  Network *network = NULL;
+
+  if (path && path[0] != '\0' && strcmp(path, "<empty>") != 0) {
+    network = loadNetwork(path);
+    if (!network) {
+      respond("info string Can't load the network %s", path);
+      return;
+    }
+  }
+
+  setSearchNetwork(engine->searcher, network);
+  freeNetwork(engine->network);
+  engine->network = network;
+}
+
+static uint64_t clampOption(const char *text, const uint64_t minimum,
+                            const uint64_t maximum) {
+  const uint64_t value = parseCount(text);
+
+  return value < minimum ? minimum : (value > maximum ? maximum : value);
+}
+
+// setoption name <name> value <value>
+static void setOption(Engine *engine, char *arguments) {
+  char *value = strstr(arguments, " value ");
+  if (value) {
+    *value = '\0';
+    value += strlen(" value ");
+  }
+  if (!isCommand(arguments, "name")) {
+    return;
+  }
+
+  const char *name = arguments + strlen("name ");
+  if (strcmp(name, "Hash") == 0) {
+    engine->hashMegabytes = clampOption(value, 1, MAX_HASH);
+    resizeSearcher(engine);
+  } else if (strcmp(name, "Threads") == 0) {
+    engine->threads = (uint16_t)clampOption(value, 1, MAX_THREADS);
+    resizeSearcher(engine);
+  } else if (strcmp(name, "Move Overhead") == 0) {
+    engine->moveOverhead = clampOption(value, 0, MAX_MOVE_OVERHEAD);
+  } else if (strcmp(name, "EvalFile") == 0) {
+    setEvalFile(engine, value);
+  } else {
+    respond("info string Unknown option: %s", name);
+  }
+}
+
+static void identify(void) {
+  respond("id name " ENGINE_NAME);
+  respond("id author " ENGINE_AUTHOR);
+  respond("option name Hash type spin default %d min 1 max %d", DEFAULT_HASH,
+          MAX_HASH);
+  respond("option name Threads type spin default %d min 1 max %d",
+          DEFAULT_THREADS, MAX_THREADS);
+  respond("option name Move Overhead type spin default %d min 0 max %d",
+          DEFAULT_MOVE_OVERHEAD, MAX_MOVE_OVERHEAD);
+  respond("option name Ponder type check default false");
+  respond("option name EvalFile type string default " DEFAULT_EVAL_FILE);
+  respond("uciok");
+}
+
+// Handles one line. Returns false on quit.
+static bool handleCommand(Engine *engine, char *line) {
+  char *arguments = strchr(line, ' ');
+  arguments = arguments ? arguments + 1 : line + strlen(line);
+
+  if (isCommand(line, "uci")) {
+    identify();
+  } else if (isCommand(line, "isready")) {
+    respond("readyok");
+  } else if (isCommand(line, "ucinewgame")) {
+    clearSearcher(engine->searcher);
+  } else if (isCommand(line, "position")) {
+    setPosition(engine, arguments);
+  } else if (isCommand(line, "go")) {
+    go(engine, arguments);
+  } else if (isCommand(line, "setoption")) {
+    setOption(engine, arguments);
+  } else if (isCommand(line, "quit")) {
+    return false;
+  } else if (isCommand(line, "stop") || isCommand(line, "ponderhit") ||
+             isCommand(line, "debug") || line[0] == '\0') {
+    // Already acted upon by the input thread, or nothing to do
+  } else {
+    respond("info string Unknown command: %s", line);
+  }
+
+  return true;
+}
+
+int main(void) {
+  Engine engine = {
+      .hashMegabytes = DEFAULT_HASH,
+      .threads = DEFAULT_THREADS,
+      .moveOverhead = DEFAULT_MOVE_OVERHEAD,
+  };
+  pthread_t inputThread;
+
+  engine.searcher = createSearcher(engine.hashMegabytes, engine.threads);
+  if (!engine.searcher || !parseFen(&engine.position, STARTING_FEN)) {
+    (void)fprintf(stderr, "Can't allocate a %zu MB hash table\n",
+                  engine.hashMegabytes);
+    return EXIT_FAILURE;
+  }
+  engine.network = loadNetwork(DEFAULT_EVAL_FILE);
+  setSearchNetwork(engine.searcher, engine.network);
+  pthread_mutex_init(&engine.searcherLock, NULL);
+  pthread_mutex_init(&engine.input.lock, NULL);
+  pthread_cond_init(&engine.input.ready, NULL);
+  if (pthread_create(&inputThread, NULL, readInput, &engine) != 0) {
+    (void)fprintf(stderr, "Can't start the input thread\n");
+    return EXIT_FAILURE;
+  }
+
+  for (char *line; (line = popLine(&engine.input)) != NULL;) {
+    const bool running = handleCommand(&engine, line);
+
+    free(line);
+    if (!running) {
+      break;
+    }
+  }
+
+  // The input thread exits on quit or at the end of stdin, one of which
+  // brought us here
+  pthread_join(inputThread, NULL);
+  for (char *line; (line = popLine(&engine.input)) != NULL;) {
+    free(line);
+  }
+
+  destroySearcher(engine.searcher);
+  freeNetwork(engine.network);
+  free(engine.history.hashes);
+  pthread_cond_destroy(&engine.input.ready);
+  pthread_mutex_destroy(&engine.input.lock);
+  pthread_mutex_destroy(&engine.searcherLock);
+
+  return EXIT_SUCCESS;
+}
@@ -1,5 +1,34 @@
 add_rules("mode.debug", "mode.release")
 
+-- Bakes luts.h, slidingluts.h and luts.bin into build/luts, again whenever
+-- the tool changes. src/bake.c needs none of the tables it generates. The
+-- fence keeps dependents from compiling before the tables are there.
+target("sysifusBake")
+  set_kind("binary")
+  set_languages("c99")
+  set_warnings("all", "error")
+  set_policy("build.fence", true)
+  add_files("bake/main.c", "src/bake.c")
+  add_includedirs("include")
+  after_build(function (target)
+    import("core.project.depend")
+
+    local outputdir = vformat("$(builddir)/luts")
+    depend.on_changed(function ()
+      os.mkdir(outputdir)
+      os.vrunv(target:targetfile(), {outputdir})
+    end, {dependfile = target:dependfile("luts"),
+          files = {target:targetfile()},
+          changed = not os.isfile(path.join(outputdir, "luts.bin"))})
+  end)
+
+-- For targets compiling against the baked tables, along with
+-- add_deps("sysifusBake") so they are there first
+rule("luts")
+  on_load(function (target)
+    target:add("includedirs", "$(builddir)/luts", { public = true })
+  end)
+
 target("sysifus")
   set_kind("shared")
   set_languages("c99")
@@ -7,7 +36,26 @@ target("sysifus")
   add_files("src/*.c")
   add_headerfiles("include/*.h")
   add_includedirs("include", { public = true })
-  set_pcheader("include/luts.h")
+  add_rules("luts")
+  add_deps("sysifusBake")
+  add_syslinks("pthread")
+
+-- Same library linked into the binary and optimized along with it, so calls
+-- into it can be inlined. Named apart from the shared one, which -lsysifus
+-- would otherwise pick from the same directory.
+target("sysifusStatic")
+  set_kind("static")
+  set_basename("sysifus_static")
+  set_languages("c99")
+  set_warnings("all", "error")
+  set_policy("build.optimization.lto", true)
+  add_files("src/*.c")
+  add_headerfiles("include/*.h")
+  add_includedirs("include", { public = true })
+  add_defines("SYSIFUS_STATIC", { public = true })
+  add_rules("luts")
+  add_deps("sysifusBake")
+  add_syslinks("pthread", { public = true })
 
 target("sysifusTesting")
   set_kind("binary")
@@ -17,3 +65,66 @@ target("sysifusTesting")
   add_deps("sysifus")
   add_includedirs("include")
   add_links("check")
+
+target("sysifusPerft")
+  set_kind("binary")
+  set_languages("c99")
+  set_warnings("all", "error")
+  add_files("perft/main.c")
+  add_deps("sysifus")
+  add_includedirs("include")
+
+target("sysifusPerftStatic")
+  set_kind("binary")
+  set_languages("c99")
+  set_warnings("all", "error")
+  set_policy("build.optimization.lto", true)
+  add_files("perft/main.c")
+  add_deps("sysifusStatic")
+  add_includedirs("include")
+
+-- The whole library compiled inside perft/main.c through amalgamation.h
+target("sysifusPerftHeaderOnly")
+  set_kind("binary")
+  set_languages("c99")
+  set_warnings("all", "error")
+  add_files("perft/main.c")
+  add_defines("SYSIFUS_HEADER_ONLY")
+  add_includedirs("include")
+  add_rules("luts")
+  add_deps("sysifusBake")
+  add_syslinks("pthread")
+
+target("sysifusBench")
+  set_kind("binary")
+  set_languages("c99")
+  set_warnings("all", "error")
+  add_files("bench/main.c")
+  add_deps("sysifus")
+  add_includedirs("include")
+
+target("sysifusSearch")
+  set_kind("binary")
+  set_languages("c99")
+  set_warnings("all", "error")
+  add_files("search/main.c")
+  add_deps("sysifus")
+  add_includedirs("include")
+
+target("sysifusPgn")
+  set_kind("binary")
+  set_languages("c99")
+  set_warnings("all", "error")
+  add_files("pgn/main.c")
+  add_deps("sysifus")
+  add_includedirs("include")
+
+-- The UCI engine, named after the library
+target("sysifusUci")
+  set_kind("binary")
+  set_basename("sysifus")
+  set_languages("c99")
+  set_warnings("all", "error")
+  add_files("uci/main.c")
+  add_deps("sysifus")
+  add_includedirs("include")